@@ -71,6 +71,29 @@ inline bool operator!=(const StringView& x, const StringView& y) {
   return !(x == y);
 }
 
+// Lexicographical ordering of the bytes, consistent with std::string.
+inline bool operator<(const StringView& x, const StringView& y) {
+  size_t size = x.size() < y.size() ? x.size() : y.size();
+  if (size > 0) {
+    int result = memcmp(x.data(), y.data(), size);
+    if (result != 0)
+      return result < 0;
+  }
+  return x.size() < y.size();
+}
+
+inline bool operator>(const StringView& x, const StringView& y) {
+  return y < x;
+}
+
+inline bool operator<=(const StringView& x, const StringView& y) {
+  return !(y < x);
+}
+
+inline bool operator>=(const StringView& x, const StringView& y) {
+  return !(x < y);
+}
+
 }  // namespace base
 }  // namespace perfetto
 
@@ -19,12 +19,32 @@
 
 #include <stdint.h>
 
+#include <string>
+#include <vector>
+
 namespace perfetto {
 namespace trace_processor {
 
 
 struct Config {
   uint64_t window_size_ns = 60 * 1000 * 1000 * 1000ULL;  // 60 seconds.
+
+  // When true, protobuf traces are loaded by a pipeline of threads: the
+  // chunks passed to Parse() are tokenized and sorted on a worker thread
+  // while the sorted events are parsed into the storage on another one.
+  // Parse() returns as soon as the chunk is queued, so queries must not be
+  // executed until NotifyEndOfFile() has returned. Ignored in the
+  // WebAssembly build, which doesn't support threads.
+  bool pipelined_parsing = false;
+
+  // The number of prepared statements kept, by SQL text, to be reused by the
+  // next queries with the same text.
+  uint32_t statement_cache_size = 64;
+
+  // The number of results of RawQueryArgs queries kept, by SQL text, to be
+  // returned again until the next change to the storage: a Parse() call or
+  // a statement which is not read-only. 0 disables the result cache.
+  uint32_t query_result_cache_size = 0;
 };
 
 // Represents a dynamically typed value returned by SQL.
@@ -48,6 +68,34 @@ struct SqlValue {
   Type type = kNull;
 };
 
+// A batch of rows returned by a query, stored column by column. Filled by
+// TraceProcessor::Iterator::NextBatch(), which is much cheaper than reading
+// the rows one value at a time for queries returning many rows.
+struct ColumnarBatch {
+  struct Column {
+    // The type of the first non-null value of the column in the results of
+    // the query (not only in this batch), or kNull if there was none so far.
+    // The values of other types are converted to it, like SQLite does.
+    SqlValue::Type type = SqlValue::kNull;
+
+    // Whether the value of each row is null.
+    std::vector<bool> is_nulls;
+
+    // Only the vector matching |type| is filled, with one value per row. The
+    // values of the null rows are 0, which is not necessarily a valid string
+    // id.
+    std::vector<int64_t> long_values;
+    std::vector<double> double_values;
+    std::vector<uint32_t> string_ids;  // Indices into |strings|.
+  };
+
+  uint32_t num_rows = 0;
+  std::vector<Column> columns;
+
+  // The distinct strings of the batch, shared by all the columns.
+  std::vector<std::string> strings;
+};
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
@@ -19,6 +19,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "perfetto/base/optional.h"
 #include "perfetto/base/string_view.h"
@@ -27,6 +29,11 @@
 namespace perfetto {
 
 namespace protos {
+class CloseQueryArgs;
+class CloseQueryResult;
+class FetchQueryRowsArgs;
+class QueryCursor;
+class QueryRowsBatch;
 class RawQueryArgs;
 class RawQueryResult;
 }  // namespace protos
@@ -62,10 +69,21 @@ class TraceProcessor {
     // kHasNext. |col| must be less than the number returned by |ColumnCount()|.
     SqlValue Get(uint32_t col);
 
+    // Replaces the contents of |batch| with the next rows of the result, at
+    // most |max_rows| of them. Returns kHasNext if at least one row was read,
+    // kEOF if there are no more rows and kError if the query failed. Can be
+    // mixed with calls to |Next()|, in which case the row read by the last
+    // |Next()| is not part of the batch.
+    NextResult NextBatch(uint32_t max_rows, ColumnarBatch* batch);
+
     // Returns the number of columns in this iterator's query. Can be called
     // even before calling |Next()|.
     uint32_t ColumnCount();
 
+    // Returns the name of the column |col|. Can be called even before calling
+    // |Next()|.
+    std::string GetColumnName(uint32_t col);
+
     // Returns the error indicated by the last |Next()| call. If no error
     // occurred, the returned value will be base::nullopt.
     base::Optional<std::string> GetLastError();
@@ -90,12 +108,32 @@ class TraceProcessor {
   // ignore the following Parse() requests and drop data on the floor.
   virtual bool Parse(std::unique_ptr<uint8_t[]>, size_t) = 0;
 
+  // Equivalent to passing the whole contents of the file at |path| to
+  // Parse(), but memory-maps the file instead of reading it into heap
+  // buffers: the packets are tokenized in place and the pages of the file
+  // are unmapped as soon as the packets they contain have been parsed.
+  // Returns false if the file cannot be mapped (e.g. it is not a regular
+  // file, or on WebAssembly) or on unrecoverable parsing errors, like
+  // Parse().
+  virtual bool ParseMappedFile(const std::string& path) = 0;
+
   // When parsing a bounded file (as opposite to streaming from a device) this
   // function should be called when the last chunk of the file has been passed
   // into Parse(). This allows to flush the events queued in the ordering stage,
   // without having to wait for their time window to expire.
   virtual void NotifyEndOfFile() = 0;
 
+  // Writes the parsed trace to |path| as a columnar snapshot, which can be
+  // loaded with LoadSnapshot() much faster than parsing the trace again.
+  // Should be called after NotifyEndOfFile(). Returns false on I/O errors.
+  virtual bool SaveSnapshot(const std::string& path) = 0;
+
+  // Loads a snapshot written by SaveSnapshot(), in place of calling Parse()
+  // and NotifyEndOfFile(). Must be called before any data is parsed. Returns
+  // false if the file is not a snapshot or was written by a different
+  // version of trace processor.
+  virtual bool LoadSnapshot(const std::string& path) = 0;
+
   // Executes a SQLite query on the loaded portion of the trace. |result| will
   // be invoked once after the result of the query is available.
   virtual void ExecuteQuery(
@@ -106,6 +144,34 @@ class TraceProcessor {
   // iterator can be used to load rows from the result.
   virtual Iterator ExecuteQuery(base::StringView sql) = 0;
 
+  // Streaming alternative to the proto-based ExecuteQuery(): opens a query
+  // whose rows are then returned in batches by FetchQueryRows(), until the
+  // last batch or until CloseQuery() is called. This keeps the memory bounded
+  // for queries returning a lot of rows, and the first rows can be used
+  // before the whole query has run. The callbacks are invoked once, before
+  // the methods return. The number of open queries is capped: past it,
+  // opening a query closes the least recently opened one.
+  virtual void OpenQuery(const protos::RawQueryArgs&,
+                         std::function<void(const protos::QueryCursor&)>) = 0;
+  virtual void FetchQueryRows(
+      const protos::FetchQueryRowsArgs&,
+      std::function<void(const protos::QueryRowsBatch&)>) = 0;
+  virtual void CloseQuery(
+      const protos::CloseQueryArgs&,
+      std::function<void(const protos::CloseQueryResult&)>) = 0;
+
+  // Executes |queries| in parallel on up to |max_threads| threads (or one
+  // thread per core if 0, and never more than 64), once the trace has been fully loaded by
+  // NotifyEndOfFile() or LoadSnapshot(). Each thread has its own read-only
+  // SQLite connection on the tables of the trace: the queries can't change
+  // the database, and the tables and views created through ExecuteQuery()
+  // are not visible to them. |callback| is invoked for each query, in order,
+  // on the calling thread, before the method returns.
+  virtual void ExecuteQueries(
+      const std::vector<std::string>& queries,
+      uint32_t max_threads,
+      std::function<void(size_t index, const protos::RawQueryResult&)>) = 0;
+
   // Interrupts the current query. Typically used by Ctrl-C handler.
   virtual void InterruptQuery() = 0;
 };
@@ -78,6 +78,21 @@ constexpr uid_t kInvalidUid = static_cast<uid_t>(-1);
 
 constexpr uint32_t kDefaultFlushTimeoutMs = 5000;
 
+// What a TraceWriter does when the shared memory buffer has no free chunk left,
+// e.g. because the service is not draining it fast enough.
+enum class BufferExhaustedPolicy {
+  // Blocks the writing thread until a chunk is freed by the service. No data
+  // is lost, but the thread can stall for a long time.
+  kStall,
+
+  // Keeps the writing thread going by writing into a throwaway chunk that is
+  // never committed. The packets written in the meantime are lost, and their
+  // number is reported to the service, which surfaces it in TraceStats.
+  kDrop,
+
+  kDefault = kStall,
+};
+
 }  // namespace perfetto
 
 #endif  // INCLUDE_PERFETTO_TRACING_CORE_BASIC_TYPES_H_
@@ -71,10 +71,14 @@ class PERFETTO_EXPORT CommitDataRequest {
     uint32_t target_buffer() const { return target_buffer_; }
     void set_target_buffer(uint32_t value) { target_buffer_ = value; }
 
+    uint32_t dropped_packets() const { return dropped_packets_; }
+    void set_dropped_packets(uint32_t value) { dropped_packets_ = value; }
+
    private:
     uint32_t page_ = {};
     uint32_t chunk_ = {};
     uint32_t target_buffer_ = {};
+    uint32_t dropped_packets_ = {};
 
     // Allows to preserve unknown protobuf fields for compatibility
     // with future versions of .proto files.
@@ -49,8 +49,11 @@ class PERFETTO_EXPORT SharedMemoryArbiter {
   // written in each chunk header owned by a given TraceWriter and is used by
   // the Service to reconstruct TracePackets written by the same TraceWriter.
   // Returns null impl of TraceWriter if all WriterID slots are exhausted.
+  // |buffer_exhausted_policy| tells the writer what to do when the SMB is full.
   virtual std::unique_ptr<TraceWriter> CreateTraceWriter(
-      BufferID target_buffer) = 0;
+      BufferID target_buffer,
+      BufferExhaustedPolicy buffer_exhausted_policy =
+          BufferExhaustedPolicy::kDefault) = 0;
 
   // Binds the provided unbound StartupTraceWriterRegistry to the arbiter's SMB.
   // Normally this happens when the perfetto service has been initialized and we
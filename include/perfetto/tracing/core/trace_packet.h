@@ -78,6 +78,10 @@ class PERFETTO_EXPORT TracePacket {
   // will be valid only as long as the original buffer is valid.
   void AddSlice(const void* start, size_t size);
 
+  // Removes all the slices. Keeps the memory allocated for them, so that the
+  // service can reuse the same instance to read packets in a loop.
+  void Clear();
+
   // Total size of all slices.
   size_t size() const { return size_; }
 
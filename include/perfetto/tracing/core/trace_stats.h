@@ -97,6 +97,20 @@ class PERFETTO_EXPORT TraceStats {
     uint64_t chunks_read() const { return chunks_read_; }
     void set_chunks_read(uint64_t value) { chunks_read_ = value; }
 
+    uint64_t unused_chunk_bytes_read() const {
+      return unused_chunk_bytes_read_;
+    }
+    void set_unused_chunk_bytes_read(uint64_t value) {
+      unused_chunk_bytes_read_ = value;
+    }
+
+    uint64_t packets_dropped_by_producers() const {
+      return packets_dropped_by_producers_;
+    }
+    void set_packets_dropped_by_producers(uint64_t value) {
+      packets_dropped_by_producers_ = value;
+    }
+
     uint64_t chunks_committed_out_of_order() const {
       return chunks_committed_out_of_order_;
     }
@@ -136,6 +150,8 @@ class PERFETTO_EXPORT TraceStats {
     uint64_t chunks_overwritten_ = {};
     uint64_t chunks_discarded_ = {};
     uint64_t chunks_read_ = {};
+    uint64_t unused_chunk_bytes_read_ = {};
+    uint64_t packets_dropped_by_producers_ = {};
     uint64_t chunks_committed_out_of_order_ = {};
     uint64_t write_wrap_count_ = {};
     uint64_t patches_succeeded_ = {};
@@ -112,8 +112,12 @@ class PERFETTO_EXPORT TracingService {
     // writer should be stored by the tracing service. This value is passed
     // upon creation of the data source (StartDataSource()) in the
     // DataSourceConfig.target_buffer().
+    // |buffer_exhausted_policy| tells the writer what to do when the shared
+    // memory buffer is full, see BufferExhaustedPolicy.
     virtual std::unique_ptr<TraceWriter> CreateTraceWriter(
-        BufferID target_buffer) = 0;
+        BufferID target_buffer,
+        BufferExhaustedPolicy buffer_exhausted_policy =
+            BufferExhaustedPolicy::kDefault) = 0;
 
     // Called in response to a Producer::Flush(request_id) call after all data
     // for the flush request has been committed.
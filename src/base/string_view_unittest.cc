@@ -54,6 +54,23 @@ TEST(StringViewTest, BasicCases) {
   }
 }
 
+TEST(StringViewTest, Ordering) {
+  EXPECT_TRUE(StringView("") < StringView("a"));
+  EXPECT_TRUE(StringView("a") < StringView("b"));
+  EXPECT_TRUE(StringView("ab") < StringView("b"));
+  EXPECT_TRUE(StringView("ab") < StringView("abc"));
+  EXPECT_FALSE(StringView("abc") < StringView("abc"));
+  EXPECT_TRUE(StringView("abc") <= StringView("abc"));
+  EXPECT_TRUE(StringView("abc") >= StringView("abc"));
+  EXPECT_TRUE(StringView("abd") > StringView("abc"));
+  EXPECT_FALSE(StringView("abc") > StringView("abcd", 3));
+
+  // Bytes are compared as unsigned, like std::string.
+  EXPECT_TRUE(StringView("a") < StringView("\xff"));
+  EXPECT_EQ(StringView("x\xff") < StringView("x\x01"),
+            std::string("x\xff") < std::string("x\x01"));
+}
+
 TEST(StringViewTest, HashCollisions) {
   std::unordered_map<uint64_t, StringView> hashes;
   std::unordered_set<StringView> sv_set;
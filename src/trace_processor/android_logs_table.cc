@@ -29,14 +29,15 @@ void AndroidLogsTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
 StorageSchema AndroidLogsTable::CreateStorageSchema() {
   const auto& alog = storage_->android_logs();
   // Note: the logs in the storage are NOT sorted by timestamp. We delegate
-  // that to the on-demand sorter by calling AddNumericColumn (instead of
-  // AddSortedNumericColumn).
+  // that to the on-demand sorter by calling AddAppendOnlyNumericColumn
+  // (instead of AddOrderedNumericColumn), which keeps the logs sorted by
+  // timestamp across queries.
   return StorageSchema::Builder()
-      .AddNumericColumn("ts", &alog.timestamps())
-      .AddNumericColumn("utid", &alog.utids())
-      .AddNumericColumn("prio", &alog.prios())
-      .AddStringColumn("tag", &alog.tag_ids(), &storage_->string_pool())
-      .AddStringColumn("msg", &alog.msg_ids(), &storage_->string_pool())
+      .AddAppendOnlyNumericColumn("ts", &alog.timestamps())
+      .AddAppendOnlyNumericColumn("utid", &alog.utids())
+      .AddAppendOnlyNumericColumn("prio", &alog.prios())
+      .AddStringColumn("tag", &alog.tag_ids(), storage_)
+      .AddStringColumn("msg", &alog.msg_ids(), storage_)
       .Build({"ts", "utid", "msg"});
 }
 
@@ -46,18 +47,11 @@ uint32_t AndroidLogsTable::RowCount() {
 
 int AndroidLogsTable::BestIndex(const QueryConstraints& qc,
                                 BestIndexInfo* info) {
-  info->estimated_cost = static_cast<uint32_t>(storage_->android_logs().size());
+  info->estimated_cost = EstimateFilterCost(qc);
 
+  // See StorageTable::OmitSupportedConstraints().
   info->order_by_consumed = true;
-
-  // Only the string columns are handled by SQLite.
-  size_t tag_index = schema().ColumnIndexFromName("tag");
-  size_t msg_index = schema().ColumnIndexFromName("msg");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] =
-        qc.constraints()[i].iColumn != static_cast<int>(tag_index) &&
-        qc.constraints()[i].iColumn != static_cast<int>(msg_index);
-  }
+  OmitSupportedConstraints(qc, info);
 
   return SQLITE_OK;
 }
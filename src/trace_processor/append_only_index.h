@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_APPEND_ONLY_INDEX_H_
+#define SRC_TRACE_PROCESSOR_APPEND_ONLY_INDEX_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "src/trace_processor/chunked_vector.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Statistics (min, max and sorted-ness) and sorted order of the values of a
+// column whose rows never change once added. When the trace is queried while
+// it is still being parsed, both are extended with the rows appended since
+// the previous query instead of being computed again from scratch.
+template <typename T>
+class AppendOnlyIndex {
+ public:
+  // Extends the statistics with the rows of |values| added since the last
+  // call.
+  void UpdateStats(const ChunkedVector<T>& values) {
+    uint32_t size = static_cast<uint32_t>(values.size());
+    PERFETTO_DCHECK(stats_size_ <= size);
+    if (stats_size_ == size)
+      return;
+
+    if (stats_size_ == 0) {
+      min_ = values[0];
+      max_ = values[0];
+    }
+    T last = values[stats_size_ == 0 ? 0 : stats_size_ - 1];
+    values.ForEachChunk(stats_size_, size,
+                        [this, &last](const T* data, uint32_t, uint32_t count) {
+                          for (uint32_t i = 0; i < count; i++) {
+                            T value = data[i];
+                            min_ = std::min(min_, value);
+                            max_ = std::max(max_, value);
+                            sorted_ = sorted_ && !(value < last);
+                            last = value;
+                          }
+                        });
+    stats_size_ = size;
+  }
+
+  // Returns the rows of |values| ordered by increasing value then by row.
+  // The rows added since the last call are sorted on their own and merged
+  // with the rows sorted before, which only moves the rows whose value is
+  // higher than the smallest new value.
+  const std::vector<uint32_t>& UpdateSortedRows(
+      const ChunkedVector<T>& values) {
+    uint32_t size = static_cast<uint32_t>(values.size());
+    uint32_t old_size = static_cast<uint32_t>(sorted_rows_.size());
+    PERFETTO_DCHECK(old_size <= size);
+    if (old_size == size)
+      return sorted_rows_;
+
+    for (uint32_t row = old_size; row < size; row++)
+      sorted_rows_.push_back(row);
+
+    auto less = [&values](uint32_t f, uint32_t s) {
+      T a = values[f];
+      T b = values[s];
+      return a < b || (!(b < a) && f < s);
+    };
+    auto mid = sorted_rows_.begin() + old_size;
+    std::sort(mid, sorted_rows_.end(), less);
+    auto first = std::upper_bound(sorted_rows_.begin(), mid, *mid, less);
+    std::inplace_merge(first, mid, sorted_rows_.end(), less);
+    return sorted_rows_;
+  }
+
+  // The statistics of the first stats_size() rows. min() and max() are only
+  // valid if stats_size() > 0.
+  uint32_t stats_size() const { return stats_size_; }
+  T min() const { return min_; }
+  T max() const { return max_; }
+
+  // Returns whether the values are in non-decreasing order.
+  bool sorted() const { return sorted_; }
+
+ private:
+  uint32_t stats_size_ = 0;
+  T min_{};
+  T max_{};
+  bool sorted_ = true;
+
+  std::vector<uint32_t> sorted_rows_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_APPEND_ONLY_INDEX_H_
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "src/trace_processor/append_only_index.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void AppendArgs(benchmark::internal::Benchmark* b) {
+  int rows = IsBenchmarkFunctionalOnly() ? 10000 : 1000000;
+  b->Args({rows, 0});
+  b->Args({rows, 1});
+}
+
+}  // namespace
+
+// Sorts a column of state.range(0) rows after every 1000 rows appended, like
+// a query ordering by the column while the trace is being parsed. The second
+// argument toggles between sorting all the rows (0) and extending the
+// sorted rows of an AppendOnlyIndex (1).
+static void BM_SortedRowsAfterAppend(benchmark::State& state) {
+  const uint32_t kAppendedRows = 1000;
+  std::minstd_rand0 rnd(0);
+  ChunkedVector<int64_t> values;
+  for (int64_t i = 0; i < state.range(0); i++)
+    values.emplace_back(static_cast<int64_t>(rnd() % 1000000));
+
+  AppendOnlyIndex<int64_t> index;
+  index.UpdateSortedRows(values);
+  std::vector<uint32_t> rows;
+  for (auto _ : state) {
+    for (uint32_t i = 0; i < kAppendedRows; i++)
+      values.emplace_back(static_cast<int64_t>(rnd() % 1000000));
+
+    if (state.range(1)) {
+      benchmark::DoNotOptimize(index.UpdateSortedRows(values).data());
+      continue;
+    }
+    rows.resize(values.size());
+    for (uint32_t row = 0; row < rows.size(); row++)
+      rows[row] = row;
+    std::sort(rows.begin(), rows.end(), [&values](uint32_t f, uint32_t s) {
+      return values[f] < values[s];
+    });
+    benchmark::DoNotOptimize(rows.data());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          kAppendedRows);
+}
+BENCHMARK(BM_SortedRowsAfterAppend)
+    ->Unit(benchmark::kMicrosecond)
+    ->Apply(AppendArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
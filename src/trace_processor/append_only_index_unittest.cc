@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/append_only_index.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+TEST(AppendOnlyIndexTest, Empty) {
+  ChunkedVector<int64_t> values;
+  AppendOnlyIndex<int64_t> index;
+  index.UpdateStats(values);
+  ASSERT_EQ(index.stats_size(), 0u);
+  ASSERT_TRUE(index.sorted());
+  ASSERT_THAT(index.UpdateSortedRows(values), IsEmpty());
+}
+
+TEST(AppendOnlyIndexTest, StatsAfterAppend) {
+  ChunkedVector<int64_t> values;
+  AppendOnlyIndex<int64_t> index;
+  values.emplace_back(5);
+  values.emplace_back(7);
+  values.emplace_back(7);
+  index.UpdateStats(values);
+  ASSERT_EQ(index.stats_size(), 3u);
+  ASSERT_EQ(index.min(), 5);
+  ASSERT_EQ(index.max(), 7);
+  ASSERT_TRUE(index.sorted());
+
+  values.emplace_back(10);
+  index.UpdateStats(values);
+  ASSERT_EQ(index.max(), 10);
+  ASSERT_TRUE(index.sorted());
+
+  values.emplace_back(-3);
+  index.UpdateStats(values);
+  ASSERT_EQ(index.stats_size(), 5u);
+  ASSERT_EQ(index.min(), -3);
+  ASSERT_EQ(index.max(), 10);
+  ASSERT_FALSE(index.sorted());
+
+  values.emplace_back(20);
+  index.UpdateStats(values);
+  ASSERT_FALSE(index.sorted());
+}
+
+TEST(AppendOnlyIndexTest, SortedRowsAfterAppend) {
+  ChunkedVector<uint32_t> values;
+  AppendOnlyIndex<uint32_t> index;
+  for (uint32_t v : {3u, 1u, 2u})
+    values.emplace_back(v);
+  ASSERT_THAT(index.UpdateSortedRows(values), ElementsAre(1u, 2u, 0u));
+
+  // Equal values are ordered by row.
+  for (uint32_t v : {2u, 0u, 5u})
+    values.emplace_back(v);
+  ASSERT_THAT(index.UpdateSortedRows(values),
+              ElementsAre(4u, 1u, 2u, 3u, 0u, 5u));
+}
+
+TEST(AppendOnlyIndexTest, SameAsSort) {
+  std::minstd_rand0 rnd(0);
+  ChunkedVector<int32_t> values;
+  AppendOnlyIndex<int32_t> index;
+  for (uint32_t batch = 1; batch < 5000; batch *= 3) {
+    for (uint32_t i = 0; i < batch; i++)
+      values.emplace_back(static_cast<int32_t>(rnd() % 1000) - 500);
+
+    std::vector<uint32_t> expected(values.size());
+    for (uint32_t i = 0; i < expected.size(); i++)
+      expected[i] = i;
+    std::stable_sort(
+        expected.begin(), expected.end(),
+        [&values](uint32_t f, uint32_t s) { return values[f] < values[s]; });
+    ASSERT_EQ(index.UpdateSortedRows(values), expected);
+
+    index.UpdateStats(values);
+    auto minmax = std::minmax_element(values.begin(), values.end());
+    ASSERT_EQ(index.min(), *minmax.first);
+    ASSERT_EQ(index.max(), *minmax.second);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,6 +16,9 @@
 
 #include "src/trace_processor/args_table.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "src/trace_processor/sqlite_utils.h"
 
 namespace perfetto {
@@ -29,11 +32,10 @@ void ArgsTable::RegisterTable(sqlite3* db, const TraceStorage* storage) {
 }
 
 StorageSchema ArgsTable::CreateStorageSchema() {
-  const auto& args = storage_->args();
   return StorageSchema::Builder()
-      .AddNumericColumn("arg_set_id", &args.set_ids())
-      .AddStringColumn("flat_key", &args.flat_keys(), &storage_->string_pool())
-      .AddStringColumn("key", &args.keys(), &storage_->string_pool())
+      .AddColumn<ArgSetIdColumn>("arg_set_id", storage_)
+      .AddColumn<KeyColumn>("flat_key", true /* flat */, storage_)
+      .AddColumn<KeyColumn>("key", false /* flat */, storage_)
       .AddColumn<ValueColumn>("int_value", VariadicType::kInt, storage_)
       .AddColumn<ValueColumn>("string_value", VariadicType::kString, storage_)
       .AddColumn<ValueColumn>("real_value", VariadicType::kReal, storage_)
@@ -45,7 +47,12 @@ uint32_t ArgsTable::RowCount() {
 }
 
 int ArgsTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
-  // In the case of an id equality filter, we can do a very efficient lookup.
+  // The set id and key constraints are fully handled by their columns, which
+  // saves SQLite reading them back for each row.
+  OmitSupportedConstraints(qc, info);
+
+  // In the case of an id equality filter, the rows of the set are found
+  // directly.
   if (qc.constraints().size() == 1) {
     auto id = static_cast<int>(schema().ColumnIndexFromName("arg_set_id"));
     const auto& cs = qc.constraints().back();
@@ -55,11 +62,187 @@ int ArgsTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
     }
   }
 
-  // Otherwise, just give the worst case scenario.
-  info->estimated_cost = static_cast<uint32_t>(storage_->args().args_count());
+  // Otherwise, estimate the cost based on the constraints.
+  info->estimated_cost = EstimateFilterCost(qc);
   return SQLITE_OK;
 }
 
+ArgsTable::ArgSetIdColumn::ArgSetIdColumn(std::string col_name,
+                                          const TraceStorage* storage)
+    : StorageColumn(col_name, false /* hidden */), storage_(storage) {}
+
+void ArgsTable::ArgSetIdColumn::ReportResult(sqlite3_context* ctx,
+                                             uint32_t row) const {
+  sqlite_utils::ReportSqliteResult(ctx, storage_->args().set_id(row));
+}
+
+uint32_t ArgsTable::ArgSetIdColumn::FirstRowOfSet(int64_t id) const {
+  const auto& args = storage_->args();
+  if (id <= 1)
+    return 0;
+  if (id > args.arg_set_count())
+    return args.args_count();
+  return args.RowsForArgSet(static_cast<ArgSetId>(id)).first;
+}
+
+ArgsTable::ArgSetIdColumn::Bounds ArgsTable::ArgSetIdColumn::BoundFilter(
+    int op,
+    sqlite3_value* sqlite_val) const {
+  Bounds bounds;
+  bounds.max_idx = storage_->args().args_count();
+  if (sqlite3_value_type(sqlite_val) != SQLITE_INTEGER)
+    return bounds;
+
+  // The rows of the sets [id, id + 1) are [FirstRowOfSet(id),
+  // FirstRowOfSet(id + 1)). The ids are clamped to avoid overflows.
+  int64_t id = std::min<int64_t>(sqlite3_value_int64(sqlite_val),
+                                 std::numeric_limits<uint32_t>::max());
+  switch (op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+      bounds.min_idx = FirstRowOfSet(id);
+      bounds.max_idx = FirstRowOfSet(id + 1);
+      break;
+    case SQLITE_INDEX_CONSTRAINT_GE:
+      bounds.min_idx = FirstRowOfSet(id);
+      break;
+    case SQLITE_INDEX_CONSTRAINT_GT:
+      bounds.min_idx = FirstRowOfSet(id + 1);
+      break;
+    case SQLITE_INDEX_CONSTRAINT_LE:
+      bounds.max_idx = FirstRowOfSet(id + 1);
+      break;
+    case SQLITE_INDEX_CONSTRAINT_LT:
+      bounds.max_idx = FirstRowOfSet(id);
+      break;
+    default:
+      return bounds;
+  }
+  bounds.consumed = true;
+  return bounds;
+}
+
+void ArgsTable::ArgSetIdColumn::Filter(int op,
+                                       sqlite3_value* value,
+                                       FilteredRowIndex* index) const {
+  auto predicate = sqlite_utils::CreateNumericPredicate<int64_t>(op, value);
+  index->FilterRows([this, &predicate](uint32_t row) {
+    return predicate(storage_->args().set_id(row));
+  });
+}
+
+ArgsTable::ArgSetIdColumn::Comparator ArgsTable::ArgSetIdColumn::Sort(
+    const QueryConstraints::OrderBy& ob) const {
+  if (ob.desc) {
+    return [this](uint32_t f, uint32_t s) {
+      return sqlite_utils::CompareValuesDesc(storage_->args().set_id(f),
+                                             storage_->args().set_id(s));
+    };
+  }
+  return [this](uint32_t f, uint32_t s) {
+    return sqlite_utils::CompareValuesAsc(storage_->args().set_id(f),
+                                          storage_->args().set_id(s));
+  };
+}
+
+ArgsTable::KeyColumn::KeyColumn(std::string col_name,
+                                bool flat,
+                                const TraceStorage* storage)
+    : StorageColumn(col_name, false /* hidden */),
+      flat_(flat),
+      storage_(storage) {}
+
+void ArgsTable::KeyColumn::ReportResult(sqlite3_context* ctx,
+                                        uint32_t row) const {
+  base::StringView str = storage_->GetString(GetKey(row));
+  if (str.empty()) {
+    sqlite3_result_null(ctx);
+  } else {
+    sqlite3_result_text(ctx, str.data(), -1, sqlite_utils::kSqliteStatic);
+  }
+}
+
+void ArgsTable::KeyColumn::Filter(int op,
+                                  sqlite3_value* value,
+                                  FilteredRowIndex* index) const {
+  if (!IsFilterSupported(op))
+    return;
+
+  // Comparing with NULL using IS and IS NOT is the same as checking for
+  // (non) NULL values.
+  if (op == SQLITE_INDEX_CONSTRAINT_IS || op == SQLITE_INDEX_CONSTRAINT_ISNOT) {
+    if (sqlite3_value_type(value) == SQLITE_NULL) {
+      op = op == SQLITE_INDEX_CONSTRAINT_IS ? SQLITE_INDEX_CONSTRAINT_ISNULL
+                                            : SQLITE_INDEX_CONSTRAINT_ISNOTNULL;
+    }
+  }
+
+  // Keys are interned so no arg can be equal to a string not in the pool.
+  if (op == SQLITE_INDEX_CONSTRAINT_EQ &&
+      sqlite3_value_type(value) == SQLITE_TEXT) {
+    const char* str = reinterpret_cast<const char*>(sqlite3_value_text(value));
+    if (!storage_->GetStringId(base::StringView(str)).has_value()) {
+      index->IntersectRows({});
+      return;
+    }
+  }
+
+  // The result of the comparison only depends on the id of the key, so it is
+  // evaluated once per key while walking the sets.
+  auto predicate = sqlite_utils::CreateStringPredicate(op, value);
+  uint32_t count = static_cast<uint32_t>(storage_->string_count());
+  BitVector evaluated(count, false);
+  BitVector matches(count, false);
+  std::vector<uint32_t> rows;
+  storage_->args().ForEachArg(
+      index->start_row(), index->end_row(),
+      [this, &predicate, &evaluated, &matches, &rows](
+          uint32_t row, const TraceStorage::Args::ShapeArg& arg) {
+        StringId id = flat_ ? arg.flat_key : arg.key;
+        if (!evaluated.IsSet(id)) {
+          evaluated.Set(id);
+          base::StringView str = storage_->GetString(id);
+          if (predicate(str.empty() ? nullptr : str.data()))
+            matches.Set(id);
+        }
+        if (matches.IsSet(id))
+          rows.push_back(row);
+      });
+  index->IntersectSortedRows(rows);
+}
+
+bool ArgsTable::KeyColumn::IsFilterSupported(int op) const {
+  switch (op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+    case SQLITE_INDEX_CONSTRAINT_NE:
+    case SQLITE_INDEX_CONSTRAINT_IS:
+    case SQLITE_INDEX_CONSTRAINT_ISNOT:
+    case SQLITE_INDEX_CONSTRAINT_GE:
+    case SQLITE_INDEX_CONSTRAINT_GT:
+    case SQLITE_INDEX_CONSTRAINT_LE:
+    case SQLITE_INDEX_CONSTRAINT_LT:
+    case SQLITE_INDEX_CONSTRAINT_LIKE:
+    case SQLITE_INDEX_CONSTRAINT_GLOB:
+    case SQLITE_INDEX_CONSTRAINT_ISNULL:
+    case SQLITE_INDEX_CONSTRAINT_ISNOTNULL:
+      return true;
+  }
+  return false;
+}
+
+ArgsTable::KeyColumn::Comparator ArgsTable::KeyColumn::Sort(
+    const QueryConstraints::OrderBy& ob) const {
+  if (ob.desc) {
+    return [this](uint32_t f, uint32_t s) {
+      return sqlite_utils::CompareValuesDesc(storage_->GetString(GetKey(f)),
+                                             storage_->GetString(GetKey(s)));
+    };
+  }
+  return [this](uint32_t f, uint32_t s) {
+    return sqlite_utils::CompareValuesAsc(storage_->GetString(GetKey(f)),
+                                          storage_->GetString(GetKey(s)));
+  };
+}
+
 ArgsTable::ValueColumn::ValueColumn(std::string col_name,
                                     VariadicType type,
                                     const TraceStorage* storage)
@@ -69,7 +252,7 @@ ArgsTable::ValueColumn::ValueColumn(std::string col_name,
 
 void ArgsTable::ValueColumn::ReportResult(sqlite3_context* ctx,
                                           uint32_t row) const {
-  const auto& value = storage_->args().arg_values()[row];
+  auto value = storage_->args().arg_value(row);
   if (value.type != type_) {
     sqlite3_result_null(ctx);
     return;
@@ -83,7 +266,7 @@ void ArgsTable::ValueColumn::ReportResult(sqlite3_context* ctx,
       sqlite_utils::ReportSqliteResult(ctx, value.real_value);
       break;
     case VariadicType::kString: {
-      const char* str = storage_->GetString(value.string_value).c_str();
+      const char* str = storage_->GetString(value.string_value).data();
       sqlite3_result_text(ctx, str, -1, sqlite_utils::kSqliteStatic);
       break;
     }
@@ -104,7 +287,7 @@ void ArgsTable::ValueColumn::Filter(int op,
       bool op_is_null = sqlite_utils::IsOpIsNull(op);
       auto predicate = sqlite_utils::CreateNumericPredicate<int64_t>(op, value);
       index->FilterRows([this, &predicate, op_is_null](uint32_t row) {
-        const auto& arg = storage_->args().arg_values()[row];
+        auto arg = storage_->args().arg_value(row);
         return arg.type == type_ ? predicate(arg.int_value) : op_is_null;
       });
       break;
@@ -113,7 +296,7 @@ void ArgsTable::ValueColumn::Filter(int op,
       bool op_is_null = sqlite_utils::IsOpIsNull(op);
       auto predicate = sqlite_utils::CreateNumericPredicate<double>(op, value);
       index->FilterRows([this, &predicate, op_is_null](uint32_t row) {
-        const auto& arg = storage_->args().arg_values()[row];
+        auto arg = storage_->args().arg_value(row);
         return arg.type == type_ ? predicate(arg.real_value) : op_is_null;
       });
       break;
@@ -121,9 +304,9 @@ void ArgsTable::ValueColumn::Filter(int op,
     case VariadicType::kString: {
       auto predicate = sqlite_utils::CreateStringPredicate(op, value);
       index->FilterRows([this, &predicate](uint32_t row) {
-        const auto& arg = storage_->args().arg_values()[row];
+        auto arg = storage_->args().arg_value(row);
         return arg.type == type_
-                   ? predicate(storage_->GetString(arg.string_value).c_str())
+                   ? predicate(storage_->GetString(arg.string_value).data())
                    : predicate(nullptr);
       });
       break;
@@ -140,8 +323,8 @@ ArgsTable::ValueColumn::Comparator ArgsTable::ValueColumn::Sort(
 }
 
 int ArgsTable::ValueColumn::CompareRefsAsc(uint32_t f, uint32_t s) const {
-  const auto& arg_f = storage_->args().arg_values()[f];
-  const auto& arg_s = storage_->args().arg_values()[s];
+  auto arg_f = storage_->args().arg_value(f);
+  auto arg_s = storage_->args().arg_value(s);
 
   if (arg_f.type == type_ && arg_s.type == type_) {
     switch (type_) {
@@ -151,8 +334,8 @@ int ArgsTable::ValueColumn::CompareRefsAsc(uint32_t f, uint32_t s) const {
         return sqlite_utils::CompareValuesAsc(arg_f.real_value,
                                               arg_s.real_value);
       case VariadicType::kString: {
-        const auto& f_str = storage_->GetString(arg_f.string_value);
-        const auto& s_str = storage_->GetString(arg_s.string_value);
+        base::StringView f_str = storage_->GetString(arg_f.string_value);
+        base::StringView s_str = storage_->GetString(arg_s.string_value);
         return sqlite_utils::CompareValuesAsc(f_str, s_str);
       }
     }
@@ -37,6 +37,69 @@ class ArgsTable : public StorageTable {
   int BestIndex(const QueryConstraints&, BestIndexInfo*) override;
 
  private:
+  // The arg_set_id column. The args are sorted by set id and the rows of a set
+  // are found from its id, so comparisons with integers are bounded without
+  // reading the column.
+  class ArgSetIdColumn final : public StorageColumn {
+   public:
+    ArgSetIdColumn(std::string col_name, const TraceStorage* storage);
+
+    void ReportResult(sqlite3_context* ctx, uint32_t row) const override;
+
+    Bounds BoundFilter(int op, sqlite3_value* sqlite_val) const override;
+
+    void Filter(int op, sqlite3_value* value, FilteredRowIndex*) const override;
+
+    Comparator Sort(const QueryConstraints::OrderBy& ob) const override;
+
+    bool IsNaturallyOrdered() const override { return true; }
+
+    bool HasLongValues() const override { return true; }
+
+    int64_t GetLong(uint32_t row) const override {
+      return storage_->args().set_id(row);
+    }
+
+    Table::ColumnType GetType() const override {
+      return Table::ColumnType::kUint;
+    }
+
+   private:
+    // Returns the first row of the set |id|, or of the next set in the
+    // storage if it is not one of them.
+    uint32_t FirstRowOfSet(int64_t id) const;
+
+    const TraceStorage* storage_ = nullptr;
+  };
+
+  // The key and flat_key columns. Keys are shared by many args so string
+  // comparisons are evaluated once per distinct key.
+  class KeyColumn final : public StorageColumn {
+   public:
+    KeyColumn(std::string col_name, bool flat, const TraceStorage* storage);
+
+    void ReportResult(sqlite3_context* ctx, uint32_t row) const override;
+
+    void Filter(int op, sqlite3_value* value, FilteredRowIndex*) const override;
+
+    bool IsFilterSupported(int op) const override;
+
+    Comparator Sort(const QueryConstraints::OrderBy& ob) const override;
+
+    Table::ColumnType GetType() const override {
+      return Table::ColumnType::kString;
+    }
+
+   private:
+    StringId GetKey(uint32_t row) const {
+      return flat_ ? storage_->args().flat_key(row)
+                   : storage_->args().key(row);
+    }
+
+    bool flat_ = false;
+    const TraceStorage* storage_ = nullptr;
+  };
+
   class ValueColumn final : public StorageColumn {
    public:
     ValueColumn(std::string col_name,
@@ -49,6 +112,9 @@ class ArgsTable : public StorageTable {
 
     void Filter(int op, sqlite3_value* value, FilteredRowIndex*) const override;
 
+    // SQLite checks the values a second time.
+    bool IsFilterSupported(int) const override { return false; }
+
     Comparator Sort(const QueryConstraints::OrderBy& ob) const override;
 
     bool IsNaturallyOrdered() const override { return false; }
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/args_table.h"
+
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/trace_storage.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Arg = TraceStorage::Args::Arg;
+using Variadic = TraceStorage::Args::Variadic;
+
+class ArgsTableTest : public ::testing::Test {
+ public:
+  ArgsTableTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+    ArgsTable::RegisterTable(db_.get(), &storage_);
+  }
+
+  Arg CreateArg(const char* key, Variadic value) {
+    Arg arg;
+    arg.flat_key = storage_.InternString(key);
+    arg.key = arg.flat_key;
+    arg.value = value;
+    return arg;
+  }
+
+  ArgSetId AddArgSet(const std::vector<Arg>& args) {
+    return storage_.mutable_args()->AddArgSet(
+        args, 0, static_cast<uint32_t>(args.size()));
+  }
+
+  // Returns the first column of the rows returned by |sql| as integers.
+  std::vector<int64_t> QueryInts(const std::string& sql) {
+    sqlite3_stmt* stmt = nullptr;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt, nullptr) ==
+                   SQLITE_OK);
+    ScopedStmt scoped_stmt(stmt);
+    std::vector<int64_t> res;
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+      res.push_back(sqlite3_column_int64(stmt, 0));
+    return res;
+  }
+
+ protected:
+  TraceStorage storage_;
+  ScopedDb db_;
+};
+
+TEST_F(ArgsTableTest, SetsShareShapes) {
+  const auto& args = storage_.args();
+  ArgSetId first = AddArgSet(
+      {CreateArg("pid", Variadic::Integer(1)),
+       CreateArg("comm", Variadic::String(storage_.InternString("a")))});
+  ArgSetId second = AddArgSet(
+      {CreateArg("pid", Variadic::Integer(2)),
+       CreateArg("comm", Variadic::String(storage_.InternString("b")))});
+  ArgSetId third = AddArgSet({CreateArg("freq", Variadic::Real(1.5))});
+  // Sets with the same args are deduplicated.
+  ASSERT_EQ(AddArgSet({CreateArg("pid", Variadic::Integer(2)),
+                       CreateArg("comm", Variadic::String(
+                                             storage_.InternString("b")))}),
+            second);
+  // The same keys with another type make a new shape.
+  ArgSetId fourth = AddArgSet({CreateArg("freq", Variadic::Integer(1))});
+
+  ASSERT_EQ(first, 1u);
+  ASSERT_EQ(second, 2u);
+  ASSERT_EQ(third, 3u);
+  ASSERT_EQ(fourth, 4u);
+  ASSERT_EQ(args.arg_set_count(), 4u);
+  ASSERT_EQ(args.args_count(), 6u);
+  ASSERT_EQ(args.shape_count(), 3u);
+
+  ASSERT_EQ(args.RowsForArgSet(second), std::make_pair(2u, 4u));
+  ASSERT_EQ(args.RowsForArgSet(fourth), std::make_pair(5u, 6u));
+  ASSERT_EQ(args.RowsForArgSet(kInvalidArgSetId), std::make_pair(6u, 6u));
+  ASSERT_EQ(args.RowsForArgSet(5), std::make_pair(6u, 6u));
+
+  ASSERT_EQ(args.set_id(3), second);
+  ASSERT_EQ(args.key(3), storage_.InternString("comm"));
+  ASSERT_EQ(args.arg_value(2).int_value, 2);
+  ASSERT_EQ(args.arg_value(3).string_value, storage_.InternString("b"));
+  ASSERT_EQ(args.arg_value(4).real_value, 1.5);
+  ASSERT_EQ(args.arg_value(5).type, Variadic::Type::kInt);
+}
+
+TEST_F(ArgsTableTest, SetOfRow) {
+  // Sets of 1 to 4 args, so that the blocks of rows start at any position in
+  // the sets.
+  std::vector<ArgSetId> expected;
+  for (int64_t i = 0; i < 1000; i++) {
+    std::vector<Arg> set;
+    for (int64_t j = 0; j <= i % 4; j++)
+      set.push_back(CreateArg("arg", Variadic::Integer(i * 4 + j)));
+    ArgSetId id = AddArgSet(set);
+    expected.insert(expected.end(), set.size(), id);
+  }
+
+  const auto& args = storage_.args();
+  ASSERT_EQ(args.args_count(), expected.size());
+  for (uint32_t row = 0; row < expected.size(); row++)
+    ASSERT_EQ(args.set_id(row), expected[row]);
+}
+
+TEST_F(ArgsTableTest, FilterBySetIdAndKey) {
+  for (int64_t i = 0; i < 100; i++) {
+    AddArgSet({CreateArg("pid", Variadic::Integer(i)),
+               CreateArg("prio", Variadic::Integer(i + 1000))});
+  }
+
+  ASSERT_EQ(QueryInts("SELECT int_value FROM args WHERE arg_set_id = 3"),
+            std::vector<int64_t>({2, 1002}));
+  ASSERT_EQ(QueryInts("SELECT int_value FROM args WHERE arg_set_id = 0"),
+            std::vector<int64_t>());
+  ASSERT_EQ(QueryInts("SELECT int_value FROM args WHERE arg_set_id > 98"),
+            std::vector<int64_t>({98, 1098, 99, 1099}));
+  ASSERT_EQ(QueryInts("SELECT int_value FROM args WHERE arg_set_id <= 2 AND "
+                      "key = 'prio'"),
+            std::vector<int64_t>({1000, 1001}));
+  ASSERT_EQ(QueryInts("SELECT count(*) FROM args WHERE key GLOB 'p*'"),
+            std::vector<int64_t>({200}));
+  ASSERT_EQ(QueryInts("SELECT count(*) FROM args WHERE key = 'unknown'"),
+            std::vector<int64_t>({0}));
+  ASSERT_EQ(QueryInts("SELECT arg_set_id FROM args WHERE key = 'pid' AND "
+                      "int_value >= 97 ORDER BY arg_set_id DESC"),
+            std::vector<int64_t>({100, 99, 98}));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
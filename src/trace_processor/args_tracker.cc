@@ -40,11 +40,13 @@ void ArgsTracker::Flush() {
   using Arg = TraceStorage::Args::Arg;
 
   // We sort here because a single packet may add multiple args with different
-  // rowids.
+  // rowids. The sort is stable to keep the args of a row in the order they
+  // were added: rows with the same keys in the same order then share the
+  // shape of their arg set in the storage.
   auto comparator = [](const Arg& f, const Arg& s) {
     return f.row_id < s.row_id;
   };
-  std::sort(args_.begin(), args_.end(), comparator);
+  std::stable_sort(args_.begin(), args_.end(), comparator);
 
   auto* storage = context_->storage.get();
   for (uint32_t i = 0; i < args_.size();) {
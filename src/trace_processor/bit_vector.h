@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_BIT_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_BIT_VECTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A fixed-size vector of bits packed in 64-bit words. Unlike std::vector<bool>
+// this exposes the underlying words, which allows filters to compute 64 rows
+// at a time and to skip over runs of unset bits quickly.
+//
+// Invariant: the bits of the last word past |size()| are always zero.
+class BitVector {
+ public:
+  static constexpr uint32_t kBitsInWord = 64;
+
+  BitVector() = default;
+  BitVector(uint32_t size, bool value)
+      : size_(size), words_(WordCount(size), value ? ~0ull : 0ull) {
+    ClearTrailingBits();
+  }
+
+  BitVector(BitVector&& other) noexcept { *this = std::move(other); }
+  BitVector& operator=(BitVector&& other) noexcept {
+    size_ = other.size_;
+    words_ = std::move(other.words_);
+    other.size_ = 0;
+    other.words_.clear();
+    return *this;
+  }
+  BitVector(const BitVector&) = delete;
+  BitVector& operator=(const BitVector&) = delete;
+
+  uint32_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  bool IsSet(uint32_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    return (words_[idx / kBitsInWord] >> (idx % kBitsInWord)) & 1;
+  }
+
+  void Set(uint32_t idx) {
+    PERFETTO_DCHECK(idx < size_);
+    words_[idx / kBitsInWord] |= 1ull << (idx % kBitsInWord);
+  }
+
+  void Clear(uint32_t idx) {
+    PERFETTO_DCHECK(idx < size_);
+    words_[idx / kBitsInWord] &= ~(1ull << (idx % kBitsInWord));
+  }
+
+  // Clears all the bits in the range [begin, end).
+  void ClearRange(uint32_t begin, uint32_t end) {
+    PERFETTO_DCHECK(begin <= end && end <= size_);
+    while (begin < end) {
+      uint32_t count = std::min(end - begin, kBitsInWord - begin % kBitsInWord);
+      AndBits(begin, count, 0);
+      begin += count;
+    }
+  }
+
+  // Clears the bits in the range [idx, idx + count) which are not set in
+  // |mask|: i.e. the i-th bit of the range is ANDed with the i-th bit of
+  // |mask|. The range can straddle two words. |count| must be <= 64.
+  void AndBits(uint32_t idx, uint32_t count, uint64_t mask) {
+    PERFETTO_DCHECK(count > 0 && count <= kBitsInWord);
+    PERFETTO_DCHECK(idx + count <= size_);
+    uint64_t range = count == kBitsInWord ? ~0ull : (1ull << count) - 1;
+    uint64_t clear = ~mask & range;
+    uint32_t word = idx / kBitsInWord;
+    uint32_t shift = idx % kBitsInWord;
+    words_[word] &= ~(clear << shift);
+    if (shift + count > kBitsInWord)
+      words_[word + 1] &= ~(clear >> (kBitsInWord - shift));
+  }
+
+  // Returns the bits in the range [idx, idx + count) as the low bits of a
+  // word. |count| must be <= 64.
+  uint64_t GetBits(uint32_t idx, uint32_t count) const {
+    PERFETTO_DCHECK(count > 0 && count <= kBitsInWord);
+    PERFETTO_DCHECK(idx + count <= size_);
+    uint64_t range = count == kBitsInWord ? ~0ull : (1ull << count) - 1;
+    uint32_t word = idx / kBitsInWord;
+    uint32_t shift = idx % kBitsInWord;
+    uint64_t bits = words_[word] >> shift;
+    if (shift + count > kBitsInWord)
+      bits |= words_[word + 1] << (kBitsInWord - shift);
+    return bits & range;
+  }
+
+  // Returns the index of the first set bit >= |idx| or size() if there is
+  // none.
+  uint32_t NextSet(uint32_t idx) const {
+    if (idx >= size_)
+      return size_;
+    uint32_t word = idx / kBitsInWord;
+    uint64_t bits = words_[word] & (~0ull << (idx % kBitsInWord));
+    while (bits == 0) {
+      if (++word == words_.size())
+        return size_;
+      bits = words_[word];
+    }
+    return word * kBitsInWord + static_cast<uint32_t>(__builtin_ctzll(bits));
+  }
+
+  // Returns the index of the last set bit <= |idx| or size() if there is
+  // none.
+  uint32_t PrevSet(uint32_t idx) const {
+    if (size_ == 0)
+      return size_;
+    if (idx >= size_)
+      idx = size_ - 1;
+    uint32_t word = idx / kBitsInWord;
+    uint32_t shift = kBitsInWord - 1 - idx % kBitsInWord;
+    uint64_t bits = words_[word] & (~0ull >> shift);
+    while (bits == 0) {
+      if (word-- == 0)
+        return size_;
+      bits = words_[word];
+    }
+    return word * kBitsInWord + kBitsInWord - 1 -
+           static_cast<uint32_t>(__builtin_clzll(bits));
+  }
+
+  // Returns the number of set bits.
+  uint32_t CountSetBits() const {
+    uint32_t count = 0;
+    for (uint64_t word : words_)
+      count += static_cast<uint32_t>(__builtin_popcountll(word));
+    return count;
+  }
+
+ private:
+  static size_t WordCount(uint32_t size) {
+    return (size + kBitsInWord - 1) / kBitsInWord;
+  }
+
+  void ClearTrailingBits() {
+    uint32_t trailing = size_ % kBitsInWord;
+    if (trailing != 0)
+      words_.back() &= (1ull << trailing) - 1;
+  }
+
+  uint32_t size_ = 0;
+  std::vector<uint64_t> words_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_BIT_VECTOR_H_
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/bit_vector.h"
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(BitVectorTest, SetAndClear) {
+  BitVector bv(100, false);
+  ASSERT_EQ(bv.size(), 100u);
+  ASSERT_EQ(bv.CountSetBits(), 0u);
+
+  bv.Set(0);
+  bv.Set(63);
+  bv.Set(64);
+  bv.Set(99);
+  ASSERT_TRUE(bv.IsSet(0));
+  ASSERT_FALSE(bv.IsSet(1));
+  ASSERT_TRUE(bv.IsSet(63));
+  ASSERT_TRUE(bv.IsSet(64));
+  ASSERT_TRUE(bv.IsSet(99));
+  ASSERT_EQ(bv.CountSetBits(), 4u);
+
+  bv.Clear(63);
+  ASSERT_FALSE(bv.IsSet(63));
+  ASSERT_EQ(bv.CountSetBits(), 3u);
+}
+
+TEST(BitVectorTest, AllSetIgnoresTrailingBits) {
+  BitVector bv(70, true);
+  ASSERT_EQ(bv.CountSetBits(), 70u);
+  ASSERT_EQ(bv.NextSet(69), 69u);
+  ASSERT_EQ(bv.NextSet(70), 70u);
+}
+
+TEST(BitVectorTest, NextAndPrevSet) {
+  BitVector bv(200, false);
+  bv.Set(5);
+  bv.Set(130);
+
+  ASSERT_EQ(bv.NextSet(0), 5u);
+  ASSERT_EQ(bv.NextSet(5), 5u);
+  ASSERT_EQ(bv.NextSet(6), 130u);
+  ASSERT_EQ(bv.NextSet(131), 200u);
+
+  ASSERT_EQ(bv.PrevSet(199), 130u);
+  ASSERT_EQ(bv.PrevSet(130), 130u);
+  ASSERT_EQ(bv.PrevSet(129), 5u);
+  ASSERT_EQ(bv.PrevSet(4), 200u);
+}
+
+TEST(BitVectorTest, AndBitsAcrossWords) {
+  BitVector bv(128, true);
+
+  // Keep only every other bit of the 64 bits starting at 32.
+  bv.AndBits(32, 64, 0x5555555555555555ull);
+  ASSERT_EQ(bv.CountSetBits(), 64u + 32u);
+  ASSERT_TRUE(bv.IsSet(31));
+  ASSERT_TRUE(bv.IsSet(32));
+  ASSERT_FALSE(bv.IsSet(33));
+  ASSERT_FALSE(bv.IsSet(95));
+  ASSERT_TRUE(bv.IsSet(96));
+
+  ASSERT_EQ(bv.GetBits(30, 4), 0x7ull);
+  ASSERT_EQ(bv.GetBits(64, 64), 0xFFFFFFFF55555555ull);
+}
+
+TEST(BitVectorTest, ClearRange) {
+  BitVector bv(300, true);
+  bv.ClearRange(10, 250);
+  ASSERT_EQ(bv.CountSetBits(), 60u);
+  ASSERT_TRUE(bv.IsSet(9));
+  ASSERT_FALSE(bv.IsSet(10));
+  ASSERT_FALSE(bv.IsSet(249));
+  ASSERT_TRUE(bv.IsSet(250));
+
+  bv.ClearRange(20, 20);
+  ASSERT_EQ(bv.CountSetBits(), 60u);
+}
+
+TEST(BitVectorTest, Move) {
+  BitVector bv(10, true);
+  BitVector moved(std::move(bv));
+  ASSERT_EQ(moved.size(), 10u);
+  ASSERT_EQ(moved.CountSetBits(), 10u);
+  ASSERT_TRUE(bv.empty());
+  ASSERT_EQ(bv.CountSetBits(), 0u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -19,9 +19,12 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <memory>
 
+#include "src/trace_processor/trace_blob_view.h"
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -38,6 +41,21 @@ class ChunkedTraceReader {
   // Returns true if the data has been succesfully parsed, false if some
   // unrecoverable parsing error happened and no more chunks should be pushed.
   virtual bool Parse(std::unique_ptr<uint8_t[]>, size_t) = 0;
+
+  // Like Parse(), but for data which is not necessarily owned as a heap
+  // buffer, e.g. a region of a memory-mapped trace file. Readers which can
+  // slice their input in place keep views on |blob| rather than copying it;
+  // the default implementation copies it and calls Parse().
+  virtual bool ParseBlob(TraceBlobView blob) {
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[blob.length()]);
+    memcpy(buf.get(), blob.data(), blob.length());
+    return Parse(std::move(buf), blob.length());
+  }
+
+  // Called after the last chunk of the trace has been pushed. Readers which
+  // buffer events (e.g. in the TraceSorter) must push them all to the next
+  // pipeline stages before returning.
+  virtual void NotifyEndOfFile() {}
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CHUNKED_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_CHUNKED_VECTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <malloc.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+// Size of the alignment of each chunk in a ChunkedVector. Matches the cache
+// line size of all the architectures we care about.
+constexpr size_t kChunkAlignment = 64;
+
+namespace chunked_vector_internal {
+
+inline void* AlignedAlloc(size_t size) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  void* ptr = _aligned_malloc(size, kChunkAlignment);
+#else
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, kChunkAlignment, size) != 0)
+    ptr = nullptr;
+#endif
+  PERFETTO_CHECK(ptr);
+  return ptr;
+}
+
+struct AlignedFreeDeleter {
+  inline void operator()(void* ptr) const {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+  }
+};
+
+}  // namespace chunked_vector_internal
+
+// ChunkedVector is an append-only container used to store the columns of the
+// tables in TraceStorage. It has the following characteristics:
+// - Elements are stored in fixed-size chunks of 2^|kChunkSizeLog2| elements.
+//   Each chunk is a single, cache-line aligned, allocation so rows in the same
+//   chunk are contiguous in memory and can be scanned linearly (and
+//   vectorized) by the filter and sort code.
+// - Appending never moves existing elements: pointers and references to
+//   elements are stable for the lifetime of the container.
+// - Random access is O(1) and costs a shift and a mask, with no per-element
+//   bookkeeping (unlike std::deque which also allocates a map of blocks).
+// - Only trivially destructible types are supported as elements are never
+//   destroyed individually.
+template <typename T, size_t kChunkSizeLog2 = 12>
+class ChunkedVector {
+ public:
+  static_assert(std::is_trivially_destructible<T>::value,
+                "ChunkedVector only supports trivially destructible types");
+  static_assert(kChunkSizeLog2 < 32, "Chunk size too large");
+
+  static constexpr size_t kChunkSize = 1ul << kChunkSizeLog2;
+  static constexpr size_t kChunkMask = kChunkSize - 1;
+
+  class ConstIterator {
+   public:
+    using difference_type = ptrdiff_t;
+    using value_type = T;
+    using pointer = const T*;
+    using reference = const T&;
+    using iterator_category = std::random_access_iterator_tag;
+
+    ConstIterator() = default;
+    ConstIterator(const ChunkedVector* vector, size_t pos)
+        : vector_(vector), pos_(pos) {}
+
+    const T& operator*() const { return (*vector_)[pos_]; }
+    const T* operator->() const { return &(*vector_)[pos_]; }
+    const T& operator[](difference_type i) const { return *(*this + i); }
+
+    ConstIterator& operator++() {
+      pos_++;
+      return *this;
+    }
+
+    ConstIterator operator++(int) {
+      ConstIterator ret = *this;
+      pos_++;
+      return ret;
+    }
+
+    ConstIterator& operator--() {
+      pos_--;
+      return *this;
+    }
+
+    ConstIterator operator--(int) {
+      ConstIterator ret = *this;
+      pos_--;
+      return ret;
+    }
+
+    ConstIterator& operator+=(difference_type offset) {
+      pos_ = static_cast<size_t>(static_cast<difference_type>(pos_) + offset);
+      return *this;
+    }
+
+    ConstIterator& operator-=(difference_type offset) {
+      return *this += -offset;
+    }
+
+    friend ConstIterator operator+(const ConstIterator& iter,
+                                   difference_type offset) {
+      ConstIterator ret = iter;
+      ret += offset;
+      return ret;
+    }
+
+    friend ConstIterator operator+(difference_type offset,
+                                   const ConstIterator& iter) {
+      return iter + offset;
+    }
+
+    friend ConstIterator operator-(const ConstIterator& iter,
+                                   difference_type offset) {
+      ConstIterator ret = iter;
+      ret -= offset;
+      return ret;
+    }
+
+    friend difference_type operator-(const ConstIterator& a,
+                                     const ConstIterator& b) {
+      return static_cast<difference_type>(a.pos_) -
+             static_cast<difference_type>(b.pos_);
+    }
+
+    friend bool operator==(const ConstIterator& a, const ConstIterator& b) {
+      return a.pos_ == b.pos_;
+    }
+    friend bool operator!=(const ConstIterator& a, const ConstIterator& b) {
+      return a.pos_ != b.pos_;
+    }
+    friend bool operator<(const ConstIterator& a, const ConstIterator& b) {
+      return a.pos_ < b.pos_;
+    }
+    friend bool operator>(const ConstIterator& a, const ConstIterator& b) {
+      return a.pos_ > b.pos_;
+    }
+    friend bool operator<=(const ConstIterator& a, const ConstIterator& b) {
+      return a.pos_ <= b.pos_;
+    }
+    friend bool operator>=(const ConstIterator& a, const ConstIterator& b) {
+      return a.pos_ >= b.pos_;
+    }
+
+   private:
+    const ChunkedVector* vector_ = nullptr;
+    size_t pos_ = 0;
+  };
+
+  ChunkedVector() = default;
+  ChunkedVector(ChunkedVector&& other) noexcept { *this = std::move(other); }
+  ChunkedVector& operator=(ChunkedVector&& other) noexcept {
+    chunks_ = std::move(other.chunks_);
+    size_ = other.size_;
+    other.chunks_.clear();
+    other.size_ = 0;
+    return *this;
+  }
+  ChunkedVector(const ChunkedVector&) = delete;
+  ChunkedVector& operator=(const ChunkedVector&) = delete;
+
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    if (PERFETTO_UNLIKELY((size_ & kChunkMask) == 0)) {
+      void* chunk = chunked_vector_internal::AlignedAlloc(sizeof(T) *
+                                                          kChunkSize);
+      chunks_.emplace_back(static_cast<T*>(chunk));
+    }
+    new (&chunks_.back().get()[size_ & kChunkMask])
+        T(std::forward<Args>(args)...);
+    size_++;
+  }
+
+  void push_back(const T& value) { emplace_back(value); }
+
+  T& operator[](size_t idx) {
+    PERFETTO_DCHECK(idx < size_);
+    return chunks_[idx >> kChunkSizeLog2].get()[idx & kChunkMask];
+  }
+
+  const T& operator[](size_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    return chunks_[idx >> kChunkSizeLog2].get()[idx & kChunkMask];
+  }
+
+  // Like operator[] but CHECKs that |idx| is in bounds also in release builds.
+  const T& at(size_t idx) const {
+    PERFETTO_CHECK(idx < size_);
+    return (*this)[idx];
+  }
+
+  T& back() { return (*this)[size_ - 1]; }
+  const T& back() const { return (*this)[size_ - 1]; }
+
+  T& front() { return (*this)[0]; }
+  const T& front() const { return (*this)[0]; }
+
+  ConstIterator begin() const { return ConstIterator(this, 0); }
+  ConstIterator end() const { return ConstIterator(this, size_); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns the number of chunks currently allocated. All chunks but the last
+  // one are full.
+  size_t chunk_count() const { return chunks_.size(); }
+
+  // Returns a pointer to the first element of the |chunk|-th chunk.
+  const T* chunk_data(size_t chunk) const {
+    PERFETTO_DCHECK(chunk < chunks_.size());
+    return chunks_[chunk].get();
+  }
+
+  // Returns the number of elements stored in the |chunk|-th chunk.
+  size_t chunk_size(size_t chunk) const {
+    PERFETTO_DCHECK(chunk < chunks_.size());
+    return chunk + 1 < chunks_.size() ? kChunkSize
+                                      : size_ - (chunk << kChunkSizeLog2);
+  }
+
+  // Calls |fn(const T* data, uint32_t first_row, uint32_t count)| for each
+  // contiguous run of elements covering the rows in [start_row, end_row).
+  // Every invocation but (possibly) the first and the last covers a whole
+  // chunk.
+  template <typename Fn>
+  void ForEachChunk(uint32_t start_row, uint32_t end_row, Fn fn) const {
+    PERFETTO_DCHECK(end_row <= size_);
+    uint32_t row = start_row;
+    while (row < end_row) {
+      const T* chunk = chunks_[row >> kChunkSizeLog2].get();
+      uint32_t offset = row & kChunkMask;
+      uint32_t count = std::min(static_cast<uint32_t>(kChunkSize - offset),
+                                end_row - row);
+      fn(chunk + offset, row, count);
+      row += count;
+    }
+  }
+
+  // Returns the number of bytes of heap memory used by this container.
+  size_t memory_usage() const {
+    return chunks_.size() * kChunkSize * sizeof(T) +
+           chunks_.capacity() * sizeof(ChunkPtr);
+  }
+
+ private:
+  using ChunkPtr =
+      std::unique_ptr<T, chunked_vector_internal::AlignedFreeDeleter>;
+
+  std::vector<ChunkPtr> chunks_;
+  size_t size_ = 0;
+};
+
+template <typename T, size_t kChunkSizeLog2>
+constexpr size_t ChunkedVector<T, kChunkSizeLog2>::kChunkSize;
+
+template <typename T, size_t kChunkSizeLog2>
+constexpr size_t ChunkedVector<T, kChunkSizeLog2>::kChunkMask;
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CHUNKED_VECTOR_H_
@@ -0,0 +1,202 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+
+#include <deque>
+#include <random>
+
+#include "benchmark/benchmark.h"
+#include "src/trace_processor/chunked_vector.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Allocator which keeps track of the number of bytes allocated by the
+// std::deque based columns, so they can be compared with
+// ChunkedVector::memory_usage().
+size_t g_deque_bytes = 0;
+
+template <typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    g_deque_bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T* p, size_t n) {
+    g_deque_bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template <typename U>
+  bool operator==(const CountingAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const CountingAllocator<U>&) const {
+    return false;
+  }
+};
+
+template <typename T>
+using CountingDeque = std::deque<T, CountingAllocator<T>>;
+
+// Mirrors the layout of TraceStorage::Slices (i.e. the sched table).
+template <template <typename> class Column>
+struct SchedColumns {
+  Column<int64_t> start_ns;
+  Column<int64_t> durations;
+  Column<uint32_t> cpus;
+  Column<uint32_t> utids;
+};
+
+template <typename T>
+using Chunked = ChunkedVector<T>;
+
+// Generates a synthetic sched trace with |rows| slices spread over 8 CPUs.
+template <template <typename> class Column>
+void FillSched(SchedColumns<Column>* sched, size_t rows) {
+  std::minstd_rand0 rnd(0);
+  int64_t ts = 0;
+  for (size_t i = 0; i < rows; i++) {
+    int64_t dur = static_cast<int64_t>(rnd() % 100000);
+    ts += static_cast<int64_t>(rnd() % 10000);
+    sched->start_ns.emplace_back(ts);
+    sched->durations.emplace_back(dur);
+    sched->cpus.emplace_back(static_cast<uint32_t>(rnd() % 8));
+    sched->utids.emplace_back(static_cast<uint32_t>(rnd() % 2048));
+  }
+}
+
+size_t MemoryUsage(const SchedColumns<Chunked>& sched) {
+  return sched.start_ns.memory_usage() + sched.durations.memory_usage() +
+         sched.cpus.memory_usage() + sched.utids.memory_usage();
+}
+
+void SchedArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1024);
+    return;
+  }
+  b->Arg(1024 * 1024);
+  b->Arg(16 * 1024 * 1024);
+}
+
+}  // namespace
+
+static void BM_ChunkedVector_Deque_Append(benchmark::State& state) {
+  size_t rows = static_cast<size_t>(state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) {
+    g_deque_bytes = 0;
+    SchedColumns<CountingDeque> sched;
+    FillSched(&sched, rows);
+    bytes = g_deque_bytes;
+  }
+  state.counters["bytes/row"] = benchmark::Counter(static_cast<double>(bytes) /
+                                                   static_cast<double>(rows));
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(rows));
+}
+BENCHMARK(BM_ChunkedVector_Deque_Append)
+    ->Unit(benchmark::kMillisecond)
+    ->Apply(SchedArgs);
+
+static void BM_ChunkedVector_Chunked_Append(benchmark::State& state) {
+  size_t rows = static_cast<size_t>(state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) {
+    SchedColumns<Chunked> sched;
+    FillSched(&sched, rows);
+    bytes = MemoryUsage(sched);
+  }
+  state.counters["bytes/row"] = benchmark::Counter(static_cast<double>(bytes) /
+                                                   static_cast<double>(rows));
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(rows));
+}
+BENCHMARK(BM_ChunkedVector_Chunked_Append)
+    ->Unit(benchmark::kMillisecond)
+    ->Apply(SchedArgs);
+
+// Equivalent of "select sum(dur) from sched where cpu = 3" using random access
+// on each row, as done by the storage columns.
+static void BM_ChunkedVector_Deque_Scan(benchmark::State& state) {
+  size_t rows = static_cast<size_t>(state.range(0));
+  SchedColumns<CountingDeque> sched;
+  FillSched(&sched, rows);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < rows; i++) {
+      if (sched.cpus[i] == 3)
+        sum += sched.durations[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(rows));
+}
+BENCHMARK(BM_ChunkedVector_Deque_Scan)->Apply(SchedArgs);
+
+static void BM_ChunkedVector_Chunked_Scan(benchmark::State& state) {
+  size_t rows = static_cast<size_t>(state.range(0));
+  SchedColumns<Chunked> sched;
+  FillSched(&sched, rows);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < rows; i++) {
+      if (sched.cpus[i] == 3)
+        sum += sched.durations[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(rows));
+}
+BENCHMARK(BM_ChunkedVector_Chunked_Scan)->Apply(SchedArgs);
+
+// Same as above but iterating over the contiguous runs of each chunk.
+static void BM_ChunkedVector_Chunked_ChunkScan(benchmark::State& state) {
+  size_t rows = static_cast<size_t>(state.range(0));
+  SchedColumns<Chunked> sched;
+  FillSched(&sched, rows);
+  for (auto _ : state) {
+    int64_t sum = 0;
+    sched.cpus.ForEachChunk(
+        0, static_cast<uint32_t>(rows),
+        [&sched, &sum](const uint32_t* cpus, uint32_t row, uint32_t count) {
+          const int64_t* durs = &sched.durations[row];
+          for (uint32_t i = 0; i < count; i++)
+            sum += cpus[i] == 3 ? durs[i] : 0;
+        });
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(rows));
+}
+BENCHMARK(BM_ChunkedVector_Chunked_ChunkScan)->Apply(SchedArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
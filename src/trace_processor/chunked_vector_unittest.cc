@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/chunked_vector.h"
+
+#include <algorithm>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Vector = ChunkedVector<int64_t, 2 /* 4 elements per chunk */>;
+
+TEST(ChunkedVectorTest, Empty) {
+  Vector vec;
+  ASSERT_TRUE(vec.empty());
+  ASSERT_EQ(vec.size(), 0u);
+  ASSERT_EQ(vec.chunk_count(), 0u);
+  ASSERT_EQ(vec.begin(), vec.end());
+  ASSERT_EQ(vec.memory_usage(), 0u);
+}
+
+TEST(ChunkedVectorTest, AppendAndRandomAccess) {
+  Vector vec;
+  for (int64_t i = 0; i < 10; i++)
+    vec.emplace_back(i * 10);
+
+  ASSERT_EQ(vec.size(), 10u);
+  ASSERT_EQ(vec.chunk_count(), 3u);
+  for (size_t i = 0; i < vec.size(); i++)
+    ASSERT_EQ(vec[i], static_cast<int64_t>(i * 10));
+  ASSERT_EQ(vec.front(), 0);
+  ASSERT_EQ(vec.back(), 90);
+
+  vec[5] = 42;
+  ASSERT_EQ(vec.at(5), 42);
+}
+
+TEST(ChunkedVectorTest, ChunksAreAlignedAndContiguous) {
+  Vector vec;
+  for (int64_t i = 0; i < 10; i++)
+    vec.push_back(i);
+
+  for (size_t c = 0; c < vec.chunk_count(); c++) {
+    const int64_t* data = vec.chunk_data(c);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(data) % kChunkAlignment, 0u);
+    for (size_t i = 0; i < vec.chunk_size(c); i++)
+      ASSERT_EQ(&data[i], &vec[c * Vector::kChunkSize + i]);
+  }
+  ASSERT_EQ(vec.chunk_size(0), 4u);
+  ASSERT_EQ(vec.chunk_size(1), 4u);
+  ASSERT_EQ(vec.chunk_size(2), 2u);
+}
+
+TEST(ChunkedVectorTest, ElementsAreStable) {
+  Vector vec;
+  vec.push_back(1);
+  const int64_t* first = &vec[0];
+  for (int64_t i = 0; i < 100; i++)
+    vec.push_back(i);
+  ASSERT_EQ(first, &vec[0]);
+  ASSERT_EQ(*first, 1);
+}
+
+TEST(ChunkedVectorTest, ForEachChunk) {
+  Vector vec;
+  for (int64_t i = 0; i < 10; i++)
+    vec.push_back(i);
+
+  std::vector<std::pair<uint32_t, uint32_t>> runs;
+  std::vector<int64_t> values;
+  vec.ForEachChunk(1, 9, [&](const int64_t* data, uint32_t row, uint32_t n) {
+    runs.emplace_back(row, n);
+    values.insert(values.end(), data, data + n);
+  });
+  ASSERT_THAT(runs, ::testing::ElementsAre(std::make_pair(1u, 3u),
+                                           std::make_pair(4u, 4u),
+                                           std::make_pair(8u, 1u)));
+  ASSERT_THAT(values, ::testing::ElementsAre(1, 2, 3, 4, 5, 6, 7, 8));
+
+  runs.clear();
+  vec.ForEachChunk(4, 4, [&](const int64_t*, uint32_t row, uint32_t n) {
+    runs.emplace_back(row, n);
+  });
+  ASSERT_TRUE(runs.empty());
+}
+
+TEST(ChunkedVectorTest, IteratorWorksWithStlAlgorithms) {
+  Vector vec;
+  for (int64_t i = 0; i < 13; i++)
+    vec.push_back(i * 2);
+
+  auto it = std::lower_bound(vec.begin(), vec.end(), 9);
+  ASSERT_EQ(std::distance(vec.begin(), it), 5);
+  ASSERT_EQ(*it, 10);
+
+  auto minmax = std::minmax_element(vec.begin(), vec.end());
+  ASSERT_EQ(*minmax.first, 0);
+  ASSERT_EQ(*minmax.second, 24);
+  ASSERT_EQ(vec.end() - vec.begin(), 13);
+}
+
+TEST(ChunkedVectorTest, Move) {
+  Vector vec;
+  for (int64_t i = 0; i < 6; i++)
+    vec.push_back(i);
+
+  Vector moved(std::move(vec));
+  ASSERT_EQ(moved.size(), 6u);
+  ASSERT_EQ(moved[5], 5);
+  ASSERT_TRUE(vec.empty());
+
+  // The moved-from vector must still be usable.
+  vec.push_back(100);
+  ASSERT_EQ(vec.size(), 1u);
+  ASSERT_EQ(vec[0], 100);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
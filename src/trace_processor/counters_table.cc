@@ -40,7 +40,7 @@ StorageSchema CountersTable::CreateStorageSchema() {
   return StorageSchema::Builder()
       .AddColumn<IdColumn>("id", TableId::kCounters)
       .AddOrderedNumericColumn("ts", &cs.timestamps())
-      .AddStringColumn("name", &cs.name_ids(), &storage_->string_pool())
+      .AddStringColumn("name", &cs.name_ids(), storage_)
       .AddNumericColumn("value", &cs.values())
       .AddColumn<RefColumn>("ref", &cs.refs(), &cs.types(), storage_)
       .AddStringColumn("ref_type", &cs.types(), &ref_types_)
@@ -53,25 +53,18 @@ uint32_t CountersTable::RowCount() {
 }
 
 int CountersTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
-  info->estimated_cost =
-      static_cast<uint32_t>(storage_->counters().counter_count());
+  info->estimated_cost = EstimateFilterCost(qc);
 
-  // Only the string columns are handled by SQLite
+  // See StorageTable::OmitSupportedConstraints().
   info->order_by_consumed = true;
-  size_t name_index = schema().ColumnIndexFromName("name");
-  size_t ref_type_index = schema().ColumnIndexFromName("ref_type");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] =
-        qc.constraints()[i].iColumn != static_cast<int>(name_index) &&
-        qc.constraints()[i].iColumn != static_cast<int>(ref_type_index);
-  }
+  OmitSupportedConstraints(qc, info);
 
   return SQLITE_OK;
 }
 
 CountersTable::RefColumn::RefColumn(std::string col_name,
-                                    const std::deque<int64_t>* refs,
-                                    const std::deque<RefType>* types,
+                                    const ChunkedVector<int64_t>* refs,
+                                    const ChunkedVector<RefType>* types,
                                     const TraceStorage* storage)
     : StorageColumn(col_name, false /* hidden */),
       refs_(refs),
@@ -40,8 +40,8 @@ class CountersTable : public StorageTable {
   class RefColumn final : public StorageColumn {
    public:
     RefColumn(std::string col_name,
-              const std::deque<int64_t>* refs,
-              const std::deque<RefType>* types,
+              const ChunkedVector<int64_t>* refs,
+              const ChunkedVector<RefType>* types,
               const TraceStorage* storage);
 
     void ReportResult(sqlite3_context* ctx, uint32_t row) const override;
@@ -61,8 +61,8 @@ class CountersTable : public StorageTable {
    private:
     int CompareRefsAsc(uint32_t f, uint32_t s) const;
 
-    const std::deque<int64_t>* refs_;
-    const std::deque<RefType>* types_;
+    const ChunkedVector<int64_t>* refs_;
+    const ChunkedVector<RefType>* types_;
     const TraceStorage* storage_ = nullptr;
   };
 
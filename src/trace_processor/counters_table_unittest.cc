@@ -235,6 +235,46 @@ TEST_F(CountersTableUnittest, RefColumnComparator) {
   ASSERT_EQ(comparator(ctr_null_upid, ctr_null_upid), 0);
 }
 
+TEST_F(CountersTableUnittest, FilterByName) {
+  auto* storage = context_.storage.get();
+  StringId cpufreq = storage->InternString("cpufreq");
+  StringId cpuidle = storage->InternString("cpuidle");
+  StringId mem = storage->InternString("mem.rss");
+  storage->InternString("unused");
+
+  auto* counters = storage->mutable_counters();
+  counters->AddCounter(1000, cpufreq, 1, 1 /* cpu */, RefType::kRefCpuId);
+  counters->AddCounter(1001, cpuidle, 2, 1 /* cpu */, RefType::kRefCpuId);
+  counters->AddCounter(1002, mem, 3, 1 /* upid */, RefType::kRefUpid);
+  counters->AddCounter(1003, cpufreq, 4, 2 /* cpu */, RefType::kRefCpuId);
+  counters->AddCounter(1004, 0 /* null name */, 5, 2, RefType::kRefCpuId);
+
+  auto values = [this](const std::string& where) {
+    PrepareValidStatement("SELECT value FROM counters WHERE " + where);
+    std::vector<int> result;
+    while (sqlite3_step(*stmt_) == SQLITE_ROW)
+      result.push_back(sqlite3_column_int(*stmt_, 0));
+    return result;
+  };
+
+  using ::testing::ElementsAre;
+  using ::testing::IsEmpty;
+  ASSERT_THAT(values("name = 'cpufreq'"), ElementsAre(1, 4));
+  ASSERT_THAT(values("name = 'cpufreq' and value > 1"), ElementsAre(4));
+  ASSERT_THAT(values("name = 'unknown'"), IsEmpty());
+  ASSERT_THAT(values("name = 'unused'"), IsEmpty());
+  ASSERT_THAT(values("name = ''"), IsEmpty());
+  ASSERT_THAT(values("name != 'cpufreq'"), ElementsAre(2, 3));
+  ASSERT_THAT(values("name != 'unknown'"), ElementsAre(1, 2, 3, 4));
+  ASSERT_THAT(values("name IS NOT 'cpufreq'"), ElementsAre(2, 3, 5));
+  ASSERT_THAT(values("name GLOB 'cpu*'"), ElementsAre(1, 2, 4));
+  ASSERT_THAT(values("name LIKE 'CPU%E'"), ElementsAre(2));
+  ASSERT_THAT(values("name > 'cpuidle'"), ElementsAre(3));
+  ASSERT_THAT(values("ref_type = 'upid'"), ElementsAre(3));
+  ASSERT_THAT(values("ref_type GLOB 'c*' and name = 'cpuidle'"),
+              ElementsAre(2));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
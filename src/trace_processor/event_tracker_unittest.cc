@@ -66,9 +66,8 @@ TEST_F(EventTrackerTest, InsertSecondSched) {
   ASSERT_EQ(timestamps.size(), 2ul);
   ASSERT_EQ(timestamps[0], timestamp);
   ASSERT_EQ(context.storage->GetThread(1).start_ns, timestamp);
-  ASSERT_EQ(std::string(context.storage->GetString(
-                context.storage->GetThread(1).name_id)),
-            kCommProc1);
+  ASSERT_EQ(context.storage->GetString(context.storage->GetThread(1).name_id),
+            base::StringView(kCommProc1));
   ASSERT_EQ(context.storage->slices().utids().front(), 1);
   ASSERT_EQ(context.storage->slices().durations().front(), 1);
 }
@@ -25,49 +25,48 @@ FilteredRowIndex::FilteredRowIndex(uint32_t start_row, uint32_t end_row)
     : mode_(Mode::kAllRows), start_row_(start_row), end_row_(end_row) {}
 
 void FilteredRowIndex::IntersectRows(std::vector<uint32_t> rows) {
+  // Sort the rows so that the intersection below makes sense.
+  std::sort(rows.begin(), rows.end());
+  IntersectSortedRows(rows);
+}
+
+void FilteredRowIndex::IntersectSortedRows(const std::vector<uint32_t>& rows) {
   PERFETTO_DCHECK(error_.empty());
+  PERFETTO_DCHECK(std::is_sorted(rows.begin(), rows.end()));
 
-  // Sort the rows so all branches below make sense.
-  std::sort(rows.begin(), rows.end());
+  // Only the rows in [start_row_, end_row_) can be returned so binary search
+  // for them: this is all which is needed if no filter was applied yet.
+  auto begin = std::lower_bound(rows.begin(), rows.end(), start_row_);
+  auto end = std::lower_bound(begin, rows.end(), end_row_);
 
   if (mode_ == kAllRows) {
     mode_ = Mode::kRowVector;
-    // Yes you're reading this code correctly. We use lower_bound in both cases.
-    // Yes this is very intentional and has to do with |end_row_| already being
-    // one greater than the value we are searching for so we need the first
-    // iterator which is *geq* the |end_row_|.
-    auto begin = std::lower_bound(rows.begin(), rows.end(), start_row_);
-    auto end = std::lower_bound(begin, rows.end(), end_row_);
     rows_.insert(rows_.end(), begin, end);
     return;
   } else if (mode_ == kRowVector) {
     std::vector<uint32_t> intersected;
-    std::set_intersection(rows_.begin(), rows_.end(), rows.begin(), rows.end(),
+    std::set_intersection(rows_.begin(), rows_.end(), begin, end,
                           std::back_inserter(intersected));
     rows_ = std::move(intersected);
     return;
   }
 
   // Initialise start to the beginning of the vector.
-  auto start = row_filter_.begin();
-
-  // Skip directly to the rows in range of start and end.
-  size_t i = 0;
-  for (; i < rows.size() && rows[i] < start_row_; i++) {
-  }
-  for (; i < rows.size() && rows[i] < end_row_; i++) {
+  uint32_t start = 0;
+  for (auto it = begin; it != end; ++it) {
     // Unset all bits between the start iterator and the iterator pointing
     // to the current row. That is, this loop sets all elements not pointed
     // to by rows to false. It does not touch the rows themselves which
     // means if they were already false (i.e. not returned) then they won't
     // be returned now and if they were true (i.e. returned) they will still
     // be returned.
-    auto row = rows[i];
-    auto end = row_filter_.begin() + static_cast<ptrdiff_t>(row - start_row_);
-    std::fill(start, end, false);
-    start = end + 1;
+    uint32_t row = *it - start_row_;
+    if (row < start)
+      continue;  // Duplicate row.
+    row_filter_.ClearRange(start, row);
+    start = row + 1;
   }
-  std::fill(start, row_filter_.end(), false);
+  row_filter_.ClearRange(start, row_filter_.size());
 }
 
 std::vector<uint32_t> FilteredRowIndex::ToRowVector() {
@@ -94,14 +93,13 @@ void FilteredRowIndex::ConvertBitVectorToRowVector() {
 
   mode_ = Mode::kRowVector;
 
-  auto b = row_filter_.begin();
-  auto e = row_filter_.end();
-  using std::find;
-  for (auto it = find(b, e, true); it != e; it = find(it + 1, e, true)) {
-    auto filter_idx = static_cast<uint32_t>(std::distance(b, it));
-    rows_.emplace_back(filter_idx + start_row_);
+  uint32_t size = row_filter_.size();
+  rows_.reserve(row_filter_.CountSetBits());
+  for (uint32_t i = row_filter_.NextSet(0); i < size;
+       i = row_filter_.NextSet(i + 1)) {
+    rows_.emplace_back(i + start_row_);
   }
-  row_filter_.clear();
+  row_filter_ = BitVector();
 }
 
 std::unique_ptr<RowIterator> FilteredRowIndex::ToRowIterator(bool desc) {
@@ -132,12 +130,11 @@ std::vector<uint32_t> FilteredRowIndex::TakeRowVector() {
   return vector;
 }
 
-std::vector<bool> FilteredRowIndex::TakeBitVector() {
+BitVector FilteredRowIndex::TakeBitVector() {
   PERFETTO_DCHECK(error_.empty());
 
   PERFETTO_DCHECK(mode_ == Mode::kBitVector);
   auto filter = std::move(row_filter_);
-  row_filter_.clear();
   mode_ = Mode::kAllRows;
   return filter;
 }
@@ -0,0 +1,124 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+
+#include <functional>
+#include <random>
+
+#include "benchmark/benchmark.h"
+#include "src/trace_processor/chunked_vector.h"
+#include "src/trace_processor/filtered_row_index.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void RowArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1024);
+    return;
+  }
+  b->Arg(1024 * 1024);
+  b->Arg(16 * 1024 * 1024);
+}
+
+// Fills |column| with |rows| random values in [0, 1024).
+template <typename T>
+void FillColumn(ChunkedVector<T>* column, uint32_t rows) {
+  std::minstd_rand0 rnd(0);
+  for (uint32_t i = 0; i < rows; i++)
+    column->emplace_back(static_cast<T>(rnd() % 1024));
+}
+
+// Filters using a type-erased per-row predicate: this is how all numeric
+// columns were filtered before FilterColumn was introduced.
+template <typename T, typename C, typename Comparator>
+void BenchmarkFilterRows(benchmark::State& state, C value, Comparator cmp) {
+  uint32_t rows = static_cast<uint32_t>(state.range(0));
+  ChunkedVector<T> column;
+  FillColumn(&column, rows);
+
+  std::function<bool(C)> predicate = [value, cmp](C v) {
+    return cmp(v, value);
+  };
+  for (auto _ : state) {
+    FilteredRowIndex index(0, rows);
+    index.FilterRows([&column, &predicate](uint32_t row) {
+      return predicate(static_cast<C>(column[row]));
+    });
+    benchmark::DoNotOptimize(index.ToRowIterator(false));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(rows));
+}
+
+template <typename T, typename C, typename Comparator>
+void BenchmarkFilterColumn(benchmark::State& state, C value, Comparator cmp) {
+  uint32_t rows = static_cast<uint32_t>(state.range(0));
+  ChunkedVector<T> column;
+  FillColumn(&column, rows);
+
+  for (auto _ : state) {
+    FilteredRowIndex index(0, rows);
+    index.FilterColumn(column, value, cmp);
+    benchmark::DoNotOptimize(index.ToRowIterator(false));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(rows));
+}
+
+}  // namespace
+
+// Equivalent of "where ts < x" with half of the rows matching.
+static void BM_FilteredRowIndex_Int64Lt_FilterRows(benchmark::State& state) {
+  BenchmarkFilterRows<int64_t>(state, int64_t(512), std::less<int64_t>());
+}
+BENCHMARK(BM_FilteredRowIndex_Int64Lt_FilterRows)->Apply(RowArgs);
+
+static void BM_FilteredRowIndex_Int64Lt_FilterColumn(benchmark::State& state) {
+  BenchmarkFilterColumn<int64_t>(state, int64_t(512), std::less<int64_t>());
+}
+BENCHMARK(BM_FilteredRowIndex_Int64Lt_FilterColumn)->Apply(RowArgs);
+
+// Equivalent of "where cpu = x" on a uint32_t column with few matches.
+static void BM_FilteredRowIndex_Uint32Eq_FilterRows(benchmark::State& state) {
+  BenchmarkFilterRows<uint32_t>(state, int64_t(3), std::equal_to<int64_t>());
+}
+BENCHMARK(BM_FilteredRowIndex_Uint32Eq_FilterRows)->Apply(RowArgs);
+
+static void BM_FilteredRowIndex_Uint32Eq_FilterColumn(
+    benchmark::State& state) {
+  BenchmarkFilterColumn<uint32_t>(state, int64_t(3), std::equal_to<int64_t>());
+}
+BENCHMARK(BM_FilteredRowIndex_Uint32Eq_FilterColumn)->Apply(RowArgs);
+
+// Equivalent of "where value > x" on a counter column.
+static void BM_FilteredRowIndex_DoubleGt_FilterRows(benchmark::State& state) {
+  BenchmarkFilterRows<double>(state, 100.0, std::greater<double>());
+}
+BENCHMARK(BM_FilteredRowIndex_DoubleGt_FilterRows)->Apply(RowArgs);
+
+static void BM_FilteredRowIndex_DoubleGt_FilterColumn(
+    benchmark::State& state) {
+  BenchmarkFilterColumn<double>(state, 100.0, std::greater<double>());
+}
+BENCHMARK(BM_FilteredRowIndex_DoubleGt_FilterColumn)->Apply(RowArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
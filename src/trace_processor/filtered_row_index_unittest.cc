@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/filtered_row_index.h"
 
+#include <functional>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -91,6 +93,86 @@ TEST(FilteredRowIndexUnittest, ToIterator) {
   ASSERT_TRUE(iterator->IsEnd());
 }
 
+TEST(FilteredRowIndexUnittest, ToIteratorDesc) {
+  FilteredRowIndex index(1, 5);
+  index.FilterRows([](uint32_t row) { return row != 3; });
+  auto iterator = index.ToRowIterator(true);
+
+  ASSERT_THAT(iterator->Row(), 4);
+  iterator->NextRow();
+  ASSERT_THAT(iterator->Row(), 2);
+  iterator->NextRow();
+  ASSERT_THAT(iterator->Row(), 1);
+  iterator->NextRow();
+  ASSERT_TRUE(iterator->IsEnd());
+}
+
+TEST(FilteredRowIndexUnittest, FilterColumn) {
+  ChunkedVector<uint32_t> column;
+  for (uint32_t i = 0; i < 10; i++)
+    column.emplace_back(i % 4);
+
+  FilteredRowIndex index(1, 9);
+  index.FilterColumn(column, int64_t(2), std::greater_equal<int64_t>());
+  ASSERT_THAT(index.ToRowVector(), ElementsAre(2, 3, 6, 7));
+}
+
+TEST(FilteredRowIndexUnittest, FilterColumnAfterFilterAndIntersect) {
+  ChunkedVector<double> column;
+  for (uint32_t i = 0; i < 10; i++)
+    column.emplace_back(i * 0.5);
+
+  FilteredRowIndex filtered(0, 10);
+  filtered.FilterRows([](uint32_t row) { return row % 2 == 0; });
+  filtered.FilterColumn(column, 3.0, std::less<double>());
+  ASSERT_THAT(filtered.ToRowVector(), ElementsAre(0, 2, 4));
+
+  FilteredRowIndex intersected(0, 10);
+  intersected.IntersectRows({1, 5, 9});
+  intersected.FilterColumn(column, 2.5, std::not_equal_to<double>());
+  ASSERT_THAT(intersected.ToRowVector(), ElementsAre(1, 9));
+}
+
+TEST(FilteredRowIndexUnittest, IntersectSortedRows) {
+  std::vector<uint32_t> rows = {0, 2, 4, 5, 10};
+
+  FilteredRowIndex all(1, 5);
+  all.IntersectSortedRows(rows);
+  ASSERT_THAT(all.ToRowVector(), ElementsAre(2, 4));
+
+  FilteredRowIndex filtered(1, 11);
+  filtered.FilterRows([](uint32_t row) { return row != 4; });
+  filtered.IntersectSortedRows(rows);
+  ASSERT_THAT(filtered.ToRowVector(), ElementsAre(2, 5, 10));
+
+  FilteredRowIndex intersected(1, 11);
+  intersected.IntersectSortedRows({2, 3, 5, 6});
+  intersected.IntersectSortedRows(rows);
+  ASSERT_THAT(intersected.ToRowVector(), ElementsAre(2, 5));
+}
+
+// Checks FilterColumn against FilterRows on enough rows to span several
+// chunks and 64-bit blocks, starting at a row which is not block aligned.
+TEST(FilteredRowIndexUnittest, FilterColumnMatchesFilterRows) {
+  ChunkedVector<int64_t> column;
+  for (uint32_t i = 0; i < 10000; i++)
+    column.emplace_back((i * 7919) % 1000);
+
+  auto pred = [&column](uint32_t row) {
+    return column[row] > 300 && column[row] <= 600;
+  };
+  FilteredRowIndex expected(37, 9990);
+  expected.FilterRows(pred);
+
+  FilteredRowIndex actual(37, 9990);
+  actual.FilterColumn(column, int64_t(300), std::greater<int64_t>());
+  actual.FilterColumn(column, int64_t(600), std::less_equal<int64_t>());
+
+  auto expected_rows = expected.ToRowVector();
+  ASSERT_FALSE(expected_rows.empty());
+  ASSERT_EQ(actual.ToRowVector(), expected_rows);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -42,7 +42,7 @@ StorageSchema InstantsTable::CreateStorageSchema() {
   return StorageSchema::Builder()
       .AddColumn<IdColumn>("id", TableId::kInstants)
       .AddOrderedNumericColumn("ts", &instants.timestamps())
-      .AddStringColumn("name", &instants.name_ids(), &storage_->string_pool())
+      .AddStringColumn("name", &instants.name_ids(), storage_)
       .AddNumericColumn("value", &instants.values())
       .AddColumn<CountersTable::RefColumn>("ref", &instants.refs(),
                                            &instants.types(), storage_)
@@ -56,18 +56,11 @@ uint32_t InstantsTable::RowCount() {
 }
 
 int InstantsTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
-  info->estimated_cost =
-      static_cast<uint32_t>(storage_->instants().instant_count());
+  info->estimated_cost = EstimateFilterCost(qc);
 
-  // Only the string columns are handled by SQLite
+  // See StorageTable::OmitSupportedConstraints().
   info->order_by_consumed = true;
-  size_t name_index = schema().ColumnIndexFromName("name");
-  size_t ref_type_index = schema().ColumnIndexFromName("ref_type");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] =
-        qc.constraints()[i].iColumn != static_cast<int>(name_index) &&
-        qc.constraints()[i].iColumn != static_cast<int>(ref_type_index);
-  }
+  OmitSupportedConstraints(qc, info);
 
   return SQLITE_OK;
 }
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/interval_index.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+constexpr uint32_t IntervalIndex::kFanOutLog2;
+constexpr uint32_t IntervalIndex::kFanOut;
+
+IntervalIndex::IntervalIndex() = default;
+IntervalIndex::~IntervalIndex() = default;
+
+void IntervalIndex::Build(const ChunkedVector<int64_t>& start,
+                          const ChunkedVector<int64_t>& dur) {
+  PERFETTO_DCHECK(start.size() == dur.size());
+  size_ = static_cast<uint32_t>(start.size());
+  max_ends_.clear();
+  max_ends_.emplace_back((size_ + kFanOut - 1) / kFanOut,
+                         std::numeric_limits<int64_t>::min());
+  std::vector<int64_t>* blocks = &max_ends_.back();
+  for (uint32_t row = 0; row < size_; row++) {
+    int64_t* block_end = &(*blocks)[row >> kFanOutLog2];
+    *block_end = std::max(*block_end, start[row] + dur[row]);
+  }
+
+  while (max_ends_.back().size() > kFanOut) {
+    const std::vector<int64_t>& nodes = max_ends_.back();
+    std::vector<int64_t> parents((nodes.size() + kFanOut - 1) / kFanOut,
+                                 std::numeric_limits<int64_t>::min());
+    for (size_t i = 0; i < nodes.size(); i++) {
+      int64_t* parent_end = &parents[i >> kFanOutLog2];
+      *parent_end = std::max(*parent_end, nodes[i]);
+    }
+    max_ends_.emplace_back(std::move(parents));
+  }
+}
+
+void IntervalIndex::FindRowsEndingAfter(int64_t ts,
+                                        bool inclusive,
+                                        uint32_t start_row,
+                                        uint32_t end_row,
+                                        const ChunkedVector<int64_t>& start,
+                                        const ChunkedVector<int64_t>& dur,
+                                        std::vector<uint32_t>* rows) const {
+  PERFETTO_DCHECK(start.size() == size_ && dur.size() == size_);
+  end_row = std::min(end_row, size_);
+  if (start_row >= end_row)
+    return;
+
+  Query query{ts, inclusive, start_row, end_row, &start, &dur, rows};
+  size_t top = max_ends_.size() - 1;
+  for (uint32_t node = 0; node < max_ends_[top].size(); node++)
+    FindInNode(query, top, node);
+}
+
+void IntervalIndex::FindInNode(const Query& query,
+                               size_t level,
+                               uint32_t node) const {
+  // Each level multiplies the number of rows covered by a node by kFanOut.
+  const uint32_t shift = static_cast<uint32_t>(level + 1) * kFanOutLog2;
+  const uint64_t first_row = static_cast<uint64_t>(node) << shift;
+  const uint64_t last_row = first_row + (uint64_t(1) << shift);
+  if (last_row <= query.start_row || first_row >= query.end_row ||
+      !query.EndsAfter(max_ends_[level][node])) {
+    return;
+  }
+
+  if (level > 0) {
+    uint32_t first_child = node << kFanOutLog2;
+    uint32_t last_child =
+        std::min(first_child + kFanOut,
+                 static_cast<uint32_t>(max_ends_[level - 1].size()));
+    for (uint32_t child = first_child; child < last_child; child++)
+      FindInNode(query, level - 1, child);
+    return;
+  }
+
+  uint32_t row = std::max(static_cast<uint32_t>(first_row), query.start_row);
+  uint32_t end =
+      static_cast<uint32_t>(std::min<uint64_t>(last_row, query.end_row));
+  for (; row < end; row++) {
+    if (query.EndsAfter((*query.start)[row] + (*query.dur)[row]))
+      query.rows->push_back(row);
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_INTERVAL_INDEX_H_
+#define SRC_TRACE_PROCESSOR_INTERVAL_INDEX_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "src/trace_processor/chunked_vector.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Index of the ends of intervals sorted by start, to find the intervals
+// ending after a timestamp without reading all of them.
+//
+// This is an interval tree whose nodes are implicit: the rows are split in
+// blocks of 64 which keep the maximum end of their rows, the blocks are
+// grouped by 64 in the same way, and so on. Searches skip the groups whose
+// maximum end is before the timestamp. As the starts are sorted, the rows
+// overlapping a timestamp X (ts <= X and ts + dur >= X) are the rows ending
+// after X among the ones before the upper bound of X in the starts. These are
+// found in time proportional to the number of rows returned.
+class IntervalIndex {
+ public:
+  IntervalIndex();
+  ~IntervalIndex();
+
+  // Builds the index of the intervals [start[i], start[i] + dur[i]]. The
+  // index has to be built again if the intervals change.
+  void Build(const ChunkedVector<int64_t>& start,
+             const ChunkedVector<int64_t>& dur);
+
+  // Appends the rows in [start_row, end_row) whose interval ends after |ts|,
+  // or at |ts| if |inclusive|, to |rows| in increasing order. |start| and
+  // |dur| must be the vectors the index was built with.
+  void FindRowsEndingAfter(int64_t ts,
+                           bool inclusive,
+                           uint32_t start_row,
+                           uint32_t end_row,
+                           const ChunkedVector<int64_t>& start,
+                           const ChunkedVector<int64_t>& dur,
+                           std::vector<uint32_t>* rows) const;
+
+  // Returns the number of rows indexed. Tables check it against the number
+  // of rows of the storage to only use an up-to-date index.
+  uint32_t size() const { return size_; }
+
+ private:
+  static constexpr uint32_t kFanOutLog2 = 6;
+  static constexpr uint32_t kFanOut = 1u << kFanOutLog2;
+
+  struct Query {
+    int64_t ts;
+    bool inclusive;
+    uint32_t start_row;
+    uint32_t end_row;
+    const ChunkedVector<int64_t>* start;
+    const ChunkedVector<int64_t>* dur;
+    std::vector<uint32_t>* rows;
+
+    bool EndsAfter(int64_t end) const {
+      return inclusive ? end >= ts : end > ts;
+    }
+  };
+
+  void FindInNode(const Query& query, size_t level, uint32_t node) const;
+
+  uint32_t size_ = 0;
+
+  // |max_ends_[0][i]| is the maximum end of the rows of the i-th block of
+  // kFanOut rows and |max_ends_[l + 1][i]| the maximum of
+  // |max_ends_[l][i * kFanOut]| to |max_ends_[l][(i + 1) * kFanOut - 1]|. The
+  // last level has at most kFanOut nodes.
+  std::vector<std::vector<int64_t>> max_ends_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_INTERVAL_INDEX_H_
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/slice_table.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Adds |slices| nested slices to |storage|, on 16 threads which each have
+// stacks of up to 8 slices. Returns the end of the last slice.
+int64_t PopulateSlices(uint32_t slices, TraceStorage* storage) {
+  const uint32_t kThreads = 16;
+  const uint32_t kMaxDepth = 8;
+  std::minstd_rand0 rnd(0);
+  auto* nestable_slices = storage->mutable_nestable_slices();
+  int64_t ts = 0;
+  for (uint32_t i = 0; i < slices;) {
+    // Each stack starts after the previous one and is nested: every slice
+    // ends before its parent.
+    ts += 1000 + static_cast<int64_t>(rnd() % 1000);
+    UniqueTid utid = static_cast<UniqueTid>(rnd() % kThreads);
+    uint32_t depth = 1 + static_cast<uint32_t>(rnd() % kMaxDepth);
+    int64_t dur = 100000;
+    for (uint8_t d = 0; d < depth && i < slices; d++, i++) {
+      nestable_slices->AddSlice(ts + d * 10, dur, utid, 0, 0, d, 0, 0);
+      dur -= 20 + static_cast<int64_t>(rnd() % 1000);
+    }
+  }
+  return ts + 100000;
+}
+
+void OverlapArgs(benchmark::internal::Benchmark* b) {
+  int slices = IsBenchmarkFunctionalOnly() ? 10000 : 1000000;
+  b->Args({slices, 0});
+  b->Args({slices, 1});
+}
+
+}  // namespace
+
+// Finds the slices open at random timestamps among state.range(0) slices. The
+// second argument toggles the index of the ends of the slices.
+static void BM_SliceOverlapQuery(benchmark::State& state) {
+  sqlite3* raw_db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+  ScopedDb db(raw_db);
+  PERFETTO_CHECK(sqlite3_exec(*db, "CREATE TABLE perfetto_tables(name STRING)",
+                              nullptr, nullptr, nullptr) == SQLITE_OK);
+  TraceStorage storage;
+  SliceTable::RegisterTable(*db, &storage);
+  int64_t end_ts =
+      PopulateSlices(static_cast<uint32_t>(state.range(0)), &storage);
+  if (state.range(1))
+    storage.mutable_nestable_slices()->BuildEndIndex();
+
+  const char kQuery[] =
+      "SELECT count(*) FROM slices WHERE ts <= ?1 AND ts_end >= ?1";
+  sqlite3_stmt* raw_stmt = nullptr;
+  PERFETTO_CHECK(sqlite3_prepare_v2(*db, kQuery, -1, &raw_stmt, nullptr) ==
+                 SQLITE_OK);
+  ScopedStmt stmt(raw_stmt);
+
+  std::minstd_rand0 rnd(0);
+  int64_t rows = 0;
+  for (auto _ : state) {
+    int64_t ts = static_cast<int64_t>(rnd() % static_cast<uint64_t>(end_ts));
+    sqlite3_reset(*stmt);
+    sqlite3_bind_int64(*stmt, 1, ts);
+    PERFETTO_CHECK(sqlite3_step(*stmt) == SQLITE_ROW);
+    rows += sqlite3_column_int64(*stmt, 0);
+  }
+  state.counters["rows"] = static_cast<double>(rows) /
+                           static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_SliceOverlapQuery)
+    ->Unit(benchmark::kMicrosecond)
+    ->Apply(OverlapArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/interval_index.h"
+
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+class IntervalIndexTest : public ::testing::Test {
+ protected:
+  void Add(int64_t start, int64_t dur) {
+    start_.emplace_back(start);
+    dur_.emplace_back(dur);
+  }
+
+  std::vector<uint32_t> Find(int64_t ts,
+                             bool inclusive,
+                             uint32_t start_row = 0,
+                             uint32_t end_row = 0xffffffff) {
+    std::vector<uint32_t> rows;
+    index_.FindRowsEndingAfter(ts, inclusive, start_row, end_row, start_, dur_,
+                               &rows);
+    return rows;
+  }
+
+  // Returns the rows found by reading all of them.
+  std::vector<uint32_t> Scan(int64_t ts,
+                             bool inclusive,
+                             uint32_t start_row,
+                             uint32_t end_row) {
+    std::vector<uint32_t> rows;
+    for (uint32_t row = start_row; row < end_row && row < start_.size();
+         row++) {
+      int64_t end = start_[row] + dur_[row];
+      if (inclusive ? end >= ts : end > ts)
+        rows.push_back(row);
+    }
+    return rows;
+  }
+
+  ChunkedVector<int64_t> start_;
+  ChunkedVector<int64_t> dur_;
+  IntervalIndex index_;
+};
+
+TEST_F(IntervalIndexTest, Empty) {
+  index_.Build(start_, dur_);
+  ASSERT_EQ(index_.size(), 0u);
+  ASSERT_THAT(Find(0, true), IsEmpty());
+}
+
+TEST_F(IntervalIndexTest, SmallIntervals) {
+  Add(10, 5);
+  Add(12, 20);
+  Add(14, 0);
+  Add(20, -1);
+  index_.Build(start_, dur_);
+  ASSERT_EQ(index_.size(), 4u);
+
+  // The starts of the rows are not bounded.
+  ASSERT_THAT(Find(15, true), ElementsAre(0, 1, 3));
+  ASSERT_THAT(Find(15, false), ElementsAre(1, 3));
+  ASSERT_THAT(Find(14, true), ElementsAre(0, 1, 2, 3));
+  ASSERT_THAT(Find(19, true), ElementsAre(1, 3));
+  ASSERT_THAT(Find(19, false), ElementsAre(1));
+  ASSERT_THAT(Find(19, true, 0, 2), ElementsAre(1));
+  ASSERT_THAT(Find(19, true, 2, 4), ElementsAre(3));
+  ASSERT_THAT(Find(33, true), IsEmpty());
+}
+
+TEST_F(IntervalIndexTest, SameAsScan) {
+  // Enough rows for three levels of nodes, with mostly short intervals and a
+  // few very long ones.
+  const uint32_t kRows = 300000;
+  std::minstd_rand0 rnd(0);
+  int64_t ts = 0;
+  for (uint32_t i = 0; i < kRows; i++) {
+    ts += static_cast<int64_t>(rnd() % 100);
+    int64_t dur = static_cast<int64_t>(rnd() % 200);
+    if (rnd() % 1000 == 0)
+      dur *= 1000;
+    Add(ts, dur);
+  }
+  index_.Build(start_, dur_);
+
+  for (int i = 0; i < 50; i++) {
+    int64_t query_ts = static_cast<int64_t>(rnd() % static_cast<uint64_t>(ts));
+    uint32_t start_row = static_cast<uint32_t>(rnd() % kRows);
+    uint32_t end_row = start_row + static_cast<uint32_t>(rnd() % kRows);
+    bool inclusive = i % 2 == 0;
+    ASSERT_EQ(Find(query_ts, inclusive, start_row, end_row),
+              Scan(query_ts, inclusive, start_row, end_row));
+    ASSERT_EQ(Find(query_ts, inclusive), Scan(query_ts, inclusive, 0, kRows));
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
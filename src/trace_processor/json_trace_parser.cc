@@ -17,8 +17,8 @@
 #include "src/trace_processor/json_trace_parser.h"
 
 #include <inttypes.h>
-#include <json/reader.h>
-#include <json/value.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <limits>
 #include <string>
@@ -29,6 +29,7 @@
 #include "src/trace_processor/process_tracker.h"
 #include "src/trace_processor/slice_tracker.h"
 #include "src/trace_processor/trace_processor_context.h"
+#include "src/trace_processor/trace_storage.h"
 
 #if !PERFETTO_BUILDFLAG(PERFETTO_STANDALONE_BUILD)
 #error The JSON trace parser is supported only in the standalone build for now.
@@ -38,92 +39,398 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
-enum ReadDictRes { kFoundDict, kNeedsMoreData, kEndOfTrace, kFatalError };
-
-// Parses at most one JSON dictionary and returns a pointer to the end of it,
-// or nullptr if no dict could be detected.
-// This is to avoid decoding the full trace in memory and reduce heap traffic.
-// E.g.  input:  { a:1 b:{ c:2, d:{ e:3 } } } , { a:4, ... },
-//       output: [   only this is parsed    ] ^return value points here.
-ReadDictRes ReadOneJsonDict(const char* start,
-                            const char* end,
-                            Json::Value* value,
-                            const char** next) {
-  int braces = 0;
-  const char* dict_begin = nullptr;
-  for (const char* s = start; s < end; s++) {
-    if (isspace(*s) || *s == ',')
-      continue;
-    if (*s == '{') {
-      if (braces == 0)
-        dict_begin = s;
-      braces++;
+// The tokenizer below reads the trace in place, one event at a time, rather
+// than building a DOM for each event: only the few fields which are imported
+// are extracted, and all the other values are skipped over.
+
+enum ScanRes { kScanOk, kScanNeedsMoreData, kScanError };
+
+inline bool IsJsonWhitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline const char* SkipWhitespace(const char* s, const char* end) {
+  while (s < end && IsJsonWhitespace(*s))
+    s++;
+  return s;
+}
+
+// Reads the string starting at the opening quote pointed by |*s|.
+ScanRes ReadString(const char** s, const char* end, JsonToken* token) {
+  const char* begin = *s + 1;
+  bool has_escapes = false;
+  for (const char* c = begin; c < end; c++) {
+    if (*c == '\\') {
+      has_escapes = true;
+      c++;
       continue;
     }
-    if (*s == '}') {
-      if (braces <= 0)
-        return kEndOfTrace;
-      if (--braces > 0)
-        continue;
-      Json::Reader reader;
-      if (!reader.parse(dict_begin, s + 1, *value, /*collectComments=*/false)) {
-        PERFETTO_ELOG("JSON error: %s",
-                      reader.getFormattedErrorMessages().c_str());
-        return kFatalError;
+    if (*c == '"') {
+      size_t size = static_cast<size_t>(c - begin);
+      *token = JsonToken(JsonToken::kString, base::StringView(begin, size),
+                         has_escapes);
+      *s = c + 1;
+      return kScanOk;
+    }
+  }
+  return kScanNeedsMoreData;
+}
+
+// Reads a number or a literal (true, false, null). As they have no closing
+// delimiter, they are complete only once the following character is in the
+// buffer.
+ScanRes ReadLiteral(const char** s, const char* end, JsonToken* token) {
+  const char* begin = *s;
+  const char* c = begin;
+  while (c < end && !IsJsonWhitespace(*c) && *c != ',' && *c != '}' &&
+         *c != ']') {
+    c++;
+  }
+  if (c == end)
+    return kScanNeedsMoreData;
+  if (c == begin)
+    return kScanError;
+  bool is_number = *begin == '-' || (*begin >= '0' && *begin <= '9');
+  *token = JsonToken(is_number ? JsonToken::kNumber : JsonToken::kOther,
+                     base::StringView(begin, static_cast<size_t>(c - begin)));
+  *s = c;
+  return kScanOk;
+}
+
+// Skips the dictionary or array starting at |*s|, including any nested one.
+// Braces and brackets inside strings are ignored.
+ScanRes SkipContainer(const char** s, const char* end) {
+  int depth = 0;
+  for (const char* c = *s; c < end; c++) {
+    switch (*c) {
+      case '"': {
+        JsonToken ignored;
+        ScanRes res = ReadString(&c, end, &ignored);
+        if (res != kScanOk)
+          return res;
+        c--;  // ReadString() moved past the closing quote.
+        break;
       }
-      *next = s + 1;
-      return kFoundDict;
+      case '{':
+      case '[':
+        depth++;
+        break;
+      case '}':
+      case ']':
+        if (--depth == 0) {
+          *s = c + 1;
+          return kScanOk;
+        }
+        break;
     }
-    // TODO(primiano): skip braces in quoted strings, e.g.: {"foo": "ba{z" }
   }
-  return kNeedsMoreData;
+  return kScanNeedsMoreData;
+}
+
+// Reads the value starting at |*s|. Dictionaries and arrays are skipped and
+// reported as kOther.
+ScanRes ReadValue(const char** s, const char* end, JsonToken* token) {
+  switch (**s) {
+    case '"':
+      return ReadString(s, end, token);
+    case '{':
+    case '[':
+      *token = JsonToken(JsonToken::kOther, base::StringView());
+      return SkipContainer(s, end);
+    default:
+      return ReadLiteral(s, end, token);
+  }
+}
+
+// Iterates over the dictionary starting at |*s|, calling |read_value| for each
+// key with |*s| pointing at the value, which it must consume.
+template <typename ReadValueFn>
+ScanRes ReadDict(const char** s, const char* end, ReadValueFn read_value) {
+  const char* c = *s + 1;
+  for (bool first = true;; first = false) {
+    c = SkipWhitespace(c, end);
+    if (c == end)
+      return kScanNeedsMoreData;
+    if (*c == '}' && first) {
+      *s = c + 1;
+      return kScanOk;
+    }
+    if (*c != '"')
+      return kScanError;
+    JsonToken key;
+    ScanRes res = ReadString(&c, end, &key);
+    if (res != kScanOk)
+      return res;
+    c = SkipWhitespace(c, end);
+    if (c == end)
+      return kScanNeedsMoreData;
+    if (*c++ != ':')
+      return kScanError;
+    c = SkipWhitespace(c, end);
+    if (c == end)
+      return kScanNeedsMoreData;
+    res = read_value(key.text, &c);
+    if (res != kScanOk)
+      return res;
+    c = SkipWhitespace(c, end);
+    if (c == end)
+      return kScanNeedsMoreData;
+    if (*c == '}') {
+      *s = c + 1;
+      return kScanOk;
+    }
+    if (*c++ != ',')
+      return kScanError;
+  }
+}
+
+void AppendUtf8(uint32_t cp, std::string* out) {
+  if (cp < 0x80) {
+    out->push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (cp >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (cp >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  }
+}
+
+// Reads the 4 hex digits of a \u escape starting at |s|.
+bool ReadHex4(const char* s, const char* end, uint32_t* out) {
+  if (end - s < 4)
+    return false;
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = s[i];
+    value <<= 4;
+    if (c >= '0' && c <= '9')
+      value |= static_cast<uint32_t>(c - '0');
+    else if (c >= 'a' && c <= 'f')
+      value |= static_cast<uint32_t>(c - 'a' + 10);
+    else if (c >= 'A' && c <= 'F')
+      value |= static_cast<uint32_t>(c - 'A' + 10);
+    else
+      return false;
+  }
+  *out = value;
+  return true;
+}
+
+// Parses the whole of |text| as a base 10 integer. The text is copied as it
+// is not null terminated.
+base::Optional<int64_t> ParseInt64(base::StringView text) {
+  std::string s(text.data(), text.size());
+  char* end;
+  int64_t n = strtoll(s.c_str(), &end, 10);
+  if (end != s.data() + s.size())
+    return base::nullopt;
+  return n;
+}
+
+double ParseDouble(base::StringView text) {
+  std::string s(text.data(), text.size());
+  return strtod(s.c_str(), nullptr);
+}
+
+bool IsRealNumber(base::StringView text) {
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text.data()[i];
+    if (c == '.' || c == 'e' || c == 'E')
+      return true;
+  }
+  return false;
+}
+
+// Returns the string value of |token|, or an empty string for any other type,
+// like the legacy parser did for missing fields.
+bool GetString(const JsonToken& token,
+               std::string* storage,
+               base::StringView* out) {
+  if (token.type != JsonToken::kString) {
+    *out = base::StringView();
+    return true;
+  }
+  return UnescapeJsonString(token, storage, out);
 }
 
 }  // namespace
 
-// Json trace event timestamps are in us.
-// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU/edit#heading=h.nso4gcezn7n1
-base::Optional<int64_t> CoerceToNs(const Json::Value& value) {
-  switch (static_cast<size_t>(value.type())) {
-    case Json::realValue:
-      return static_cast<int64_t>(value.asDouble() * 1000);
-    case Json::uintValue:
-    case Json::intValue:
-      return value.asInt64() * 1000;
-    case Json::stringValue: {
-      std::string s = value.asString();
-      char* end;
-      int64_t n = strtoll(s.c_str(), &end, 10);
-      if (end != s.data() + s.size())
-        return base::nullopt;
-      return n * 1000;
+ReadDictRes ReadOneJsonEvent(const char* start,
+                             const char* end,
+                             JsonEvent* event,
+                             const char** next) {
+  const char* s = start;
+  while (s < end && (IsJsonWhitespace(*s) || *s == ','))
+    s++;
+  if (s == end)
+    return kNeedsMoreData;
+  if (*s == ']' || *s == '}')
+    return kEndOfTrace;
+  if (*s != '{') {
+    PERFETTO_ELOG("JSON error: expected an event at offset %zu",
+                  static_cast<size_t>(s - start));
+    return kFatalError;
+  }
+
+  auto read_args = [event, end](base::StringView key,
+                                const char** c) -> ScanRes {
+    if (key == "name")
+      return ReadValue(c, end, &event->args_name);
+    JsonToken ignored;
+    return ReadValue(c, end, &ignored);
+  };
+  auto read_field = [event, end, &read_args](base::StringView key,
+                                             const char** c) -> ScanRes {
+    JsonToken* token = nullptr;
+    switch (key.size()) {
+      case 2:
+        if (key == "ph")
+          token = &event->ph;
+        else if (key == "ts")
+          token = &event->ts;
+        break;
+      case 3:
+        if (key == "dur")
+          token = &event->dur;
+        else if (key == "pid")
+          token = &event->pid;
+        else if (key == "tid")
+          token = &event->tid;
+        else if (key == "cat")
+          token = &event->cat;
+        break;
+      case 4:
+        if (key == "name")
+          token = &event->name;
+        else if (key == "args" && **c == '{')
+          return ReadDict(c, end, read_args);
+        break;
     }
-    default:
-      return base::nullopt;
+    if (token)
+      return ReadValue(c, end, token);
+    JsonToken ignored;
+    return ReadValue(c, end, &ignored);
+  };
+
+  *event = JsonEvent();
+  switch (ReadDict(&s, end, read_field)) {
+    case kScanOk:
+      *next = s;
+      return kFoundDict;
+    case kScanNeedsMoreData:
+      return kNeedsMoreData;
+    case kScanError:
+      break;
   }
+  PERFETTO_ELOG("JSON error: malformed event");
+  return kFatalError;
 }
 
-base::Optional<int64_t> CoerceToInt64(const Json::Value& value) {
-  switch (static_cast<size_t>(value.type())) {
-    case Json::realValue:
-    case Json::uintValue:
-    case Json::intValue:
-      return value.asInt64();
-    case Json::stringValue: {
-      std::string s = value.asString();
-      char* end;
-      int64_t n = strtoll(s.c_str(), &end, 10);
-      if (end != s.data() + s.size())
+bool UnescapeJsonString(const JsonToken& token,
+                        std::string* storage,
+                        base::StringView* out) {
+  if (!token.has_escapes) {
+    *out = token.text;
+    return true;
+  }
+  storage->clear();
+  const char* s = token.text.data();
+  const char* end = s + token.text.size();
+  while (s < end) {
+    if (*s != '\\') {
+      storage->push_back(*s++);
+      continue;
+    }
+    if (++s == end)
+      return false;
+    char c = *s++;
+    switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        storage->push_back(c);
+        break;
+      case 'b':
+        storage->push_back('\b');
+        break;
+      case 'f':
+        storage->push_back('\f');
+        break;
+      case 'n':
+        storage->push_back('\n');
+        break;
+      case 'r':
+        storage->push_back('\r');
+        break;
+      case 't':
+        storage->push_back('\t');
+        break;
+      case 'u': {
+        uint32_t cp;
+        if (!ReadHex4(s, end, &cp))
+          return false;
+        s += 4;
+        // Code points outside the BMP are encoded as a surrogate pair.
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+          uint32_t low;
+          if (end - s < 6 || s[0] != '\\' || s[1] != 'u' ||
+              !ReadHex4(s + 2, end, &low) || low < 0xDC00 || low > 0xDFFF) {
+            return false;
+          }
+          s += 6;
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        AppendUtf8(cp, storage);
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  *out = base::StringView(*storage);
+  return true;
+}
+
+// Json trace event timestamps are in us.
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU/edit#heading=h.nso4gcezn7n1
+base::Optional<int64_t> CoerceToNs(const JsonToken& token) {
+  if (token.type == JsonToken::kNumber && IsRealNumber(token.text))
+    return static_cast<int64_t>(ParseDouble(token.text) * 1000);
+  base::Optional<int64_t> n = CoerceToInt64(token);
+  if (!n.has_value())
+    return base::nullopt;
+  return n.value() * 1000;
+}
+
+base::Optional<int64_t> CoerceToInt64(const JsonToken& token) {
+  switch (token.type) {
+    case JsonToken::kNumber:
+      if (IsRealNumber(token.text))
+        return static_cast<int64_t>(ParseDouble(token.text));
+      return ParseInt64(token.text);
+    case JsonToken::kString: {
+      std::string storage;
+      base::StringView text;
+      if (!UnescapeJsonString(token, &storage, &text))
         return base::nullopt;
-      return n;
+      return ParseInt64(text);
     }
-    default:
-      return base::nullopt;
+    case JsonToken::kMissing:
+    case JsonToken::kOther:
+      break;
   }
+  return base::nullopt;
 }
 
-base::Optional<uint32_t> CoerceToUint32(const Json::Value& value) {
-  base::Optional<int64_t> result = CoerceToInt64(value);
+base::Optional<uint32_t> CoerceToUint32(const JsonToken& token) {
+  base::Optional<int64_t> result = CoerceToInt64(token);
   if (!result.has_value())
     return base::nullopt;
   int64_t n = result.value();
@@ -163,35 +470,39 @@ bool JsonTraceParser::Parse(std::unique_ptr<uint8_t[]> data, size_t size) {
   TraceStorage* storage = context_->storage.get();
   SliceTracker* slice_tracker = context_->slice_tracker.get();
 
+  // Holds the unescaped strings of the current event.
+  std::string cat_storage;
+  std::string name_storage;
+  std::string args_name_storage;
+
   while (next < end) {
-    Json::Value value;
-    const auto res = ReadOneJsonDict(next, end, &value, &next);
+    JsonEvent event;
+    const auto res = ReadOneJsonEvent(next, end, &event, &next);
     if (res == kFatalError)
       return false;
     if (res == kEndOfTrace || res == kNeedsMoreData)
       break;
-    auto& ph = value["ph"];
-    if (!ph.isString())
+    if (event.ph.type != JsonToken::kString)
       continue;
-    char phase = *ph.asCString();
+    char phase = event.ph.text.size() ? event.ph.text.data()[0] : '\0';
 
-    base::Optional<uint32_t> opt_pid;
-    base::Optional<uint32_t> opt_tid;
-
-    if (value.isMember("pid"))
-      opt_pid = CoerceToUint32(value["pid"]);
-    if (value.isMember("tid"))
-      opt_tid = CoerceToUint32(value["tid"]);
+    base::Optional<uint32_t> opt_pid = CoerceToUint32(event.pid);
+    base::Optional<uint32_t> opt_tid = CoerceToUint32(event.tid);
 
     uint32_t pid = opt_pid.value_or(0);
     uint32_t tid = opt_tid.value_or(pid);
 
-    base::Optional<int64_t> opt_ts = CoerceToNs(value["ts"]);
+    base::Optional<int64_t> opt_ts = CoerceToNs(event.ts);
     PERFETTO_CHECK(opt_ts.has_value());
     int64_t ts = opt_ts.value();
 
-    const char* cat = value.isMember("cat") ? value["cat"].asCString() : "";
-    const char* name = value.isMember("name") ? value["name"].asCString() : "";
+    base::StringView cat;
+    base::StringView name;
+    if (!GetString(event.cat, &cat_storage, &cat) ||
+        !GetString(event.name, &name_storage, &name)) {
+      PERFETTO_ELOG("JSON error: invalid escape sequence");
+      return false;
+    }
     StringId cat_id = storage->InternString(cat);
     StringId name_id = storage->InternString(name);
     UniqueTid utid = procs->UpdateThread(tid, pid);
@@ -206,21 +517,25 @@ bool JsonTraceParser::Parse(std::unique_ptr<uint8_t[]> data, size_t size) {
         break;
       }
       case 'X': {  // TRACE_EVENT (scoped event).
-        base::Optional<int64_t> opt_dur = CoerceToNs(value["dur"]);
+        base::Optional<int64_t> opt_dur = CoerceToNs(event.dur);
         if (!opt_dur.has_value())
           continue;
         slice_tracker->Scoped(ts, utid, cat_id, name_id, opt_dur.value());
         break;
       }
       case 'M': {  // Metadata events (process and thread names).
-        if (strcmp(value["name"].asCString(), "thread_name") == 0) {
-          const char* thread_name = value["args"]["name"].asCString();
-          procs->UpdateThreadName(tid, pid, thread_name);
+        base::StringView args_name;
+        if (event.args_name.type != JsonToken::kString ||
+            !UnescapeJsonString(event.args_name, &args_name_storage,
+                                &args_name)) {
+          break;
+        }
+        if (name == "thread_name") {
+          procs->UpdateThreadName(tid, pid, args_name);
           break;
         }
-        if (strcmp(value["name"].asCString(), "process_name") == 0) {
-          const char* proc_name = value["args"]["name"].asCString();
-          procs->UpdateProcess(pid, base::nullopt, proc_name);
+        if (name == "process_name") {
+          procs->UpdateProcess(pid, base::nullopt, args_name);
           break;
         }
       }
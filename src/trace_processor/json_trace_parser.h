@@ -20,24 +20,65 @@
 #include <stdint.h>
 
 #include <memory>
-#include <tuple>
-#include <unordered_map>
+#include <string>
+#include <vector>
 
+#include "perfetto/base/optional.h"
+#include "perfetto/base/string_view.h"
 #include "src/trace_processor/chunked_trace_reader.h"
-#include "src/trace_processor/trace_storage.h"
-
-namespace Json {
-class Value;
-}
 
 namespace perfetto {
 namespace trace_processor {
 
 class TraceProcessorContext;
 
-base::Optional<int64_t> CoerceToNs(const Json::Value& value);
-base::Optional<int64_t> CoerceToInt64(const Json::Value& value);
-base::Optional<uint32_t> CoerceToUint32(const Json::Value& value);
+// A JSON value read by the event tokenizer. Only strings and numbers are
+// decoded: the text of a string excludes the quotes and is still escaped,
+// numbers keep their textual representation.
+struct JsonToken {
+  enum Type { kMissing, kString, kNumber, kOther };
+
+  JsonToken() = default;
+  JsonToken(Type t, base::StringView txt, bool escapes = false)
+      : type(t), text(txt), has_escapes(escapes) {}
+
+  Type type = kMissing;
+  base::StringView text;
+  bool has_escapes = false;
+};
+
+// The fields of a trace event which are imported. Everything else in the
+// event dictionary is skipped without being decoded.
+struct JsonEvent {
+  JsonToken ph;
+  JsonToken ts;
+  JsonToken dur;
+  JsonToken pid;
+  JsonToken tid;
+  JsonToken name;
+  JsonToken cat;
+  JsonToken args_name;  // The "name" entry of the "args" dictionary.
+};
+
+enum ReadDictRes { kFoundDict, kNeedsMoreData, kEndOfTrace, kFatalError };
+
+// Reads at most one event dictionary from [start, end). On kFoundDict,
+// |event| is filled and |next| points past the end of the dictionary;
+// otherwise |next| is left untouched.
+ReadDictRes ReadOneJsonEvent(const char* start,
+                             const char* end,
+                             JsonEvent* event,
+                             const char** next);
+
+// Returns the decoded text of a string token, using |storage| only if the
+// string contains escape sequences. Returns false on invalid escapes.
+bool UnescapeJsonString(const JsonToken& token,
+                        std::string* storage,
+                        base::StringView* out);
+
+base::Optional<int64_t> CoerceToNs(const JsonToken& token);
+base::Optional<int64_t> CoerceToInt64(const JsonToken& token);
+base::Optional<uint32_t> CoerceToUint32(const JsonToken& token);
 
 // Parses legacy chrome JSON traces. The support for now is extremely rough
 // and supports only explicit TRACE_EVENT_BEGIN/END events.
@@ -16,35 +16,190 @@
 
 #include "src/trace_processor/json_trace_parser.h"
 
-#include <json/value.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "perfetto/trace_processor/trace_processor.h"
 
 namespace perfetto {
 namespace trace_processor {
 namespace {
 
+JsonToken Number(const char* text) {
+  return JsonToken(JsonToken::kNumber, base::StringView(text));
+}
+
+JsonToken String(const char* text) {
+  return JsonToken(JsonToken::kString, base::StringView(text),
+                   strchr(text, '\\') != nullptr);
+}
+
+std::string ToString(base::StringView view) {
+  return std::string(view.data(), view.size());
+}
+
 TEST(JsonTraceParserTest, CoerceToUint32) {
-  ASSERT_EQ(CoerceToUint32(Json::Value(42)).value_or(0), 42);
-  ASSERT_EQ(CoerceToUint32(Json::Value("42")).value_or(0), 42);
-  ASSERT_EQ(CoerceToInt64(Json::Value(42.1)).value_or(-1), 42);
+  ASSERT_EQ(CoerceToUint32(Number("42")).value_or(0), 42u);
+  ASSERT_EQ(CoerceToUint32(String("42")).value_or(0), 42u);
+  ASSERT_EQ(CoerceToInt64(Number("42.1")).value_or(-1), 42);
+  ASSERT_FALSE(CoerceToUint32(Number("-1")).has_value());
+  ASSERT_FALSE(CoerceToUint32(Number("4294967296")).has_value());
 }
 
 TEST(JsonTraceParserTest, CoerceToInt64) {
-  ASSERT_EQ(CoerceToInt64(Json::Value(42)).value_or(-1), 42);
-  ASSERT_EQ(CoerceToInt64(Json::Value("42")).value_or(-1), 42);
-  ASSERT_EQ(CoerceToInt64(Json::Value(42.1)).value_or(-1), 42);
-  ASSERT_FALSE(CoerceToInt64(Json::Value("foo")).has_value());
-  ASSERT_FALSE(CoerceToInt64(Json::Value("1234!")).has_value());
+  ASSERT_EQ(CoerceToInt64(Number("42")).value_or(-1), 42);
+  ASSERT_EQ(CoerceToInt64(String("42")).value_or(-1), 42);
+  ASSERT_EQ(CoerceToInt64(Number("42.1")).value_or(-1), 42);
+  ASSERT_FALSE(CoerceToInt64(String("foo")).has_value());
+  ASSERT_FALSE(CoerceToInt64(String("1234!")).has_value());
+  ASSERT_FALSE(CoerceToInt64(JsonToken()).has_value());
 }
 
 TEST(JsonTraceParserTest, CoerceToNs) {
-  ASSERT_EQ(CoerceToNs(Json::Value(42)).value_or(-1), 42000);
-  ASSERT_EQ(CoerceToNs(Json::Value("42")).value_or(-1), 42000);
-  ASSERT_EQ(CoerceToNs(Json::Value(42.1)).value_or(-1), 42100);
-  ASSERT_FALSE(CoerceToNs(Json::Value("foo")).has_value());
-  ASSERT_FALSE(CoerceToNs(Json::Value("1234!")).has_value());
+  ASSERT_EQ(CoerceToNs(Number("42")).value_or(-1), 42000);
+  ASSERT_EQ(CoerceToNs(String("42")).value_or(-1), 42000);
+  ASSERT_EQ(CoerceToNs(Number("42.1")).value_or(-1), 42100);
+  ASSERT_EQ(CoerceToNs(Number("1e3")).value_or(-1), 1000000);
+  ASSERT_FALSE(CoerceToNs(String("foo")).has_value());
+  ASSERT_FALSE(CoerceToNs(String("1234!")).has_value());
+}
+
+TEST(JsonTraceParserTest, UnescapeJsonString) {
+  std::string storage;
+  base::StringView out;
+  ASSERT_TRUE(UnescapeJsonString(String("plain"), &storage, &out));
+  ASSERT_EQ(ToString(out), "plain");
+  ASSERT_TRUE(storage.empty());
+
+  ASSERT_TRUE(
+      UnescapeJsonString(String("a\\\"b\\\\c\\/\\n\\t"), &storage, &out));
+  ASSERT_EQ(ToString(out), "a\"b\\c/\n\t");
+  ASSERT_TRUE(UnescapeJsonString(String("\\u00e9\\u20ac\\ud83d\\ude00"),
+                                 &storage, &out));
+  ASSERT_EQ(ToString(out), "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+
+  ASSERT_FALSE(UnescapeJsonString(String("\\x"), &storage, &out));
+  ASSERT_FALSE(UnescapeJsonString(String("\\u12"), &storage, &out));
+  ASSERT_FALSE(UnescapeJsonString(String("\\ud83d"), &storage, &out));
+}
+
+TEST(JsonTraceParserTest, ReadOneJsonEvent) {
+  const std::string json =
+      R"( , {"cat": "c{a}t", "name": "n\"}", "ph": "X", "ts": 10.5,)"
+      R"( "dur": "3", "pid": 1, "tid": 2, "id": [1, {"x": "]}"}],)"
+      R"( "args": {"a": {"name": 5}, "name": "thread"}, "s": "\\"} ])";
+  const char* start = json.data();
+  const char* end = start + json.size();
+  JsonEvent event;
+  const char* next = nullptr;
+  ASSERT_EQ(ReadOneJsonEvent(start, end, &event, &next), kFoundDict);
+  ASSERT_EQ(std::string(next), " ]");
+  ASSERT_EQ(ToString(event.cat.text), "c{a}t");
+  ASSERT_EQ(ToString(event.name.text), "n\\\"}");
+  ASSERT_TRUE(event.name.has_escapes);
+  ASSERT_EQ(ToString(event.ph.text), "X");
+  ASSERT_EQ(event.ts.type, JsonToken::kNumber);
+  ASSERT_EQ(ToString(event.ts.text), "10.5");
+  ASSERT_EQ(event.dur.type, JsonToken::kString);
+  ASSERT_EQ(ToString(event.pid.text), "1");
+  ASSERT_EQ(ToString(event.tid.text), "2");
+  ASSERT_EQ(ToString(event.args_name.text), "thread");
+
+  ASSERT_EQ(ReadOneJsonEvent(next, end, &event, &next), kEndOfTrace);
+
+  // Every prefix of the event is incomplete.
+  for (const char* prefix_end = start; prefix_end < start + json.size() - 2;
+       prefix_end++) {
+    next = nullptr;
+    ASSERT_EQ(ReadOneJsonEvent(start, prefix_end, &event, &next),
+              kNeedsMoreData);
+    ASSERT_EQ(next, nullptr);
+  }
+}
+
+TEST(JsonTraceParserTest, ReadOneJsonEventErrors) {
+  for (const char* json : {R"(x)", R"({"ph" "B"})", R"({"ph": "B" "ts": 1})",
+                           R"({ph: "B"})", R"({"ph": , "ts": 1})"}) {
+    JsonEvent event;
+    const char* next = nullptr;
+    ASSERT_EQ(ReadOneJsonEvent(json, json + strlen(json), &event, &next),
+              kFatalError)
+        << json;
+  }
+}
+
+std::vector<std::string> LoadAndQuery(const std::string& json,
+                                      size_t chunk_size) {
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  for (size_t off = 0; off < json.size(); off += chunk_size) {
+    size_t size = std::min(chunk_size, json.size() - off);
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+    memcpy(buf.get(), json.data() + off, size);
+    EXPECT_TRUE(tp->Parse(std::move(buf), size));
+  }
+  tp->NotifyEndOfFile();
+
+  std::vector<std::string> rows;
+  const char* kQueries[] = {
+      "select ts, dur, cat, slices.name, depth, tid from slices "
+      "inner join thread using(utid) order by ts",
+      "select tid, thread.name, pid, process.name from thread "
+      "left join process using(upid) order by tid",
+  };
+  for (const char* query : kQueries) {
+    auto it = tp->ExecuteQuery(query);
+    for (;;) {
+      auto res = it.Next();
+      EXPECT_NE(res, TraceProcessor::Iterator::NextResult::kError) << query;
+      if (res != TraceProcessor::Iterator::NextResult::kHasNext)
+        break;
+      std::string row;
+      for (uint32_t i = 0; i < it.ColumnCount(); i++) {
+        SqlValue value = it.Get(i);
+        if (value.type == SqlValue::kLong)
+          row += std::to_string(value.long_value);
+        else if (value.type == SqlValue::kString)
+          row += value.string_value;
+        else
+          row += "null";
+        row += "|";
+      }
+      rows.push_back(row);
+    }
+  }
+  return rows;
+}
+
+TEST(JsonTraceParserTest, ImportEvents) {
+  const std::string json = R"({"traceEvents": [
+    {"ph": "M", "pid": 1, "tid": 2, "name": "thread_name", "ts": 0,
+     "args": {"name": "Main \"thread\""}},
+    {"ph": "M", "pid": 1, "name": "process_name", "ts": 0,
+     "args": {"name": "browser"}},
+    {"ph": "B", "pid": 1, "tid": 2, "ts": 100, "cat": "cat{", "name": "A}"},
+    {"ph": "X", "pid": "1", "tid": 2, "ts": 110.5, "dur": 5, "name": "\u00e9",
+     "args": {"nested": {"name": "ignored", "v": [1, "]"]}}},
+    {"ph": "i", "pid": 1, "tid": 3, "ts": 115, "name": "instant"},
+    {"ph": "E", "pid": 1, "tid": 2, "ts": 120, "cat": "cat{", "name": "A}"}
+  ], "metadata": {"foo": "bar"}})";
+  const std::vector<std::string> expected = {
+      "100000|20000|cat{|A}|0|2|",
+      "110500|5000|null|\xc3\xa9|1|2|",
+      "0||null|null|",
+      "1||1|browser|",
+      "2|Main \"thread\"|1|browser|",
+      "3||1|browser|",
+  };
+  ASSERT_EQ(LoadAndQuery(json, json.size()), expected);
+
+  // The result does not depend on where events are split across chunks. The
+  // first chunk must contain the opening bracket of the event array.
+  for (size_t chunk_size : {size_t(17), size_t(18), size_t(64)})
+    ASSERT_EQ(LoadAndQuery(json, chunk_size), expected) << chunk_size;
 }
 
 }  // namespace
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_LRU_CACHE_H_
+#define SRC_TRACE_PROCESSOR_LRU_CACHE_H_
+
+#include <stddef.h>
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "perfetto/base/string_view.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A map from strings to values which keeps at most |capacity| entries,
+// evicting the least recently used one when full.
+template <typename Value>
+class LruCache {
+ public:
+  explicit LruCache(size_t capacity) : capacity_(capacity) {}
+
+  // Returns the value of |key| and marks it as the most recently used, or
+  // nullptr if there is no such entry.
+  Value* Find(base::StringView key) {
+    auto it = index_.find(key);
+    if (it == index_.end())
+      return nullptr;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &it->second->second;
+  }
+
+  // Moves the value of |key| to |value| and removes the entry. Returns false
+  // if there is no such entry.
+  bool Take(base::StringView key, Value* value) {
+    auto it = index_.find(key);
+    if (it == index_.end())
+      return false;
+    *value = std::move(it->second->second);
+    entries_.erase(it->second);
+    index_.erase(it);
+    return true;
+  }
+
+  // Inserts or replaces the value of |key|, making it the most recently used.
+  void Insert(std::string key, Value value) {
+    if (capacity_ == 0)
+      return;
+    Value* existing = Find(base::StringView(key));
+    if (existing) {
+      *existing = std::move(value);
+      return;
+    }
+    if (entries_.size() == capacity_) {
+      index_.erase(base::StringView(entries_.back().first));
+      entries_.pop_back();
+    }
+    entries_.emplace_front(std::move(key), std::move(value));
+    index_.emplace(base::StringView(entries_.front().first), entries_.begin());
+  }
+
+  void Clear() {
+    index_.clear();
+    entries_.clear();
+  }
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  using Entry = std::pair<std::string, Value>;
+
+  const size_t capacity_;
+
+  // The entries, the most recently used first. The keys of |index_| point to
+  // the strings of the entries, which never move.
+  std::list<Entry> entries_;
+  std::unordered_map<base::StringView, typename std::list<Entry>::iterator>
+      index_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_LRU_CACHE_H_
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/lru_cache.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(LruCacheTest, EvictsLeastRecentlyUsed) {
+  LruCache<int> cache(2);
+  cache.Insert("a", 1);
+  cache.Insert("b", 2);
+  ASSERT_EQ(*cache.Find("a"), 1);
+  cache.Insert("c", 3);
+  ASSERT_EQ(cache.size(), 2u);
+  ASSERT_EQ(cache.Find("b"), nullptr);
+  ASSERT_EQ(*cache.Find("a"), 1);
+  ASSERT_EQ(*cache.Find("c"), 3);
+
+  cache.Insert("a", 4);
+  ASSERT_EQ(cache.size(), 2u);
+  ASSERT_EQ(*cache.Find("a"), 4);
+}
+
+TEST(LruCacheTest, Take) {
+  LruCache<std::unique_ptr<int>> cache(2);
+  cache.Insert("a", std::unique_ptr<int>(new int(1)));
+  std::unique_ptr<int> value;
+  ASSERT_FALSE(cache.Take("b", &value));
+  ASSERT_TRUE(cache.Take("a", &value));
+  ASSERT_EQ(*value, 1);
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_EQ(cache.Find("a"), nullptr);
+}
+
+TEST(LruCacheTest, ZeroCapacity) {
+  LruCache<int> cache(0);
+  cache.Insert("a", 1);
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_EQ(cache.Find("a"), nullptr);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/mapped_trace_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/base/scoped_file.h"
+#include "perfetto/base/utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+std::shared_ptr<MappedTraceFile> MappedTraceFile::Create(
+    const std::string& path) {
+  base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
+  if (!fd) {
+    PERFETTO_PLOG("Could not open %s", path.c_str());
+    return nullptr;
+  }
+  struct stat st {};
+  if (fstat(*fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 0)
+    return nullptr;
+  size_t size = static_cast<size_t>(st.st_size);
+  if (size == 0)
+    return std::shared_ptr<MappedTraceFile>(new MappedTraceFile(nullptr, 0));
+
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, *fd, 0);
+  if (data == MAP_FAILED) {
+    PERFETTO_PLOG("mmap(%s) failed", path.c_str());
+    return nullptr;
+  }
+  // The file is tokenized front to back: let the kernel read ahead
+  // aggressively.
+  madvise(data, size, MADV_SEQUENTIAL);
+  return std::shared_ptr<MappedTraceFile>(
+      new MappedTraceFile(static_cast<uint8_t*>(data), size));
+}
+
+// static
+TraceBlobView MappedTraceFile::CreateView(std::shared_ptr<MappedTraceFile> file,
+                                          size_t offset,
+                                          size_t length) {
+  PERFETTO_CHECK(offset + length <= file->size());
+  uint8_t* start = file->data_ + offset;
+
+  // The pages at the edges of the range can be shared with the neighbouring
+  // views: they are released together with the whole file.
+  uintptr_t first_page = base::AlignUp<base::kPageSize>(
+      reinterpret_cast<uintptr_t>(start));
+  uintptr_t last_page =
+      reinterpret_cast<uintptr_t>(start + length) & ~(base::kPageSize - 1);
+  // The pages are only dropped, not unmapped: the range stays reserved for
+  // the file until its destructor unmaps it in one go. Unmapping them here
+  // would let the kernel reuse the range for other mappings, which the
+  // destructor would then unmap too.
+  auto release = [file, first_page, last_page] {
+    if (last_page > first_page) {
+      madvise(reinterpret_cast<void*>(first_page),
+              static_cast<size_t>(last_page - first_page), MADV_DONTNEED);
+    }
+  };
+  return TraceBlobView(start, 0, length, std::move(release));
+}
+
+MappedTraceFile::MappedTraceFile(uint8_t* data, size_t size)
+    : data_(data), size_(size) {}
+
+MappedTraceFile::~MappedTraceFile() {
+  if (data_)
+    munmap(data_, size_);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
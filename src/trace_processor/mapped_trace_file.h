@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_MAPPED_TRACE_FILE_H_
+#define SRC_TRACE_PROCESSOR_MAPPED_TRACE_FILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "src/trace_processor/trace_blob_view.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A read-only memory mapping of a whole trace file, handed to the tokenizer
+// as TraceBlobViews pointing directly into the mapping. This avoids copying
+// the file into heap buffers and, when the views are cut on packet
+// boundaries, gluing the packets which straddle two buffers.
+class MappedTraceFile {
+ public:
+  // Returns nullptr if |path| cannot be opened or mapped (e.g. it is a pipe).
+  static std::shared_ptr<MappedTraceFile> Create(const std::string& path);
+
+  // Returns a view on the [offset, offset + length) range of |file|. The
+  // pages lying entirely within the range are dropped from memory as soon as
+  // the view and all its slices have been destroyed, so the ranges of
+  // different views must not overlap. The views keep |file| alive.
+  static TraceBlobView CreateView(std::shared_ptr<MappedTraceFile> file,
+                                  size_t offset,
+                                  size_t length);
+
+  ~MappedTraceFile();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedTraceFile(uint8_t* data, size_t size);
+  MappedTraceFile(const MappedTraceFile&) = delete;
+  MappedTraceFile& operator=(const MappedTraceFile&) = delete;
+
+  uint8_t* const data_;
+  const size_t size_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_MAPPED_TRACE_FILE_H_
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/mapped_trace_file.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "perfetto/base/file_utils.h"
+#include "perfetto/base/paged_memory.h"
+#include "perfetto/base/temp_file.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/proto_trace_tokenizer.h"
+
+#include "perfetto/trace/trace.pb.h"
+#include "perfetto/trace/trace_packet.pb.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+base::TempFile WriteTempFile(const std::string& contents) {
+  base::TempFile file = base::TempFile::Create();
+  PERFETTO_CHECK(base::WriteAll(file.fd(), contents.data(), contents.size()) ==
+                 static_cast<ssize_t>(contents.size()));
+  return file;
+}
+
+// Builds a trace larger than 1MB, so that it is split in several views.
+std::string CreateTrace() {
+  protos::Trace trace;
+  const uint32_t kCpus = 4;
+  for (int b = 0; b < 200; b++) {
+    for (uint32_t cpu = 0; cpu < kCpus; cpu++) {
+      auto* bundle = trace.add_packet()->mutable_ftrace_events();
+      bundle->set_cpu(cpu);
+      for (int e = 0; e < 50; e++) {
+        int idx = b * 50 + e;
+        auto* event = bundle->add_event();
+        event->set_timestamp(static_cast<uint64_t>(1000 + idx * 100) + cpu);
+        event->set_pid(static_cast<uint32_t>(idx % 7));
+        auto* sched = event->mutable_sched_switch();
+        sched->set_prev_pid(10 + (idx + static_cast<int>(cpu)) % 13);
+        sched->set_prev_comm("prev");
+        sched->set_prev_state(idx % 3);
+        sched->set_next_pid(10 + (idx + static_cast<int>(cpu) + 1) % 13);
+        sched->set_next_comm("next_" + std::to_string(idx % 13));
+      }
+    }
+  }
+  return trace.SerializeAsString();
+}
+
+std::vector<std::string> Query(TraceProcessor* tp) {
+  const char* kQueries[] = {
+      "select count(*), sum(ts), sum(dur), sum(utid) from sched",
+      "select count(*), sum(ts) from raw",
+      "select count(*) from args",
+      "select count(*) from thread",
+  };
+  std::vector<std::string> rows;
+  for (const char* query : kQueries) {
+    auto it = tp->ExecuteQuery(query);
+    std::string row = query;
+    while (it.Next() == TraceProcessor::Iterator::NextResult::kHasNext) {
+      for (uint32_t i = 0; i < it.ColumnCount(); i++) {
+        SqlValue value = it.Get(i);
+        row += " ";
+        row += value.type == SqlValue::kLong ? std::to_string(value.long_value)
+                                             : "null";
+      }
+    }
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+TEST(MappedTraceFileTest, NonExistentFile) {
+  ASSERT_EQ(MappedTraceFile::Create("/non/existent/trace"), nullptr);
+
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  ASSERT_FALSE(tp->ParseMappedFile("/non/existent/trace"));
+}
+
+TEST(MappedTraceFileTest, ViewsOutliveFile) {
+  std::string contents(3 * base::kPageSize + 100, 'x');
+  for (size_t i = 0; i < contents.size(); i++)
+    contents[i] = static_cast<char>(i % 251);
+  base::TempFile temp = WriteTempFile(contents);
+
+  std::shared_ptr<MappedTraceFile> file = MappedTraceFile::Create(temp.path());
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(file->size(), contents.size());
+
+  size_t mid = base::kPageSize + 10;
+  TraceBlobView head = MappedTraceFile::CreateView(file, 0, mid);
+  std::unique_ptr<TraceBlobView> tail(new TraceBlobView(
+      MappedTraceFile::CreateView(file, mid, contents.size() - mid)));
+  file.reset();
+  ASSERT_EQ(memcmp(head.data(), contents.data(), mid), 0);
+
+  // Slices keep the pages of the view mapped.
+  TraceBlobView tail_slice = tail->slice(5, 100);
+  tail.reset();
+  ASSERT_EQ(memcmp(tail_slice.data(), contents.data() + mid + 5, 100), 0);
+}
+
+// Released views must not give their pages back to the address space: memory
+// allocated afterwards could land there and be unmapped by the file.
+TEST(MappedTraceFileTest, DestroyFileAfterReleasingViews) {
+  const size_t kPages = 64;
+  std::string contents(kPages * base::kPageSize, 'x');
+  base::TempFile temp = WriteTempFile(contents);
+
+  std::shared_ptr<MappedTraceFile> file = MappedTraceFile::Create(temp.path());
+  ASSERT_NE(file, nullptr);
+  const uint8_t* file_begin = file->data();
+  const uint8_t* file_end = file_begin + file->size();
+  {
+    std::vector<TraceBlobView> views;
+    for (size_t i = 0; i < kPages; i += 8) {
+      views.emplace_back(MappedTraceFile::CreateView(
+          file, i * base::kPageSize, 8 * base::kPageSize));
+    }
+  }
+
+  // Allocate enough page-sized mappings to reuse any range freed above.
+  std::vector<base::PagedMemory> allocs;
+  for (size_t i = 0; i < 2 * kPages; i++) {
+    base::PagedMemory mem = base::PagedMemory::Allocate(base::kPageSize);
+    const uint8_t* ptr = static_cast<const uint8_t*>(mem.Get());
+    ASSERT_FALSE(ptr >= file_begin && ptr < file_end);
+    memset(mem.Get(), static_cast<int>(i), base::kPageSize);
+    allocs.emplace_back(std::move(mem));
+  }
+  file.reset();
+
+  for (size_t i = 0; i < allocs.size(); i++) {
+    const uint8_t* ptr = static_cast<const uint8_t*>(allocs[i].Get());
+    ASSERT_EQ(ptr[0], static_cast<uint8_t>(i));
+    ASSERT_EQ(ptr[base::kPageSize - 1], static_cast<uint8_t>(i));
+  }
+}
+
+TEST(MappedTraceFileTest, PacketAlignedLength) {
+  protos::Trace trace;
+  for (uint32_t i = 0; i < 10; i++)
+    trace.add_packet()->mutable_ftrace_events()->set_cpu(1000 + i);
+  std::string data = trace.SerializeAsString();
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data.data());
+  const size_t size = data.size();
+
+  // All the packets have the same size.
+  ASSERT_EQ(size % 10, 0u);
+  const size_t packet = size / 10;
+  ASSERT_EQ(ProtoTraceTokenizer::PacketAlignedLength(ptr, size, 0), 0u);
+  ASSERT_EQ(ProtoTraceTokenizer::PacketAlignedLength(ptr, size, 1), packet);
+  ASSERT_EQ(ProtoTraceTokenizer::PacketAlignedLength(ptr, size, packet),
+            packet);
+  ASSERT_EQ(
+      ProtoTraceTokenizer::PacketAlignedLength(ptr, size, 2 * packet + 1),
+      3 * packet);
+  ASSERT_EQ(ProtoTraceTokenizer::PacketAlignedLength(ptr, size, size + 1),
+            size);
+
+  // A truncated packet ends the last view.
+  ASSERT_EQ(ProtoTraceTokenizer::PacketAlignedLength(ptr, size - 1, size - 2),
+            size - 1);
+}
+
+TEST(MappedTraceFileTest, SameResultsAsParse) {
+  std::string trace = CreateTrace();
+  ASSERT_GT(trace.size(), 1024u * 1024);
+  base::TempFile temp = WriteTempFile(trace);
+
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  const size_t kChunkSize = 1024 * 1024;
+  for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+    size_t size = std::min(kChunkSize, trace.size() - off);
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+    memcpy(buf.get(), trace.data() + off, size);
+    ASSERT_TRUE(tp->Parse(std::move(buf), size));
+  }
+  tp->NotifyEndOfFile();
+  std::vector<std::string> expected = Query(tp.get());
+  ASSERT_EQ(expected[0].find("select count(*), sum(ts), sum(dur), sum(utid) "
+                             "from sched 40000 "),
+            0u);
+
+  for (bool pipelined : {false, true}) {
+    Config config;
+    config.pipelined_parsing = pipelined;
+    std::unique_ptr<TraceProcessor> mapped_tp =
+        TraceProcessor::CreateInstance(config);
+    ASSERT_TRUE(mapped_tp->ParseMappedFile(temp.path()));
+    mapped_tp->NotifyEndOfFile();
+    ASSERT_EQ(Query(mapped_tp.get()), expected);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
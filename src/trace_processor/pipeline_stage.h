@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PIPELINE_STAGE_H_
+#define SRC_TRACE_PROCESSOR_PIPELINE_STAGE_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Calls |fn| on a dedicated thread for each item pushed, in FIFO order.
+// Push() blocks while |capacity| items are pending, which bounds the memory
+// used when the producer is faster than the stage.
+//
+// The destructor processes all the pending items before joining the thread.
+template <typename T>
+class PipelineStage {
+ public:
+  PipelineStage(size_t capacity, std::function<void(T)> fn)
+      : capacity_(capacity),
+        fn_(std::move(fn)),
+        thread_(&PipelineStage::Run, this) {
+    PERFETTO_CHECK(capacity > 0);
+  }
+
+  ~PipelineStage() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  PipelineStage(const PipelineStage&) = delete;
+  PipelineStage& operator=(const PipelineStage&) = delete;
+
+  void Push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return queue_.size() < capacity_; });
+    queue_.emplace_back(std::move(item));
+    lock.unlock();
+    cv_.notify_all();
+  }
+
+  // Blocks until all the items pushed so far have been processed. Everything
+  // written by |fn| is visible to the calling thread once this returns.
+  void Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cv_.wait(lock, [this] { return !queue_.empty() || quit_; });
+      if (queue_.empty())
+        return;
+      T item = std::move(queue_.front());
+      queue_.pop_front();
+      busy_ = true;
+      lock.unlock();
+      cv_.notify_all();
+
+      fn_(std::move(item));
+
+      lock.lock();
+      busy_ = false;
+      cv_.notify_all();
+    }
+  }
+
+  const size_t capacity_;
+  const std::function<void(T)> fn_;
+
+  // All the fields below are guarded by |mutex_|. A single condition variable
+  // is used for all the state changes as there are only two threads.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<T> queue_;
+  bool busy_ = false;
+  bool quit_ = false;
+
+  // Keep last: the thread must be started after the fields above have been
+  // initialized.
+  std::thread thread_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PIPELINE_STAGE_H_
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/pipelined_trace_reader.h"
+
+#include "src/trace_processor/proto_trace_parser.h"
+#include "src/trace_processor/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+PipelinedTraceReader::PipelinedTraceReader(
+    TraceProcessorContext* context,
+    std::unique_ptr<ChunkedTraceReader> tokenizer)
+    : context_(context), tokenizer_(std::move(tokenizer)) {
+  parse_stage_.reset(new PipelineStage<TraceSorter::SortedEventBatch>(
+      kMaxPendingBatches, [this](TraceSorter::SortedEventBatch batch) {
+        ParseSortedEvents(std::move(batch));
+      }));
+  tokenize_stage_.reset(new PipelineStage<TraceBlobView>(
+      kMaxPendingChunks,
+      [this](TraceBlobView chunk) { Tokenize(std::move(chunk)); }));
+
+  // Called on the tokenizer thread, other than at the end of the trace.
+  context_->sorter->set_sorted_events_callback(
+      [this](TraceSorter::SortedEventBatch batch) {
+        parse_stage_->Push(std::move(batch));
+      });
+}
+
+PipelinedTraceReader::~PipelinedTraceReader() {
+  // Drain the stages before the sorter stops handing batches to the parser.
+  tokenize_stage_.reset();
+  parse_stage_.reset();
+  context_->sorter->set_sorted_events_callback(nullptr);
+}
+
+bool PipelinedTraceReader::Parse(std::unique_ptr<uint8_t[]> data,
+                                 size_t size) {
+  return ParseBlob(TraceBlobView(std::move(data), 0, size));
+}
+
+bool PipelinedTraceReader::ParseBlob(TraceBlobView chunk) {
+  if (tokenizer_failed_.load(std::memory_order_relaxed))
+    return false;
+  tokenize_stage_->Push(std::move(chunk));
+  return true;
+}
+
+void PipelinedTraceReader::NotifyEndOfFile() {
+  tokenize_stage_->Flush();
+
+  // The tokenizer thread is now idle so the events left in the sorter can be
+  // extracted on this thread. The last batches are still parsed on the parser
+  // thread to keep the order of the events.
+  tokenizer_->NotifyEndOfFile();
+  parse_stage_->Flush();
+}
+
+void PipelinedTraceReader::Tokenize(TraceBlobView chunk) {
+  // Like TraceProcessorImpl, drop all the data following an unrecoverable
+  // error.
+  if (tokenizer_failed_.load(std::memory_order_relaxed))
+    return;
+  if (!tokenizer_->ParseBlob(std::move(chunk)))
+    tokenizer_failed_.store(true, std::memory_order_relaxed);
+}
+
+void PipelinedTraceReader::ParseSortedEvents(
+    TraceSorter::SortedEventBatch batch) {
+  ProtoTraceParser* parser = context_->proto_parser.get();
+  for (auto& event : batch) {
+    if (event.cpu == TraceSorter::kNoCpu) {
+      parser->ParseTracePacket(event.timestamp, std::move(event.blob_view));
+    } else {
+      parser->ParseFtracePacket(event.cpu, event.timestamp,
+                                std::move(event.blob_view));
+    }
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_PIPELINED_TRACE_READER_H_
+#define SRC_TRACE_PROCESSOR_PIPELINED_TRACE_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "src/trace_processor/chunked_trace_reader.h"
+#include "src/trace_processor/pipeline_stage.h"
+#include "src/trace_processor/trace_sorter.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceProcessorContext;
+
+// Runs the stages of the loading of a protobuf trace on different threads:
+// - The thread calling Parse() only queues the chunks of the trace.
+// - The tokenizer thread splits the chunks into packets and ftrace events
+//   and pushes them into the TraceSorter, which sorts them and extracts them
+//   in batches.
+// - The parser thread parses the sorted batches into the storage. This is
+//   the only thread writing to the storage (with the exception of the
+//   tokenizer stats) until NotifyEndOfFile() returns.
+//
+// Used when Config::pipelined_parsing is set.
+class PipelinedTraceReader : public ChunkedTraceReader {
+ public:
+  // |tokenizer| must push its events into the sorter of |context|.
+  PipelinedTraceReader(TraceProcessorContext* context,
+                       std::unique_ptr<ChunkedTraceReader> tokenizer);
+  ~PipelinedTraceReader() override;
+
+  // ChunkedTraceReader implementation.
+  // Tokenization errors are detected asynchronously: they make the calls
+  // following the one which pushed the faulty chunk return false.
+  bool Parse(std::unique_ptr<uint8_t[]>, size_t size) override;
+  bool ParseBlob(TraceBlobView) override;
+
+  // Blocks until all the chunks pushed so far have been tokenized and all the
+  // events have been parsed.
+  void NotifyEndOfFile() override;
+
+ private:
+  // Number of chunks and batches of events which can be queued in front of
+  // the tokenizer and the parser before Parse() blocks.
+  static constexpr size_t kMaxPendingChunks = 4;
+  static constexpr size_t kMaxPendingBatches = 64;
+
+  void Tokenize(TraceBlobView);
+  void ParseSortedEvents(TraceSorter::SortedEventBatch);
+
+  TraceProcessorContext* const context_;
+  std::unique_ptr<ChunkedTraceReader> tokenizer_;
+  std::atomic<bool> tokenizer_failed_{false};
+
+  // Keep last: the stages must be destroyed (i.e. their threads joined)
+  // before the fields above. The tokenizer stage pushes into the parser stage
+  // so is destroyed first.
+  std::unique_ptr<PipelineStage<TraceSorter::SortedEventBatch>> parse_stage_;
+  std::unique_ptr<PipelineStage<TraceBlobView>> tokenize_stage_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_PIPELINED_TRACE_READER_H_
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/pipelined_trace_reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/pipeline_stage.h"
+
+#include "perfetto/trace/trace.pb.h"
+#include "perfetto/trace/trace_packet.pb.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+
+TEST(PipelineStageTest, ProcessesItemsInOrder) {
+  std::vector<int> processed;
+  PipelineStage<int> stage(2, [&processed](int i) { processed.push_back(i); });
+  for (int i = 0; i < 100; i++)
+    stage.Push(i);
+  stage.Flush();
+  ASSERT_EQ(processed.size(), 100u);
+  for (int i = 0; i < 100; i++)
+    ASSERT_EQ(processed[static_cast<size_t>(i)], i);
+}
+
+TEST(PipelineStageTest, DestructorDrainsQueue) {
+  std::vector<int> processed;
+  {
+    PipelineStage<int> stage(8, [&processed](int i) {
+      processed.push_back(i);
+    });
+    stage.Push(1);
+    stage.Push(2);
+    stage.Push(3);
+  }
+  ASSERT_THAT(processed, ElementsAre(1, 2, 3));
+}
+
+// Builds a trace where the ftrace bundles of each CPU and the process tree
+// packets overlap in time, so the events have to be sorted before parsing.
+std::string CreateTrace() {
+  protos::Trace trace;
+  const uint32_t kCpus = 4;
+  const int kBundles = 50;
+  const int kEventsPerBundle = 40;
+  for (int b = 0; b < kBundles; b++) {
+    for (uint32_t cpu = 0; cpu < kCpus; cpu++) {
+      auto* bundle = trace.add_packet()->mutable_ftrace_events();
+      bundle->set_cpu(cpu);
+      for (int e = 0; e < kEventsPerBundle; e++) {
+        int idx = b * kEventsPerBundle + e;
+        auto* event = bundle->add_event();
+        event->set_timestamp(static_cast<uint64_t>(1000 + idx * 100) + cpu);
+        event->set_pid(static_cast<uint32_t>(idx % 7));
+        if (e % 4 == 0) {
+          auto* freq = event->mutable_cpu_frequency();
+          freq->set_cpu_id(cpu);
+          freq->set_state(static_cast<uint32_t>(100000 * (idx % 5 + 1)));
+          continue;
+        }
+        auto* sched = event->mutable_sched_switch();
+        sched->set_prev_pid(10 + (idx + static_cast<int>(cpu)) % 13);
+        sched->set_prev_comm("prev");
+        sched->set_prev_state(idx % 3);
+        sched->set_next_pid(10 + (idx + static_cast<int>(cpu) + 1) % 13);
+        sched->set_next_comm("next_" + std::to_string(idx % 13));
+      }
+    }
+    auto* process = trace.add_packet()->mutable_process_tree()->add_processes();
+    process->set_pid(100 + b);
+    process->set_ppid(1);
+    process->add_cmdline("proc_" + std::to_string(b));
+  }
+  return trace.SerializeAsString();
+}
+
+// Loads |trace| in small chunks, so that packets straddle chunk boundaries,
+// and returns the rows of a few queries covering all the parsed tables.
+std::vector<std::string> LoadAndQuery(const std::string& trace,
+                                      bool pipelined) {
+  Config config;
+  config.pipelined_parsing = pipelined;
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+
+  const size_t kChunkSize = 1000;
+  for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+    size_t size = std::min(kChunkSize, trace.size() - off);
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+    memcpy(buf.get(), trace.data() + off, size);
+    EXPECT_TRUE(tp->Parse(std::move(buf), size));
+  }
+  tp->NotifyEndOfFile();
+
+  const char* kQueries[] = {
+      "select count(*), sum(ts), sum(dur), sum(utid) from sched",
+      "select count(*), sum(ts), sum(value) from counters",
+      "select count(*), sum(ts) from raw",
+      "select count(*) from args",
+      "select count(*), sum(upid) from thread",
+      "select count(*) from process",
+  };
+  std::vector<std::string> rows;
+  for (const char* query : kQueries) {
+    auto it = tp->ExecuteQuery(query);
+    std::string row = query;
+    while (it.Next() == TraceProcessor::Iterator::NextResult::kHasNext) {
+      for (uint32_t i = 0; i < it.ColumnCount(); i++) {
+        SqlValue value = it.Get(i);
+        row += " ";
+        if (value.type == SqlValue::kLong)
+          row += std::to_string(value.long_value);
+        else if (value.type == SqlValue::kDouble)
+          row += std::to_string(value.double_value);
+        else
+          row += "null";
+      }
+    }
+    EXPECT_FALSE(it.GetLastError().has_value()) << query;
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+TEST(PipelinedTraceReaderTest, SameResultsAsSerialParsing) {
+  std::string trace = CreateTrace();
+  std::vector<std::string> serial = LoadAndQuery(trace, false);
+  std::vector<std::string> pipelined = LoadAndQuery(trace, true);
+  ASSERT_EQ(serial, pipelined);
+
+  // Sanity check that the trace was actually parsed.
+  ASSERT_EQ(serial[0].find("select count(*), sum(ts), sum(dur), sum(utid) "
+                           "from sched 6000 "),
+            0u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
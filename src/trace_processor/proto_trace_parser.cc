@@ -1617,6 +1617,18 @@ void ProtoTraceParser::ParseTraceStats(TraceBlobView packet) {
               storage->SetIndexedStats(stats::traced_buf_chunks_read, buf_num,
                                        fld2.as_int64());
               break;
+            case protos::TraceStats::BufferStats::
+                kUnusedChunkBytesReadFieldNumber:
+              storage->SetIndexedStats(
+                  stats::traced_buf_unused_chunk_bytes_read, buf_num,
+                  fld2.as_int64());
+              break;
+            case protos::TraceStats::BufferStats::
+                kPacketsDroppedByProducersFieldNumber:
+              storage->SetIndexedStats(
+                  stats::traced_buf_packets_dropped_by_producers, buf_num,
+                  fld2.as_int64());
+              break;
             case protos::TraceStats::BufferStats::
                 kChunksCommittedOutOfOrderFieldNumber:
               storage->SetIndexedStats(
@@ -193,12 +193,12 @@ TEST_F(ProtoTraceParserTest, LoadEventsIntoRaw) {
   ASSERT_EQ(raw.raw_event_count(), 2);
   const auto& args = context_.storage->args();
   ASSERT_EQ(args.args_count(), 6);
-  ASSERT_EQ(args.arg_values()[0].int_value, 123);
-  ASSERT_EQ(args.arg_values()[1].string_value, 0);
-  ASSERT_EQ(args.arg_values()[2].int_value, 12);
-  ASSERT_EQ(args.arg_values()[3].int_value, 15);
-  ASSERT_EQ(args.arg_values()[4].int_value, 20);
-  ASSERT_EQ(args.arg_values()[5].string_value, 0);
+  ASSERT_EQ(args.arg_value(0).int_value, 123);
+  ASSERT_EQ(args.arg_value(1).string_value, 0);
+  ASSERT_EQ(args.arg_value(2).int_value, 12);
+  ASSERT_EQ(args.arg_value(3).int_value, 15);
+  ASSERT_EQ(args.arg_value(4).int_value, 20);
+  ASSERT_EQ(args.arg_value(5).string_value, 0);
 
   // TODO(taylori): Add test ftrace event with all field types
   // and test here.
@@ -250,16 +250,13 @@ TEST_F(ProtoTraceParserTest, LoadGenericFtrace) {
   auto set_id = raw.arg_set_ids().back();
 
   const auto& args = storage_->args();
-  auto id_it =
-      std::equal_range(args.set_ids().begin(), args.set_ids().end(), set_id);
 
   // Ignore string calls as they are handled by checking InternString calls
   // above.
 
-  auto it = id_it.first;
-  auto row = static_cast<size_t>(std::distance(args.set_ids().begin(), it));
-  ASSERT_EQ(args.arg_values()[++row].int_value, -2);
-  ASSERT_EQ(args.arg_values()[++row].int_value, 3);
+  uint32_t row = args.RowsForArgSet(set_id).first;
+  ASSERT_EQ(args.arg_value(++row).int_value, -2);
+  ASSERT_EQ(args.arg_value(++row).int_value, 3);
 }
 
 TEST_F(ProtoTraceParserTest, LoadMultipleEvents) {
@@ -39,6 +39,7 @@ using protozero::ProtoDecoder;
 using protozero::proto_utils::MakeTagLengthDelimited;
 using protozero::proto_utils::MakeTagVarInt;
 using protozero::proto_utils::ParseVarInt;
+using protozero::proto_utils::ProtoWireType;
 
 ProtoTraceTokenizer::ProtoTraceTokenizer(TraceProcessorContext* ctx)
     : trace_sorter_(ctx->sorter.get()), trace_storage_(ctx->storage.get()) {}
@@ -46,7 +47,12 @@ ProtoTraceTokenizer::~ProtoTraceTokenizer() = default;
 
 bool ProtoTraceTokenizer::Parse(std::unique_ptr<uint8_t[]> owned_buf,
                                 size_t size) {
-  uint8_t* data = &owned_buf[0];
+  return ParseBlob(TraceBlobView(std::move(owned_buf), 0, size));
+}
+
+bool ProtoTraceTokenizer::ParseBlob(TraceBlobView blob) {
+  const uint8_t* data = blob.data();
+  size_t size = blob.length();
   if (!partial_buf_.empty()) {
     // It takes ~5 bytes for a proto preamble + the varint size.
     const size_t kHeaderBytes = 5;
@@ -97,31 +103,54 @@ bool ProtoTraceTokenizer::Parse(std::unique_ptr<uint8_t[]> owned_buf,
       data += size_missing;
       size -= size_missing;
       partial_buf_.clear();
-      uint8_t* buf_start = &buf[0];  // Note that buf is std::moved below.
-      ParseInternal(std::move(buf), buf_start, size_incl_header);
+      ParseInternal(TraceBlobView(std::move(buf), 0, size_incl_header));
     } else {
       partial_buf_.insert(partial_buf_.end(), data, &data[size]);
       return true;
     }
   }
-  ParseInternal(std::move(owned_buf), data, size);
+  ParseInternal(blob.slice(blob.offset_of(data), size));
   return true;
 }
 
-void ProtoTraceTokenizer::ParseInternal(std::unique_ptr<uint8_t[]> owned_buf,
-                                        uint8_t* data,
-                                        size_t size) {
-  PERFETTO_DCHECK(data >= &owned_buf[0]);
-  const uint8_t* start = &owned_buf[0];
-  const size_t data_off = static_cast<size_t>(data - start);
-  TraceBlobView whole_buf(std::move(owned_buf), data_off, size);
+void ProtoTraceTokenizer::NotifyEndOfFile() {
+  trace_sorter_->ExtractEventsForced();
+}
+
+// static
+size_t ProtoTraceTokenizer::PacketAlignedLength(const uint8_t* data,
+                                                size_t size,
+                                                size_t min_length) {
+  const uint8_t* pos = data;
+  const uint8_t* end = data + size;
+  while (static_cast<size_t>(pos - data) < min_length) {
+    // Only the length-delimited fields of the root Trace proto (i.e. the
+    // packets) can be skipped without decoding them.
+    uint64_t tag = 0;
+    const uint8_t* next = ParseVarInt(pos, end, &tag);
+    auto wire_type = static_cast<ProtoWireType>(tag & 0x07);
+    if (next == pos || wire_type != ProtoWireType::kLengthDelimited)
+      return size;
+    pos = next;
+    uint64_t field_size = 0;
+    next = ParseVarInt(pos, end, &field_size);
+    if (next == pos || field_size > static_cast<uint64_t>(end - next))
+      return size;
+    pos = next + field_size;
+  }
+  return static_cast<size_t>(pos - data);
+}
+
+void ProtoTraceTokenizer::ParseInternal(TraceBlobView whole_buf) {
+  const uint8_t* data = whole_buf.data();
+  const size_t size = whole_buf.length();
   ProtoDecoder decoder(data, size);
   for (auto fld = decoder.ReadField(); fld.id != 0; fld = decoder.ReadField()) {
     if (fld.id != protos::Trace::kPacketFieldNumber) {
       PERFETTO_ELOG("Non-trace packet field found in root Trace proto");
       continue;
     }
-    size_t field_offset = static_cast<size_t>(fld.data() - start);
+    size_t field_offset = whole_buf.offset_of(fld.data());
     ParsePacket(whole_buf.slice(field_offset, fld.size()));
   }
 
@@ -206,9 +235,8 @@ void ProtoTraceTokenizer::ParseFtraceBundle(TraceBlobView bundle) {
   for (auto fld = decoder.ReadField(); fld.id != 0; fld = decoder.ReadField()) {
     switch (fld.id) {
       case protos::FtraceEventBundle::kEventFieldNumber: {
-        const size_t fld_off = bundle.offset_of(fld.data());
         auto cpu_32 = static_cast<uint32_t>(cpu);
-        ParseFtraceEvent(cpu_32, bundle.slice(fld_off, fld.size()));
+        ParseFtraceEvent(cpu_32, bundle, fld.data(), fld.size());
         break;
       }
       default:
@@ -220,11 +248,12 @@ void ProtoTraceTokenizer::ParseFtraceBundle(TraceBlobView bundle) {
 }
 
 PERFETTO_ALWAYS_INLINE
-void ProtoTraceTokenizer::ParseFtraceEvent(uint32_t cpu, TraceBlobView event) {
+void ProtoTraceTokenizer::ParseFtraceEvent(uint32_t cpu,
+                                           const TraceBlobView& bundle,
+                                           const uint8_t* data,
+                                           size_t length) {
   constexpr auto kTimestampFieldNumber =
       protos::FtraceEvent::kTimestampFieldNumber;
-  const uint8_t* data = event.data();
-  const size_t length = event.length();
   ProtoDecoder decoder(data, length);
   uint64_t raw_timestamp = 0;
   bool timestamp_found = false;
@@ -254,7 +283,7 @@ void ProtoTraceTokenizer::ParseFtraceEvent(uint32_t cpu, TraceBlobView event) {
 
   // We don't need to parse this packet, just push it to be sorted with
   // the timestamp.
-  trace_sorter_->PushFtraceEvent(cpu, timestamp, std::move(event));
+  trace_sorter_->PushFtraceEvent(cpu, timestamp, bundle, data, length);
 }
 
 }  // namespace trace_processor
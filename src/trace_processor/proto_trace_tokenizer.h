@@ -28,7 +28,6 @@ namespace perfetto {
 namespace trace_processor {
 
 class TraceProcessorContext;
-class TraceBlobView;
 class TraceSorter;
 class TraceStorage;
 
@@ -43,20 +42,31 @@ class ProtoTraceTokenizer : public ChunkedTraceReader {
 
   // ChunkedTraceReader implementation.
   bool Parse(std::unique_ptr<uint8_t[]>, size_t size) override;
+  bool ParseBlob(TraceBlobView) override;
+  void NotifyEndOfFile() override;
+
+  // Returns the length of the shortest prefix of |data| which is at least
+  // |min_length| bytes long and ends on a TracePacket boundary, or |size| if
+  // there is no such prefix. Passing such prefixes to ParseBlob() avoids
+  // copying packets into |partial_buf_|.
+  static size_t PacketAlignedLength(const uint8_t* data,
+                                    size_t size,
+                                    size_t min_length);
 
  private:
-  void ParseInternal(std::unique_ptr<uint8_t[]> owned_buf,
-                     uint8_t* data,
-                     size_t size);
+  void ParseInternal(TraceBlobView);
   void ParsePacket(TraceBlobView);
   void ParseFtraceBundle(TraceBlobView);
-  void ParseFtraceEvent(uint32_t cpu, TraceBlobView);
+  void ParseFtraceEvent(uint32_t cpu,
+                        const TraceBlobView& bundle,
+                        const uint8_t* data,
+                        size_t length);
 
   TraceSorter* const trace_sorter_;
   TraceStorage* const trace_storage_;
 
   // Used to glue together trace packets that span across two (or more)
-  // Parse() boundaries.
+  // Parse() or ParseBlob() boundaries.
   std::vector<uint8_t> partial_buf_;
 
   // Temporary. Currently trace packets do not have a timestamp, so the
@@ -46,9 +46,9 @@ StorageSchema RawTable::CreateStorageSchema() {
   return StorageSchema::Builder()
       .AddColumn<IdColumn>("id", TableId::kRawEvents)
       .AddOrderedNumericColumn("ts", &raw.timestamps())
-      .AddStringColumn("name", &raw.name_ids(), &storage_->string_pool())
-      .AddNumericColumn("cpu", &raw.cpus())
-      .AddNumericColumn("utid", &raw.utids())
+      .AddStringColumn("name", &raw.name_ids(), storage_)
+      .AddAppendOnlyNumericColumn("cpu", &raw.cpus())
+      .AddAppendOnlyNumericColumn("utid", &raw.utids())
       .AddNumericColumn("arg_set_id", &raw.arg_set_ids())
       .Build({"name", "ts"});
 }
@@ -58,26 +58,20 @@ uint32_t RawTable::RowCount() {
 }
 
 int RawTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
-  info->estimated_cost = RowCount();
+  info->estimated_cost = EstimateFilterCost(qc);
 
-  // Only the string columns are handled by SQLite
+  // See StorageTable::OmitSupportedConstraints().
   info->order_by_consumed = true;
-  size_t name_index = schema().ColumnIndexFromName("name");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] = qc.constraints()[i].iColumn != static_cast<int>(name_index);
-  }
+  OmitSupportedConstraints(qc, info);
 
   return SQLITE_OK;
 }
 
-void RawTable::FormatSystraceArgs(const std::string& event_name,
+void RawTable::FormatSystraceArgs(base::StringView event_name,
                                   ArgSetId arg_set_id,
                                   base::StringWriter* writer) {
-  const auto& set_ids = storage_->args().set_ids();
-  auto lb = std::lower_bound(set_ids.begin(), set_ids.end(), arg_set_id);
-  auto ub = std::find(lb, set_ids.end(), arg_set_id + 1);
-
-  auto start_row = static_cast<uint32_t>(std::distance(set_ids.begin(), lb));
+  auto set_rows = storage_->args().RowsForArgSet(arg_set_id);
+  uint32_t start_row = set_rows.first;
 
   using Variadic = TraceStorage::Args::Variadic;
   using ValueWriter = std::function<void(const Variadic&)>;
@@ -90,24 +84,24 @@ void RawTable::FormatSystraceArgs(const std::string& event_name,
         writer->AppendDouble(value.real_value);
         break;
       case TraceStorage::Args::Variadic::kString: {
-        const auto& str = storage_->GetString(value.string_value);
-        writer->AppendString(str.c_str(), str.size());
+        base::StringView str = storage_->GetString(value.string_value);
+        writer->AppendString(str.data(), str.size());
       }
     }
   };
   auto write_value_at_index = [this, start_row](uint32_t arg_idx,
                                                 ValueWriter value_fn) {
-    value_fn(storage_->args().arg_values()[start_row + arg_idx]);
+    value_fn(storage_->args().arg_value(start_row + arg_idx));
   };
   auto write_arg = [this, writer, start_row](uint32_t arg_idx,
                                              ValueWriter value_fn) {
     uint32_t arg_row = start_row + arg_idx;
     const auto& args = storage_->args();
-    const auto& key = storage_->GetString(args.keys()[arg_row]);
-    const auto& value = args.arg_values()[arg_row];
+    base::StringView key = storage_->GetString(args.key(arg_row));
+    Variadic value = args.arg_value(arg_row);
 
     writer->AppendChar(' ');
-    writer->AppendString(key.c_str(), key.length());
+    writer->AppendString(key.data(), key.size());
     writer->AppendChar('=');
     value_fn(value);
   };
@@ -184,20 +178,19 @@ void RawTable::FormatSystraceArgs(const std::string& event_name,
     using P = protos::PrintFtraceEvent;
     write_arg(P::kIpFieldNumber - 1, write_value);
     write_arg(P::kBufFieldNumber - 1, [this, writer](const Variadic& value) {
-      const auto& str = storage_->GetString(value.string_value);
+      base::StringView str = storage_->GetString(value.string_value);
 
       // If the last character is a newline in a print, just drop it.
-      auto chars_to_print = str.size() > 0 && str[str.size() - 1] == '\n'
+      auto chars_to_print = str.size() > 0 && str.data()[str.size() - 1] == '\n'
                                 ? str.size() - 1
                                 : str.size();
-      writer->AppendString(str.c_str(), chars_to_print);
+      writer->AppendString(str.data(), chars_to_print);
     });
     return;
   }
 
-  uint32_t arg = 0;
-  for (auto it = lb; it != ub; it++) {
-    write_arg(arg++, write_value);
+  for (uint32_t row = set_rows.first; row < set_rows.second; row++) {
+    write_arg(row - start_row, write_value);
   }
 }
 
@@ -221,18 +214,18 @@ void RawTable::ToSystrace(sqlite3_context* ctx,
   if (thread.upid.has_value()) {
     tgid = storage_->GetProcess(thread.upid.value()).pid;
   }
-  const auto& name = storage_->GetString(thread.name_id);
+  base::StringView name = storage_->GetString(thread.name_id);
 
   char line[4096];
   base::StringWriter writer(line, sizeof(line));
 
   ftrace_utils::FormatSystracePrefix(raw_evts.timestamps()[row],
                                      raw_evts.cpus()[row], thread.tid, tgid,
-                                     base::StringView(name), &writer);
+                                     name, &writer);
 
-  const auto& event_name = storage_->GetString(raw_evts.name_ids()[row]);
+  base::StringView event_name = storage_->GetString(raw_evts.name_ids()[row]);
   writer.AppendChar(' ');
-  writer.AppendString(event_name.c_str(), event_name.size());
+  writer.AppendString(event_name.data(), event_name.size());
   writer.AppendChar(':');
 
   FormatSystraceArgs(event_name, raw_evts.arg_set_ids()[row], &writer);
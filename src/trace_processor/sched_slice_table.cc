@@ -30,12 +30,15 @@ StorageSchema SchedSliceTable::CreateStorageSchema() {
   const auto& slices = storage_->slices();
   return StorageSchema::Builder()
       .AddOrderedNumericColumn("ts", &slices.start_ns())
-      .AddNumericColumn("cpu", &slices.cpus())
+      .AddAppendOnlyNumericColumn("cpu", &slices.cpus(),
+                                  &slices.rows_for_cpus())
       .AddNumericColumn("dur", &slices.durations())
-      .AddColumn<TsEndColumn>("ts_end", &slices.start_ns(), &slices.durations())
-      .AddNumericColumn("utid", &slices.utids(), &slices.rows_for_utids())
+      .AddColumn<TsEndColumn>("ts_end", &slices.start_ns(), &slices.durations(),
+                              &slices.end_index())
+      .AddAppendOnlyNumericColumn("utid", &slices.utids(),
+                                  &slices.rows_for_utids())
       .AddColumn<EndStateColumn>("end_state", &slices.end_state())
-      .AddNumericColumn("priority", &slices.priorities())
+      .AddAppendOnlyNumericColumn("priority", &slices.priorities())
       .AddColumn<IdColumn>("row_id", TableId::kSched)
       .Build({"cpu", "ts"});
 }
@@ -59,6 +62,13 @@ int SchedSliceTable::BestIndex(const QueryConstraints& qc,
 uint32_t SchedSliceTable::EstimateQueryCost(const QueryConstraints& qc) {
   const auto& cs = qc.constraints();
 
+  size_t cpu_idx = schema().ColumnIndexFromName("cpu");
+  auto has_cpu_eq_cs = [cpu_idx](const QueryConstraints::Constraint& c) {
+    return c.iColumn == static_cast<int>(cpu_idx) &&
+           sqlite_utils::IsOpEq(c.op);
+  };
+  bool has_cpu_eq = std::any_of(cs.begin(), cs.end(), has_cpu_eq_cs);
+
   size_t ts_idx = schema().ColumnIndexFromName("ts");
   auto has_ts_column = [ts_idx](const QueryConstraints::Constraint& c) {
     return c.iColumn == static_cast<int>(ts_idx);
@@ -66,8 +76,20 @@ uint32_t SchedSliceTable::EstimateQueryCost(const QueryConstraints& qc) {
   bool has_time_constraint = std::any_of(cs.begin(), cs.end(), has_ts_column);
   if (has_time_constraint) {
     // If there is a constraint on ts, we can do queries very fast (O(log n))
-    // so always make this preferred if available.
-    return 10;
+    // so always make this preferred if available. Adding an equality
+    // constraint on cpu only costs two more binary searches in the rows of
+    // that cpu, instead of a scan of all the rows in the time range.
+    return has_cpu_eq ? 5 : 10;
+  }
+
+  // Without any special filter logic, the cost is the number of rows.
+  uint32_t cost = RowCount();
+  if (has_cpu_eq) {
+    // The rows of each cpu are indexed, so estimate the cost by dividing the
+    // number of slices by the number of cpus.
+    const auto& rows_for_cpus = storage_->slices().rows_for_cpus();
+    cost = RowCount() /
+           std::max(static_cast<uint32_t>(rows_for_cpus.size()), 1u);
   }
 
   size_t utid_idx = schema().ColumnIndexFromName("utid");
@@ -82,18 +104,16 @@ uint32_t SchedSliceTable::EstimateQueryCost(const QueryConstraints& qc) {
     // it's actually better to do subqueries on this table. Estimate the cost
     // of filtering on utid equality constraint by dividing the number of slices
     // by the number of threads.
-    return RowCount() / storage_->thread_count();
+    cost = std::min(
+        cost, static_cast<uint32_t>(RowCount() / storage_->thread_count()));
   }
-
-  // If we get to this point, we do not have any special filter logic so
-  // simply return the number of rows.
-  return RowCount();
+  return cost;
 }
 
 SchedSliceTable::EndStateColumn::EndStateColumn(
     std::string col_name,
-    const std::deque<ftrace_utils::TaskState>* deque)
-    : StorageColumn(col_name, false), deque_(deque) {
+    const ChunkedVector<ftrace_utils::TaskState>* vector)
+    : StorageColumn(col_name, false), vector_(vector) {
   for (uint16_t i = 0; i < state_strings_.size(); i++) {
     state_strings_[i] = ftrace_utils::TaskState(i).ToString();
   }
@@ -102,7 +122,7 @@ SchedSliceTable::EndStateColumn::~EndStateColumn() = default;
 
 void SchedSliceTable::EndStateColumn::ReportResult(sqlite3_context* ctx,
                                                    uint32_t row) const {
-  const auto& state = (*deque_)[row];
+  const auto& state = (*vector_)[row];
   if (state.is_valid()) {
     PERFETTO_CHECK(state.raw_state() < state_strings_.size());
     sqlite3_result_text(ctx, state_strings_[state.raw_state()].data(), -1,
@@ -120,7 +140,7 @@ void SchedSliceTable::EndStateColumn::Filter(int op,
     case SQLITE_INDEX_CONSTRAINT_ISNOTNULL: {
       bool non_nulls = op == SQLITE_INDEX_CONSTRAINT_ISNOTNULL;
       index->FilterRows([this, non_nulls](uint32_t row) {
-        const auto& state = (*deque_)[row];
+        const auto& state = (*vector_)[row];
         return state.is_valid() == non_nulls;
       });
       break;
@@ -155,17 +175,17 @@ void SchedSliceTable::EndStateColumn::FilterOnState(
   uint16_t raw_state = compare.raw_state();
   if (op == SQLITE_INDEX_CONSTRAINT_EQ) {
     index->FilterRows([this, raw_state](uint32_t row) {
-      const auto& state = (*deque_)[row];
+      const auto& state = (*vector_)[row];
       return state.is_valid() && state.raw_state() == raw_state;
     });
   } else if (op == SQLITE_INDEX_CONSTRAINT_NE) {
     index->FilterRows([this, raw_state](uint32_t row) {
-      const auto& state = (*deque_)[row];
+      const auto& state = (*vector_)[row];
       return state.is_valid() && state.raw_state() != raw_state;
     });
   } else if (op == SQLITE_INDEX_CONSTRAINT_MATCH) {
     index->FilterRows([this, compare](uint32_t row) {
-      const auto& state = (*deque_)[row];
+      const auto& state = (*vector_)[row];
       if (!state.is_valid())
         return false;
       return (state.raw_state() & compare.raw_state()) == compare.raw_state();
@@ -179,8 +199,8 @@ StorageColumn::Comparator SchedSliceTable::EndStateColumn::Sort(
     const QueryConstraints::OrderBy& ob) const {
   if (ob.desc) {
     return [this](uint32_t f, uint32_t s) {
-      const auto& a = (*deque_)[f];
-      const auto& b = (*deque_)[s];
+      const auto& a = (*vector_)[f];
+      const auto& b = (*vector_)[s];
       if (!a.is_valid()) {
         return !b.is_valid() ? 0 : 1;
       } else if (!b.is_valid()) {
@@ -190,8 +210,8 @@ StorageColumn::Comparator SchedSliceTable::EndStateColumn::Sort(
     };
   }
   return [this](uint32_t f, uint32_t s) {
-    const auto& a = (*deque_)[f];
-    const auto& b = (*deque_)[s];
+    const auto& a = (*vector_)[f];
+    const auto& b = (*vector_)[s];
     if (!a.is_valid()) {
       return !b.is_valid() ? 0 : -1;
     } else if (!b.is_valid()) {
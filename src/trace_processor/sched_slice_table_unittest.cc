@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/sched_slice_table.h"
 
+#include <algorithm>
+
 #include "src/trace_processor/args_tracker.h"
 #include "src/trace_processor/event_tracker.h"
 #include "src/trace_processor/process_tracker.h"
@@ -263,6 +265,126 @@ TEST_F(SchedSliceTableTest, TimestampFiltering) {
   ASSERT_THAT(query("ts >= 59 and ts < 73"), ElementsAre(59, 60, 70, 71, 72));
 }
 
+TEST_F(SchedSliceTableTest, CpuAndTimestampFiltering) {
+  uint32_t pid = 1;
+  int64_t prev_state = 32;
+  int32_t prio = 1024;
+
+  // Interleave the sched switches of 3 cpus, one per time unit from T=100.
+  for (int64_t i = 0; i < 30; i++) {
+    uint32_t cpu = static_cast<uint32_t>(i % 3);
+    context_.event_tracker->PushSchedSwitch(cpu, 100 + i, pid, "pid", prio,
+                                            prev_state, pid, "pid", prio);
+  }
+
+  auto query = [this](const std::string& where_clauses) {
+    PrepareValidStatement("SELECT ts from sched WHERE " + where_clauses);
+    std::vector<int> res;
+    while (sqlite3_step(*stmt_) == SQLITE_ROW) {
+      res.push_back(sqlite3_column_int(*stmt_, 0));
+    }
+    return res;
+  };
+
+  ASSERT_THAT(query("cpu = 1 and ts >= 110 and ts < 120"),
+              ElementsAre(110, 113, 116, 119));
+  ASSERT_THAT(query("ts >= 110 and ts <= 119 and cpu = 2"),
+              ElementsAre(111, 114, 117));
+  ASSERT_THAT(query("cpu = 0 and ts > 120"), ElementsAre(121, 124, 127));
+  ASSERT_THAT(query("cpu = 0 and ts < 100"), IsEmpty());
+  ASSERT_THAT(query("cpu = 5 and ts >= 100"), IsEmpty());
+  ASSERT_THAT(query("cpu = 1 and dur != 0 and ts > 120"),
+              ElementsAre(122, 125));
+}
+
+TEST_F(SchedSliceTableTest, OverlapFiltering) {
+  auto* slices = context_.storage->mutable_slices();
+  for (int64_t i = 0; i < 1000; i++) {
+    slices->AddSlice(static_cast<uint32_t>(i % 4), i * 10, (i % 7) * 15, 1,
+                     ftrace_utils::TaskState(), 120);
+  }
+  auto count_overlapping = [this](int64_t ts) {
+    std::string sql = "SELECT count(*), sum(ts) FROM sched WHERE ts <= " +
+                      std::to_string(ts) + " AND ts_end >= " +
+                      std::to_string(ts);
+    PrepareValidStatement(sql);
+    PERFETTO_CHECK(sqlite3_step(*stmt_) == SQLITE_ROW);
+    return std::make_pair(sqlite3_column_int64(*stmt_, 0),
+                          sqlite3_column_int64(*stmt_, 1));
+  };
+
+  // The results must be the same with and without the index of the ends.
+  std::vector<std::pair<int64_t, int64_t>> expected;
+  for (int64_t ts : {0, 5, 95, 100, 4321, 9990, 10100})
+    expected.push_back(count_overlapping(ts));
+  ASSERT_EQ(expected[2].first, 5);
+  ASSERT_EQ(expected[2].second, 40 + 50 + 60 + 80 + 90);
+
+  slices->BuildEndIndex();
+  std::vector<std::pair<int64_t, int64_t>> actual;
+  for (int64_t ts : {0, 5, 95, 100, 4321, 9990, 10100})
+    actual.push_back(count_overlapping(ts));
+  ASSERT_EQ(actual, expected);
+}
+
+TEST_F(SchedSliceTableTest, AppendOnlyColumnsWhileAppending) {
+  using Row = std::pair<int64_t, int64_t>;
+  auto* slices = context_.storage->mutable_slices();
+  auto add_slices = [slices](int64_t start, int64_t end) {
+    for (int64_t i = start; i < end; i++) {
+      auto utid = static_cast<UniqueTid>((i * 37) % 101);
+      slices->AddSlice(0, i * 10, 5, utid, ftrace_utils::TaskState(),
+                       static_cast<int32_t>(100 + i % 20));
+    }
+  };
+  auto query = [this](const std::string& where) {
+    PrepareValidStatement("SELECT utid, ts FROM sched WHERE " + where +
+                          " ORDER BY utid");
+    std::vector<Row> rows;
+    while (sqlite3_step(*stmt_) == SQLITE_ROW) {
+      rows.emplace_back(sqlite3_column_int64(*stmt_, 0),
+                        sqlite3_column_int64(*stmt_, 1));
+    }
+    return rows;
+  };
+  // Returns the rows matching |pred| sorted by utid.
+  auto expected = [slices](std::function<bool(int64_t, int32_t)> pred) {
+    std::vector<Row> rows;
+    for (uint32_t i = 0; i < slices->slice_count(); i++) {
+      if (pred(slices->utids()[i], slices->priorities()[i]))
+        rows.emplace_back(slices->utids()[i], slices->start_ns()[i]);
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+  };
+  auto sorted = [](std::vector<Row> rows) {
+    auto by_utid = [](const Row& a, const Row& b) { return a.first < b.first; };
+    EXPECT_TRUE(std::is_sorted(rows.begin(), rows.end(), by_utid));
+    std::sort(rows.begin(), rows.end());
+    return rows;
+  };
+
+  add_slices(0, 500);
+  for (int round = 0; round < 4; round++) {
+    ASSERT_EQ(sorted(query("utid >= 20")),
+              expected([](int64_t utid, int32_t) { return utid >= 20; }));
+    ASSERT_EQ(sorted(query("utid < 50 AND priority > 110")),
+              expected([](int64_t utid, int32_t prio) {
+                return utid < 50 && prio > 110;
+              }));
+    // Only the rows added at the end of the previous rounds match.
+    ASSERT_EQ(query("utid > 100").size(), static_cast<size_t>(round));
+    ASSERT_EQ(query("priority < 100").size(), static_cast<size_t>(round));
+    ASSERT_EQ(query("priority >= 100").size(),
+              slices->slice_count() - static_cast<size_t>(round));
+
+    // Adds rows with values outside of the ones seen by the queries above.
+    add_slices(500 + round * 300, 800 + round * 300);
+    slices->AddSlice(0, 100000 + round, 5, 200, ftrace_utils::TaskState(),
+                     90);
+  }
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
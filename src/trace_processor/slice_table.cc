@@ -16,11 +16,17 @@
 
 #include "src/trace_processor/slice_table.h"
 
+#include <algorithm>
+
 #include "src/trace_processor/storage_columns.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+using Constraint = QueryConstraints::Constraint;
+}  // namespace
+
 SliceTable::SliceTable(sqlite3*, const TraceStorage* storage)
     : storage_(storage) {}
 
@@ -33,12 +39,14 @@ StorageSchema SliceTable::CreateStorageSchema() {
   return StorageSchema::Builder()
       .AddOrderedNumericColumn("ts", &slices.start_ns())
       .AddNumericColumn("dur", &slices.durations())
-      .AddNumericColumn("utid", &slices.utids())
-      .AddStringColumn("cat", &slices.cats(), &storage_->string_pool())
-      .AddStringColumn("name", &slices.names(), &storage_->string_pool())
-      .AddNumericColumn("depth", &slices.depths())
+      .AddColumn<TsEndColumn>("ts_end", &slices.start_ns(), &slices.durations(),
+                              &slices.end_index())
+      .AddAppendOnlyNumericColumn("utid", &slices.utids())
+      .AddStringColumn("cat", &slices.cats(), storage_)
+      .AddStringColumn("name", &slices.names(), storage_)
+      .AddAppendOnlyNumericColumn("depth", &slices.depths())
       .AddNumericColumn("stack_id", &slices.stack_ids())
-      .AddNumericColumn("parent_stack_id", &slices.parent_stack_ids())
+      .AddAppendOnlyNumericColumn("parent_stack_id", &slices.parent_stack_ids())
       .Build({"utid", "ts", "depth"});
 }
 
@@ -47,18 +55,31 @@ uint32_t SliceTable::RowCount() {
 }
 
 int SliceTable::BestIndex(const QueryConstraints& qc, BestIndexInfo* info) {
-  info->estimated_cost =
-      static_cast<uint32_t>(storage_->nestable_slices().slice_count());
+  info->estimated_cost = EstimateFilterCost(qc);
 
-  // Only the string columns are handled by SQLite
+  // Overlap queries (ts <= X and ts_end >= X) only read the slices open at X
+  // through the index of the ends, like the time constraints of the sched
+  // table.
+  const auto& cs = qc.constraints();
+  int ts_idx = static_cast<int>(schema().ColumnIndexFromName("ts"));
+  int ts_end_idx = static_cast<int>(schema().ColumnIndexFromName("ts_end"));
+  bool has_ts_upper_bound =
+      std::any_of(cs.begin(), cs.end(), [ts_idx](const Constraint& c) {
+        return c.iColumn == ts_idx &&
+               (sqlite_utils::IsOpLe(c.op) || sqlite_utils::IsOpLt(c.op));
+      });
+  bool has_ts_end_lower_bound =
+      std::any_of(cs.begin(), cs.end(), [ts_end_idx](const Constraint& c) {
+        return c.iColumn == ts_end_idx &&
+               (sqlite_utils::IsOpGe(c.op) || sqlite_utils::IsOpGt(c.op));
+      });
+  if (has_ts_upper_bound && has_ts_end_lower_bound)
+    info->estimated_cost = std::min(info->estimated_cost, 10u);
+
+  // See StorageTable::OmitSupportedConstraints().
   info->order_by_consumed = true;
-  size_t name_index = schema().ColumnIndexFromName("name");
-  size_t cat_index = schema().ColumnIndexFromName("cat");
-  for (size_t i = 0; i < qc.constraints().size(); i++) {
-    info->omit[i] =
-        qc.constraints()[i].iColumn != static_cast<int>(name_index) &&
-        qc.constraints()[i].iColumn != static_cast<int>(cat_index);
-  }
+  OmitSupportedConstraints(qc, info);
+
   return SQLITE_OK;
 }
 
@@ -59,7 +59,7 @@ TEST(SliceTrackerTest, OneSliceDetailed) {
   tracker.Begin(2 /*ts*/, 42 /*tid*/, 0 /*cat*/, 1 /*name*/);
   tracker.End(10 /*ts*/, 42 /*tid*/, 0 /*cat*/, 1 /*name*/);
 
-  auto slices = context.storage->nestable_slices();
+  const auto& slices = context.storage->nestable_slices();
   EXPECT_EQ(slices.slice_count(), 1);
   EXPECT_EQ(slices.start_ns()[0], 2);
   EXPECT_EQ(slices.durations()[0], 8);
@@ -79,7 +79,7 @@ TEST(SliceTrackerTest, TwoSliceDetailed) {
   tracker.End(5 /*ts*/, 42 /*tid*/);
   tracker.End(10 /*ts*/, 42 /*tid*/);
 
-  auto slices = context.storage->nestable_slices();
+  const auto& slices = context.storage->nestable_slices();
 
   EXPECT_EQ(slices.slice_count(), 2);
 
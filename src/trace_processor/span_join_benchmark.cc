@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "src/trace_processor/sched_slice_table.h"
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/span_join_operator_table.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void RunStatement(sqlite3* db, const std::string& sql) {
+  char* error = nullptr;
+  sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error);
+  if (error) {
+    PERFETTO_FATAL("Error running %s: %s", sql.c_str(), error);
+  }
+}
+
+// Adds |slices| sched slices spread over 8 CPUs to |storage|, and a freq
+// table to |db| with a new frequency every 40us on each CPU.
+void PopulateTables(uint32_t slices, TraceStorage* storage, sqlite3* db) {
+  const uint32_t kCpus = 8;
+  std::minstd_rand0 rnd(0);
+  int64_t ts = 0;
+  for (uint32_t i = 0; i < slices; i++) {
+    // Slices on the same CPU are at least 4us apart, so they do not overlap.
+    ts += 500 + static_cast<int64_t>(rnd() % 500);
+    storage->mutable_slices()->AddSlice(
+        i % kCpus, ts, static_cast<int64_t>(rnd() % 4000),
+        static_cast<UniqueTid>(rnd() % 2048), ftrace_utils::TaskState(), 120);
+  }
+
+  RunStatement(db, "CREATE TABLE freq(ts BIG INT, dur BIG INT, cpu UNSIGNED "
+                   "INT, freq BIG INT);");
+  RunStatement(db, "BEGIN;");
+  const int64_t kFreqDur = static_cast<int64_t>(kCpus * 10 * 500);
+  for (int64_t freq_ts = 0; freq_ts < ts; freq_ts += kFreqDur) {
+    for (uint32_t cpu = 0; cpu < kCpus; cpu++) {
+      RunStatement(db, "INSERT INTO freq VALUES(" + std::to_string(freq_ts) +
+                           ", " + std::to_string(kFreqDur) + ", " +
+                           std::to_string(cpu) + ", " +
+                           std::to_string(rnd() % 3000000) + ");");
+    }
+  }
+  RunStatement(db, "COMMIT;");
+  // The view hides the storage table from the span join, which then reads it
+  // through SQLite.
+  RunStatement(db, "CREATE VIEW sched_view AS SELECT * FROM sched;");
+}
+
+void SpanJoinArgs(benchmark::internal::Benchmark* b) {
+  int slices = IsBenchmarkFunctionalOnly() ? 10000 : 1000000;
+  b->Args({slices, 0});
+  b->Args({slices, 1});
+}
+
+}  // namespace
+
+// Joins state.range(0) sched slices with the CPU frequency. The second
+// argument toggles between reading the sched table directly (0) and through
+// SQLite (1).
+static void BM_SpanJoinSchedFreq(benchmark::State& state) {
+  sqlite3* raw_db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+  ScopedDb db(raw_db);
+  RunStatement(*db, "CREATE TABLE perfetto_tables(name STRING)");
+  TraceStorage storage;
+  SchedSliceTable::RegisterTable(*db, &storage);
+  SpanJoinOperatorTable::RegisterTable(*db, &storage);
+  PopulateTables(static_cast<uint32_t>(state.range(0)), &storage, *db);
+
+  const char* sched = state.range(1) ? "sched_view" : "sched";
+  RunStatement(*db, std::string("CREATE VIRTUAL TABLE sp USING span_join(") +
+                        sched + " PARTITIONED cpu, freq PARTITIONED cpu);");
+
+  const std::string kQuery = "SELECT count(*), sum(dur * freq) FROM sp";
+  int64_t rows = 0;
+  for (auto _ : state) {
+    sqlite3_stmt* raw_stmt = nullptr;
+    PERFETTO_CHECK(sqlite3_prepare_v2(*db, kQuery.c_str(), -1, &raw_stmt,
+                                      nullptr) == SQLITE_OK);
+    ScopedStmt stmt(raw_stmt);
+    PERFETTO_CHECK(sqlite3_step(*stmt) == SQLITE_ROW);
+    rows += sqlite3_column_int64(*stmt, 0);
+    benchmark::DoNotOptimize(sqlite3_column_int64(*stmt, 1));
+  }
+  state.SetItemsProcessed(rows);
+}
+BENCHMARK(BM_SpanJoinSchedFreq)
+    ->Unit(benchmark::kMillisecond)
+    ->Apply(SpanJoinArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -26,7 +26,10 @@
 #include "perfetto/base/string_splitter.h"
 #include "perfetto/base/string_utils.h"
 #include "perfetto/base/string_view.h"
+#include "src/trace_processor/sched_slice_table.h"
+#include "src/trace_processor/slice_table.h"
 #include "src/trace_processor/sqlite_utils.h"
+#include "src/trace_processor/storage_table.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -38,14 +41,37 @@ constexpr int64_t kI64Max = std::numeric_limits<int64_t>::max();
 constexpr char kTsColumnName[] = "ts";
 constexpr char kDurColumnName[] = "dur";
 
+// Returns true if |name| resolves to the table registered by the trace
+// processor, which is eponymous and so has no entry in main.sqlite_master. A
+// TEMP table, or a non virtual table in main, with the same name shadows it.
+bool ResolvesToStorageTable(sqlite3* db, const std::string& name) {
+  const char kSql[] =
+      "SELECT "
+      "(SELECT count(*) FROM temp.sqlite_master "
+      "WHERE type IN ('table', 'view') AND name = ?1) = 0 AND "
+      "(SELECT count(*) FROM main.sqlite_master "
+      "WHERE type IN ('table', 'view') AND name = ?1 AND "
+      "sql NOT LIKE 'CREATE VIRTUAL TABLE % USING ' || ?1 || '%') = 0";
+  sqlite3_stmt* raw_stmt = nullptr;
+  int err = sqlite3_prepare_v2(db, kSql, -1, &raw_stmt, nullptr);
+  ScopedStmt stmt(raw_stmt);
+  if (err != SQLITE_OK)
+    return false;
+  sqlite3_bind_text(raw_stmt, 1, name.c_str(), -1,
+                    sqlite_utils::kSqliteTransient);
+  return sqlite3_step(raw_stmt) == SQLITE_ROW &&
+         sqlite3_column_int(raw_stmt, 0) == 1;
+}
+
 bool IsRequiredColumn(const std::string& name) {
   return name == kTsColumnName || name == kDurColumnName;
 }
 
 }  // namespace
 
-SpanJoinOperatorTable::SpanJoinOperatorTable(sqlite3* db, const TraceStorage*)
-    : db_(db) {}
+SpanJoinOperatorTable::SpanJoinOperatorTable(sqlite3* db,
+                                             const TraceStorage* storage)
+    : db_(db), storage_(storage) {}
 
 void SpanJoinOperatorTable::RegisterTable(sqlite3* db,
                                           const TraceStorage* storage) {
@@ -217,8 +243,30 @@ SpanJoinOperatorTable::CreateTableDefinition(const TableDescriptor& desc) {
   PERFETTO_DCHECK(dur_idx < cols.size());
   PERFETTO_DCHECK(desc.partition_col.empty() || partition_idx < cols.size());
 
-  return TableDefinition(desc.name, desc.partition_col, std::move(cols), ts_idx,
-                         dur_idx, partition_idx);
+  TableDefinition defn(desc.name, desc.partition_col, std::move(cols), ts_idx,
+                       dur_idx, partition_idx);
+  defn.set_storage_table(CreateStorageTable(desc.name));
+  return defn;
+}
+
+std::shared_ptr<StorageTable> SpanJoinOperatorTable::CreateStorageTable(
+    const std::string& name) {
+  if (!storage_ || !ResolvesToStorageTable(db_, name))
+    return nullptr;
+
+  // The tables backed by TraceStorage which have the ts and dur columns. This
+  // instance is private to the span join: it is only used to filter the rows
+  // and read the columns.
+  std::shared_ptr<StorageTable> table;
+  if (name == "sched") {
+    table.reset(new SchedSliceTable(db_, storage_));
+  } else if (name == "slices") {
+    table.reset(new SliceTable(db_, storage_));
+  } else {
+    return nullptr;
+  }
+  table->Init(0, nullptr);
+  return table;
 }
 
 std::string SpanJoinOperatorTable::GetNameForGlobalColumnIndex(
@@ -346,7 +394,7 @@ int SpanJoinOperatorTable::MixedPartitioningCursor::Next() {
 
     // t1 switched partitions, rewind the unpartitioned table.
     if (t1_.partition() != prev_partition) {
-      int reset_err = t2_.PrepareRawStmt();
+      int reset_err = t2_.Rewind();
       if (reset_err != SQLITE_OK)
         return reset_err;
       next_stepped_table_ = &t2_;
@@ -408,12 +456,104 @@ SpanJoinOperatorTable::Cursor::TableQueryState::TableQueryState(
 int SpanJoinOperatorTable::Cursor::TableQueryState::Initialize(
     const QueryConstraints& qc,
     sqlite3_value** argv) {
+  // The cursor may be filtered again, and take the other path this time.
+  reads_storage_ = false;
+  storage_rows_.clear();
+  next_storage_row_ = 0;
+  if (defn_->storage_table() && InitializeStorageRows(qc, argv))
+    return SQLITE_OK;
+
   sql_query_ = CreateSqlQuery(
       table_->ComputeSqlConstraintsForDefinition(*defn_, qc, argv));
   return PrepareRawStmt();
 }
 
+bool SpanJoinOperatorTable::Cursor::TableQueryState::InitializeStorageRows(
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  // The table may have been shadowed since the span join was created.
+  if (!ResolvesToStorageTable(db_, defn_->name()))
+    return false;
+
+  const StorageSchema& schema = defn_->storage_table()->schema();
+  storage_cols_.clear();
+  for (const Table::Column& col : defn_->columns()) {
+    size_t idx = schema.ColumnIndexFromName(col.name());
+    if (idx == schema.num_columns())
+      return false;
+    storage_cols_.emplace_back(&schema.GetColumn(idx));
+  }
+  ts_col_ = storage_cols_[defn_->ts_idx()];
+  dur_col_ = storage_cols_[defn_->dur_idx()];
+  partition_col_ = defn_->IsPartitioned()
+                       ? storage_cols_[defn_->partition_idx()]
+                       : nullptr;
+  if (!ts_col_->HasLongValues() || !dur_col_->HasLongValues() ||
+      (partition_col_ && !partition_col_->HasLongValues())) {
+    return false;
+  }
+
+  // Pass the constraints on the columns of this table to the storage table,
+  // as CreateSqlQuery() does.
+  QueryConstraints storage_qc;
+  std::vector<sqlite3_value*> storage_argv;
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    auto col_name = table_->GetNameForGlobalColumnIndex(*defn_, cs.iColumn);
+    if (col_name == "" || IsRequiredColumn(col_name))
+      continue;
+
+    size_t col = schema.ColumnIndexFromName(col_name);
+    if (!schema.GetColumn(col).IsFilterSupported(cs.op))
+      return false;
+    storage_qc.AddConstraint(static_cast<int>(col), cs.op);
+    storage_argv.emplace_back(argv[i]);
+  }
+  auto ts_idx = static_cast<int>(schema.ColumnIndexFromName(kTsColumnName));
+  storage_qc.AddOrderBy(ts_idx, false);
+
+  // On errors, fall back to SQLite which reports them.
+  auto it = defn_->storage_table()->CreateRowIterator(storage_qc,
+                                                      storage_argv.data());
+  if (!it)
+    return false;
+
+  // The rows are in ts order so a stable sort on the partition gives the
+  // (partition, ts) order of the SQL query.
+  storage_rows_.clear();
+  for (; !it->IsEnd(); it->NextRow()) {
+    uint32_t row = it->Row();
+    int64_t partition = partition_col_ ? partition_col_->GetLong(row) : 0;
+    storage_rows_.emplace_back(StorageRow{partition, row});
+  }
+  if (partition_col_) {
+    std::stable_sort(storage_rows_.begin(), storage_rows_.end(),
+                     [](const StorageRow& a, const StorageRow& b) {
+                       return a.partition < b.partition;
+                     });
+  }
+  next_storage_row_ = 0;
+  reads_storage_ = true;
+  return true;
+}
+
 int SpanJoinOperatorTable::Cursor::TableQueryState::StepAndCacheValues() {
+  if (reads_storage_) {
+    if (next_storage_row_ == storage_rows_.size()) {
+      ts_start_ = kI64Max;
+      ts_end_ = kI64Max;
+      partition_ = kI64Max;
+      return SQLITE_DONE;
+    }
+    const StorageRow& storage_row = storage_rows_[next_storage_row_++];
+    row_ = storage_row.row;
+    ts_start_ = ts_col_->GetLong(row_);
+    ts_end_ = ts_start_ + dur_col_->GetLong(row_);
+    if (partition_col_)
+      partition_ = storage_row.partition;
+    return SQLITE_ROW;
+  }
+
   sqlite3_stmt* stmt = stmt_.get();
 
   auto ts_idx = static_cast<int>(definition()->ts_idx());
@@ -472,6 +612,14 @@ std::string SpanJoinOperatorTable::Cursor::TableQueryState::CreateSqlQuery(
   return sql;
 }
 
+int SpanJoinOperatorTable::Cursor::TableQueryState::Rewind() {
+  if (reads_storage_) {
+    next_storage_row_ = 0;
+    return SQLITE_OK;
+  }
+  return PrepareRawStmt();
+}
+
 int SpanJoinOperatorTable::Cursor::TableQueryState::PrepareRawStmt() {
   sqlite3_stmt* stmt = nullptr;
   int err =
@@ -484,6 +632,11 @@ int SpanJoinOperatorTable::Cursor::TableQueryState::PrepareRawStmt() {
 void SpanJoinOperatorTable::Cursor::TableQueryState::ReportSqliteResult(
     sqlite3_context* context,
     size_t index) {
+  if (reads_storage_) {
+    storage_cols_[index]->ReportResult(context, row_);
+    return;
+  }
+
   sqlite3_stmt* stmt = stmt_.get();
   int idx = static_cast<int>(index);
   switch (sqlite3_column_type(stmt, idx)) {
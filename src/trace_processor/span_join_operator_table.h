@@ -33,6 +33,9 @@
 namespace perfetto {
 namespace trace_processor {
 
+class StorageColumn;
+class StorageTable;
+
 // Implements the SPAN JOIN operation between two tables on a particular column.
 //
 // Span:
@@ -65,6 +68,10 @@ namespace trace_processor {
 //
 // All other columns apart from timestamp (ts), duration (dur) and the join key
 // are passed through unchanged.
+//
+// The child tables are queried through SQLite, except for the tables backed
+// by TraceStorage (e.g. sched): their columns are read directly, which avoids
+// the overhead of a SQLite virtual table for each row.
 class SpanJoinOperatorTable : public Table {
  public:
   // Columns of the span operator table.
@@ -123,10 +130,18 @@ class SpanJoinOperatorTable : public Table {
 
     bool IsPartitioned() const { return !partition_col_.empty(); }
 
+    // The table backed by TraceStorage with this name, whose columns can be
+    // read directly. Null for all the other tables and views.
+    StorageTable* storage_table() const { return storage_table_.get(); }
+    void set_storage_table(std::shared_ptr<StorageTable> storage_table) {
+      storage_table_ = std::move(storage_table);
+    }
+
    private:
     std::string name_;
     std::string partition_col_;
     std::vector<Table::Column> cols_;
+    std::shared_ptr<StorageTable> storage_table_;
     uint32_t ts_idx_ = std::numeric_limits<uint32_t>::max();
     uint32_t dur_idx_ = std::numeric_limits<uint32_t>::max();
     uint32_t partition_idx_ = std::numeric_limits<uint32_t>::max();
@@ -152,7 +167,9 @@ class SpanJoinOperatorTable : public Table {
       int Initialize(const QueryConstraints& qc, sqlite3_value** argv);
       int StepAndCacheValues();
       void ReportSqliteResult(sqlite3_context* context, size_t index);
-      int PrepareRawStmt();
+
+      // Restarts from the first row.
+      int Rewind();
 
       const TableDefinition* definition() const { return defn_; }
 
@@ -164,11 +181,35 @@ class SpanJoinOperatorTable : public Table {
       }
 
      private:
+      // A row of the storage table, see InitializeStorageRows().
+      struct StorageRow {
+        int64_t partition;
+        uint32_t row;
+      };
+
+      // Reads the rows from the storage table of the definition, if any,
+      // rather than querying SQLite. Returns false if this is not possible for
+      // the columns or constraints of the query.
+      bool InitializeStorageRows(const QueryConstraints& qc,
+                                 sqlite3_value** argv);
+
       std::string CreateSqlQuery(const std::vector<std::string>& cs) const;
+      int PrepareRawStmt();
 
       std::string sql_query_;
       ScopedStmt stmt_;
 
+      // Only used when reading the storage table directly: the matching rows
+      // ordered by partition and ts, and the columns of the definition.
+      bool reads_storage_ = false;
+      std::vector<StorageRow> storage_rows_;
+      size_t next_storage_row_ = 0;
+      uint32_t row_ = 0;
+      std::vector<const StorageColumn*> storage_cols_;
+      const StorageColumn* ts_col_ = nullptr;
+      const StorageColumn* dur_col_ = nullptr;
+      const StorageColumn* partition_col_ = nullptr;
+
       int64_t ts_start_ = std::numeric_limits<int64_t>::max();
       int64_t ts_end_ = std::numeric_limits<int64_t>::max();
       int64_t partition_ = std::numeric_limits<int64_t>::max();
@@ -216,6 +257,8 @@ class SpanJoinOperatorTable : public Table {
   base::Optional<TableDefinition> CreateTableDefinition(
       const TableDescriptor& desc);
 
+  std::shared_ptr<StorageTable> CreateStorageTable(const std::string& name);
+
   std::vector<std::string> ComputeSqlConstraintsForDefinition(
       const TableDefinition& defn,
       const QueryConstraints& qc,
@@ -233,6 +276,7 @@ class SpanJoinOperatorTable : public Table {
   std::unordered_map<size_t, ColumnLocator> global_index_to_column_locator_;
 
   sqlite3* const db_;
+  const TraceStorage* const storage_;
 };
 
 }  // namespace trace_processor
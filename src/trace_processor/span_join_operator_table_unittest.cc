@@ -16,8 +16,11 @@
 
 #include "src/trace_processor/span_join_operator_table.h"
 
+#include <algorithm>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "src/trace_processor/sched_slice_table.h"
 #include "src/trace_processor/trace_processor_context.h"
 #include "src/trace_processor/trace_storage.h"
 
@@ -58,6 +61,26 @@ class SpanJoinOperatorTableTest : public ::testing::Test {
     }
   }
 
+  // Returns the rows of |sql| as strings, sorted as the order of the rows
+  // with the same ts is unspecified.
+  std::vector<std::string> SortedRows(const std::string& sql) {
+    PrepareValidStatement(sql);
+    std::vector<std::string> rows;
+    int err;
+    while ((err = sqlite3_step(stmt_.get())) == SQLITE_ROW) {
+      std::string row;
+      for (int i = 0; i < sqlite3_column_count(stmt_.get()); i++) {
+        const unsigned char* text = sqlite3_column_text(stmt_.get(), i);
+        row += text ? reinterpret_cast<const char*>(text) : "null";
+        row += " ";
+      }
+      rows.emplace_back(std::move(row));
+    }
+    EXPECT_EQ(err, SQLITE_DONE);
+    std::sort(rows.begin(), rows.end());
+    return rows;
+  }
+
   ~SpanJoinOperatorTableTest() override { context_.storage->ResetStorage(); }
 
  protected:
@@ -261,6 +284,140 @@ TEST_F(SpanJoinOperatorTableTest, NoPartitioning) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
+TEST_F(SpanJoinOperatorTableTest, StorageTableSameResultsAsSql) {
+  SchedSliceTable::RegisterTable(db_.get(), context_.storage.get());
+  auto* slices = context_.storage->mutable_slices();
+  int64_t ts[] = {100, 100, 100, 100};
+  for (uint32_t i = 0; i < 40; i++) {
+    uint32_t cpu = (i * 7) % 4;
+    ts[cpu] += 5 + (i * 13) % 11;
+    int64_t dur = 3 + (i * 5) % 17;
+    slices->AddSlice(cpu, ts[cpu], dur, i % 5, ftrace_utils::TaskState(),
+                     static_cast<int32_t>(i));
+    ts[cpu] += dur;
+  }
+  // The view hides the storage table, so the span join queries it through
+  // SQLite.
+  RunStatement("CREATE VIEW sched_view AS SELECT * FROM sched;");
+  RunStatement(
+      "CREATE TEMP TABLE freq("
+      "ts BIG INT, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "freq BIG INT"
+      ");");
+  RunStatement(
+      "CREATE TEMP TABLE counter("
+      "ts BIG INT PRIMARY KEY, "
+      "dur BIG INT, "
+      "value BIG INT"
+      ");");
+  for (int cpu = 0; cpu < 3; cpu++) {
+    for (int i = 0; i < 10; i++) {
+      RunStatement("INSERT INTO freq VALUES(" + std::to_string(90 + i * 50) +
+                   ", 50, " + std::to_string(cpu) + ", " +
+                   std::to_string(cpu * 100 + i) + ");");
+    }
+  }
+  for (int i = 0; i < 10; i++) {
+    RunStatement("INSERT INTO counter VALUES(" + std::to_string(95 + i * 40) +
+                 ", 30, " + std::to_string(i) + ");");
+  }
+
+  const char* kSpanJoins[] = {
+      "span_join(%s PARTITIONED cpu, freq PARTITIONED cpu)",
+      "span_join(freq PARTITIONED cpu, %s PARTITIONED cpu)",
+      "span_join(%s PARTITIONED cpu, counter)",
+  };
+  for (const char* span_join : kSpanJoins) {
+    for (const char* table : {"sched", "sched_view"}) {
+      char args[128];
+      snprintf(args, sizeof(args), span_join, table);
+      RunStatement(std::string("CREATE VIRTUAL TABLE sp_") + table +
+                   " USING " + args + ";");
+    }
+    for (const char* where : {"", " WHERE cpu = 1", " WHERE utid = 2",
+                              " WHERE priority > 30"}) {
+      auto expected = SortedRows(std::string("SELECT * FROM sp_sched_view") +
+                                 where);
+      ASSERT_FALSE(expected.empty()) << span_join << where;
+      ASSERT_EQ(SortedRows(std::string("SELECT * FROM sp_sched") + where),
+                expected)
+          << span_join << where;
+    }
+    RunStatement("DROP TABLE sp_sched;");
+    RunStatement("DROP TABLE sp_sched_view;");
+  }
+}
+
+TEST_F(SpanJoinOperatorTableTest, TempTableShadowsStorageTable) {
+  SchedSliceTable::RegisterTable(db_.get(), context_.storage.get());
+  context_.storage->mutable_slices()->AddSlice(0, 100, 10, 1,
+                                               ftrace_utils::TaskState(), 10);
+  RunStatement(
+      "CREATE TEMP TABLE freq("
+      "ts BIG INT, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "freq BIG INT"
+      ");");
+  RunStatement("INSERT INTO freq VALUES(0, 1000, 0, 5);");
+
+  // The first span join is created while sched is still the storage table,
+  // the second one after it has been shadowed: both must read the TEMP table.
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp_before USING span_join(sched PARTITIONED cpu, "
+      "freq PARTITIONED cpu);");
+  RunStatement(
+      "CREATE TEMP TABLE sched("
+      "ts BIG INT, "
+      "cpu UNSIGNED INT, "
+      "dur BIG INT, "
+      "ts_end BIG INT, "
+      "utid UNSIGNED INT, "
+      "end_state STRING, "
+      "priority INT, "
+      "row_id BIG INT"
+      ");");
+  RunStatement("INSERT INTO sched VALUES(200, 0, 20, 220, 2, 'S', 20, 0);");
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp_after USING span_join(sched PARTITIONED cpu, "
+      "freq PARTITIONED cpu);");
+
+  for (const char* table : {"sp_before", "sp_after"}) {
+    PrepareValidStatement(std::string("SELECT ts, dur, utid FROM ") + table);
+    AssertNextRow({200, 20, 2});
+    ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE) << table;
+  }
+}
+
+TEST_F(SpanJoinOperatorTableTest, StorageCursorFilteredAgainThroughSql) {
+  SchedSliceTable::RegisterTable(db_.get(), context_.storage.get());
+  context_.storage->mutable_slices()->AddSlice(
+      0, 100, 10, 1, ftrace_utils::TaskState("R"), 10);
+  RunStatement(
+      "CREATE TEMP TABLE freq("
+      "ts BIG INT, "
+      "dur BIG INT, "
+      "cpu UNSIGNED INT, "
+      "freq BIG INT"
+      ");");
+  RunStatement("INSERT INTO freq VALUES(0, 1000, 0, 5);");
+  RunStatement(
+      "CREATE VIRTUAL TABLE sp USING span_join(sched PARTITIONED cpu, "
+      "freq PARTITIONED cpu);");
+
+  // The span join cursor is filtered once per state. The first filter reads
+  // the storage table. The storage table rejects the second state, so the
+  // second filter falls back to SQLite: it must step the new statement, which
+  // reports the error, rather than the rows of the first filter.
+  PrepareValidStatement(
+      "SELECT sp.ts FROM (SELECT 'R' AS state UNION ALL SELECT 'Q') AS states "
+      "CROSS JOIN sp WHERE sp.end_state = states.state;");
+  AssertNextRow({100});
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_ERROR);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
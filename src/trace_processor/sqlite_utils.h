@@ -197,10 +197,14 @@ inline std::function<bool(const char*)> CreateStringPredicate(
         return str != nullptr && strcmp(str, val) == 0;
       };
     case SQLITE_INDEX_CONSTRAINT_NE:
-    case SQLITE_INDEX_CONSTRAINT_ISNOT:
       return [val](const char* str) {
         return str != nullptr && strcmp(str, val) != 0;
       };
+    case SQLITE_INDEX_CONSTRAINT_ISNOT:
+      // Unlike !=, IS NOT is true when comparing NULL with a non-null value.
+      return [val](const char* str) {
+        return str == nullptr || strcmp(str, val) != 0;
+      };
     case SQLITE_INDEX_CONSTRAINT_GE:
       return [val](const char* str) {
         return str != nullptr && strcmp(str, val) >= 0;
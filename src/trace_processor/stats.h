@@ -29,6 +29,8 @@ namespace stats {
   F(android_log_num_failed,                     kSingle,  kError, kTrace),    \
   F(android_log_num_skipped,                    kSingle,  kError, kTrace),    \
   F(android_log_num_total,                      kSingle,  kInfo,  kTrace),    \
+  F(args_memory_bytes,                          kSingle,  kInfo,  kAnalysis), \
+  F(args_num_shapes,                            kSingle,  kInfo,  kAnalysis), \
   F(atrace_tgid_mismatch,                       kSingle,  kError, kTrace),    \
   F(clock_snapshot_not_monotonic,               kSingle,  kError, kTrace),    \
   F(counter_events_out_of_order,                kSingle,  kError, kAnalysis), \
@@ -56,9 +58,17 @@ namespace stats {
   F(mm_unknown_counter,                         kSingle,  kError, kAnalysis), \
   F(mm_unknown_type,                            kSingle,  kError, kAnalysis), \
   F(proc_stat_unknown_counters,                 kSingle,  kError, kAnalysis), \
+  F(query_result_cache_hits,                    kSingle,  kInfo,  kAnalysis), \
+  F(query_result_cache_misses,                  kSingle,  kInfo,  kAnalysis), \
+  F(query_statement_cache_hits,                 kSingle,  kInfo,  kAnalysis), \
+  F(query_statement_cache_misses,               kSingle,  kInfo,  kAnalysis), \
   F(rss_stat_unknown_keys,                      kSingle,  kError, kAnalysis), \
   F(rss_stat_negative_size,                     kSingle,  kInfo,  kAnalysis), \
   F(sched_switch_out_of_order,                  kSingle,  kError, kAnalysis), \
+  F(sorter_peak_memory_bytes,                   kSingle,  kInfo,  kAnalysis), \
+  F(sorter_peak_num_events,                     kSingle,  kInfo,  kAnalysis), \
+  F(string_pool_memory_bytes,                   kSingle,  kInfo,  kAnalysis), \
+  F(string_pool_num_strings,                    kSingle,  kInfo,  kAnalysis), \
   F(sys_unknown_sys_id,                         kSingle,  kError, kAnalysis), \
   F(traced_buf_buffer_size,                     kIndexed, kInfo,  kTrace),    \
   F(traced_buf_bytes_overwritten,               kIndexed, kInfo,  kTrace),    \
@@ -70,12 +80,14 @@ namespace stats {
   F(traced_buf_chunks_rewritten,                kIndexed, kInfo,  kTrace),    \
   F(traced_buf_chunks_written,                  kIndexed, kInfo,  kTrace),    \
   F(traced_buf_chunks_committed_out_of_order,   kIndexed, kInfo,  kTrace),    \
+  F(traced_buf_packets_dropped_by_producers,    kIndexed, kInfo,  kTrace),    \
   F(traced_buf_padding_bytes_cleared,           kIndexed, kInfo,  kTrace),    \
   F(traced_buf_padding_bytes_written,           kIndexed, kInfo,  kTrace),    \
   F(traced_buf_patches_failed,                  kIndexed, kInfo,  kTrace),    \
   F(traced_buf_patches_succeeded,               kIndexed, kInfo,  kTrace),    \
   F(traced_buf_readaheads_failed,               kIndexed, kInfo,  kTrace),    \
   F(traced_buf_readaheads_succeeded,            kIndexed, kInfo,  kTrace),    \
+  F(traced_buf_unused_chunk_bytes_read,         kIndexed, kInfo,  kTrace),    \
   F(traced_buf_write_wrap_count,                kIndexed, kInfo,  kTrace),    \
   F(traced_chunks_discarded,                    kSingle,  kInfo,  kTrace),    \
   F(traced_data_sources_registered,             kSingle,  kInfo,  kTrace),    \
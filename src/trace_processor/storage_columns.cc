@@ -24,11 +24,13 @@ StorageColumn::StorageColumn(std::string col_name, bool hidden)
 StorageColumn::~StorageColumn() = default;
 
 TsEndColumn::TsEndColumn(std::string col_name,
-                         const std::deque<int64_t>* ts_start,
-                         const std::deque<int64_t>* dur)
+                         const ChunkedVector<int64_t>* ts_start,
+                         const ChunkedVector<int64_t>* dur,
+                         const IntervalIndex* end_index)
     : StorageColumn(col_name, false /* hidden */),
       ts_start_(ts_start),
-      dur_(dur) {}
+      dur_(dur),
+      end_index_(end_index) {}
 TsEndColumn::~TsEndColumn() = default;
 
 void TsEndColumn::ReportResult(sqlite3_context* ctx, uint32_t row) const {
@@ -45,6 +47,18 @@ TsEndColumn::Bounds TsEndColumn::BoundFilter(int, sqlite3_value*) const {
 void TsEndColumn::Filter(int op,
                          sqlite3_value* value,
                          FilteredRowIndex* index) const {
+  bool is_lower_bound = sqlite_utils::IsOpGe(op) || sqlite_utils::IsOpGt(op);
+  if (is_lower_bound && end_index_ != nullptr &&
+      end_index_->size() == ts_start_->size() &&
+      sqlite3_value_type(value) == SQLITE_INTEGER) {
+    std::vector<uint32_t> rows;
+    end_index_->FindRowsEndingAfter(
+        sqlite3_value_int64(value), sqlite_utils::IsOpGe(op),
+        index->start_row(), index->end_row(), *ts_start_, *dur_, &rows);
+    index->IntersectSortedRows(rows);
+    return;
+  }
+
   auto predicate = sqlite_utils::CreateNumericPredicate<int64_t>(op, value);
   index->FilterRows([this, &predicate](uint32_t row) {
     return predicate((*ts_start_)[row] + (*dur_)[row]);
@@ -71,5 +85,45 @@ IdColumn::IdColumn(std::string column_name, TableId table_id)
     : StorageColumn(std::move(column_name), false), table_id_(table_id) {}
 IdColumn::~IdColumn() = default;
 
+IdColumn::Bounds IdColumn::BoundFilter(int op, sqlite3_value* value) const {
+  // Row ids are the row index offset by the table id (stored in the upper
+  // bits) so, like a sorted column, any range constraint on the id can be
+  // converted into a range of rows.
+  using namespace sqlite_utils;
+
+  constexpr RowId kMin = std::numeric_limits<RowId>::lowest();
+  constexpr RowId kMax = std::numeric_limits<RowId>::max();
+  RowId min = kMin;
+  RowId max = kMax;
+  if (IsOpGe(op) || IsOpGt(op)) {
+    min = FindGtBound<RowId>(IsOpGe(op), value);
+  } else if (IsOpLe(op) || IsOpLt(op)) {
+    max = FindLtBound<RowId>(IsOpLe(op), value);
+  } else if (IsOpEq(op)) {
+    min = FindEqBound<RowId>(value);
+    max = min;
+  }
+
+  Bounds bounds;
+  if (min <= kMin && max >= kMax)
+    return bounds;
+
+  // Returns the number of rows in the table whose id is < |id|.
+  const RowId base = TraceStorage::CreateRowId(table_id_, 0);
+  auto rows_before = [base](RowId id) -> uint32_t {
+    if (id <= base)
+      return 0u;
+    RowId rows = id - base;
+    return rows >= std::numeric_limits<uint32_t>::max()
+               ? std::numeric_limits<uint32_t>::max()
+               : static_cast<uint32_t>(rows);
+  };
+  bounds.min_idx = min <= kMin ? 0 : rows_before(min);
+  if (max < kMax)
+    bounds.max_idx = rows_before(max + 1);
+  bounds.consumed = true;
+  return bounds;
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -19,7 +19,11 @@
 #include <memory>
 #include <string>
 
+#include "src/trace_processor/append_only_index.h"
+#include "src/trace_processor/bit_vector.h"
+#include "src/trace_processor/chunked_vector.h"
 #include "src/trace_processor/filtered_row_index.h"
+#include "src/trace_processor/interval_index.h"
 #include "src/trace_processor/sqlite_utils.h"
 #include "src/trace_processor/trace_storage.h"
 
@@ -55,6 +59,10 @@ class StorageColumn {
   // Returns the type of this column.
   virtual Table::ColumnType GetType() const = 0;
 
+  // Returns whether Filter() fully handles constraints with the operator |op|.
+  // Tables use this to tell SQLite which constraints it can omit checking.
+  virtual bool IsFilterSupported(int) const { return true; }
+
   // Bounds a filter on this column between a minimum and maximum index.
   // Generally this is only possible if the column is sorted.
   virtual Bounds BoundFilter(int, sqlite3_value*) const { return Bounds{}; }
@@ -62,6 +70,19 @@ class StorageColumn {
   // Returns whether this column is sorted in the storage.
   virtual bool IsNaturallyOrdered() const { return false; }
 
+  // Returns all the rows of this column ordered by increasing value, or
+  // nullptr if the column does not keep them sorted.
+  virtual const std::vector<uint32_t>* GetSortedRows() const { return nullptr; }
+
+  // Returns whether the values of this column are integers which can be read
+  // with GetLong(), without going through SQLite.
+  virtual bool HasLongValues() const { return false; }
+
+  // Returns the value at |row|. Only valid if HasLongValues() is true.
+  virtual int64_t GetLong(uint32_t) const {
+    PERFETTO_FATAL("Column %s has no integer values", col_name_.c_str());
+  }
+
   const std::string& name() const { return col_name_; }
   bool hidden() const { return hidden_; }
 
@@ -70,32 +91,40 @@ class StorageColumn {
   bool hidden_ = false;
 };
 
-// A column of numeric data backed by a deque.
+// A column of numeric data backed by a ChunkedVector.
 template <typename T>
 class NumericColumn : public StorageColumn {
  public:
-  // |index| is an optional multimap which maps the values in deque
-  // to the rows they are located at.
+  // |index| is an optional multimap which maps the values in |vector|
+  // to the rows they are located at, in increasing order.
+  // |is_append_only| is true if the values in |vector| never change once
+  // added. The column then keeps statistics and the sorted order of its
+  // values across queries and only extends them with the new rows.
   NumericColumn(std::string col_name,
-                const std::deque<T>* deque,
+                const ChunkedVector<T>* vector,
                 const std::deque<std::vector<uint32_t>>* index,
                 bool hidden,
-                bool is_naturally_ordered)
+                bool is_naturally_ordered,
+                bool is_append_only = false)
       : StorageColumn(col_name, hidden),
-        deque_(deque),
+        vector_(vector),
         index_(index),
-        is_naturally_ordered_(is_naturally_ordered) {}
+        is_naturally_ordered_(is_naturally_ordered),
+        is_append_only_(is_append_only && std::is_integral<T>::value) {}
 
   void ReportResult(sqlite3_context* ctx, uint32_t row) const override {
-    sqlite_utils::ReportSqliteResult(ctx, (*deque_)[row]);
+    sqlite_utils::ReportSqliteResult(ctx, (*vector_)[row]);
   }
 
   Bounds BoundFilter(int op, sqlite3_value* sqlite_val) const override {
     Bounds bounds;
-    bounds.max_idx = static_cast<uint32_t>(deque_->size());
+    bounds.max_idx = static_cast<uint32_t>(vector_->size());
 
-    if (!is_naturally_ordered_)
+    if (!is_naturally_ordered_) {
+      if (is_append_only_ && sqlite3_value_type(sqlite_val) == SQLITE_INTEGER)
+        BoundFilterWithStats(op, sqlite3_value_int64(sqlite_val), &bounds);
       return bounds;
+    }
 
     // Makes the below code much more readable.
     using namespace sqlite_utils;
@@ -115,13 +144,13 @@ class NumericColumn : public StorageColumn {
     if (min <= kTMin && max >= kTMax)
       return bounds;
 
-    // Convert the values into indices into the deque.
-    auto min_it = std::lower_bound(deque_->begin(), deque_->end(), min);
+    // Convert the values into indices into the vector.
+    auto min_it = std::lower_bound(vector_->begin(), vector_->end(), min);
     bounds.min_idx =
-        static_cast<uint32_t>(std::distance(deque_->begin(), min_it));
-    auto max_it = std::upper_bound(min_it, deque_->end(), max);
+        static_cast<uint32_t>(std::distance(vector_->begin(), min_it));
+    auto max_it = std::upper_bound(min_it, vector_->end(), max);
     bounds.max_idx =
-        static_cast<uint32_t>(std::distance(deque_->begin(), max_it));
+        static_cast<uint32_t>(std::distance(vector_->begin(), max_it));
     bounds.consumed = true;
 
     return bounds;
@@ -152,16 +181,29 @@ class NumericColumn : public StorageColumn {
   Comparator Sort(const QueryConstraints::OrderBy& ob) const override {
     if (ob.desc) {
       return [this](uint32_t f, uint32_t s) {
-        return sqlite_utils::CompareValuesDesc((*deque_)[f], (*deque_)[s]);
+        return sqlite_utils::CompareValuesDesc((*vector_)[f], (*vector_)[s]);
       };
     }
     return [this](uint32_t f, uint32_t s) {
-      return sqlite_utils::CompareValuesAsc((*deque_)[f], (*deque_)[s]);
+      return sqlite_utils::CompareValuesAsc((*vector_)[f], (*vector_)[s]);
     };
   }
 
   bool IsNaturallyOrdered() const override { return is_naturally_ordered_; }
 
+  const std::vector<uint32_t>* GetSortedRows() const override {
+    if (!is_append_only_)
+      return nullptr;
+    return &append_only_index_.UpdateSortedRows(*vector_);
+  }
+
+  bool HasLongValues() const override { return std::is_integral<T>::value; }
+
+  int64_t GetLong(uint32_t row) const override {
+    PERFETTO_DCHECK(HasLongValues());
+    return static_cast<int64_t>((*vector_)[row]);
+  }
+
   Table::ColumnType GetType() const override {
     if (std::is_same<T, int32_t>::value) {
       return Table::ColumnType::kInt;
@@ -177,13 +219,81 @@ class NumericColumn : public StorageColumn {
   }
 
  protected:
-  const std::deque<T>* deque_ = nullptr;
+  const ChunkedVector<T>* vector_ = nullptr;
   const std::deque<std::vector<uint32_t>>* index_ = nullptr;
 
  private:
   T kTMin = std::numeric_limits<T>::lowest();
   T kTMax = std::numeric_limits<T>::max();
 
+  static void SetEmpty(Bounds* bounds) {
+    bounds->min_idx = 0;
+    bounds->max_idx = 0;
+    bounds->consumed = true;
+  }
+
+  // Bounds a comparison with the integer |value| using the statistics of the
+  // column: constraints matching no row or all the rows are consumed without
+  // reading the column, and so are all constraints if the values happen to
+  // be sorted.
+  void BoundFilterWithStats(int op, int64_t value, Bounds* bounds) const {
+    append_only_index_.UpdateStats(*vector_);
+    if (append_only_index_.stats_size() == 0)
+      return;
+
+    // The range [lo, hi] of the values matching the constraint.
+    int64_t lo = std::numeric_limits<int64_t>::min();
+    int64_t hi = std::numeric_limits<int64_t>::max();
+    switch (op) {
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+        lo = value;
+        hi = value;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_GE:
+        lo = value;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_GT:
+        if (value == hi) {
+          SetEmpty(bounds);
+          return;
+        }
+        lo = value + 1;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_LE:
+        hi = value;
+        break;
+      case SQLITE_INDEX_CONSTRAINT_LT:
+        if (value == lo) {
+          SetEmpty(bounds);
+          return;
+        }
+        hi = value - 1;
+        break;
+      default:
+        return;
+    }
+
+    auto min = static_cast<int64_t>(append_only_index_.min());
+    auto max = static_cast<int64_t>(append_only_index_.max());
+    if (lo > max || hi < min) {
+      SetEmpty(bounds);
+    } else if (lo <= min && hi >= max) {
+      bounds->consumed = true;
+    } else if (append_only_index_.sorted()) {
+      auto min_it = std::lower_bound(
+          vector_->begin(), vector_->end(), lo,
+          [](T v, int64_t x) { return static_cast<int64_t>(v) < x; });
+      auto max_it = std::upper_bound(
+          min_it, vector_->end(), hi,
+          [](int64_t x, T v) { return x < static_cast<int64_t>(v); });
+      bounds->min_idx =
+          static_cast<uint32_t>(std::distance(vector_->begin(), min_it));
+      bounds->max_idx =
+          static_cast<uint32_t>(std::distance(vector_->begin(), max_it));
+      bounds->consumed = true;
+    }
+  }
+
   void FilterIntegerIndexEq(sqlite3_value* value,
                             FilteredRowIndex* index) const {
     auto raw = sqlite_utils::ExtractSqliteValue<int64_t>(value);
@@ -191,61 +301,150 @@ class NumericColumn : public StorageColumn {
       index->IntersectRows({});
       return;
     }
-    index->IntersectRows((*index_)[static_cast<size_t>(raw)]);
+    index->IntersectSortedRows((*index_)[static_cast<size_t>(raw)]);
   }
 
   template <typename C>
   void FilterWithCast(int op,
                       sqlite3_value* value,
                       FilteredRowIndex* index) const {
+    // Comparison operators are evaluated on blocks of contiguous rows at a
+    // time, see FilteredRowIndex::FilterColumn.
+    switch (op) {
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+      case SQLITE_INDEX_CONSTRAINT_IS:
+        FilterColumnWith<C>(value, index, std::equal_to<C>());
+        return;
+      case SQLITE_INDEX_CONSTRAINT_NE:
+      case SQLITE_INDEX_CONSTRAINT_ISNOT:
+        FilterColumnWith<C>(value, index, std::not_equal_to<C>());
+        return;
+      case SQLITE_INDEX_CONSTRAINT_GE:
+        FilterColumnWith<C>(value, index, std::greater_equal<C>());
+        return;
+      case SQLITE_INDEX_CONSTRAINT_GT:
+        FilterColumnWith<C>(value, index, std::greater<C>());
+        return;
+      case SQLITE_INDEX_CONSTRAINT_LE:
+        FilterColumnWith<C>(value, index, std::less_equal<C>());
+        return;
+      case SQLITE_INDEX_CONSTRAINT_LT:
+        FilterColumnWith<C>(value, index, std::less<C>());
+        return;
+    }
+
     auto predicate = sqlite_utils::CreateNumericPredicate<C>(op, value);
     index->FilterRows([this, &predicate](uint32_t row) {
-      return predicate(static_cast<C>((*deque_)[row]));
+      return predicate(static_cast<C>((*vector_)[row]));
     });
   }
 
+  template <typename C, typename Comparator>
+  void FilterColumnWith(sqlite3_value* value,
+                        FilteredRowIndex* index,
+                        Comparator cmp) const {
+    C val = sqlite_utils::ExtractSqliteValue<C>(value);
+    index->FilterColumn(*vector_, val, cmp);
+  }
+
   bool is_naturally_ordered_ = false;
+  bool is_append_only_ = false;
+
+  // Only used if |is_append_only_|. Extended by queries as rows are added.
+  mutable AppendOnlyIndex<T> append_only_index_;
 };
 
+// A column of ids into a list of strings. Empty strings are reported as NULL.
 template <typename Id>
 class StringColumn final : public StorageColumn {
  public:
   StringColumn(std::string col_name,
-               const std::deque<Id>* deque,
+               const ChunkedVector<Id>* vector,
                const std::deque<std::string>* string_map,
                bool hidden = false)
       : StorageColumn(col_name, hidden),
-        deque_(deque),
+        vector_(vector),
         string_map_(string_map) {}
 
+  // Creates a column of ids into the string pool of |storage|. Equality and
+  // null constraints on this column are resolved by looking up the string
+  // compared against in the string index and comparing ids.
+  StringColumn(std::string col_name,
+               const ChunkedVector<Id>* vector,
+               const TraceStorage* storage)
+      : StorageColumn(col_name, false /* hidden */),
+        vector_(vector),
+        storage_(storage) {}
+
   void ReportResult(sqlite3_context* ctx, uint32_t row) const override {
-    const auto& str = (*string_map_)[(*deque_)[row]];
+    base::StringView str = GetStringView((*vector_)[row]);
     if (str.empty()) {
       sqlite3_result_null(ctx);
     } else {
-      sqlite3_result_text(ctx, str.c_str(), -1, sqlite_utils::kSqliteStatic);
+      sqlite3_result_text(ctx, str.data(), -1, sqlite_utils::kSqliteStatic);
     }
   }
 
   Bounds BoundFilter(int, sqlite3_value*) const override {
     Bounds bounds;
-    bounds.max_idx = static_cast<uint32_t>(deque_->size());
+    bounds.max_idx = static_cast<uint32_t>(vector_->size());
     return bounds;
   }
 
-  void Filter(int, sqlite3_value*, FilteredRowIndex*) const override {}
+  void Filter(int op,
+              sqlite3_value* value,
+              FilteredRowIndex* index) const override {
+    if (!IsFilterSupported(op))
+      return;
+
+    // Comparing with NULL using IS and IS NOT is the same as checking for
+    // (non) NULL values.
+    if (op == SQLITE_INDEX_CONSTRAINT_IS ||
+        op == SQLITE_INDEX_CONSTRAINT_ISNOT) {
+      if (sqlite3_value_type(value) == SQLITE_NULL) {
+        op = op == SQLITE_INDEX_CONSTRAINT_IS
+                 ? SQLITE_INDEX_CONSTRAINT_ISNULL
+                 : SQLITE_INDEX_CONSTRAINT_ISNOTNULL;
+      }
+    }
+
+    if (storage_ != nullptr && FilterWithStringIndex(op, value, index))
+      return;
+
+    FilterDistinctStrings(sqlite_utils::CreateStringPredicate(op, value),
+                          index);
+  }
+
+  bool IsFilterSupported(int op) const override {
+    switch (op) {
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+      case SQLITE_INDEX_CONSTRAINT_NE:
+      case SQLITE_INDEX_CONSTRAINT_IS:
+      case SQLITE_INDEX_CONSTRAINT_ISNOT:
+      case SQLITE_INDEX_CONSTRAINT_GE:
+      case SQLITE_INDEX_CONSTRAINT_GT:
+      case SQLITE_INDEX_CONSTRAINT_LE:
+      case SQLITE_INDEX_CONSTRAINT_LT:
+      case SQLITE_INDEX_CONSTRAINT_LIKE:
+      case SQLITE_INDEX_CONSTRAINT_GLOB:
+      case SQLITE_INDEX_CONSTRAINT_ISNULL:
+      case SQLITE_INDEX_CONSTRAINT_ISNOTNULL:
+        return true;
+    }
+    return false;
+  }
 
   Comparator Sort(const QueryConstraints::OrderBy& ob) const override {
     if (ob.desc) {
       return [this](uint32_t f, uint32_t s) {
-        const std::string& a = (*string_map_)[(*deque_)[f]];
-        const std::string& b = (*string_map_)[(*deque_)[s]];
+        base::StringView a = GetStringView((*vector_)[f]);
+        base::StringView b = GetStringView((*vector_)[s]);
         return sqlite_utils::CompareValuesDesc(a, b);
       };
     }
     return [this](uint32_t f, uint32_t s) {
-      const std::string& a = (*string_map_)[(*deque_)[f]];
-      const std::string& b = (*string_map_)[(*deque_)[s]];
+      base::StringView a = GetStringView((*vector_)[f]);
+      base::StringView b = GetStringView((*vector_)[s]);
       return sqlite_utils::CompareValuesAsc(a, b);
     };
   }
@@ -257,17 +456,128 @@ class StringColumn final : public StorageColumn {
   bool IsNaturallyOrdered() const override { return false; }
 
  private:
-  const std::deque<Id>* deque_ = nullptr;
+  // Id of the empty string which is reported as NULL.
+  static constexpr Id kNullId = static_cast<Id>(0);
+
+  // Returns the string with id |id|, which is always null terminated.
+  base::StringView GetStringView(Id id) const {
+    if (storage_ != nullptr)
+      return storage_->GetString(static_cast<StringId>(id));
+    const std::string& str = (*string_map_)[id];
+    return base::StringView(str);
+  }
+
+  size_t string_count() const {
+    return storage_ != nullptr ? storage_->string_count()
+                               : string_map_->size();
+  }
+
+  // Tries to filter |op| by comparing the ids in the column with the id of
+  // the string in |value|. Returns false if the constraint needs to be
+  // handled by comparing strings instead.
+  bool FilterWithStringIndex(int op,
+                             sqlite3_value* value,
+                             FilteredRowIndex* index) const {
+    switch (op) {
+      case SQLITE_INDEX_CONSTRAINT_ISNULL:
+        index->FilterColumn(*vector_, kNullId, std::equal_to<Id>());
+        return true;
+      case SQLITE_INDEX_CONSTRAINT_ISNOTNULL:
+        index->FilterColumn(*vector_, kNullId, std::not_equal_to<Id>());
+        return true;
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+      case SQLITE_INDEX_CONSTRAINT_IS:
+      case SQLITE_INDEX_CONSTRAINT_NE:
+      case SQLITE_INDEX_CONSTRAINT_ISNOT:
+        break;
+      default:
+        return false;
+    }
+
+    if (sqlite3_value_type(value) != SQLITE_TEXT)
+      return false;
+    const char* str = reinterpret_cast<const char*>(sqlite3_value_text(value));
+    base::StringView str_view(str,
+                              static_cast<size_t>(sqlite3_value_bytes(value)));
+
+    // The empty string has an id (kNullId) but is reported as NULL so leave
+    // this edge case to the string comparisons.
+    if (str_view.empty())
+      return false;
+
+    auto opt_id = storage_->GetStringId(str_view);
+    switch (op) {
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+      case SQLITE_INDEX_CONSTRAINT_IS:
+        if (!opt_id.has_value()) {
+          index->IntersectRows({});
+          return true;
+        }
+        index->FilterColumn(*vector_, static_cast<Id>(*opt_id),
+                            std::equal_to<Id>());
+        return true;
+      case SQLITE_INDEX_CONSTRAINT_NE:
+        // Unlike IS NOT, != is false for NULL values.
+        index->FilterColumn(*vector_, kNullId, std::not_equal_to<Id>());
+        if (opt_id.has_value()) {
+          index->FilterColumn(*vector_, static_cast<Id>(*opt_id),
+                              std::not_equal_to<Id>());
+        }
+        return true;
+      case SQLITE_INDEX_CONSTRAINT_ISNOT:
+        if (opt_id.has_value()) {
+          index->FilterColumn(*vector_, static_cast<Id>(*opt_id),
+                              std::not_equal_to<Id>());
+        }
+        return true;
+    }
+    PERFETTO_FATAL("For GCC");
+  }
+
+  // Filters the rows using |predicate|, calling it at most once for each
+  // distinct id in the column: as strings are interned, the result of the
+  // comparison only depends on the id. This makes GLOB and LIKE constraints
+  // cost one pattern match per distinct string rather than one per row.
+  void FilterDistinctStrings(std::function<bool(const char*)> predicate,
+                             FilteredRowIndex* index) const {
+    uint32_t count = static_cast<uint32_t>(string_count());
+    BitVector evaluated(count, false);
+    BitVector matches(count, false);
+    index->FilterRows([this, &predicate, &evaluated, &matches](uint32_t row) {
+      auto id = static_cast<uint32_t>((*vector_)[row]);
+      if (!evaluated.IsSet(id)) {
+        evaluated.Set(id);
+        base::StringView str = GetStringView(static_cast<Id>(id));
+        if (predicate(str.empty() ? nullptr : str.data()))
+          matches.Set(id);
+      }
+      return matches.IsSet(id);
+    });
+  }
+
+  const ChunkedVector<Id>* vector_ = nullptr;
+
+  // Exactly one of these is set: the list of strings indexed by id or the
+  // storage, for columns of ids into its string pool.
   const std::deque<std::string>* string_map_ = nullptr;
+  const TraceStorage* storage_ = nullptr;
 };
 
+template <typename Id>
+constexpr Id StringColumn<Id>::kNullId;
+
 // Column which represents the "ts_end" column present in all time based
-// tables. It is computed by adding together the values in two deques.
+// tables. It is computed by adding together the values in two columns.
+//
+// If |end_index| is set and up to date, lower bound constraints are resolved
+// with the index: combined with the bound of an upper bound constraint on the
+// ts column, this only reads the rows overlapping the timestamp.
 class TsEndColumn final : public StorageColumn {
  public:
   TsEndColumn(std::string col_name,
-              const std::deque<int64_t>* ts_start,
-              const std::deque<int64_t>* dur);
+              const ChunkedVector<int64_t>* ts_start,
+              const ChunkedVector<int64_t>* dur,
+              const IntervalIndex* end_index = nullptr);
   virtual ~TsEndColumn() override;
 
   void ReportResult(sqlite3_context*, uint32_t) const override;
@@ -286,8 +596,9 @@ class TsEndColumn final : public StorageColumn {
   bool IsNaturallyOrdered() const override { return false; }
 
  private:
-  const std::deque<int64_t>* ts_start_;
-  const std::deque<int64_t>* dur_;
+  const ChunkedVector<int64_t>* ts_start_;
+  const ChunkedVector<int64_t>* dur_;
+  const IntervalIndex* end_index_;
 };
 
 // Column which is used to reference the args table in other tables. That is,
@@ -302,7 +613,7 @@ class IdColumn final : public StorageColumn {
     sqlite_utils::ReportSqliteResult(ctx, id);
   }
 
-  Bounds BoundFilter(int, sqlite3_value*) const override { return Bounds{}; }
+  Bounds BoundFilter(int op, sqlite3_value* value) const override;
 
   void Filter(int op,
               sqlite3_value* value,
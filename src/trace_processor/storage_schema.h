@@ -45,16 +45,28 @@ class StorageSchema {
     template <class T>
     Builder& AddNumericColumn(
         std::string column_name,
-        const std::deque<T>* vals,
+        const ChunkedVector<T>* vals,
         const std::deque<std::vector<uint32_t>>* index = nullptr) {
       columns_.emplace_back(
           new NumericColumn<T>(column_name, vals, index, false, false));
       return *this;
     }
 
+    // Adds a numeric column whose values never change once added to |vals|,
+    // which allows the column to keep indexes across queries.
+    template <class T>
+    Builder& AddAppendOnlyNumericColumn(
+        std::string column_name,
+        const ChunkedVector<T>* vals,
+        const std::deque<std::vector<uint32_t>>* index = nullptr) {
+      columns_.emplace_back(
+          new NumericColumn<T>(column_name, vals, index, false, false, true));
+      return *this;
+    }
+
     template <class T>
     Builder& AddOrderedNumericColumn(std::string column_name,
-                                     const std::deque<T>* vals) {
+                                     const ChunkedVector<T>* vals) {
       columns_.emplace_back(
           new NumericColumn<T>(column_name, vals, nullptr, false, true));
       return *this;
@@ -62,12 +74,21 @@ class StorageSchema {
 
     template <class Id>
     Builder& AddStringColumn(std::string column_name,
-                             const std::deque<Id>* ids,
+                             const ChunkedVector<Id>* ids,
                              const std::deque<std::string>* string_map) {
       columns_.emplace_back(new StringColumn<Id>(column_name, ids, string_map));
       return *this;
     }
 
+    // Adds a column of ids into the string pool of |storage|.
+    Builder& AddStringColumn(std::string column_name,
+                             const ChunkedVector<StringId>* ids,
+                             const TraceStorage* storage) {
+      columns_.emplace_back(
+          new StringColumn<StringId>(column_name, ids, storage));
+      return *this;
+    }
+
     StorageSchema Build(std::vector<std::string> primary_keys) {
       return StorageSchema(std::move(columns_), std::move(primary_keys));
     }
@@ -85,6 +106,8 @@ class StorageSchema {
 
   const StorageColumn& GetColumn(size_t idx) const { return *(columns_[idx]); }
 
+  size_t num_columns() const { return columns_.size(); }
+
   Columns* mutable_columns() { return &columns_; }
 
  private:
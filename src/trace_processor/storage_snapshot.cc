@@ -0,0 +1,804 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage_snapshot.h"
+
+#include <string.h>
+
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "perfetto/base/file_utils.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/base/string_view.h"
+#include "perfetto/base/utils.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'P', 'S', 'N', 'A', 'P', 'S', 'H'};
+
+// All the sections of the file are padded to this alignment.
+constexpr size_t kAlignment = 8;
+
+// Stored in place of a null upid/pupid.
+constexpr uint32_t kNullUpid = std::numeric_limits<uint32_t>::max();
+
+size_t PaddedSize(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+// Buffers the snapshot and writes it out in large blocks.
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(int fd) : fd_(fd) { buf_.reserve(kBufferSize); }
+
+  void WriteBytes(const void* data, size_t size) {
+    const uint8_t* ptr = static_cast<const uint8_t*>(data);
+    buf_.insert(buf_.end(), ptr, ptr + size);
+    written_ += size;
+    if (buf_.size() >= kBufferSize)
+      Flush();
+  }
+
+  void WritePadding() {
+    static const uint8_t kZeros[kAlignment] = {};
+    WriteBytes(kZeros, PaddedSize(written_) - written_);
+  }
+
+  void WriteCount(size_t count) {
+    uint64_t value = count;
+    WriteBytes(&value, sizeof(value));
+  }
+
+  template <typename T>
+  void WriteColumn(const ChunkedVector<T>& column) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Columns must be trivially copyable");
+    for (size_t i = 0; i < column.chunk_count(); i++)
+      WriteBytes(column.chunk_data(i), column.chunk_size(i) * sizeof(T));
+    WritePadding();
+  }
+
+  // Writes a column of |rows| values computed by |fn|, for the columns which
+  // are not stored as a ChunkedVector or need to be converted.
+  template <typename T, typename Fn>
+  void WriteColumn(size_t rows, Fn fn) {
+    for (size_t i = 0; i < rows; i++) {
+      T value = fn(i);
+      WriteBytes(&value, sizeof(value));
+    }
+    WritePadding();
+  }
+
+  // Writes |count| strings returned by |fn| as a column of lengths followed by
+  // their concatenated contents.
+  template <typename Fn>
+  void WriteStrings(size_t count, Fn fn) {
+    WriteCount(count);
+    WriteColumn<uint32_t>(
+        count, [&fn](size_t i) { return static_cast<uint32_t>(fn(i).size()); });
+    for (size_t i = 0; i < count; i++) {
+      base::StringView str = fn(i);
+      WriteBytes(str.data(), str.size());
+    }
+    WritePadding();
+  }
+
+  bool Flush() {
+    if (ok_ && !buf_.empty()) {
+      ok_ = base::WriteAll(fd_, buf_.data(), buf_.size()) ==
+            static_cast<ssize_t>(buf_.size());
+    }
+    buf_.clear();
+    return ok_;
+  }
+
+ private:
+  static constexpr size_t kBufferSize = 1024 * 1024;
+
+  const int fd_;
+  std::vector<uint8_t> buf_;
+  size_t written_ = 0;
+  bool ok_ = true;
+};
+
+// A column of a snapshot, read in place. Values are copied out with memcpy()
+// so that the snapshot does not need to be aligned.
+template <typename T>
+class SnapshotColumn {
+ public:
+  SnapshotColumn() = default;
+  explicit SnapshotColumn(const uint8_t* data) : data_(data) {}
+
+  T operator[](size_t row) const {
+    T value;
+    memcpy(&value, data_ + row * sizeof(T), sizeof(T));
+    return value;
+  }
+
+ private:
+  const uint8_t* data_ = nullptr;
+};
+
+class SnapshotReader {
+ public:
+  SnapshotReader(const uint8_t* data, size_t size)
+      : ptr_(data), end_(data + size) {}
+
+  const uint8_t* ReadBytes(size_t size) {
+    size_t padded = PaddedSize(size);
+    if (padded < size || padded > static_cast<size_t>(end_ - ptr_))
+      return nullptr;
+    const uint8_t* data = ptr_;
+    ptr_ += padded;
+    return data;
+  }
+
+  bool ReadCount(size_t* count) {
+    const uint8_t* data = ReadBytes(sizeof(uint64_t));
+    if (!data)
+      return false;
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    if (value > std::numeric_limits<uint32_t>::max())
+      return false;
+    *count = static_cast<size_t>(value);
+    return true;
+  }
+
+  template <typename T>
+  bool ReadColumn(size_t rows, SnapshotColumn<T>* column) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Columns must be trivially copyable");
+    const uint8_t* data = ReadBytes(rows * sizeof(T));
+    if (!data)
+      return false;
+    *column = SnapshotColumn<T>(data);
+    return true;
+  }
+
+  // Reads strings written by SnapshotWriter::WriteStrings() and passes them
+  // to |fn| in order. Stops and returns false if |fn| returns false.
+  template <typename Fn>
+  bool ReadStrings(Fn fn) {
+    size_t count = 0;
+    SnapshotColumn<uint32_t> lengths;
+    if (!ReadCount(&count) || !ReadColumn(count, &lengths))
+      return false;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++)
+      total += lengths[i];
+    const uint8_t* data = ReadBytes(total);
+    if (!data)
+      return false;
+    const char* str = reinterpret_cast<const char*>(data);
+    for (size_t i = 0; i < count; i++) {
+      if (!fn(i, base::StringView(str, lengths[i])))
+        return false;
+      str += lengths[i];
+    }
+    return true;
+  }
+
+ private:
+  const uint8_t* ptr_;
+  const uint8_t* const end_;
+};
+
+uint32_t UpidOrNull(const base::Optional<UniquePid>& upid) {
+  return upid ? *upid : kNullUpid;
+}
+
+base::Optional<UniquePid> UpidFromColumn(uint32_t upid) {
+  if (upid == kNullUpid)
+    return base::nullopt;
+  return upid;
+}
+
+// The ids read from a snapshot index the string pool and the process and
+// thread tables, so they are checked before being stored: a corrupted
+// snapshot must be rejected rather than read out of bounds later.
+template <typename T>
+bool IdsBelow(const SnapshotColumn<T>& ids, size_t rows, size_t limit) {
+  for (size_t i = 0; i < rows; i++) {
+    if (ids[i] >= limit)
+      return false;
+  }
+  return true;
+}
+
+bool UpidsBelow(const SnapshotColumn<uint32_t>& upids,
+                size_t rows,
+                size_t limit) {
+  for (size_t i = 0; i < rows; i++) {
+    if (upids[i] != kNullUpid && upids[i] >= limit)
+      return false;
+  }
+  return true;
+}
+
+// The end states are reported through a table of strings indexed by their raw
+// value.
+bool EndStatesInRange(const SnapshotColumn<ftrace_utils::TaskState>& states,
+                      size_t rows) {
+  for (size_t i = 0; i < rows; i++) {
+    ftrace_utils::TaskState state = states[i];
+    if (state.is_valid() &&
+        state.raw_state() > ftrace_utils::TaskState::kMaxState) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RefInRange(const TraceStorage& storage, int64_t ref, uint32_t type) {
+  switch (type) {
+    case RefType::kRefUtid:
+    case RefType::kRefUtidLookupUpid:
+      return ref >= 0 && static_cast<uint64_t>(ref) < storage.thread_count();
+    case RefType::kRefUpid:
+      return ref >= 0 && static_cast<uint64_t>(ref) < storage.process_count();
+  }
+  return true;
+}
+
+// The value of an arg is stored as its type and its 64 bits payload.
+uint64_t ArgPayload(const TraceStorage::Args::Variadic& value) {
+  using Variadic = TraceStorage::Args::Variadic;
+  uint64_t payload = 0;
+  switch (value.type) {
+    case Variadic::Type::kInt:
+      memcpy(&payload, &value.int_value, sizeof(value.int_value));
+      break;
+    case Variadic::Type::kString:
+      payload = value.string_value;
+      break;
+    case Variadic::Type::kReal:
+      memcpy(&payload, &value.real_value, sizeof(value.real_value));
+      break;
+  }
+  return payload;
+}
+
+bool ArgFromPayload(uint8_t type,
+                    uint64_t payload,
+                    TraceStorage::Args::Variadic* value) {
+  using Variadic = TraceStorage::Args::Variadic;
+  switch (type) {
+    case Variadic::Type::kInt: {
+      int64_t int_value;
+      memcpy(&int_value, &payload, sizeof(int_value));
+      *value = Variadic::Integer(int_value);
+      return true;
+    }
+    case Variadic::Type::kString:
+      *value = Variadic::String(static_cast<StringId>(payload));
+      return true;
+    case Variadic::Type::kReal: {
+      double real_value;
+      memcpy(&real_value, &payload, sizeof(real_value));
+      *value = Variadic::Real(real_value);
+      return true;
+    }
+  }
+  return false;
+}
+
+const TraceStorage::Process& ProcessAt(const TraceStorage& storage,
+                                      size_t row) {
+  return storage.GetProcess(static_cast<UniquePid>(row));
+}
+
+const TraceStorage::Thread& ThreadAt(const TraceStorage& storage, size_t row) {
+  return storage.GetThread(static_cast<UniqueTid>(row));
+}
+
+void WriteProcesses(const TraceStorage& storage, SnapshotWriter* writer) {
+  size_t rows = storage.process_count();
+  writer->WriteCount(rows);
+  writer->WriteColumn<int64_t>(
+      rows, [&storage](size_t i) { return ProcessAt(storage, i).start_ns; });
+  writer->WriteColumn<int64_t>(
+      rows, [&storage](size_t i) { return ProcessAt(storage, i).end_ns; });
+  writer->WriteColumn<StringId>(
+      rows, [&storage](size_t i) { return ProcessAt(storage, i).name_id; });
+  writer->WriteColumn<uint32_t>(
+      rows, [&storage](size_t i) { return ProcessAt(storage, i).pid; });
+  writer->WriteColumn<uint32_t>(rows, [&storage](size_t i) {
+    return UpidOrNull(ProcessAt(storage, i).pupid);
+  });
+}
+
+bool ReadProcesses(SnapshotReader* reader, TraceStorage* storage) {
+  size_t rows = 0;
+  SnapshotColumn<int64_t> start_ns;
+  SnapshotColumn<int64_t> end_ns;
+  SnapshotColumn<StringId> name_ids;
+  SnapshotColumn<uint32_t> pids;
+  SnapshotColumn<uint32_t> pupids;
+  if (!reader->ReadCount(&rows) || !reader->ReadColumn(rows, &start_ns) ||
+      !reader->ReadColumn(rows, &end_ns) ||
+      !reader->ReadColumn(rows, &name_ids) ||
+      !reader->ReadColumn(rows, &pids) ||
+      !reader->ReadColumn(rows, &pupids)) {
+    return false;
+  }
+  size_t strings = storage->string_pool().size();
+  if (!IdsBelow(name_ids, rows, strings) || !UpidsBelow(pupids, rows, rows))
+    return false;
+  for (size_t i = 0; i < rows; i++) {
+    // Upid 0 always exists.
+    UniquePid upid = i == 0 ? 0 : storage->AddEmptyProcess(pids[i]);
+    TraceStorage::Process* process = storage->GetMutableProcess(upid);
+    process->start_ns = start_ns[i];
+    process->end_ns = end_ns[i];
+    process->name_id = name_ids[i];
+    process->pid = pids[i];
+    process->pupid = UpidFromColumn(pupids[i]);
+  }
+  return true;
+}
+
+void WriteThreads(const TraceStorage& storage, SnapshotWriter* writer) {
+  size_t rows = storage.thread_count();
+  writer->WriteCount(rows);
+  writer->WriteColumn<int64_t>(
+      rows, [&storage](size_t i) { return ThreadAt(storage, i).start_ns; });
+  writer->WriteColumn<int64_t>(
+      rows, [&storage](size_t i) { return ThreadAt(storage, i).end_ns; });
+  writer->WriteColumn<StringId>(
+      rows, [&storage](size_t i) { return ThreadAt(storage, i).name_id; });
+  writer->WriteColumn<uint32_t>(rows, [&storage](size_t i) {
+    return UpidOrNull(ThreadAt(storage, i).upid);
+  });
+  writer->WriteColumn<uint32_t>(
+      rows, [&storage](size_t i) { return ThreadAt(storage, i).tid; });
+}
+
+bool ReadThreads(SnapshotReader* reader, TraceStorage* storage) {
+  size_t rows = 0;
+  SnapshotColumn<int64_t> start_ns;
+  SnapshotColumn<int64_t> end_ns;
+  SnapshotColumn<StringId> name_ids;
+  SnapshotColumn<uint32_t> upids;
+  SnapshotColumn<uint32_t> tids;
+  if (!reader->ReadCount(&rows) || !reader->ReadColumn(rows, &start_ns) ||
+      !reader->ReadColumn(rows, &end_ns) ||
+      !reader->ReadColumn(rows, &name_ids) ||
+      !reader->ReadColumn(rows, &upids) || !reader->ReadColumn(rows, &tids)) {
+    return false;
+  }
+  if (!IdsBelow(name_ids, rows, storage->string_pool().size()) ||
+      !UpidsBelow(upids, rows, storage->process_count())) {
+    return false;
+  }
+  for (size_t i = 0; i < rows; i++) {
+    // Utid 0 always exists.
+    UniqueTid utid = i == 0 ? 0 : storage->AddEmptyThread(tids[i]);
+    TraceStorage::Thread* thread = storage->GetMutableThread(utid);
+    thread->start_ns = start_ns[i];
+    thread->end_ns = end_ns[i];
+    thread->name_id = name_ids[i];
+    thread->upid = UpidFromColumn(upids[i]);
+    thread->tid = tids[i];
+  }
+  return true;
+}
+
+void WriteSlices(const TraceStorage::Slices& slices, SnapshotWriter* writer) {
+  writer->WriteCount(slices.slice_count());
+  writer->WriteColumn(slices.cpus());
+  writer->WriteColumn(slices.start_ns());
+  writer->WriteColumn(slices.durations());
+  writer->WriteColumn(slices.utids());
+  writer->WriteColumn(slices.end_state());
+  writer->WriteColumn(slices.priorities());
+}
+
+bool ReadSlices(SnapshotReader* reader, TraceStorage* storage) {
+  size_t rows = 0;
+  SnapshotColumn<uint32_t> cpus;
+  SnapshotColumn<int64_t> start_ns;
+  SnapshotColumn<int64_t> durations;
+  SnapshotColumn<UniqueTid> utids;
+  SnapshotColumn<ftrace_utils::TaskState> end_states;
+  SnapshotColumn<int32_t> priorities;
+  if (!reader->ReadCount(&rows) || !reader->ReadColumn(rows, &cpus) ||
+      !reader->ReadColumn(rows, &start_ns) ||
+      !reader->ReadColumn(rows, &durations) ||
+      !reader->ReadColumn(rows, &utids) ||
+      !reader->ReadColumn(rows, &end_states) ||
+      !reader->ReadColumn(rows, &priorities)) {
+    return false;
+  }
+  if (!IdsBelow(utids, rows, storage->thread_count()) ||
+      !IdsBelow(cpus, rows, base::kMaxCpus) ||
+      !EndStatesInRange(end_states, rows)) {
+    return false;
+  }
+  TraceStorage::Slices* slices = storage->mutable_slices();
+  for (size_t i = 0; i < rows; i++) {
+    slices->AddSlice(cpus[i], start_ns[i], durations[i], utids[i],
+                     end_states[i], priorities[i]);
+  }
+  return true;
+}
+
+void WriteNestableSlices(const TraceStorage::NestableSlices& slices,
+                         SnapshotWriter* writer) {
+  writer->WriteCount(slices.slice_count());
+  writer->WriteColumn(slices.start_ns());
+  writer->WriteColumn(slices.durations());
+  writer->WriteColumn(slices.utids());
+  writer->WriteColumn(slices.cats());
+  writer->WriteColumn(slices.names());
+  writer->WriteColumn(slices.depths());
+  writer->WriteColumn(slices.stack_ids());
+  writer->WriteColumn(slices.parent_stack_ids());
+}
+
+bool ReadNestableSlices(SnapshotReader* reader, TraceStorage* storage) {
+  size_t rows = 0;
+  SnapshotColumn<int64_t> start_ns;
+  SnapshotColumn<int64_t> durations;
+  SnapshotColumn<UniqueTid> utids;
+  SnapshotColumn<StringId> cats;
+  SnapshotColumn<StringId> names;
+  SnapshotColumn<uint8_t> depths;
+  SnapshotColumn<int64_t> stack_ids;
+  SnapshotColumn<int64_t> parent_stack_ids;
+  if (!reader->ReadCount(&rows) || !reader->ReadColumn(rows, &start_ns) ||
+      !reader->ReadColumn(rows, &durations) ||
+      !reader->ReadColumn(rows, &utids) || !reader->ReadColumn(rows, &cats) ||
+      !reader->ReadColumn(rows, &names) || !reader->ReadColumn(rows, &depths) ||
+      !reader->ReadColumn(rows, &stack_ids) ||
+      !reader->ReadColumn(rows, &parent_stack_ids)) {
+    return false;
+  }
+  size_t strings = storage->string_pool().size();
+  if (!IdsBelow(utids, rows, storage->thread_count()) ||
+      !IdsBelow(cats, rows, strings) || !IdsBelow(names, rows, strings)) {
+    return false;
+  }
+  TraceStorage::NestableSlices* slices = storage->mutable_nestable_slices();
+  for (size_t i = 0; i < rows; i++) {
+    slices->AddSlice(start_ns[i], durations[i], utids[i], cats[i], names[i],
+                     depths[i], stack_ids[i], parent_stack_ids[i]);
+  }
+  return true;
+}
+
+// Counters and Instants have the same columns.
+template <typename Table>
+void WriteCounterLikeTable(const Table& table,
+                           size_t rows,
+                           SnapshotWriter* writer) {
+  writer->WriteCount(rows);
+  writer->WriteColumn(table.timestamps());
+  writer->WriteColumn(table.name_ids());
+  writer->WriteColumn(table.values());
+  writer->WriteColumn(table.refs());
+  writer->WriteColumn<uint32_t>(rows, [&table](size_t i) {
+    return static_cast<uint32_t>(table.types()[i]);
+  });
+  writer->WriteColumn(table.arg_set_ids());
+}
+
+template <typename Table, typename AddFn>
+bool ReadCounterLikeTable(SnapshotReader* reader,
+                          const TraceStorage& storage,
+                          Table* table,
+                          AddFn add_fn) {
+  size_t rows = 0;
+  SnapshotColumn<int64_t> timestamps;
+  SnapshotColumn<StringId> name_ids;
+  SnapshotColumn<double> values;
+  SnapshotColumn<int64_t> refs;
+  SnapshotColumn<uint32_t> types;
+  SnapshotColumn<ArgSetId> arg_set_ids;
+  if (!reader->ReadCount(&rows) || !reader->ReadColumn(rows, &timestamps) ||
+      !reader->ReadColumn(rows, &name_ids) ||
+      !reader->ReadColumn(rows, &values) || !reader->ReadColumn(rows, &refs) ||
+      !reader->ReadColumn(rows, &types) ||
+      !reader->ReadColumn(rows, &arg_set_ids)) {
+    return false;
+  }
+  if (!IdsBelow(name_ids, rows, storage.string_pool().size()))
+    return false;
+  for (size_t i = 0; i < rows; i++) {
+    if (types[i] >= RefType::kRefMax ||
+        !RefInRange(storage, refs[i], types[i])) {
+      return false;
+    }
+    size_t row = add_fn(table, timestamps[i], name_ids[i], values[i], refs[i],
+                        static_cast<RefType>(types[i]));
+    table->set_arg_set_id(static_cast<uint32_t>(row), arg_set_ids[i]);
+  }
+  return true;
+}
+
+void WriteRawEvents(const TraceStorage::RawEvents& raw,
+                    SnapshotWriter* writer) {
+  writer->WriteCount(raw.raw_event_count());
+  writer->WriteColumn(raw.timestamps());
+  writer->WriteColumn(raw.name_ids());
+  writer->WriteColumn(raw.cpus());
+  writer->WriteColumn(raw.utids());
+  writer->WriteColumn(raw.arg_set_ids());
+}
+
+bool ReadRawEvents(SnapshotReader* reader, TraceStorage* storage) {
+  size_t rows = 0;
+  SnapshotColumn<int64_t> timestamps;
+  SnapshotColumn<StringId> name_ids;
+  SnapshotColumn<uint32_t> cpus;
+  SnapshotColumn<UniqueTid> utids;
+  SnapshotColumn<ArgSetId> arg_set_ids;
+  if (!reader->ReadCount(&rows) || !reader->ReadColumn(rows, &timestamps) ||
+      !reader->ReadColumn(rows, &name_ids) ||
+      !reader->ReadColumn(rows, &cpus) ||
+      !reader->ReadColumn(rows, &utids) ||
+      !reader->ReadColumn(rows, &arg_set_ids)) {
+    return false;
+  }
+  if (!IdsBelow(name_ids, rows, storage->string_pool().size()) ||
+      !IdsBelow(utids, rows, storage->thread_count()) ||
+      !IdsBelow(cpus, rows, base::kMaxCpus)) {
+    return false;
+  }
+  TraceStorage::RawEvents* raw = storage->mutable_raw_events();
+  for (size_t i = 0; i < rows; i++) {
+    raw->AddRawEvent(timestamps[i], name_ids[i], cpus[i], utids[i]);
+    raw->set_arg_set_id(static_cast<uint32_t>(i), arg_set_ids[i]);
+  }
+  return true;
+}
+
+void WriteAndroidLogs(const TraceStorage::AndroidLogs& logs,
+                      SnapshotWriter* writer) {
+  writer->WriteCount(logs.size());
+  writer->WriteColumn(logs.timestamps());
+  writer->WriteColumn(logs.utids());
+  writer->WriteColumn(logs.prios());
+  writer->WriteColumn(logs.tag_ids());
+  writer->WriteColumn(logs.msg_ids());
+}
+
+bool ReadAndroidLogs(SnapshotReader* reader, TraceStorage* storage) {
+  size_t rows = 0;
+  SnapshotColumn<int64_t> timestamps;
+  SnapshotColumn<UniqueTid> utids;
+  SnapshotColumn<uint8_t> prios;
+  SnapshotColumn<StringId> tag_ids;
+  SnapshotColumn<StringId> msg_ids;
+  if (!reader->ReadCount(&rows) || !reader->ReadColumn(rows, &timestamps) ||
+      !reader->ReadColumn(rows, &utids) || !reader->ReadColumn(rows, &prios) ||
+      !reader->ReadColumn(rows, &tag_ids) ||
+      !reader->ReadColumn(rows, &msg_ids)) {
+    return false;
+  }
+  size_t strings = storage->string_pool().size();
+  if (!IdsBelow(utids, rows, storage->thread_count()) ||
+      !IdsBelow(tag_ids, rows, strings) || !IdsBelow(msg_ids, rows, strings)) {
+    return false;
+  }
+  TraceStorage::AndroidLogs* logs = storage->mutable_android_log();
+  for (size_t i = 0; i < rows; i++) {
+    logs->AddLogEvent(timestamps[i], utids[i], prios[i], tag_ids[i],
+                      msg_ids[i]);
+  }
+  return true;
+}
+
+void WriteArgs(const TraceStorage::Args& args, SnapshotWriter* writer) {
+  size_t rows = args.args_count();
+  writer->WriteCount(rows);
+  // The args are stored by set, so their columns are read row by row.
+  writer->WriteColumn<ArgSetId>(rows, [&args](size_t i) {
+    return args.set_id(static_cast<uint32_t>(i));
+  });
+  writer->WriteColumn<StringId>(rows, [&args](size_t i) {
+    return args.flat_key(static_cast<uint32_t>(i));
+  });
+  writer->WriteColumn<StringId>(rows, [&args](size_t i) {
+    return args.key(static_cast<uint32_t>(i));
+  });
+  writer->WriteColumn<uint8_t>(rows, [&args](size_t i) {
+    return static_cast<uint8_t>(args.arg_value(static_cast<uint32_t>(i)).type);
+  });
+  writer->WriteColumn<uint64_t>(rows, [&args](size_t i) {
+    return ArgPayload(args.arg_value(static_cast<uint32_t>(i)));
+  });
+}
+
+// The rows of each arg set are contiguous and the sets are numbered in order,
+// so adding the sets one by one recreates the same set ids.
+bool ReadArgs(SnapshotReader* reader, TraceStorage* storage) {
+  size_t rows = 0;
+  SnapshotColumn<ArgSetId> set_ids;
+  SnapshotColumn<StringId> flat_keys;
+  SnapshotColumn<StringId> keys;
+  SnapshotColumn<uint8_t> types;
+  SnapshotColumn<uint64_t> payloads;
+  if (!reader->ReadCount(&rows) || !reader->ReadColumn(rows, &set_ids) ||
+      !reader->ReadColumn(rows, &flat_keys) ||
+      !reader->ReadColumn(rows, &keys) || !reader->ReadColumn(rows, &types) ||
+      !reader->ReadColumn(rows, &payloads)) {
+    return false;
+  }
+  size_t strings = storage->string_pool().size();
+  if (!IdsBelow(flat_keys, rows, strings) || !IdsBelow(keys, rows, strings))
+    return false;
+  TraceStorage::Args* args = storage->mutable_args();
+  std::vector<TraceStorage::Args::Arg> set;
+  for (size_t i = 0; i < rows; i++) {
+    TraceStorage::Args::Arg arg;
+    arg.flat_key = flat_keys[i];
+    arg.key = keys[i];
+    if (!ArgFromPayload(types[i], payloads[i], &arg.value))
+      return false;
+    if (arg.value.type == TraceStorage::Args::Variadic::Type::kString &&
+        arg.value.string_value >= strings) {
+      return false;
+    }
+    set.emplace_back(arg);
+    if (i + 1 < rows && set_ids[i + 1] == set_ids[i])
+      continue;
+    uint32_t size = static_cast<uint32_t>(set.size());
+    if (args->AddArgSet(set, 0, size) != set_ids[i])
+      return false;
+    set.clear();
+  }
+  return true;
+}
+
+// Stats are stored by name, as their keys change across versions.
+void WriteStats(const TraceStorage::StatsMap& stats, SnapshotWriter* writer) {
+  struct Entry {
+    size_t key;
+    int64_t index;
+    int64_t value;
+  };
+  std::vector<Entry> entries;
+  for (size_t key = 0; key < stats::kNumKeys; key++) {
+    if (stats::kTypes[key] == stats::kSingle) {
+      entries.push_back({key, 0, stats[key].value});
+      continue;
+    }
+    for (const auto& index_value : stats[key].indexed_values)
+      entries.push_back({key, index_value.first, index_value.second});
+  }
+  writer->WriteStrings(entries.size(), [&entries](size_t i) {
+    return base::StringView(stats::kNames[entries[i].key]);
+  });
+  writer->WriteColumn<int64_t>(
+      entries.size(), [&entries](size_t i) { return entries[i].index; });
+  writer->WriteColumn<int64_t>(
+      entries.size(), [&entries](size_t i) { return entries[i].value; });
+}
+
+bool ReadStats(SnapshotReader* reader, TraceStorage* storage) {
+  std::vector<size_t> keys;
+  bool res = reader->ReadStrings([&keys](size_t, base::StringView name) {
+    size_t key = 0;
+    while (key < stats::kNumKeys && name != stats::kNames[key])
+      key++;
+    keys.push_back(key);
+    return true;
+  });
+  SnapshotColumn<int64_t> indexes;
+  SnapshotColumn<int64_t> values;
+  if (!res || !reader->ReadColumn(keys.size(), &indexes) ||
+      !reader->ReadColumn(keys.size(), &values)) {
+    return false;
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    // Stats which have been removed since the snapshot was written are
+    // dropped.
+    if (keys[i] == stats::kNumKeys)
+      continue;
+    if (stats::kTypes[keys[i]] == stats::kSingle) {
+      storage->SetStats(keys[i], values[i]);
+    } else {
+      storage->SetIndexedStats(keys[i], static_cast<int>(indexes[i]),
+                               values[i]);
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool WriteStorageSnapshot(const TraceStorage& storage, int fd) {
+  SnapshotWriter writer(fd);
+  writer.WriteBytes(kMagic, sizeof(kMagic));
+  writer.WriteCount(kStorageSnapshotVersion);
+
+  const StringPool& pool = storage.string_pool();
+  writer.WriteStrings(pool.size(), [&pool](size_t i) {
+    return pool.Get(static_cast<StringId>(i));
+  });
+  WriteStats(storage.stats(), &writer);
+  WriteProcesses(storage, &writer);
+  WriteThreads(storage, &writer);
+  WriteSlices(storage.slices(), &writer);
+  WriteNestableSlices(storage.nestable_slices(), &writer);
+  WriteCounterLikeTable(storage.counters(),
+                        storage.counters().counter_count(), &writer);
+  WriteCounterLikeTable(storage.instants(),
+                        storage.instants().instant_count(), &writer);
+  WriteRawEvents(storage.raw_events(), &writer);
+  WriteAndroidLogs(storage.android_logs(), &writer);
+  WriteArgs(storage.args(), &writer);
+  return writer.Flush();
+}
+
+bool ReadStorageSnapshot(const uint8_t* data,
+                         size_t size,
+                         TraceStorage* storage) {
+  SnapshotReader reader(data, size);
+  const uint8_t* magic = reader.ReadBytes(sizeof(kMagic));
+  if (!magic || memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    PERFETTO_ELOG("Not a trace processor snapshot");
+    return false;
+  }
+  size_t version = 0;
+  if (!reader.ReadCount(&version) || version != kStorageSnapshotVersion) {
+    PERFETTO_ELOG("Unsupported snapshot version %zu (expected %u)", version,
+                  kStorageSnapshotVersion);
+    return false;
+  }
+
+  // Interning the strings in order recreates the same ids. The empty string
+  // (id 0) is always in the pool already.
+  bool res = reader.ReadStrings([storage](size_t i, base::StringView str) {
+    return i == 0 ? str.empty() : storage->InternString(str) == i;
+  });
+  res = res && ReadStats(&reader, storage);
+  res = res && ReadProcesses(&reader, storage);
+  res = res && ReadThreads(&reader, storage);
+  res = res && ReadSlices(&reader, storage);
+  res = res && ReadNestableSlices(&reader, storage);
+  res = res && ReadCounterLikeTable(
+                   &reader, *storage, storage->mutable_counters(),
+                   [](TraceStorage::Counters* counters, int64_t ts,
+                      StringId name_id, double value, int64_t ref,
+                      RefType type) {
+                     return counters->AddCounter(ts, name_id, value, ref, type);
+                   });
+  res = res && ReadCounterLikeTable(
+                   &reader, *storage, storage->mutable_instants(),
+                   [](TraceStorage::Instants* instants, int64_t ts,
+                      StringId name_id, double value, int64_t ref,
+                      RefType type) -> size_t {
+                     return instants->AddInstantEvent(ts, name_id, value, ref,
+                                                      type);
+                   });
+  res = res && ReadRawEvents(&reader, storage);
+  res = res && ReadAndroidLogs(&reader, storage);
+  res = res && ReadArgs(&reader, storage);
+  if (!res)
+    PERFETTO_ELOG("Corrupted or truncated snapshot");
+  return res;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
+#define SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceStorage;
+
+// Snapshots are a columnar dump of a parsed TraceStorage, which can be loaded
+// much faster than parsing the trace again.
+//
+// The file starts with a header (magic and version) followed by the string
+// pool and the tables, each as a row count followed by one array per column.
+// All the arrays are stored in the host byte order and padded to 8 bytes, so
+// a memory-mapped snapshot can be read in place without any decoding.
+//
+// Snapshots written by a different version of trace processor are rejected:
+// kStorageSnapshotVersion must be bumped whenever the layout changes.
+constexpr uint32_t kStorageSnapshotVersion = 1;
+
+// Writes a snapshot of |storage| to |fd|. Returns false on I/O errors.
+bool WriteStorageSnapshot(const TraceStorage& storage, int fd);
+
+// Loads the snapshot in [data, data + size) into |storage|, which must be
+// empty. Returns false if the data is not a snapshot, has a different
+// version or is truncated, in which case |storage| is left in an undefined
+// state.
+bool ReadStorageSnapshot(const uint8_t* data,
+                         size_t size,
+                         TraceStorage* storage);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STORAGE_SNAPSHOT_H_
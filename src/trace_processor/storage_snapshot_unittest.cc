@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage_snapshot.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "perfetto/base/file_utils.h"
+#include "perfetto/base/temp_file.h"
+#include "perfetto/base/utils.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/trace_storage.h"
+
+#include "perfetto/trace/trace.pb.h"
+#include "perfetto/trace/trace_packet.pb.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Variadic = TraceStorage::Args::Variadic;
+
+void PopulateStorage(TraceStorage* storage) {
+  StringId name = storage->InternString("name");
+  StringId cat = storage->InternString("cat");
+  StringId key = storage->InternString("key");
+
+  UniquePid upid = storage->AddEmptyProcess(10);
+  storage->GetMutableProcess(upid)->name_id = name;
+  storage->GetMutableProcess(upid)->start_ns = 100;
+  UniqueTid utid = storage->AddEmptyThread(11);
+  storage->GetMutableThread(utid)->upid = upid;
+  storage->GetMutableThread(utid)->name_id = name;
+
+  storage->SetStats(stats::android_log_num_failed, 3);
+  storage->SetIndexedStats(stats::ftrace_cpu_commit_overrun_begin, 1, 42);
+
+  storage->mutable_slices()->AddSlice(2, 1000, 50, utid,
+                                      ftrace_utils::TaskState("R"), 120);
+  storage->mutable_nestable_slices()->AddSlice(1000, 10, utid, cat, name, 1,
+                                               7, 5);
+  storage->mutable_counters()->AddCounter(1000, name, 1.5, 2,
+                                          RefType::kRefCpuId);
+  storage->mutable_instants()->AddInstantEvent(1010, name, 3, utid,
+                                               RefType::kRefUtid);
+  storage->mutable_raw_events()->AddRawEvent(1020, name, 1, utid);
+  storage->mutable_android_log()->AddLogEvent(1030, utid, 4, cat, name);
+
+  std::vector<TraceStorage::Args::Arg> args(3);
+  args[0].flat_key = key;
+  args[0].key = key;
+  args[0].value = Variadic::Integer(-5);
+  args[1].flat_key = key;
+  args[1].key = name;
+  args[1].value = Variadic::String(cat);
+  args[2].flat_key = cat;
+  args[2].key = cat;
+  args[2].value = Variadic::Real(0.25);
+  ArgSetId first = storage->mutable_args()->AddArgSet(args, 0, 2);
+  ArgSetId second = storage->mutable_args()->AddArgSet(args, 2, 3);
+  storage->mutable_raw_events()->set_arg_set_id(0, first);
+  storage->mutable_counters()->set_arg_set_id(0, second);
+}
+
+std::string WriteSnapshot(const TraceStorage& storage) {
+  base::TempFile file = base::TempFile::Create();
+  PERFETTO_CHECK(WriteStorageSnapshot(storage, file.fd()));
+  std::string snapshot;
+  PERFETTO_CHECK(base::ReadFile(file.path(), &snapshot));
+  return snapshot;
+}
+
+bool ReadSnapshot(const std::string& snapshot, TraceStorage* storage) {
+  return ReadStorageSnapshot(reinterpret_cast<const uint8_t*>(snapshot.data()),
+                             snapshot.size(), storage);
+}
+
+TEST(StorageSnapshotTest, RoundTrip) {
+  TraceStorage storage;
+  PopulateStorage(&storage);
+  std::string snapshot = WriteSnapshot(storage);
+  ASSERT_EQ(snapshot.size() % 8, 0u);
+
+  TraceStorage loaded;
+  ASSERT_TRUE(ReadSnapshot(snapshot, &loaded));
+
+  // Writing the loaded storage again must give back the same bytes.
+  ASSERT_EQ(WriteSnapshot(loaded), snapshot);
+
+  ASSERT_EQ(loaded.string_pool().size(), storage.string_pool().size());
+  ASSERT_EQ(loaded.GetString(loaded.GetProcess(1).name_id), "name");
+  ASSERT_EQ(loaded.GetProcess(1).pid, 10u);
+  ASSERT_FALSE(loaded.GetProcess(1).pupid.has_value());
+  ASSERT_EQ(*loaded.GetThread(1).upid, 1u);
+  ASSERT_EQ(loaded.stats()[stats::android_log_num_failed].value, 3);
+  const auto& overrun = loaded.stats()[stats::ftrace_cpu_commit_overrun_begin];
+  ASSERT_EQ(overrun.indexed_values.at(1), 42);
+
+  const auto& slices = loaded.slices();
+  ASSERT_EQ(slices.slice_count(), 1u);
+  ASSERT_EQ(slices.durations()[0], 50);
+  ASSERT_STREQ(slices.end_state()[0].ToString().data(), "R");
+  ASSERT_EQ(slices.rows_for_utids()[1], std::vector<uint32_t>{0});
+
+  ASSERT_EQ(loaded.nestable_slices().parent_stack_ids()[0], 5);
+  ASSERT_EQ(loaded.counters().values()[0], 1.5);
+  ASSERT_EQ(loaded.instants().types()[0], RefType::kRefUtid);
+  ASSERT_EQ(loaded.raw_events().timestamps()[0], 1020);
+  ASSERT_EQ(loaded.android_logs().prios()[0], 4u);
+
+  const auto& args = loaded.args();
+  ASSERT_EQ(args.args_count(), 3u);
+  ASSERT_EQ(args.arg_value(0).int_value, -5);
+  ASSERT_EQ(args.arg_value(1).string_value, loaded.InternString("cat"));
+  ASSERT_EQ(args.arg_value(2).real_value, 0.25);
+  ASSERT_EQ(loaded.raw_events().arg_set_ids()[0], args.set_id(0));
+  ASSERT_EQ(loaded.counters().arg_set_ids()[0], args.set_id(2));
+}
+
+TEST(StorageSnapshotTest, RejectsInvalidSnapshots) {
+  TraceStorage storage;
+  PopulateStorage(&storage);
+  std::string snapshot = WriteSnapshot(storage);
+
+  std::string bad_magic = snapshot;
+  bad_magic[0] = 'X';
+  TraceStorage loaded;
+  ASSERT_FALSE(ReadSnapshot(bad_magic, &loaded));
+
+  std::string bad_version = snapshot;
+  bad_version[8] = static_cast<char>(kStorageSnapshotVersion + 1);
+  ASSERT_FALSE(ReadSnapshot(bad_version, &loaded));
+
+  for (size_t size : {size_t(0), size_t(12), snapshot.size() / 2,
+                      snapshot.size() - 8}) {
+    TraceStorage truncated;
+    ASSERT_FALSE(ReadSnapshot(snapshot.substr(0, size), &truncated)) << size;
+  }
+}
+
+TEST(StorageSnapshotTest, RejectsOutOfRangeIds) {
+  // Each of these corrupts one id so that it points past the string pool, the
+  // process and thread tables, the cpus or the valid end states.
+  std::vector<void (*)(TraceStorage*)> corruptions = {
+      [](TraceStorage* s) { s->GetMutableProcess(1)->name_id = 1000; },
+      [](TraceStorage* s) { s->GetMutableProcess(1)->pupid = 5; },
+      [](TraceStorage* s) { s->GetMutableThread(1)->upid = 7; },
+      [](TraceStorage* s) {
+        s->mutable_slices()->AddSlice(1, 2000, 10, 9,
+                                      ftrace_utils::TaskState("S"), 120);
+      },
+      [](TraceStorage* s) {
+        s->mutable_slices()->AddSlice(base::kMaxCpus, 2000, 10, 1,
+                                      ftrace_utils::TaskState("S"), 120);
+      },
+      [](TraceStorage* s) {
+        s->mutable_slices()->AddSlice(
+            1, 2000, 10, 1,
+            ftrace_utils::TaskState(ftrace_utils::TaskState::kMaxState + 1),
+            120);
+      },
+      [](TraceStorage* s) {
+        s->mutable_nestable_slices()->AddSlice(2000, 10, 1, 0, 1000, 0, 1, 0);
+      },
+      [](TraceStorage* s) {
+        s->mutable_instants()->AddInstantEvent(2000, 0, 0, 9,
+                                               RefType::kRefUtid);
+      },
+      [](TraceStorage* s) {
+        s->mutable_counters()->AddCounter(2000, 0, 0, 4, RefType::kRefUpid);
+      },
+      [](TraceStorage* s) {
+        s->mutable_raw_events()->AddRawEvent(2000, 0, 0, 9);
+      },
+      [](TraceStorage* s) {
+        s->mutable_raw_events()->AddRawEvent(2000, 0, base::kMaxCpus, 1);
+      },
+      [](TraceStorage* s) {
+        s->mutable_android_log()->AddLogEvent(2000, 1, 4, 1000, 0);
+      },
+      [](TraceStorage* s) {
+        std::vector<TraceStorage::Args::Arg> args(1);
+        args[0].value = Variadic::String(1000);
+        s->mutable_args()->AddArgSet(args, 0, 1);
+      },
+  };
+  for (size_t i = 0; i < corruptions.size(); i++) {
+    TraceStorage storage;
+    PopulateStorage(&storage);
+    corruptions[i](&storage);
+    std::string snapshot = WriteSnapshot(storage);
+    TraceStorage loaded;
+    ASSERT_FALSE(ReadSnapshot(snapshot, &loaded)) << i;
+  }
+}
+
+TEST(StorageSnapshotTest, LoadSnapshotRejectsBadCpusAndEndStates) {
+  using ftrace_utils::TaskState;
+  for (bool bad_cpu : {true, false}) {
+    TraceStorage storage;
+    PopulateStorage(&storage);
+    uint32_t cpu = bad_cpu ? base::kMaxCpus : 1;
+    uint16_t state = bad_cpu ? TaskState::kRunnable : TaskState::kMaxState + 1;
+    storage.mutable_slices()->AddSlice(cpu, 2000, 10, 1, TaskState(state), 0);
+
+    base::TempFile file = base::TempFile::Create();
+    ASSERT_TRUE(WriteStorageSnapshot(storage, file.fd()));
+    std::unique_ptr<TraceProcessor> tp =
+        TraceProcessor::CreateInstance(Config());
+    ASSERT_FALSE(tp->LoadSnapshot(file.path())) << bad_cpu;
+  }
+}
+
+std::string CreateTrace() {
+  protos::Trace trace;
+  auto* bundle = trace.add_packet()->mutable_ftrace_events();
+  bundle->set_cpu(1);
+  for (int i = 0; i < 100; i++) {
+    auto* event = bundle->add_event();
+    event->set_timestamp(static_cast<uint64_t>(1000 + i * 100));
+    event->set_pid(static_cast<uint32_t>(i % 7));
+    auto* sched = event->mutable_sched_switch();
+    sched->set_prev_pid(10 + i % 13);
+    sched->set_prev_comm("prev");
+    sched->set_prev_state(i % 3);
+    sched->set_next_pid(10 + (i + 1) % 13);
+    sched->set_next_comm("next_" + std::to_string(i % 13));
+  }
+  return trace.SerializeAsString();
+}
+
+std::vector<std::string> Query(TraceProcessor* tp) {
+  const char* kQueries[] = {
+      "select ts, dur, cpu, utid, end_state, priority from sched",
+      "select utid, tid, name from thread",
+      "select ts, name, cpu, utid, arg_set_id from raw",
+      "select arg_set_id, key, int_value, string_value from args",
+  };
+  std::vector<std::string> rows;
+  for (const char* query : kQueries) {
+    auto it = tp->ExecuteQuery(query);
+    while (it.Next() == TraceProcessor::Iterator::NextResult::kHasNext) {
+      std::string row = query;
+      for (uint32_t i = 0; i < it.ColumnCount(); i++) {
+        SqlValue value = it.Get(i);
+        row += " ";
+        if (value.type == SqlValue::kLong)
+          row += std::to_string(value.long_value);
+        else if (value.type == SqlValue::kString)
+          row += value.string_value;
+        else
+          row += "null";
+      }
+      rows.push_back(row);
+    }
+  }
+  return rows;
+}
+
+TEST(StorageSnapshotTest, SameResultsAsParse) {
+  std::string trace = CreateTrace();
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[trace.size()]);
+  memcpy(buf.get(), trace.data(), trace.size());
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  ASSERT_TRUE(tp->Parse(std::move(buf), trace.size()));
+  tp->NotifyEndOfFile();
+  std::vector<std::string> expected = Query(tp.get());
+  ASSERT_GT(expected.size(), 200u);
+
+  base::TempFile snapshot = base::TempFile::Create();
+  ASSERT_TRUE(tp->SaveSnapshot(snapshot.path()));
+
+  std::unique_ptr<TraceProcessor> loaded_tp =
+      TraceProcessor::CreateInstance(Config());
+  ASSERT_TRUE(loaded_tp->LoadSnapshot(snapshot.path()));
+  ASSERT_EQ(Query(loaded_tp.get()), expected);
+
+  // No data can be parsed on top of a snapshot, nor can a snapshot be loaded
+  // after parsing.
+  ASSERT_FALSE(tp->LoadSnapshot(snapshot.path()));
+  buf.reset(new uint8_t[trace.size()]);
+  memcpy(buf.get(), trace.data(), trace.size());
+  ASSERT_FALSE(loaded_tp->Parse(std::move(buf), trace.size()));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,6 +16,8 @@
 
 #include "src/trace_processor/storage_table.h"
 
+#include <algorithm>
+
 namespace perfetto {
 namespace trace_processor {
 
@@ -37,6 +39,31 @@ std::unique_ptr<Table::Cursor> StorageTable::CreateCursor(
       new Cursor(std::move(iterator), schema_.mutable_columns()));
 }
 
+void StorageTable::OmitSupportedConstraints(const QueryConstraints& qc,
+                                            BestIndexInfo* info) const {
+  const auto& cs = qc.constraints();
+  for (size_t i = 0; i < cs.size(); i++) {
+    const auto& col = schema_.GetColumn(static_cast<size_t>(cs[i].iColumn));
+    info->omit[i] = col.IsFilterSupported(cs[i].op);
+  }
+}
+
+uint32_t StorageTable::EstimateFilterCost(const QueryConstraints& qc) {
+  uint32_t cost = RowCount();
+  for (const auto& c : qc.constraints()) {
+    if (sqlite_utils::IsOpEq(c.op) || c.op == SQLITE_INDEX_CONSTRAINT_IS) {
+      // Assume equality constraints are very selective.
+      cost /= 10;
+    } else if (c.op != SQLITE_INDEX_CONSTRAINT_NE &&
+               c.op != SQLITE_INDEX_CONSTRAINT_ISNOT &&
+               c.op != SQLITE_INDEX_CONSTRAINT_ISNOTNULL) {
+      // Range, pattern and null constraints.
+      cost /= 2;
+    }
+  }
+  return std::max(cost, 1u);
+}
+
 std::unique_ptr<RowIterator> StorageTable::CreateBestRowIterator(
     const QueryConstraints& qc,
     sqlite3_value** argv) {
@@ -142,6 +169,16 @@ std::vector<uint32_t> StorageTable::CreateSortedIndexVector(
   // Retrieve the index created above from the index.
   std::vector<uint32_t> sorted_rows = index.ToRowVector();
 
+  // Columns keeping their rows sorted across queries avoid sorting a large
+  // number of rows: the sorted rows of the column are walked and the filtered
+  // ones kept. This is only worth it if a large part of the rows is returned.
+  if (obs.size() == 1) {
+    const auto& col = schema_.GetColumn(static_cast<size_t>(obs[0].iColumn));
+    const std::vector<uint32_t>* all_rows = col.GetSortedRows();
+    if (all_rows && sorted_rows.size() * kSortedRowsRatio >= all_rows->size())
+      return FilterSortedRows(*all_rows, sorted_rows, obs[0].desc);
+  }
+
   std::vector<StorageColumn::Comparator> comparators;
   for (const auto& ob : obs) {
     auto col = static_cast<size_t>(ob.iColumn);
@@ -161,6 +198,28 @@ std::vector<uint32_t> StorageTable::CreateSortedIndexVector(
   return sorted_rows;
 }
 
+std::vector<uint32_t> StorageTable::FilterSortedRows(
+    const std::vector<uint32_t>& all_rows,
+    const std::vector<uint32_t>& rows,
+    bool desc) {
+  BitVector filter(static_cast<uint32_t>(all_rows.size()), false);
+  for (uint32_t row : rows)
+    filter.Set(row);
+
+  std::vector<uint32_t> sorted_rows;
+  sorted_rows.reserve(rows.size());
+  auto keep = [&filter, &sorted_rows](uint32_t row) {
+    if (filter.IsSet(row))
+      sorted_rows.push_back(row);
+  };
+  if (desc) {
+    std::for_each(all_rows.rbegin(), all_rows.rend(), keep);
+  } else {
+    std::for_each(all_rows.begin(), all_rows.end(), keep);
+  }
+  return sorted_rows;
+}
+
 StorageTable::Cursor::Cursor(std::unique_ptr<RowIterator> iterator,
                              std::vector<std::unique_ptr<StorageColumn>>* cols)
     : iterator_(std::move(iterator)), columns_(std::move(cols)) {}
@@ -59,9 +59,34 @@ class StorageTable : public Table {
   virtual StorageSchema CreateStorageSchema() = 0;
   virtual uint32_t RowCount() = 0;
 
- protected:
+  // Creates an iterator over the rows matching the constraints of |qc|, in
+  // the order of its order by clauses. This allows reading the columns of
+  // the table directly rather than through SQLite (see
+  // SpanJoinOperatorTable). The constraints must all be supported by the
+  // columns (see StorageColumn::IsFilterSupported()). Returns nullptr on
+  // error.
+  std::unique_ptr<RowIterator> CreateRowIterator(const QueryConstraints& qc,
+                                                 sqlite3_value** argv) {
+    return CreateBestRowIterator(qc, argv);
+  }
+
   const StorageSchema& schema() const { return schema_; }
 
+ protected:
+  // Marks the constraints which are fully handled by the columns of this
+  // table as omitted, so SQLite does not check them a second time. The
+  // storage tables also consume all order by clauses: the columns handle
+  // every constraint and sort, apart from the rare string operators they
+  // don't support, which are left to SQLite.
+  void OmitSupportedConstraints(const QueryConstraints& qc,
+                                BestIndexInfo* info) const;
+
+  // Returns a cost for filtering this table with the constraints in |qc|,
+  // based on a rough estimate of the number of rows they leave. Plans with
+  // more constraints being cheaper ensures SQLite prefers passing us the
+  // constraints rather than filtering the rows itself.
+  uint32_t EstimateFilterCost(const QueryConstraints& qc);
+
  private:
   // Creates a row iterator which is optimized for a generic storage schema
   // (i.e. it does not make assumptions about values of columns).
@@ -83,6 +108,17 @@ class StorageTable : public Table {
       FilteredRowIndex index,
       const std::vector<QueryConstraints::OrderBy>& obs);
 
+  // Returns the rows of |rows| in the order they appear in |all_rows|, or in
+  // the reverse order if |desc|.
+  static std::vector<uint32_t> FilterSortedRows(
+      const std::vector<uint32_t>& all_rows,
+      const std::vector<uint32_t>& rows,
+      bool desc);
+
+  // Walking all the sorted rows of a column is about as expensive as sorting
+  // 1 row out of 16 of them (log2 of the number of rows in a typical trace).
+  static constexpr size_t kSortedRowsRatio = 16;
+
   StorageSchema schema_;
 };
 
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/string_pool.h"
+
+#include <limits>
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Initial number of slots in the hash index. Must be a power of two.
+constexpr uint32_t kInitialSlotsLog2 = 10;
+
+}  // namespace
+
+StringPool::StringPool()
+    : slots_(1u << kInitialSlotsLog2, Slot{0, 0}),
+      index_shift_(64 - kInitialSlotsLog2) {
+  // Reserve string ID 0 for the empty string.
+  AppendEntry(base::StringView());
+}
+
+StringPool::~StringPool() = default;
+
+StringPool::StringPool(StringPool&&) noexcept = default;
+StringPool& StringPool::operator=(StringPool&&) = default;
+
+StringPool::Id StringPool::InternString(base::StringView str) {
+  if (str.empty())
+    return 0;
+
+  uint64_t hash = str.Hash();
+  size_t slot_idx = FindSlot(str, hash);
+  if (slots_[slot_idx].id != 0)
+    return slots_[slot_idx].id;
+
+  Id id = AppendEntry(str);
+  slots_[slot_idx] = Slot{id, static_cast<uint32_t>(hash)};
+
+  // Keep the load factor of the index below 3/4. The empty string is not
+  // stored in the index hence the -1.
+  if ((size() - 1) * 4 > slots_.size() * 3)
+    GrowIndex();
+  return id;
+}
+
+base::Optional<StringPool::Id> StringPool::GetId(base::StringView str) const {
+  if (str.empty())
+    return Id(0);
+
+  const Slot& slot = slots_[FindSlot(str, str.Hash())];
+  if (slot.id == 0)
+    return base::nullopt;
+  return slot.id;
+}
+
+size_t StringPool::memory_usage() const {
+  return blocks_bytes_ + blocks_.capacity() * sizeof(blocks_[0]) +
+         entries_.memory_usage() + slots_.capacity() * sizeof(Slot);
+}
+
+size_t StringPool::FindSlot(base::StringView str, uint64_t hash) const {
+  const size_t mask = slots_.size() - 1;
+  const uint32_t hash_tag = static_cast<uint32_t>(hash);
+  for (size_t i = SlotIndexForHash(hash);; i = (i + 1) & mask) {
+    const Slot& slot = slots_[i];
+    if (slot.id == 0)
+      return i;
+    if (slot.hash_tag == hash_tag && Get(slot.id) == str)
+      return i;
+  }
+}
+
+StringPool::Id StringPool::AppendEntry(base::StringView str) {
+  PERFETTO_CHECK(entries_.size() < std::numeric_limits<Id>::max());
+  PERFETTO_CHECK(str.size() < std::numeric_limits<uint32_t>::max());
+
+  size_t entry_size = sizeof(uint32_t) + str.size() + 1;
+  uint8_t* entry;
+  if (entry_size > kMaxSizeInBlock) {
+    // Give large strings their own allocation so they don't waste the end of
+    // the current block.
+    blocks_.emplace_back(new uint8_t[entry_size]);
+    blocks_bytes_ += entry_size;
+    entry = blocks_.back().get();
+  } else {
+    if (static_cast<size_t>(block_end_ - block_pos_) < entry_size) {
+      blocks_.emplace_back(new uint8_t[kBlockSize]);
+      blocks_bytes_ += kBlockSize;
+      block_pos_ = blocks_.back().get();
+      block_end_ = block_pos_ + kBlockSize;
+    }
+    entry = block_pos_;
+    block_pos_ += entry_size;
+  }
+
+  uint32_t size = static_cast<uint32_t>(str.size());
+  memcpy(entry, &size, sizeof(size));
+  // The empty string interned by the constructor has a null data().
+  if (str.size() > 0)
+    memcpy(entry + sizeof(size), str.data(), str.size());
+  entry[sizeof(size) + str.size()] = '\0';
+
+  entries_.emplace_back(entry);
+  return static_cast<Id>(entries_.size() - 1);
+}
+
+void StringPool::GrowIndex() {
+  PERFETTO_CHECK(index_shift_ > 32);
+  std::vector<Slot> old_slots(slots_.size() * 2, Slot{0, 0});
+  slots_.swap(old_slots);
+  index_shift_--;
+
+  const size_t mask = slots_.size() - 1;
+  for (const Slot& slot : old_slots) {
+    if (slot.id == 0)
+      continue;
+    size_t i = SlotIndexForHash(Get(slot.id).Hash());
+    while (slots_[i].id != 0)
+      i = (i + 1) & mask;
+    slots_[i] = slot;
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
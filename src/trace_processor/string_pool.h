@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_STRING_POOL_H_
+#define SRC_TRACE_PROCESSOR_STRING_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/base/optional.h"
+#include "perfetto/base/string_view.h"
+#include "src/trace_processor/chunked_vector.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Interns strings, assigning each distinct string a dense 32-bit id.
+//
+// Strings are copied into large blocks of memory (the "arena") instead of
+// each getting their own heap allocation. Each entry is stored as a 32-bit
+// length followed by the string bytes and a null terminator. Strings are
+// indexed by an open-addressing hash table (with linear probing) which maps
+// to their id.
+//
+// The empty string is always interned with id 0.
+class StringPool {
+ public:
+  using Id = uint32_t;
+
+  StringPool();
+  ~StringPool();
+
+  // Pools are not copyable. A moved-from pool must not be used anymore.
+  StringPool(StringPool&&) noexcept;
+  StringPool& operator=(StringPool&&);
+
+  // Returns the id of |str|, copying the string into the pool if it was not
+  // interned before.
+  Id InternString(base::StringView str);
+
+  // Returns the id of |str| if it was previously interned or nullopt
+  // otherwise.
+  base::Optional<Id> GetId(base::StringView str) const;
+
+  // Returns the string with id |id|. The returned view is valid for the
+  // lifetime of the pool and is always null terminated (i.e. data()[size()]
+  // is '\0') so data() can be passed to functions expecting a C string.
+  base::StringView Get(Id id) const {
+    const uint8_t* entry = entries_[id];
+    uint32_t size;
+    memcpy(&size, entry, sizeof(size));
+    return base::StringView(reinterpret_cast<const char*>(entry + sizeof(size)),
+                            size);
+  }
+
+  // Returns the number of interned strings, including the empty string.
+  size_t size() const { return entries_.size(); }
+
+  // Returns the number of bytes of heap memory used by the pool, including
+  // unused space in the arena and in the hash index.
+  size_t memory_usage() const;
+
+ private:
+  // Size of the blocks of the arena. Strings which take more than 1/16th of
+  // the block get their own, exactly sized, allocation.
+  static constexpr size_t kBlockSize = 1024 * 1024;
+  static constexpr size_t kMaxSizeInBlock = kBlockSize / 16;
+
+  // A slot of the hash index. |id| == 0 (the empty string, which is never
+  // stored in the index) marks an empty slot. |hash_tag| stores the low bits
+  // of the hash of the string to avoid most string comparisons when probing.
+  struct Slot {
+    Id id;
+    uint32_t hash_tag;
+  };
+
+  // Returns the index of the slot containing |str| or of the empty slot
+  // where it should be inserted.
+  size_t FindSlot(base::StringView str, uint64_t hash) const;
+
+  // Copies |str| into the arena and returns the id of the new entry.
+  Id AppendEntry(base::StringView str);
+
+  // Doubles the number of slots in the index and reinserts all the strings.
+  void GrowIndex();
+
+  size_t SlotIndexForHash(uint64_t hash) const {
+    // Fibonacci hashing: the high bits of the product depend on all the
+    // bits of the hash, unlike the low bits of FNV-1a.
+    return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> index_shift_);
+  }
+
+  std::vector<std::unique_ptr<uint8_t[]>> blocks_;
+  size_t blocks_bytes_ = 0;
+
+  // Free space in the last (non-dedicated) block of the arena.
+  uint8_t* block_pos_ = nullptr;
+  uint8_t* block_end_ = nullptr;
+
+  // Pointer to the entry of each string, indexed by id.
+  ChunkedVector<const uint8_t*> entries_;
+
+  // The hash index: its size is always a power of two.
+  std::vector<Slot> slots_;
+  uint32_t index_shift_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STRING_POOL_H_
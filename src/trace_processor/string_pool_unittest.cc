@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/string_pool.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(StringPoolTest, EmptyString) {
+  StringPool pool;
+  ASSERT_EQ(pool.size(), 1u);
+  ASSERT_EQ(pool.InternString(""), 0u);
+  ASSERT_EQ(pool.InternString(base::StringView()), 0u);
+  ASSERT_EQ(pool.GetId(""), base::Optional<StringPool::Id>(0u));
+  ASSERT_TRUE(pool.Get(0).empty());
+  ASSERT_EQ(pool.Get(0).data()[0], '\0');
+  ASSERT_EQ(pool.size(), 1u);
+}
+
+TEST(StringPoolTest, InternAndGet) {
+  StringPool pool;
+  StringPool::Id foo = pool.InternString("foo");
+  StringPool::Id bar = pool.InternString("bar");
+  ASSERT_NE(foo, 0u);
+  ASSERT_NE(bar, 0u);
+  ASSERT_NE(foo, bar);
+  ASSERT_EQ(pool.size(), 3u);
+
+  ASSERT_EQ(pool.InternString("foo"), foo);
+  ASSERT_EQ(pool.InternString(base::StringView("barbaz", 3)), bar);
+  ASSERT_EQ(pool.size(), 3u);
+
+  ASSERT_EQ(pool.Get(foo), base::StringView("foo"));
+  ASSERT_EQ(pool.Get(bar), base::StringView("bar"));
+
+  // The strings are always null terminated.
+  ASSERT_STREQ(pool.Get(foo).data(), "foo");
+  ASSERT_STREQ(pool.Get(bar).data(), "bar");
+}
+
+TEST(StringPoolTest, GetId) {
+  StringPool pool;
+  ASSERT_FALSE(pool.GetId("foo").has_value());
+  StringPool::Id foo = pool.InternString("foo");
+  ASSERT_EQ(pool.GetId("foo"), base::Optional<StringPool::Id>(foo));
+  ASSERT_FALSE(pool.GetId("fo").has_value());
+  ASSERT_FALSE(pool.GetId("fooo").has_value());
+  ASSERT_EQ(pool.size(), 2u);
+}
+
+TEST(StringPoolTest, EmbeddedNulls) {
+  StringPool pool;
+  StringPool::Id a = pool.InternString(base::StringView("a\0b", 3));
+  StringPool::Id b = pool.InternString(base::StringView("a\0c", 3));
+  ASSERT_NE(a, b);
+  ASSERT_EQ(pool.Get(a), base::StringView("a\0b", 3));
+  ASSERT_EQ(pool.Get(b), base::StringView("a\0c", 3));
+}
+
+TEST(StringPoolTest, LargeStrings) {
+  StringPool pool;
+  StringPool::Id small = pool.InternString("small");
+  std::string large(1024 * 1024 * 3, 'x');
+  StringPool::Id large_id = pool.InternString(base::StringView(large));
+  StringPool::Id after = pool.InternString("after");
+
+  ASSERT_EQ(pool.Get(large_id), base::StringView(large));
+  ASSERT_EQ(pool.Get(large_id).data()[large.size()], '\0');
+  ASSERT_EQ(pool.Get(small), base::StringView("small"));
+  ASSERT_EQ(pool.Get(after), base::StringView("after"));
+  ASSERT_EQ(pool.InternString(base::StringView(large)), large_id);
+  ASSERT_GE(pool.memory_usage(), large.size());
+}
+
+TEST(StringPoolTest, ManyStrings) {
+  StringPool pool;
+  std::vector<StringPool::Id> ids;
+  const size_t kNumStrings = 100000;
+  for (size_t i = 0; i < kNumStrings; i++)
+    ids.push_back(pool.InternString(base::StringView(std::to_string(i))));
+  ASSERT_EQ(pool.size(), kNumStrings + 1);
+
+  // All the strings must still be found after the index has grown and the
+  // arena has been extended with new blocks.
+  for (size_t i = 0; i < kNumStrings; i++) {
+    std::string str = std::to_string(i);
+    ASSERT_EQ(ids[i], i + 1);
+    ASSERT_EQ(pool.Get(ids[i]), base::StringView(str));
+    ASSERT_EQ(pool.InternString(base::StringView(str)), ids[i]);
+  }
+  ASSERT_EQ(pool.size(), kNumStrings + 1);
+}
+
+TEST(StringPoolTest, Move) {
+  StringPool pool;
+  StringPool::Id foo = pool.InternString("foo");
+  const char* data = pool.Get(foo).data();
+
+  StringPool moved(std::move(pool));
+  ASSERT_EQ(moved.Get(foo), base::StringView("foo"));
+  // Moving the pool must not move the strings themselves.
+  ASSERT_EQ(moved.Get(foo).data(), data);
+  ASSERT_EQ(moved.InternString("foo"), foo);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -65,8 +65,14 @@ std::string TypeToString(Table::ColumnType type) {
 // static
 bool Table::debug = false;
 
-Table::Table() = default;
-Table::~Table() = default;
+// The sqlite3_vtab fields are zeroed as not every table is created by SQLite:
+// the span join creates private instances of the storage tables.
+Table::Table() : sqlite3_vtab() {}
+
+Table::~Table() {
+  // SQLite takes the error messages of the tables it created.
+  sqlite3_free(zErrMsg);
+}
 
 void Table::RegisterInternal(sqlite3* db,
                              const TraceStorage* storage,
@@ -20,6 +20,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
+#include <functional>
 #include <limits>
 #include <memory>
 
@@ -43,6 +45,21 @@ class TraceBlobView {
     PERFETTO_DCHECK(length <= std::numeric_limits<uint32_t>::max());
   }
 
+  // Creates a view on memory which is not owned as a heap buffer, e.g. a
+  // region of a memory-mapped trace file (see MappedTraceFile). |release| is
+  // invoked, possibly on another thread, once the last view on |buffer| has
+  // been destroyed.
+  TraceBlobView(const uint8_t* buffer,
+                size_t offset,
+                size_t length,
+                std::function<void()> release)
+      : shbuf_(SharedBuf(buffer, std::move(release))),
+        offset_(static_cast<uint32_t>(offset)),
+        length_(static_cast<uint32_t>(length)) {
+    PERFETTO_DCHECK(offset <= std::numeric_limits<uint32_t>::max());
+    PERFETTO_DCHECK(length <= std::numeric_limits<uint32_t>::max());
+  }
+
   // Allow std::move().
   TraceBlobView(TraceBlobView&&) noexcept = default;
   TraceBlobView& operator=(TraceBlobView&&) = default;
@@ -51,11 +68,16 @@ class TraceBlobView {
   TraceBlobView(const TraceBlobView&) = delete;
   TraceBlobView& operator=(const TraceBlobView&) = delete;
 
-  TraceBlobView slice(size_t offset, size_t length) {
+  TraceBlobView slice(size_t offset, size_t length) const {
     PERFETTO_DCHECK(offset + length <= offset_ + length_);
     return TraceBlobView(shbuf_, offset, length);
   }
 
+  // Returns true if both views are on the same buffer.
+  bool SharesBufferWith(const TraceBlobView& other) const {
+    return shbuf_ == other.shbuf_;
+  }
+
   bool operator==(const TraceBlobView& rhs) const {
     return (shbuf_ == rhs.shbuf_) && (offset_ == rhs.offset_) &&
            (length_ == rhs.length_);
@@ -76,23 +98,31 @@ class TraceBlobView {
  private:
   // An equivalent to std::shared_ptr<uint8_t>, with the differnce that:
   // - Supports array types, available for shared_ptr only in C++17.
-  // - Is not thread safe, which is not needed for our purposes.
+  // - Only the refcount is thread safe: views of the same buffer can be
+  //   created and destroyed on different threads when parsing is pipelined
+  //   (see Config::pipelined_parsing), but a SharedBuf instance itself must
+  //   not be accessed concurrently.
   class SharedBuf {
    public:
     explicit SharedBuf(std::unique_ptr<uint8_t[]> mem) {
-      rcbuf_ = new RefCountedBuf(std::move(mem));
+      const uint8_t* data = mem.get();
+      rcbuf_ = new RefCountedBuf(data, std::move(mem), nullptr);
+    }
+
+    SharedBuf(const uint8_t* data, std::function<void()> release) {
+      rcbuf_ = new RefCountedBuf(data, nullptr, std::move(release));
     }
 
     SharedBuf(const SharedBuf& copy) : rcbuf_(copy.rcbuf_) {
-      PERFETTO_DCHECK(rcbuf_->refcount > 0);
-      rcbuf_->refcount++;
+      PERFETTO_DCHECK(rcbuf_->refcount.load(std::memory_order_relaxed) > 0);
+      rcbuf_->refcount.fetch_add(1, std::memory_order_relaxed);
     }
 
     ~SharedBuf() {
       if (!rcbuf_)
         return;
-      PERFETTO_DCHECK(rcbuf_->refcount > 0);
-      if (--rcbuf_->refcount == 0) {
+      PERFETTO_DCHECK(rcbuf_->refcount.load(std::memory_order_relaxed) > 0);
+      if (rcbuf_->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
         RefCountedBuf* rcbuf = rcbuf_;
         rcbuf_ = nullptr;
         delete rcbuf;
@@ -117,14 +147,24 @@ class TraceBlobView {
 
     bool operator==(const SharedBuf& x) const { return x.rcbuf_ == rcbuf_; }
     bool operator!=(const SharedBuf& x) const { return !(x == *this); }
-    const uint8_t* data() const { return rcbuf_->mem.get(); }
+    const uint8_t* data() const { return rcbuf_->data; }
 
    private:
+    // Exactly one of |mem| and |release| is set, depending on who owns the
+    // memory pointed by |data|.
     struct RefCountedBuf {
-      explicit RefCountedBuf(std::unique_ptr<uint8_t[]> buf)
-          : refcount(1), mem(std::move(buf)) {}
-      int refcount;
+      RefCountedBuf(const uint8_t* d,
+                    std::unique_ptr<uint8_t[]> m,
+                    std::function<void()> r)
+          : refcount(1), data(d), mem(std::move(m)), release(std::move(r)) {}
+      ~RefCountedBuf() {
+        if (release)
+          release();
+      }
+      std::atomic<int> refcount;
+      const uint8_t* const data;
       std::unique_ptr<uint8_t[]> mem;
+      std::function<void()> release;
     };
 
     RefCountedBuf* rcbuf_ = nullptr;
@@ -0,0 +1,152 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "perfetto/trace_processor/trace_processor.h"
+
+#include "perfetto/trace/trace.pb.h"
+#include "perfetto/trace/trace_packet.pb.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Generates a synthetic ftrace trace with |events| sched_switch and
+// cpu_frequency events spread over 8 CPUs, in bundles of 500 events.
+std::string CreateTrace(int events) {
+  const uint32_t kCpus = 8;
+  const int kEventsPerBundle = 500;
+  std::minstd_rand0 rnd(0);
+  protos::Trace trace;
+  uint64_t ts = 0;
+  for (int i = 0; i < events; i += kEventsPerBundle) {
+    auto* bundle = trace.add_packet()->mutable_ftrace_events();
+    bundle->set_cpu((static_cast<uint32_t>(i / kEventsPerBundle)) % kCpus);
+    for (int e = 0; e < kEventsPerBundle; e++) {
+      ts += rnd() % 1000;
+      auto* event = bundle->add_event();
+      event->set_timestamp(ts);
+      event->set_pid(static_cast<uint32_t>(rnd() % 2048));
+      if (e % 8 == 0) {
+        auto* freq = event->mutable_cpu_frequency();
+        freq->set_cpu_id(bundle->cpu());
+        freq->set_state(static_cast<uint32_t>(rnd() % 3000000));
+        continue;
+      }
+      auto* sched = event->mutable_sched_switch();
+      sched->set_prev_pid(static_cast<int32_t>(rnd() % 2048));
+      sched->set_prev_comm("thread");
+      sched->set_prev_state(static_cast<int64_t>(rnd() % 3));
+      sched->set_next_pid(static_cast<int32_t>(rnd() % 2048));
+      sched->set_next_comm("thread");
+    }
+  }
+  return trace.SerializeAsString();
+}
+
+// Generates a synthetic legacy JSON trace with |events| complete ('X') events
+// spread over 64 threads, each with a few args, in the format written by
+// Chrome.
+std::string CreateJsonTrace(int events) {
+  std::minstd_rand0 rnd(0);
+  std::string trace = "{\"traceEvents\":[";
+  uint64_t ts = 0;
+  for (int i = 0; i < events; i++) {
+    ts += rnd() % 1000;
+    uint32_t tid = static_cast<uint32_t>(rnd() % 64);
+    if (i > 0)
+      trace += ",\n";
+    trace += "{\"pid\":" + std::to_string(tid / 8) +
+             ",\"tid\":" + std::to_string(tid) +
+             ",\"ts\":" + std::to_string(ts) + "." +
+             std::to_string(rnd() % 1000) +
+             ",\"ph\":\"X\",\"cat\":\"toplevel,ipc\",\"name\":\"Task" +
+             std::to_string(rnd() % 100) +
+             "\",\"dur\":" + std::to_string(rnd() % 100) +
+             ",\"tdur\":12,\"tts\":" + std::to_string(ts / 2) +
+             ",\"args\":{\"src_file\":\"../../base/message_loop.cc\","
+             "\"src_func\":\"PostTask\",\"data\":{\"id\":" +
+             std::to_string(i) + ",\"list\":[1,2,3]}}}";
+  }
+  trace += "],\"metadata\":{\"product\":\"Chrome\"}}";
+  return trace;
+}
+
+void LoadArgs(benchmark::internal::Benchmark* b) {
+  int events = IsBenchmarkFunctionalOnly() ? 10000 : 2000000;
+  b->Args({events, 0});
+  b->Args({events, 1});
+}
+
+}  // namespace
+
+// Loads the trace in 1MB chunks, like trace_processor_shell does. The second
+// argument toggles Config::pipelined_parsing.
+static void BM_TraceLoad(benchmark::State& state) {
+  std::string trace = CreateTrace(static_cast<int>(state.range(0)));
+  Config config;
+  config.pipelined_parsing = state.range(1) != 0;
+
+  const size_t kChunkSize = 1024 * 1024;
+  for (auto _ : state) {
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+    for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, trace.size() - off);
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), trace.data() + off, size);
+      tp->Parse(std::move(buf), size);
+    }
+    tp->NotifyEndOfFile();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+}
+BENCHMARK(BM_TraceLoad)->Unit(benchmark::kMillisecond)->Apply(LoadArgs);
+
+// Loads a legacy JSON trace of state.range(0) events in 1MB chunks.
+static void BM_JsonTraceLoad(benchmark::State& state) {
+  std::string trace = CreateJsonTrace(static_cast<int>(state.range(0)));
+
+  const size_t kChunkSize = 1024 * 1024;
+  for (auto _ : state) {
+    std::unique_ptr<TraceProcessor> tp =
+        TraceProcessor::CreateInstance(Config());
+    for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, trace.size() - off);
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), trace.data() + off, size);
+      tp->Parse(std::move(buf), size);
+    }
+    tp->NotifyEndOfFile();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+}
+BENCHMARK(BM_JsonTraceLoad)
+    ->Unit(benchmark::kMillisecond)
+    ->Arg(IsBenchmarkFunctionalOnly() ? 10000 : 1000000);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -48,11 +48,23 @@ SqlValue TraceProcessor::Iterator::Get(uint32_t col) {
   return iterator_->Get(col);
 }
 
+TraceProcessor::Iterator::NextResult TraceProcessor::Iterator::NextBatch(
+    uint32_t max_rows,
+    ColumnarBatch* batch) {
+  PERFETTO_DCHECK(IsValid());
+  return iterator_->NextBatch(max_rows, batch);
+}
+
 uint32_t TraceProcessor::Iterator::ColumnCount() {
   PERFETTO_DCHECK(IsValid());
   return iterator_->ColumnCount();
 }
 
+std::string TraceProcessor::Iterator::GetColumnName(uint32_t col) {
+  PERFETTO_DCHECK(IsValid());
+  return iterator_->GetColumnName(col);
+}
+
 base::Optional<std::string> TraceProcessor::Iterator::GetLastError() {
   PERFETTO_DCHECK(IsValid());
   return iterator_->GetLastError();
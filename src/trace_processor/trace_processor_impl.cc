@@ -16,11 +16,14 @@
 
 #include "src/trace_processor/trace_processor_impl.h"
 
+#include <fcntl.h>
 #include <inttypes.h>
+#include <string.h>
 #include <algorithm>
 #include <functional>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/base/scoped_file.h"
 #include "perfetto/base/time.h"
 #include "src/trace_processor/android_logs_table.h"
 #include "src/trace_processor/args_table.h"
@@ -40,6 +43,7 @@
 #include "src/trace_processor/span_join_operator_table.h"
 #include "src/trace_processor/sql_stats_table.h"
 #include "src/trace_processor/stats_table.h"
+#include "src/trace_processor/storage_snapshot.h"
 #include "src/trace_processor/string_table.h"
 #include "src/trace_processor/table.h"
 #include "src/trace_processor/thread_table.h"
@@ -53,6 +57,14 @@
 #include "src/trace_processor/json_trace_parser.h"
 #endif
 
+// Threads and mmap() are not supported in the WebAssembly build.
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+#include <thread>
+
+#include "src/trace_processor/mapped_trace_file.h"
+#include "src/trace_processor/pipelined_trace_reader.h"
+#endif
+
 // In Android tree builds, we don't have the percentile module.
 // Just don't include it.
 #if !PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
@@ -110,6 +122,23 @@ namespace perfetto {
 namespace trace_processor {
 namespace {
 
+void RegisterTables(sqlite3* db, TraceStorage* storage) {
+  ArgsTable::RegisterTable(db, storage);
+  ProcessTable::RegisterTable(db, storage);
+  SchedSliceTable::RegisterTable(db, storage);
+  SliceTable::RegisterTable(db, storage);
+  SqlStatsTable::RegisterTable(db, storage);
+  StringTable::RegisterTable(db, storage);
+  ThreadTable::RegisterTable(db, storage);
+  CountersTable::RegisterTable(db, storage);
+  SpanJoinOperatorTable::RegisterTable(db, storage);
+  WindowOperatorTable::RegisterTable(db, storage);
+  InstantsTable::RegisterTable(db, storage);
+  StatsTable::RegisterTable(db, storage);
+  AndroidLogsTable::RegisterTable(db, storage);
+  RawTable::RegisterTable(db, storage);
+}
+
 bool IsPrefix(const std::string& a, const std::string& b) {
   return a.size() <= b.size() && b.substr(0, a.size()) == a;
 }
@@ -120,6 +149,189 @@ std::string RemoveWhitespace(const std::string& input) {
   return str;
 }
 
+// Appends |values| to the end of |field|.
+template <typename T, typename V>
+void AppendToRepeatedField(const std::vector<V>& values,
+                           google::protobuf::RepeatedField<T>* field) {
+  int size = field->size();
+  field->Resize(size + static_cast<int>(values.size()), T());
+  std::copy(values.begin(), values.end(), field->mutable_data() + size);
+}
+
+// Appends the rows of the column |col| of |batch| to |column|. See
+// ReadRawQueryResult() for |leading_nulls|.
+void AppendColumnBatch(const ColumnarBatch& batch,
+                       uint32_t col,
+                       uint64_t* leading_nulls,
+                       protos::RawQueryResult::ColumnValues* column) {
+  const ColumnarBatch::Column& values = batch.columns[col];
+  AppendToRepeatedField(values.is_nulls, column->mutable_is_nulls());
+
+  switch (values.type) {
+    case SqlValue::kNull:
+      *leading_nulls += batch.num_rows;
+      break;
+    case SqlValue::kLong:
+      for (; *leading_nulls > 0; (*leading_nulls)--)
+        column->add_long_values(0);
+      AppendToRepeatedField(values.long_values, column->mutable_long_values());
+      break;
+    case SqlValue::kDouble:
+      for (; *leading_nulls > 0; (*leading_nulls)--)
+        column->add_double_values(0);
+      AppendToRepeatedField(values.double_values,
+                            column->mutable_double_values());
+      break;
+    case SqlValue::kString:
+      for (; *leading_nulls > 0; (*leading_nulls)--)
+        column->add_string_values("[NULL]");
+      for (uint32_t row = 0; row < batch.num_rows; row++) {
+        if (values.is_nulls[row]) {
+          column->add_string_values("[NULL]");
+        } else {
+          column->add_string_values(batch.strings[values.string_ids[row]]);
+        }
+      }
+      break;
+  }
+}
+
+// Encodes |values|, a column of |batch|, into |column|.
+void EncodeColumnBatch(const ColumnarBatch& batch,
+                       const ColumnarBatch::Column& values,
+                       protos::QueryRowsBatch::Column* column) {
+  using ColumnDesc = protos::RawQueryResult::ColumnDesc;
+  std::string null_bitmap((batch.num_rows + 7) / 8, '\0');
+  bool has_nulls = false;
+  for (uint32_t row = 0; row < batch.num_rows; row++) {
+    if (values.is_nulls[row]) {
+      null_bitmap[row / 8] = static_cast<char>(null_bitmap[row / 8] |
+                                               (1 << (row % 8)));
+      has_nulls = true;
+    }
+  }
+  if (has_nulls)
+    column->set_null_bitmap(std::move(null_bitmap));
+
+  switch (values.type) {
+    case SqlValue::kNull:
+      column->set_type(ColumnDesc::UNKNOWN);
+      break;
+    case SqlValue::kLong:
+      column->set_type(ColumnDesc::LONG);
+      AppendToRepeatedField(values.long_values, column->mutable_long_values());
+      break;
+    case SqlValue::kDouble:
+      column->set_type(ColumnDesc::DOUBLE);
+      AppendToRepeatedField(values.double_values,
+                            column->mutable_double_values());
+      break;
+    case SqlValue::kString:
+      column->set_type(ColumnDesc::STRING);
+      AppendToRepeatedField(values.string_ids, column->mutable_string_ids());
+      break;
+  }
+}
+
+// Reads all the rows of |it|, a TraceProcessor::Iterator or IteratorImpl, into
+// |proto|. Returns false if the query failed, in which case only the error is
+// set.
+template <typename It>
+bool ReadRawQueryResult(It* it, protos::RawQueryResult* proto) {
+  // The values of the null rows are left out of the batches, but the proto
+  // needs one value for each row in the vector of the column type. The type of
+  // the column is only known at its first non-null value, so the number of
+  // nulls before it is kept in |leading_nulls|.
+  using Result = TraceProcessor::Iterator::NextResult;
+  const uint32_t kBatchRows = 4096;
+  ColumnarBatch batch;
+  std::vector<uint64_t> leading_nulls(it->ColumnCount());
+  uint64_t row_count = 0;
+  for (;;) {
+    Result res = it->NextBatch(kBatchRows, &batch);
+    if (res == Result::kError) {
+      proto->set_error(*it->GetLastError());
+      return false;
+    }
+    if (res == Result::kEOF)
+      break;
+
+    if (row_count == 0) {
+      for (uint32_t col = 0; col < it->ColumnCount(); col++) {
+        proto->add_column_descriptors()->set_name(it->GetColumnName(col));
+        proto->add_columns();
+      }
+    }
+    for (uint32_t col = 0; col < batch.columns.size(); col++) {
+      AppendColumnBatch(batch, col, &leading_nulls[col],
+                        proto->mutable_columns(static_cast<int>(col)));
+    }
+    row_count += batch.num_rows;
+  }
+
+  using ColumnDesc = protos::RawQueryResult::ColumnDesc;
+  for (uint32_t col = 0; row_count && col < batch.columns.size(); col++) {
+    auto* desc = proto->mutable_column_descriptors(static_cast<int>(col));
+    switch (batch.columns[col].type) {
+      case SqlValue::kLong:
+        desc->set_type(ColumnDesc::LONG);
+        break;
+      case SqlValue::kString:
+        desc->set_type(ColumnDesc::STRING);
+        break;
+      case SqlValue::kDouble:
+        desc->set_type(ColumnDesc::DOUBLE);
+        break;
+      case SqlValue::kNull: {
+        // Columns with only nulls have a value of each type for every row.
+        desc->set_type(ColumnDesc::UNKNOWN);
+        auto* column = proto->mutable_columns(static_cast<int>(col));
+        for (uint64_t i = 0; i < leading_nulls[col]; i++) {
+          column->add_long_values(0);
+          column->add_string_values("[NULL]");
+          column->add_double_values(0);
+        }
+        break;
+      }
+    }
+  }
+
+  proto->set_num_records(row_count);
+  return true;
+}
+
+// Runs |sql| on |db|, a connection of ExecuteQueries(), and stores its
+// result in |proto|. Returns the time at which the query started.
+int64_t ExecuteReadOnlyQuery(sqlite3* db,
+                             const std::string& sql,
+                             protos::RawQueryResult* proto) {
+  base::TimeNanos t_start = base::GetWallTimeNs();
+  sqlite3_stmt* raw_stmt = nullptr;
+  int err = sqlite3_prepare_v2(db, sql.c_str(), static_cast<int>(sql.size()),
+                               &raw_stmt, nullptr);
+  ScopedStmt stmt(raw_stmt);
+  uint32_t col_count = 0;
+  base::Optional<std::string> error;
+  if (err) {
+    error = base::Optional<std::string>(sqlite3_errmsg(db));
+  } else if (raw_stmt && !sqlite3_stmt_readonly(raw_stmt)) {
+    error = base::Optional<std::string>(
+        "Only read-only queries can run in parallel");
+  } else {
+    col_count = static_cast<uint32_t>(sqlite3_column_count(raw_stmt));
+  }
+
+  // The iterator is not tied to the trace processor, which is not thread-safe.
+  TraceProcessor::IteratorImpl it(nullptr, db, std::move(stmt), col_count,
+                                  error);
+  if (ReadRawQueryResult(&it, proto)) {
+    base::TimeNanos t_end = base::GetWallTimeNs();
+    proto->set_execution_time_ns(
+        static_cast<uint64_t>((t_end - t_start).count()));
+  }
+  return t_start.count();
+}
+
 }  // namespace
 
 TraceType GuessTraceType(const uint8_t* data, size_t size) {
@@ -135,7 +347,18 @@ TraceType GuessTraceType(const uint8_t* data, size_t size) {
   return kProtoTraceType;
 }
 
-TraceProcessorImpl::TraceProcessorImpl(const Config& cfg) {
+constexpr size_t TraceProcessorImpl::kMaxOpenCursors;
+constexpr size_t TraceProcessorImpl::kMaxQueryThreads;
+
+struct TraceProcessorImpl::CachedResult {
+  uint64_t storage_generation;
+  protos::RawQueryResult result;
+};
+
+TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
+    : config_(cfg),
+      statement_cache_(cfg.statement_cache_size),
+      result_cache_(cfg.query_result_cache_size) {
   sqlite3* db = nullptr;
   PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
   InitializeSqliteModules(db);
@@ -152,20 +375,9 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg) {
   context_.sorter.reset(
       new TraceSorter(&context_, static_cast<int64_t>(cfg.window_size_ns)));
 
-  ArgsTable::RegisterTable(*db_, context_.storage.get());
-  ProcessTable::RegisterTable(*db_, context_.storage.get());
-  SchedSliceTable::RegisterTable(*db_, context_.storage.get());
-  SliceTable::RegisterTable(*db_, context_.storage.get());
-  SqlStatsTable::RegisterTable(*db_, context_.storage.get());
-  StringTable::RegisterTable(*db_, context_.storage.get());
-  ThreadTable::RegisterTable(*db_, context_.storage.get());
-  CountersTable::RegisterTable(*db_, context_.storage.get());
-  SpanJoinOperatorTable::RegisterTable(*db_, context_.storage.get());
-  WindowOperatorTable::RegisterTable(*db_, context_.storage.get());
-  InstantsTable::RegisterTable(*db_, context_.storage.get());
-  StatsTable::RegisterTable(*db_, context_.storage.get());
-  AndroidLogsTable::RegisterTable(*db_, context_.storage.get());
-  RawTable::RegisterTable(*db_, context_.storage.get());
+  RegisterTables(*db_, context_.storage.get());
+
+  sqlite3_set_authorizer(*db_, &TraceProcessorImpl::AuthorizeStatement, this);
 }
 
 TraceProcessorImpl::~TraceProcessorImpl() {
@@ -181,33 +393,150 @@ bool TraceProcessorImpl::Parse(std::unique_ptr<uint8_t[]> data, size_t size) {
 
   // If this is the first Parse() call, guess the trace type and create the
   // appropriate parser.
-  if (!context_.chunk_reader) {
-    TraceType trace_type = GuessTraceType(data.get(), size);
-    switch (trace_type) {
-      case kJsonTraceType:
-        PERFETTO_DLOG("Legacy JSON trace detected");
+  if (!context_.chunk_reader && !CreateChunkReader(data.get(), size))
+    return false;
+
+  storage_generation_++;
+  bool res = context_.chunk_reader->Parse(std::move(data), size);
+  unrecoverable_parse_error_ |= !res;
+  return res;
+}
+
+bool TraceProcessorImpl::ParseMappedFile(const std::string& path) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  PERFETTO_ELOG("Memory-mapped files are not supported (%s)", path.c_str());
+  return false;
+#else
+  std::shared_ptr<MappedTraceFile> file = MappedTraceFile::Create(path);
+  if (!file)
+    return false;
+  if (file->size() == 0)
+    return true;
+  if (unrecoverable_parse_error_)
+    return false;
+  if (!context_.chunk_reader && !CreateChunkReader(file->data(), file->size()))
+    return false;
+  storage_generation_++;
+
+  // Cut the file in views of about the size of the chunks passed to Parse()
+  // by trace_processor_shell, ending on packet boundaries so that the
+  // tokenizer never has to copy a packet to glue it together. The pages of
+  // each view are unmapped once all its packets have been parsed.
+  const size_t kViewSize = 1024 * 1024;
+  bool is_proto =
+      GuessTraceType(file->data(), file->size()) == kProtoTraceType;
+  for (size_t off = 0; off < file->size();) {
+    const uint8_t* data = file->data() + off;
+    size_t size = file->size() - off;
+    size_t length =
+        is_proto ? ProtoTraceTokenizer::PacketAlignedLength(data, size,
+                                                            kViewSize)
+                 : std::min(size, kViewSize);
+    bool res = context_.chunk_reader->ParseBlob(
+        MappedTraceFile::CreateView(file, off, length));
+    unrecoverable_parse_error_ |= !res;
+    if (!res)
+      return false;
+    off += length;
+  }
+  return true;
+#endif
+}
+
+bool TraceProcessorImpl::CreateChunkReader(const uint8_t* data, size_t size) {
+  TraceType trace_type = GuessTraceType(data, size);
+  switch (trace_type) {
+    case kJsonTraceType:
+      PERFETTO_DLOG("Legacy JSON trace detected");
 #if PERFETTO_BUILDFLAG(PERFETTO_STANDALONE_BUILD)
-        context_.chunk_reader.reset(new JsonTraceParser(&context_));
+      context_.chunk_reader.reset(new JsonTraceParser(&context_));
 #else
-        PERFETTO_FATAL("JSON traces only supported in standalone mode.");
+      PERFETTO_FATAL("JSON traces only supported in standalone mode.");
 #endif
-        break;
-      case kProtoTraceType:
-        context_.chunk_reader.reset(new ProtoTraceTokenizer(&context_));
-        break;
-      case kUnknownTraceType:
-        return false;
+      return true;
+    case kProtoTraceType: {
+      std::unique_ptr<ChunkedTraceReader> tokenizer(
+          new ProtoTraceTokenizer(&context_));
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+      if (config_.pipelined_parsing) {
+        tokenizer.reset(
+            new PipelinedTraceReader(&context_, std::move(tokenizer)));
+      }
+#endif
+      context_.chunk_reader = std::move(tokenizer);
+      return true;
     }
+    case kUnknownTraceType:
+      return false;
   }
-
-  bool res = context_.chunk_reader->Parse(std::move(data), size);
-  unrecoverable_parse_error_ |= !res;
-  return res;
+  return false;
 }
 
 void TraceProcessorImpl::NotifyEndOfFile() {
-  context_.sorter->ExtractEventsForced();
+  storage_generation_++;
+  end_of_file_ = true;
+  if (context_.chunk_reader)
+    context_.chunk_reader->NotifyEndOfFile();
   BuildBoundsTable(*db_, context_.storage->GetTraceTimestampBoundsNs());
+
+  // All the strings of the trace have been interned at this point, and the
+  // slices won't change anymore.
+  TraceStorage* storage = context_.storage.get();
+  storage->mutable_slices()->BuildEndIndex();
+  storage->mutable_nestable_slices()->BuildEndIndex();
+  const StringPool& string_pool = storage->string_pool();
+  storage->SetStats(stats::string_pool_memory_bytes,
+                    static_cast<int64_t>(string_pool.memory_usage()));
+  storage->SetStats(stats::string_pool_num_strings,
+                    static_cast<int64_t>(string_pool.size()));
+  const TraceStorage::Args& args = storage->args();
+  storage->SetStats(stats::args_memory_bytes,
+                    static_cast<int64_t>(args.memory_usage()));
+  storage->SetStats(stats::args_num_shapes,
+                    static_cast<int64_t>(args.shape_count()));
+  if (context_.sorter) {
+    const TraceSorter& sorter = *context_.sorter;
+    storage->SetStats(stats::sorter_peak_memory_bytes,
+                      static_cast<int64_t>(sorter.peak_memory_bytes()));
+    storage->SetStats(stats::sorter_peak_num_events,
+                      static_cast<int64_t>(sorter.peak_num_events()));
+  }
+}
+
+bool TraceProcessorImpl::SaveSnapshot(const std::string& path) {
+  base::ScopedFile fd(
+      base::OpenFile(path, O_WRONLY | O_CREAT | O_TRUNC, 0600));
+  if (!fd) {
+    PERFETTO_PLOG("Could not open %s", path.c_str());
+    return false;
+  }
+  return WriteStorageSnapshot(*context_.storage, *fd);
+}
+
+bool TraceProcessorImpl::LoadSnapshot(const std::string& path) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  PERFETTO_ELOG("Snapshots are not supported (%s)", path.c_str());
+  return false;
+#else
+  if (context_.chunk_reader || unrecoverable_parse_error_) {
+    PERFETTO_ELOG("Snapshots must be loaded before parsing any data");
+    return false;
+  }
+  std::shared_ptr<MappedTraceFile> file = MappedTraceFile::Create(path);
+  if (!file)
+    return false;
+  if (!ReadStorageSnapshot(file->data(), file->size(),
+                           context_.storage.get())) {
+    context_.storage->ResetStorage();
+    return false;
+  }
+
+  // The trackers used while parsing are not part of the snapshot, so no more
+  // data can be parsed on top of it.
+  unrecoverable_parse_error_ = true;
+  NotifyEndOfFile();
+  return true;
+#endif
 }
 
 void TraceProcessorImpl::ExecuteQuery(
@@ -220,143 +549,321 @@ void TraceProcessorImpl::ExecuteQuery(
   const std::string& sql = args.sql_query();
   context_.storage->mutable_sql_stats()->RecordQueryBegin(
       sql, static_cast<int64_t>(args.time_queued_ns()), t_start.count());
-  sqlite3_stmt* raw_stmt;
-  int err = sqlite3_prepare_v2(*db_, sql.c_str(), static_cast<int>(sql.size()),
-                               &raw_stmt, nullptr);
-  ScopedStmt stmt(raw_stmt);
-
-  int col_count = sqlite3_column_count(*stmt);
-  int row_count = 0;
-
-  while (!err) {
-    int r = sqlite3_step(*stmt);
-    if (r != SQLITE_ROW) {
-      if (r != SQLITE_DONE)
-        err = r;
-      break;
-    }
-
-    using ColumnDesc = protos::RawQueryResult::ColumnDesc;
-    for (int col = 0; col < col_count; col++) {
-      if (row_count == 0) {
-        // Setup the descriptors.
-        auto* descriptor = proto.add_column_descriptors();
-        descriptor->set_name(sqlite3_column_name(*stmt, col));
-        descriptor->set_type(ColumnDesc::UNKNOWN);
-
-        // Add an empty column.
-        proto.add_columns();
-      }
-
-      auto* column = proto.mutable_columns(col);
-      auto* desc = proto.mutable_column_descriptors(col);
-      auto col_type = sqlite3_column_type(*stmt, col);
-      if (desc->type() == ColumnDesc::UNKNOWN) {
-        switch (col_type) {
-          case SQLITE_INTEGER:
-            desc->set_type(ColumnDesc::LONG);
-            break;
-          case SQLITE_TEXT:
-            desc->set_type(ColumnDesc::STRING);
-            break;
-          case SQLITE_FLOAT:
-            desc->set_type(ColumnDesc::DOUBLE);
-            break;
-          case SQLITE_NULL:
-            break;
-        }
-      }
 
-      // If either the column type is null or we still don't know the type,
-      // just add null values to all the columns.
-      if (col_type == SQLITE_NULL || desc->type() == ColumnDesc::UNKNOWN) {
-        column->add_long_values(0);
-        column->add_string_values("[NULL]");
-        column->add_double_values(0);
-        column->add_is_nulls(true);
-        continue;
-      }
-
-      // Cast the sqlite value to the type of the column.
-      switch (desc->type()) {
-        case ColumnDesc::LONG:
-          column->add_long_values(sqlite3_column_int64(*stmt, col));
-          column->add_is_nulls(false);
-          break;
-        case ColumnDesc::STRING: {
-          const char* str =
-              reinterpret_cast<const char*>(sqlite3_column_text(*stmt, col));
-          column->add_string_values(str);
-          column->add_is_nulls(false);
-          break;
-        }
-        case ColumnDesc::DOUBLE:
-          column->add_double_values(sqlite3_column_double(*stmt, col));
-          column->add_is_nulls(false);
-          break;
-        case ColumnDesc::UNKNOWN:
-          PERFETTO_FATAL("Handled in if statement above.");
-      }
+  // Cached results are returned as they were, including their execution
+  // time.
+  if (config_.query_result_cache_size > 0) {
+    std::unique_ptr<CachedResult>* cached =
+        result_cache_.Find(base::StringView(sql));
+    if (cached && (*cached)->storage_generation == storage_generation_) {
+      context_.storage->IncrementStats(stats::query_result_cache_hits);
+      context_.storage->mutable_sql_stats()->RecordQueryEnd(
+          base::GetWallTimeNs().count());
+      callback((*cached)->result);
+      return;
     }
-    row_count++;
+    context_.storage->IncrementStats(stats::query_result_cache_misses);
   }
 
-  if (err) {
-    proto.set_error(sqlite3_errmsg(*db_));
+  bool results_cacheable = false;
+  Iterator it = ExecuteQueryInternal(base::StringView(sql), &results_cacheable);
+
+  if (!ReadRawQueryResult(&it, &proto)) {
     callback(std::move(proto));
     return;
   }
 
-  proto.set_num_records(static_cast<uint64_t>(row_count));
-
   if (query_interrupted_.load()) {
     PERFETTO_ELOG("SQLite query interrupted");
     query_interrupted_ = false;
+    results_cacheable = false;
   }
 
   base::TimeNanos t_end = base::GetWallTimeNs();
   context_.storage->mutable_sql_stats()->RecordQueryEnd(t_end.count());
   proto.set_execution_time_ns(static_cast<uint64_t>((t_end - t_start).count()));
-  callback(proto);
+  if (!results_cacheable || config_.query_result_cache_size == 0) {
+    callback(proto);
+    return;
+  }
+  std::unique_ptr<CachedResult> cached(new CachedResult());
+  cached->storage_generation = storage_generation_;
+  cached->result.Swap(&proto);
+  const protos::RawQueryResult& result = cached->result;
+  result_cache_.Insert(sql, std::move(cached));
+  callback(result);
 }
 
 TraceProcessor::Iterator TraceProcessorImpl::ExecuteQuery(
     base::StringView sql) {
-  sqlite3_stmt* raw_stmt;
-  int err = sqlite3_prepare_v2(*db_, sql.data(), static_cast<int>(sql.size()),
-                               &raw_stmt, nullptr);
+  return ExecuteQueryInternal(sql, nullptr);
+}
 
-  uint32_t col_count = 0;
+TraceProcessor::Iterator TraceProcessorImpl::ExecuteQueryInternal(
+    base::StringView sql,
+    bool* results_cacheable) {
   base::Optional<std::string> error;
-  if (err) {
-    error = base::Optional<std::string>(sqlite3_errmsg(*db_));
-  } else {
+  PreparedStatement statement = PrepareStatement(sql, &error);
+
+  uint32_t col_count = 0;
+  if (!error.has_value()) {
+    sqlite3_stmt* raw_stmt = *statement.stmt;
     col_count = static_cast<uint32_t>(sqlite3_column_count(raw_stmt));
+    // Any statement which may write to the database invalidates the cached
+    // results.
+    if (raw_stmt && !sqlite3_stmt_readonly(raw_stmt))
+      storage_generation_++;
   }
+  if (results_cacheable)
+    *results_cacheable = !error.has_value() && statement.results_cacheable;
 
-  std::unique_ptr<IteratorImpl> impl(
-      new IteratorImpl(this, *db_, ScopedStmt(raw_stmt), col_count, error));
+  std::unique_ptr<IteratorImpl> impl(new IteratorImpl(
+      this, *db_, std::move(statement.stmt), col_count, error,
+      sql.ToStdString(), statement.results_cacheable));
   iterators_.emplace_back(impl.get());
   return TraceProcessor::Iterator(std::move(impl));
 }
 
+TraceProcessorImpl::PreparedStatement TraceProcessorImpl::PrepareStatement(
+    base::StringView sql,
+    base::Optional<std::string>* error) {
+  PreparedStatement statement;
+  if (statement_cache_.Take(sql, &statement)) {
+    context_.storage->IncrementStats(stats::query_statement_cache_hits);
+    return statement;
+  }
+  context_.storage->IncrementStats(stats::query_statement_cache_misses);
+
+  sqlite3_stmt* raw_stmt = nullptr;
+  prepare_has_volatile_results_ = false;
+  int err = sqlite3_prepare_v2(*db_, sql.data(), static_cast<int>(sql.size()),
+                               &raw_stmt, nullptr);
+  statement.stmt.reset(raw_stmt);
+  if (err) {
+    *error = base::Optional<std::string>(sqlite3_errmsg(*db_));
+    return statement;
+  }
+  statement.results_cacheable = raw_stmt && sqlite3_stmt_readonly(raw_stmt) &&
+                                !prepare_has_volatile_results_;
+  return statement;
+}
+
+void TraceProcessorImpl::ReleaseStatement(std::string sql,
+                                          PreparedStatement statement) {
+  sqlite3_reset(*statement.stmt);
+  sqlite3_clear_bindings(*statement.stmt);
+  statement_cache_.Insert(std::move(sql), std::move(statement));
+}
+
+// static
+int TraceProcessorImpl::AuthorizeStatement(void* self,
+                                           int action,
+                                           const char* arg1,
+                                           const char* arg2,
+                                           const char*,
+                                           const char*) {
+  // The stats tables change with every query, so the results of the queries
+  // reading them can't be cached.
+  if (action == SQLITE_READ && arg1 &&
+      (strcmp(arg1, "sqlstats") == 0 || strcmp(arg1, "stats") == 0)) {
+    static_cast<TraceProcessorImpl*>(self)->prepare_has_volatile_results_ =
+        true;
+  }
+  // Nor can the results of the functions which don't only depend on their
+  // arguments. The date and time functions can read the current time.
+  static const char* const kVolatileFunctions[] = {
+      "random", "randomblob", "changes",  "total_changes", "last_insert_rowid",
+      "date",   "time",       "datetime", "julianday",     "strftime"};
+  if (action == SQLITE_FUNCTION && arg2) {
+    for (const char* function : kVolatileFunctions) {
+      if (sqlite3_stricmp(arg2, function) == 0) {
+        static_cast<TraceProcessorImpl*>(self)->prepare_has_volatile_results_ =
+            true;
+        break;
+      }
+    }
+  }
+  return SQLITE_OK;
+}
+
+void TraceProcessorImpl::OpenQuery(
+    const protos::RawQueryArgs& args,
+    std::function<void(const protos::QueryCursor&)> callback) {
+  protos::QueryCursor proto;
+  Iterator it = ExecuteQuery(base::StringView(args.sql_query()));
+  base::Optional<std::string> error = it.GetLastError();
+  if (error.has_value()) {
+    proto.set_error(*error);
+    callback(proto);
+    return;
+  }
+  for (uint32_t col = 0; col < it.ColumnCount(); col++) {
+    auto* desc = proto.add_column_descriptors();
+    desc->set_name(it.GetColumnName(col));
+    desc->set_type(protos::RawQueryResult::ColumnDesc::UNKNOWN);
+  }
+  // The cursors are held until the last batch or until CloseQuery(): don't
+  // let an embedder which forgets to close them hold their statements forever.
+  // The ids only increase, so the first cursor is the least recently opened.
+  if (cursors_.size() >= kMaxOpenCursors)
+    cursors_.erase(cursors_.begin());
+  uint32_t cursor_id = ++last_cursor_id_;
+  cursors_.emplace(cursor_id, std::move(it));
+  proto.set_cursor_id(cursor_id);
+  callback(proto);
+}
+
+void TraceProcessorImpl::FetchQueryRows(
+    const protos::FetchQueryRowsArgs& args,
+    std::function<void(const protos::QueryRowsBatch&)> callback) {
+  protos::QueryRowsBatch proto;
+  auto cursor = cursors_.find(args.cursor_id());
+  if (cursor == cursors_.end()) {
+    proto.set_error("Invalid cursor");
+    callback(proto);
+    return;
+  }
+
+  const uint32_t kDefaultBatchRows = 1000;
+  uint32_t max_rows = args.max_rows() ? args.max_rows() : kDefaultBatchRows;
+  Iterator* it = &cursor->second;
+  ColumnarBatch batch;
+  Iterator::NextResult res = it->NextBatch(max_rows, &batch);
+  if (res == Iterator::NextResult::kError) {
+    proto.set_error(*it->GetLastError());
+    cursors_.erase(cursor);
+    callback(proto);
+    return;
+  }
+
+  proto.set_num_rows(batch.num_rows);
+  for (const ColumnarBatch::Column& values : batch.columns)
+    EncodeColumnBatch(batch, values, proto.add_columns());
+  for (const std::string& str : batch.strings)
+    proto.add_strings(str);
+
+  // NextBatch() only returns fewer rows than requested at the end.
+  if (batch.num_rows < max_rows) {
+    proto.set_is_last_batch(true);
+    cursors_.erase(cursor);
+  }
+  callback(proto);
+}
+
+void TraceProcessorImpl::CloseQuery(
+    const protos::CloseQueryArgs& args,
+    std::function<void(const protos::CloseQueryResult&)> callback) {
+  cursors_.erase(args.cursor_id());
+  callback(protos::CloseQueryResult());
+}
+
 void TraceProcessorImpl::InterruptQuery() {
   if (!db_)
     return;
   query_interrupted_.store(true);
   sqlite3_interrupt(db_.get());
+  size_t num_read_only_dbs = num_read_only_dbs_.load();
+  for (size_t i = 0; i < num_read_only_dbs; i++)
+    sqlite3_interrupt(read_only_dbs_[i].get());
+}
+
+void TraceProcessorImpl::ExecuteQueries(
+    const std::vector<std::string>& queries,
+    uint32_t max_threads,
+    std::function<void(size_t, const protos::RawQueryResult&)> callback) {
+  std::vector<protos::RawQueryResult> results(queries.size());
+  if (!end_of_file_) {
+    for (size_t i = 0; i < queries.size(); i++) {
+      results[i].set_error("Queries can only run in parallel after the end "
+                           "of the trace");
+      callback(i, results[i]);
+    }
+    return;
+  }
+
+  size_t num_threads = max_threads;
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  num_threads = 1;
+#else
+  if (num_threads == 0)
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+#endif
+  num_threads = std::min({num_threads, queries.size(), kMaxQueryThreads});
+  for (size_t i = num_read_only_dbs_.load(); i < num_threads; i++) {
+    read_only_dbs_[i] = CreateReadOnlyDb();
+    num_read_only_dbs_.store(i + 1);
+  }
+
+  // The threads take the next query to run from |next_query|. Each of them
+  // only writes to the results of the queries it took.
+  query_interrupted_.store(false, std::memory_order_relaxed);
+  int64_t time_queued = base::GetWallTimeNs().count();
+  std::vector<int64_t> times_started(queries.size());
+  std::atomic<size_t> next_query{0};
+  auto run_queries = [&queries, &results, &times_started,
+                      &next_query](sqlite3* db) {
+    for (size_t i = next_query++; i < queries.size(); i = next_query++)
+      times_started[i] = ExecuteReadOnlyQuery(db, queries[i], &results[i]);
+  };
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  if (num_threads > 0)
+    run_queries(*read_only_dbs_[0]);
+#else
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; i++)
+    threads.emplace_back(run_queries, *read_only_dbs_[i]);
+  for (std::thread& thread : threads)
+    thread.join();
+#endif
+
+  if (query_interrupted_.load()) {
+    PERFETTO_ELOG("SQLite query interrupted");
+    query_interrupted_ = false;
+  }
+
+  auto* sql_stats = context_.storage->mutable_sql_stats();
+  for (size_t i = 0; i < queries.size(); i++) {
+    sql_stats->RecordQueryBegin(queries[i], time_queued, times_started[i]);
+    sql_stats->RecordQueryEnd(
+        times_started[i] +
+        static_cast<int64_t>(results[i].execution_time_ns()));
+    callback(i, results[i]);
+  }
+}
+
+ScopedDb TraceProcessorImpl::CreateReadOnlyDb() {
+  sqlite3* db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+  ScopedDb scoped_db(db);
+  InitializeSqliteModules(db);
+  CreateBuiltinTables(db);
+  RegisterTables(db, context_.storage.get());
+  BuildBoundsTable(db, context_.storage->GetTraceTimestampBoundsNs());
+
+  char* error = nullptr;
+  sqlite3_exec(db, "PRAGMA query_only = 1", nullptr, nullptr, &error);
+  if (error) {
+    PERFETTO_ELOG("Error initializing: %s", error);
+    sqlite3_free(error);
+  }
+  return scoped_db;
 }
 
 TraceProcessor::IteratorImpl::IteratorImpl(TraceProcessorImpl* trace_processor,
                                            sqlite3* db,
                                            ScopedStmt stmt,
                                            uint32_t column_count,
-                                           base::Optional<std::string> error)
+                                           base::Optional<std::string> error,
+                                           std::string sql,
+                                           bool results_cacheable)
     : trace_processor_(trace_processor),
       db_(db),
       stmt_(std::move(stmt)),
       column_count_(column_count),
-      error_(error) {}
+      error_(error),
+      sql_(std::move(sql)),
+      results_cacheable_(results_cacheable),
+      column_types_(column_count, SqlValue::kNull) {}
 
 TraceProcessor::IteratorImpl::~IteratorImpl() {
   if (trace_processor_) {
@@ -364,9 +871,131 @@ TraceProcessor::IteratorImpl::~IteratorImpl() {
     auto it = std::find(its->begin(), its->end(), this);
     PERFETTO_CHECK(it != its->end());
     its->erase(it);
+
+    if (stmt_) {
+      // The statement may have changed the database while it was stepped,
+      // after ExecuteQueryInternal() invalidated the cached results.
+      if (!sqlite3_stmt_readonly(*stmt_))
+        trace_processor_->storage_generation_++;
+      TraceProcessorImpl::PreparedStatement statement;
+      statement.stmt = std::move(stmt_);
+      statement.results_cacheable = results_cacheable_;
+      trace_processor_->ReleaseStatement(std::move(sql_),
+                                         std::move(statement));
+    }
   }
 }
 
+TraceProcessor::Iterator::NextResult TraceProcessor::IteratorImpl::NextBatch(
+    uint32_t max_rows,
+    ColumnarBatch* batch) {
+  using Result = TraceProcessor::Iterator::NextResult;
+  batch->num_rows = 0;
+  batch->columns.resize(column_count_);
+  for (ColumnarBatch::Column& column : batch->columns) {
+    column.is_nulls.clear();
+    column.long_values.clear();
+    column.double_values.clear();
+    column.string_ids.clear();
+  }
+  batch->strings.clear();
+  batch_string_ids_.clear();
+  batch_string_ptrs_.clear();
+  if (error_.has_value())
+    return Result::kError;
+
+  sqlite3_stmt* stmt = *stmt_;
+  while (!done_ && batch->num_rows < max_rows) {
+    int ret = sqlite3_step(stmt);
+    if (ret == SQLITE_DONE) {
+      done_ = true;
+      break;
+    }
+    if (ret != SQLITE_ROW) {
+      error_ = base::Optional<std::string>(sqlite3_errmsg(db_));
+      return Result::kError;
+    }
+
+    const uint32_t row = batch->num_rows++;
+    for (uint32_t col = 0; col < column_count_; col++) {
+      ColumnarBatch::Column* column = &batch->columns[col];
+      auto sql_col = static_cast<int>(col);
+      int col_type = sqlite3_column_type(stmt, sql_col);
+      bool is_null = col_type == SQLITE_NULL;
+      column->is_nulls.push_back(is_null);
+
+      // The first non-null value gives the type of the column. The previous
+      // rows of the batch were all null, their values are padded.
+      SqlValue::Type* type = &column_types_[col];
+      if (*type == SqlValue::kNull) {
+        switch (col_type) {
+          case SQLITE_INTEGER:
+            *type = SqlValue::kLong;
+            column->long_values.resize(row);
+            break;
+          case SQLITE_TEXT:
+            *type = SqlValue::kString;
+            column->string_ids.resize(row);
+            break;
+          case SQLITE_FLOAT:
+            *type = SqlValue::kDouble;
+            column->double_values.resize(row);
+            break;
+          case SQLITE_NULL:
+            continue;
+        }
+      }
+
+      switch (*type) {
+        case SqlValue::kLong:
+          column->long_values.push_back(
+              is_null ? 0 : sqlite3_column_int64(stmt, sql_col));
+          break;
+        case SqlValue::kDouble:
+          column->double_values.push_back(
+              is_null ? 0 : sqlite3_column_double(stmt, sql_col));
+          break;
+        case SqlValue::kString: {
+          if (is_null) {
+            column->string_ids.push_back(0);
+            break;
+          }
+          const char* str = reinterpret_cast<const char*>(
+              sqlite3_column_text(stmt, sql_col));
+          column->string_ids.push_back(GetBatchStringId(str, batch));
+          break;
+        }
+        case SqlValue::kNull:
+          PERFETTO_FATAL("Handled above");
+      }
+    }
+  }
+
+  for (uint32_t col = 0; col < column_count_; col++)
+    batch->columns[col].type = column_types_[col];
+  return batch->num_rows > 0 ? Result::kHasNext : Result::kEOF;
+}
+
+uint32_t TraceProcessor::IteratorImpl::GetBatchStringId(
+    const char* str,
+    ColumnarBatch* batch) {
+  // The strings of the tables point into the string pool, so the same pointer
+  // is most likely the same string. This is much faster than hashing it.
+  auto ptr_it = batch_string_ptrs_.find(str);
+  if (ptr_it != batch_string_ptrs_.end() &&
+      strcmp(batch->strings[ptr_it->second].c_str(), str) == 0) {
+    return ptr_it->second;
+  }
+
+  auto id = static_cast<uint32_t>(batch->strings.size());
+  auto it_and_inserted = batch_string_ids_.emplace(str, id);
+  if (it_and_inserted.second)
+    batch->strings.emplace_back(str);
+  id = it_and_inserted.first->second;
+  batch_string_ptrs_[str] = id;
+  return id;
+}
+
 void TraceProcessor::IteratorImpl::Reset() {
   *this = IteratorImpl(nullptr, nullptr, ScopedStmt(), 0, base::nullopt);
 }
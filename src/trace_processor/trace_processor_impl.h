@@ -18,20 +18,30 @@
 #define SRC_TRACE_PROCESSOR_TRACE_PROCESSOR_IMPL_H_
 
 #include <sqlite3.h>
+#include <array>
 #include <atomic>
 #include <functional>
+#include <map>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "perfetto/base/string_view.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/lru_cache.h"
 #include "src/trace_processor/scoped_db.h"
 #include "src/trace_processor/trace_processor_context.h"
 
 namespace perfetto {
 
 namespace protos {
+class CloseQueryArgs;
+class CloseQueryResult;
+class FetchQueryRowsArgs;
+class QueryCursor;
+class QueryRowsBatch;
 class RawQueryArgs;
 class RawQueryResult;
 }  // namespace protos
@@ -50,32 +60,123 @@ TraceType GuessTraceType(const uint8_t* data, size_t size);
 // execution of SQL queries on the events in these traces.
 class TraceProcessorImpl : public TraceProcessor {
  public:
+  // Maximum number of queries opened by OpenQuery() and not closed yet. Past
+  // it, opening a query closes the least recently opened one.
+  static constexpr size_t kMaxOpenCursors = 16;
+
   explicit TraceProcessorImpl(const Config&);
 
   ~TraceProcessorImpl() override;
 
   bool Parse(std::unique_ptr<uint8_t[]>, size_t) override;
 
+  bool ParseMappedFile(const std::string& path) override;
+
   void NotifyEndOfFile() override;
 
+  bool SaveSnapshot(const std::string& path) override;
+
+  bool LoadSnapshot(const std::string& path) override;
+
   void ExecuteQuery(
       const protos::RawQueryArgs&,
       std::function<void(const protos::RawQueryResult&)>) override;
 
   Iterator ExecuteQuery(base::StringView sql) override;
 
+  void OpenQuery(const protos::RawQueryArgs&,
+                 std::function<void(const protos::QueryCursor&)>) override;
+
+  void FetchQueryRows(
+      const protos::FetchQueryRowsArgs&,
+      std::function<void(const protos::QueryRowsBatch&)>) override;
+
+  void CloseQuery(
+      const protos::CloseQueryArgs&,
+      std::function<void(const protos::CloseQueryResult&)>) override;
+
+  void ExecuteQueries(
+      const std::vector<std::string>& queries,
+      uint32_t max_threads,
+      std::function<void(size_t, const protos::RawQueryResult&)>) override;
+
   void InterruptQuery() override;
 
  private:
   // Needed for iterators to be able to delete themselves from the vector.
   friend class IteratorImpl;
 
+  // A prepared statement and whether the results of its queries can be
+  // cached until the storage changes.
+  struct PreparedStatement {
+    ScopedStmt stmt;
+    bool results_cacheable = false;
+  };
+
+  // Guesses the trace type from the first chunk of the trace and creates the
+  // appropriate ChunkedTraceReader. Returns false if the type is unknown.
+  bool CreateChunkReader(const uint8_t* data, size_t size);
+
+  // Like ExecuteQuery(), but also returns whether the results of the query
+  // can be cached.
+  Iterator ExecuteQueryInternal(base::StringView sql, bool* results_cacheable);
+
+  // Returns the statement for |sql|, from the statement cache if possible.
+  PreparedStatement PrepareStatement(base::StringView sql,
+                                     base::Optional<std::string>* error);
+
+  // Called by the iterators when they are done with their statement, to keep
+  // it in the statement cache.
+  void ReleaseStatement(std::string sql, PreparedStatement statement);
+
+  // Creates a query_only connection on the tables of the trace, for
+  // ExecuteQueries().
+  ScopedDb CreateReadOnlyDb();
+
+  // Called by the SQLite authorizer when preparing a statement.
+  static int AuthorizeStatement(void* self,
+                                int action,
+                                const char* arg1,
+                                const char* arg2,
+                                const char* db_name,
+                                const char* view_name);
+
   ScopedDb db_;  // Keep first.
+  const Config config_;
   TraceProcessorContext context_;
   bool unrecoverable_parse_error_ = false;
+  bool end_of_file_ = false;
+
+  // The connections used by ExecuteQueries(), one per thread. They are kept
+  // for the next calls. InterruptQuery() can be called from a signal handler
+  // on any thread: it only reads the first |num_read_only_dbs_| connections,
+  // which are published once created and never move.
+  static constexpr size_t kMaxQueryThreads = 64;
+  std::array<ScopedDb, kMaxQueryThreads> read_only_dbs_;
+  std::atomic<size_t> num_read_only_dbs_{0};
 
   std::vector<IteratorImpl*> iterators_;
 
+  // The statements not used by any iterator, by SQL text.
+  LruCache<PreparedStatement> statement_cache_;
+
+  // Set by AuthorizeStatement() when the results of the statement being
+  // prepared can change without the tables changing: it reads a table which
+  // changes with each query, like sqlstats, or calls a non deterministic
+  // function, like random().
+  bool prepare_has_volatile_results_ = false;
+
+  // The results of the last queries, by SQL text, with the storage generation
+  // they were computed at. The generation is bumped on every Parse() call
+  // and every statement which may change the tables.
+  struct CachedResult;
+  LruCache<std::unique_ptr<CachedResult>> result_cache_;
+  uint64_t storage_generation_ = 0;
+
+  // The queries opened by OpenQuery(), by cursor id.
+  std::map<uint32_t, Iterator> cursors_;
+  uint32_t last_cursor_id_ = 0;
+
   // This is atomic because it is set by the CTRL-C signal handler and we need
   // to prevent single-flow compiler optimizations in ExecuteQuery().
   std::atomic<bool> query_interrupted_{false};
@@ -88,7 +189,9 @@ class TraceProcessor::IteratorImpl {
                sqlite3* db,
                ScopedStmt,
                uint32_t column_count,
-               base::Optional<std::string> error);
+               base::Optional<std::string> error,
+               std::string sql = std::string(),
+               bool results_cacheable = false);
   ~IteratorImpl();
 
   IteratorImpl(IteratorImpl&) noexcept = delete;
@@ -136,8 +239,14 @@ class TraceProcessor::IteratorImpl {
     return value;
   }
 
+  Iterator::NextResult NextBatch(uint32_t max_rows, ColumnarBatch* batch);
+
   uint32_t ColumnCount() { return column_count_; }
 
+  std::string GetColumnName(uint32_t col) {
+    return sqlite3_column_name(*stmt_, static_cast<int>(col));
+  }
+
   base::Optional<std::string> GetLastError() { return error_; }
 
   bool IsValid() { return trace_processor_ != nullptr; }
@@ -146,11 +255,27 @@ class TraceProcessor::IteratorImpl {
   void Reset();
 
  private:
+  // Returns the index of |str| in the strings of |batch|, adding it if
+  // needed.
+  uint32_t GetBatchStringId(const char* str, ColumnarBatch* batch);
+
   TraceProcessorImpl* trace_processor_;
   sqlite3* db_ = nullptr;
   ScopedStmt stmt_;
   uint32_t column_count_ = 0;
   base::Optional<std::string> error_;
+
+  // The text of the statement, to return it to the statement cache.
+  std::string sql_;
+  bool results_cacheable_ = false;
+
+  // State of NextBatch(): the type of the columns so far, the indices of the
+  // strings of the current batch by value and by address, and whether the
+  // query has returned all the rows.
+  std::vector<SqlValue::Type> column_types_;
+  std::unordered_map<std::string, uint32_t> batch_string_ids_;
+  std::unordered_map<const char*, uint32_t> batch_string_ptrs_;
+  bool done_ = false;
 };
 
 }  // namespace trace_processor
@@ -16,9 +16,16 @@
 
 #include "src/trace_processor/trace_processor_impl.h"
 
+#include <string.h>
+
+#include <string>
+#include <vector>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+#include "perfetto/trace_processor/raw_query.pb.h"
+
 namespace perfetto {
 namespace trace_processor {
 namespace {
@@ -48,6 +55,350 @@ TEST(TraceProcessorImplTest, GuessTraceType_Proto) {
   EXPECT_EQ(kProtoTraceType, GuessTraceType(prefix, sizeof(prefix)));
 }
 
+// 10000 rows with a long column, a double column which is null in the first
+// half, a string column with some nulls and a null column.
+constexpr char kBatchQuery[] =
+    "WITH RECURSIVE n(x) AS (SELECT 0 UNION ALL SELECT x + 1 FROM n "
+    "WHERE x < 9999) "
+    "SELECT x, CASE WHEN x < 5000 THEN NULL ELSE x * 0.5 END AS d, "
+    "CASE WHEN x % 3 = 0 THEN NULL ELSE 'str' || (x % 10) END AS s, "
+    "NULL AS n FROM n";
+
+TEST(TraceProcessorImplTest, NextBatch) {
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  auto rows_it = tp->ExecuteQuery(kBatchQuery);
+  auto batch_it = tp->ExecuteQuery(kBatchQuery);
+  ASSERT_EQ(batch_it.ColumnCount(), 4u);
+  ASSERT_EQ(batch_it.GetColumnName(2), "s");
+
+  ColumnarBatch batch;
+  uint32_t rows = 0;
+  while (batch_it.NextBatch(3000, &batch) ==
+         TraceProcessor::Iterator::NextResult::kHasNext) {
+    ASSERT_EQ(batch.num_rows, std::min(3000u, 10000 - rows));
+    ASSERT_EQ(batch.columns.size(), 4u);
+    ASSERT_EQ(batch.columns[0].type, SqlValue::kLong);
+    SqlValue::Type double_type =
+        rows + batch.num_rows > 5000 ? SqlValue::kDouble : SqlValue::kNull;
+    ASSERT_EQ(batch.columns[1].type, double_type);
+    ASSERT_EQ(batch.columns[2].type, SqlValue::kString);
+    ASSERT_EQ(batch.columns[3].type, SqlValue::kNull);
+    // The strings of the batch are deduplicated.
+    ASSERT_LE(batch.strings.size(), 10u);
+
+    for (uint32_t r = 0; r < batch.num_rows; r++, rows++) {
+      ASSERT_EQ(rows_it.Next(), TraceProcessor::Iterator::NextResult::kHasNext);
+      for (uint32_t c = 0; c < 4; c++) {
+        const ColumnarBatch::Column& col = batch.columns[c];
+        SqlValue value = rows_it.Get(c);
+        ASSERT_EQ(col.is_nulls[r], value.type == SqlValue::kNull);
+        if (value.type == SqlValue::kLong) {
+          ASSERT_EQ(col.long_values[r], value.long_value);
+        } else if (value.type == SqlValue::kDouble) {
+          ASSERT_EQ(col.double_values[r], value.double_value);
+        } else if (value.type == SqlValue::kString) {
+          ASSERT_EQ(batch.strings[col.string_ids[r]], value.string_value);
+        }
+      }
+    }
+  }
+  ASSERT_EQ(rows, 10000u);
+  ASSERT_EQ(rows_it.Next(), TraceProcessor::Iterator::NextResult::kEOF);
+  ASSERT_EQ(batch_it.NextBatch(3000, &batch),
+            TraceProcessor::Iterator::NextResult::kEOF);
+  ASSERT_EQ(batch.num_rows, 0u);
+
+  auto error_it = tp->ExecuteQuery("SELECT * FROM no_such_table");
+  ASSERT_EQ(error_it.NextBatch(3000, &batch),
+            TraceProcessor::Iterator::NextResult::kError);
+  ASSERT_TRUE(error_it.GetLastError().has_value());
+}
+
+TEST(TraceProcessorImplTest, RawQueryResult) {
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  protos::RawQueryArgs args;
+  args.set_sql_query(kBatchQuery);
+  protos::RawQueryResult res;
+  tp->ExecuteQuery(args, [&res](const protos::RawQueryResult& r) { res = r; });
+
+  using ColumnDesc = protos::RawQueryResult::ColumnDesc;
+  ASSERT_FALSE(res.has_error());
+  ASSERT_EQ(res.num_records(), 10000u);
+  ASSERT_EQ(res.column_descriptors_size(), 4);
+  ASSERT_EQ(res.column_descriptors(0).name(), "x");
+  ASSERT_EQ(res.column_descriptors(0).type(), ColumnDesc::LONG);
+  ASSERT_EQ(res.column_descriptors(1).type(), ColumnDesc::DOUBLE);
+  ASSERT_EQ(res.column_descriptors(2).type(), ColumnDesc::STRING);
+  ASSERT_EQ(res.column_descriptors(3).type(), ColumnDesc::UNKNOWN);
+  for (int c = 0; c < 4; c++)
+    ASSERT_EQ(res.columns(c).is_nulls_size(), 10000);
+
+  // The null rows have a value in the vector of the type of the column.
+  ASSERT_EQ(res.columns(0).long_values(9999), 9999);
+  ASSERT_EQ(res.columns(1).double_values_size(), 10000);
+  ASSERT_TRUE(res.columns(1).is_nulls(4999));
+  ASSERT_EQ(res.columns(1).double_values(5001), 2500.5);
+  ASSERT_EQ(res.columns(2).string_values_size(), 10000);
+  ASSERT_EQ(res.columns(2).string_values(3), "[NULL]");
+  ASSERT_EQ(res.columns(2).string_values(4), "str4");
+  ASSERT_EQ(res.columns(3).long_values_size(), 10000);
+  ASSERT_EQ(res.columns(3).string_values_size(), 10000);
+  ASSERT_EQ(res.columns(3).double_values_size(), 10000);
+
+  args.set_sql_query("SELECT * FROM no_such_table");
+  tp->ExecuteQuery(args, [&res](const protos::RawQueryResult& r) { res = r; });
+  ASSERT_TRUE(res.has_error());
+}
+
+TEST(TraceProcessorImplTest, StreamingQuery) {
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  protos::RawQueryArgs args;
+  args.set_sql_query(kBatchQuery);
+  protos::RawQueryResult expected;
+  tp->ExecuteQuery(
+      args, [&expected](const protos::RawQueryResult& r) { expected = r; });
+
+  protos::QueryCursor cursor;
+  tp->OpenQuery(args, [&cursor](const protos::QueryCursor& r) { cursor = r; });
+  ASSERT_FALSE(cursor.has_error());
+  ASSERT_EQ(cursor.column_descriptors_size(), 4);
+  ASSERT_EQ(cursor.column_descriptors(1).name(), "d");
+
+  using ColumnDesc = protos::RawQueryResult::ColumnDesc;
+  protos::FetchQueryRowsArgs fetch_args;
+  fetch_args.set_cursor_id(cursor.cursor_id());
+  fetch_args.set_max_rows(3000);
+  protos::QueryRowsBatch batch;
+  int rows = 0;
+  do {
+    tp->FetchQueryRows(
+        fetch_args, [&batch](const protos::QueryRowsBatch& r) { batch = r; });
+    ASSERT_FALSE(batch.has_error());
+    ASSERT_EQ(batch.columns_size(), 4);
+    ASSERT_EQ(batch.columns(0).type(), ColumnDesc::LONG);
+    ASSERT_EQ(batch.columns(3).type(), ColumnDesc::UNKNOWN);
+    for (int r = 0; r < static_cast<int>(batch.num_rows()); r++, rows++) {
+      for (int c = 0; c < 4; c++) {
+        const auto& col = batch.columns(c);
+        bool is_null = !col.null_bitmap().empty() &&
+                       (col.null_bitmap()[static_cast<size_t>(r / 8)] >>
+                        (r % 8)) & 1;
+        ASSERT_EQ(is_null, expected.columns(c).is_nulls(rows));
+        if (is_null)
+          continue;
+        if (col.type() == ColumnDesc::LONG) {
+          ASSERT_EQ(col.long_values(r), expected.columns(c).long_values(rows));
+        } else if (col.type() == ColumnDesc::DOUBLE) {
+          ASSERT_EQ(col.double_values(r),
+                    expected.columns(c).double_values(rows));
+        } else {
+          ASSERT_EQ(col.type(), ColumnDesc::STRING);
+          ASSERT_EQ(batch.strings(static_cast<int>(col.string_ids(r))),
+                    expected.columns(c).string_values(rows));
+        }
+      }
+    }
+    ASSERT_EQ(batch.is_last_batch(), rows == 10000);
+  } while (!batch.is_last_batch());
+
+  // The cursor is closed after the last batch.
+  tp->FetchQueryRows(fetch_args,
+                     [&batch](const protos::QueryRowsBatch& r) { batch = r; });
+  ASSERT_TRUE(batch.has_error());
+
+  // Queries can be closed before the last batch.
+  tp->OpenQuery(args, [&cursor](const protos::QueryCursor& r) { cursor = r; });
+  fetch_args.set_cursor_id(cursor.cursor_id());
+  protos::CloseQueryArgs close_args;
+  close_args.set_cursor_id(cursor.cursor_id());
+  tp->CloseQuery(close_args, [](const protos::CloseQueryResult&) {});
+  tp->FetchQueryRows(fetch_args,
+                     [&batch](const protos::QueryRowsBatch& r) { batch = r; });
+  ASSERT_TRUE(batch.has_error());
+
+  args.set_sql_query("SELECT * FROM no_such_table");
+  tp->OpenQuery(args, [&cursor](const protos::QueryCursor& r) { cursor = r; });
+  ASSERT_TRUE(cursor.has_error());
+
+  // The queries left open are closed with the trace processor.
+  args.set_sql_query(kBatchQuery);
+  tp->OpenQuery(args, [&cursor](const protos::QueryCursor& r) { cursor = r; });
+  ASSERT_FALSE(cursor.has_error());
+  tp.reset();
+}
+
+TEST(TraceProcessorImplTest, StreamingQueryCursorsAreCapped) {
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  protos::RawQueryArgs args;
+  args.set_sql_query(kBatchQuery);
+  std::vector<uint32_t> cursor_ids;
+  for (size_t i = 0; i < TraceProcessorImpl::kMaxOpenCursors + 2; i++) {
+    tp->OpenQuery(args, [&cursor_ids](const protos::QueryCursor& r) {
+      ASSERT_FALSE(r.has_error());
+      cursor_ids.push_back(r.cursor_id());
+    });
+  }
+
+  // The two least recently opened queries have been closed.
+  for (size_t i = 0; i < cursor_ids.size(); i++) {
+    protos::FetchQueryRowsArgs fetch_args;
+    fetch_args.set_cursor_id(cursor_ids[i]);
+    fetch_args.set_max_rows(1);
+    protos::QueryRowsBatch batch;
+    tp->FetchQueryRows(
+        fetch_args, [&batch](const protos::QueryRowsBatch& r) { batch = r; });
+    ASSERT_EQ(batch.has_error(), i < 2) << i;
+  }
+}
+
+int64_t GetStat(TraceProcessor* tp, const std::string& name) {
+  std::string sql = "SELECT value FROM stats WHERE name = '" + name + "'";
+  auto it = tp->ExecuteQuery(base::StringView(sql));
+  PERFETTO_CHECK(it.Next() == TraceProcessor::Iterator::NextResult::kHasNext);
+  return it.Get(0).long_value;
+}
+
+int64_t QueryLong(TraceProcessor* tp, const std::string& sql) {
+  protos::RawQueryArgs args;
+  args.set_sql_query(sql);
+  protos::RawQueryResult res;
+  tp->ExecuteQuery(args, [&res](const protos::RawQueryResult& r) { res = r; });
+  PERFETTO_CHECK(!res.has_error() && res.num_records() == 1);
+  return res.columns(0).long_values(0);
+}
+
+TEST(TraceProcessorImplTest, StatementCache) {
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  for (int i = 0; i < 3; i++) {
+    auto it = tp->ExecuteQuery("SELECT 1");
+    ASSERT_EQ(it.Next(), TraceProcessor::Iterator::NextResult::kHasNext);
+    ASSERT_EQ(it.Get(0).long_value, 1);
+  }
+  ASSERT_EQ(GetStat(tp.get(), "query_statement_cache_hits"), 2);
+
+  // The statements are only reused once their iterator is destroyed.
+  auto first = tp->ExecuteQuery("SELECT 2");
+  auto second = tp->ExecuteQuery("SELECT 2");
+  ASSERT_EQ(first.Next(), TraceProcessor::Iterator::NextResult::kHasNext);
+  ASSERT_EQ(second.Next(), TraceProcessor::Iterator::NextResult::kHasNext);
+  // The only new hit is the second query of the stats.
+  ASSERT_EQ(GetStat(tp.get(), "query_statement_cache_hits"), 3);
+}
+
+TEST(TraceProcessorImplTest, ResultCache) {
+  Config config;
+  config.query_result_cache_size = 4;
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+  ASSERT_EQ(QueryLong(tp.get(), "SELECT 42"), 42);
+  ASSERT_EQ(QueryLong(tp.get(), "SELECT 42"), 42);
+  ASSERT_EQ(GetStat(tp.get(), "query_result_cache_hits"), 1);
+  ASSERT_EQ(GetStat(tp.get(), "query_result_cache_misses"), 1);
+
+  // Statements changing the database invalidate the cache.
+  const char kCount[] = "SELECT count(*) FROM t";
+  tp->ExecuteQuery("CREATE TABLE t(x INT)").Next();
+  ASSERT_EQ(QueryLong(tp.get(), kCount), 0);
+  tp->ExecuteQuery("INSERT INTO t VALUES(1)").Next();
+  ASSERT_EQ(QueryLong(tp.get(), kCount), 1);
+  ASSERT_EQ(GetStat(tp.get(), "query_result_cache_hits"), 1);
+
+  // Including when they only run after the results have been cached.
+  {
+    auto insert = tp->ExecuteQuery("INSERT INTO t VALUES(2)");
+    ASSERT_EQ(QueryLong(tp.get(), kCount), 1);
+    insert.Next();
+  }
+  ASSERT_EQ(QueryLong(tp.get(), kCount), 2);
+  ASSERT_EQ(GetStat(tp.get(), "query_result_cache_hits"), 1);
+
+  // The results of non deterministic functions are never cached.
+  QueryLong(tp.get(), "SELECT random()");
+  QueryLong(tp.get(), "SELECT random()");
+  QueryLong(tp.get(), "SELECT changes()");
+  QueryLong(tp.get(), "SELECT changes()");
+  ASSERT_EQ(GetStat(tp.get(), "query_result_cache_hits"), 1);
+
+  // So does parsing more data.
+  const char kSlices[] = "SELECT count(*) FROM slices";
+  const char kTrace[] =
+      "{\"traceEvents\":[{\"ph\":\"X\",\"ts\":1,\"dur\":2,\"pid\":1,"
+      "\"tid\":1,\"name\":\"a\"}]}";
+  ASSERT_EQ(QueryLong(tp.get(), kSlices), 0);
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[sizeof(kTrace)]);
+  memcpy(buf.get(), kTrace, sizeof(kTrace));
+  ASSERT_TRUE(tp->Parse(std::move(buf), sizeof(kTrace) - 1));
+  tp->NotifyEndOfFile();
+  ASSERT_EQ(QueryLong(tp.get(), kSlices), 1);
+  ASSERT_EQ(QueryLong(tp.get(), kSlices), 1);
+  ASSERT_EQ(GetStat(tp.get(), "query_result_cache_hits"), 2);
+
+  // The results of queries on the stats tables are never cached.
+  const char kStats[] = "SELECT count(*) FROM sqlstats";
+  int64_t queries = QueryLong(tp.get(), kStats);
+  ASSERT_GT(QueryLong(tp.get(), kStats), queries);
+}
+
+TEST(TraceProcessorImplTest, ExecuteQueries) {
+  std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(Config());
+  std::string trace = "{\"traceEvents\":[";
+  for (int i = 0; i < 100; i++) {
+    trace += std::string(i ? "," : "") + "{\"ph\":\"X\",\"ts\":" +
+             std::to_string(i * 10) + ",\"dur\":5,\"pid\":1,\"tid\":" +
+             std::to_string(i % 4) + ",\"name\":\"s" + std::to_string(i) +
+             "\"}";
+  }
+  trace += "]}";
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[trace.size()]);
+  memcpy(buf.get(), trace.data(), trace.size());
+  ASSERT_TRUE(tp->Parse(std::move(buf), trace.size()));
+
+  std::vector<std::string> queries;
+  for (int i = 0; i < 40; i++) {
+    queries.push_back("SELECT count(*), sum(ts) FROM slices WHERE ts >= " +
+                      std::to_string(i * 20000));
+  }
+  queries.push_back("SELECT end_ts FROM trace_bounds");
+  queries.push_back("SELECT * FROM no_such_table");
+  queries.push_back("CREATE TABLE t(x INT)");
+
+  // The queries can only run once the trace has been fully loaded.
+  std::vector<protos::RawQueryResult> results;
+  auto store_result = [&results](size_t index,
+                                 const protos::RawQueryResult& result) {
+    ASSERT_EQ(index, results.size());
+    results.push_back(result);
+  };
+  tp->ExecuteQueries(queries, 4, store_result);
+  ASSERT_EQ(results.size(), queries.size());
+  ASSERT_TRUE(results[0].has_error());
+  tp->NotifyEndOfFile();
+
+  for (uint32_t threads : {1u, 4u, 64u}) {
+    results.clear();
+    tp->ExecuteQueries(queries, threads, store_result);
+    ASSERT_EQ(results.size(), queries.size());
+    for (int i = 0; i < 40; i++) {
+      ASSERT_FALSE(results[static_cast<size_t>(i)].has_error());
+      int64_t count = 100 - i * 2;
+      int64_t sum = (i * 20 + 990) * count / 2 * 1000;
+      ASSERT_EQ(results[static_cast<size_t>(i)].columns(0).long_values(0),
+                count);
+      ASSERT_EQ(results[static_cast<size_t>(i)].columns(1).long_values(0),
+                sum);
+    }
+    ASSERT_EQ(results[40].columns(0).long_values(0), 990000);
+    ASSERT_TRUE(results[41].has_error());
+    ASSERT_TRUE(results[42].has_error());
+  }
+
+  // The queries are logged in the sqlstats table, which keeps the last 100.
+  auto it = tp->ExecuteQuery(
+      "SELECT count(*) FROM sqlstats WHERE query = 'CREATE TABLE t(x INT)' "
+      "AND started >= queued AND ended >= started");
+  ASSERT_EQ(it.Next(), TraceProcessor::Iterator::NextResult::kHasNext);
+  ASSERT_EQ(it.Get(0).long_value, 3);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -301,41 +301,28 @@ int StartInteractiveShell() {
   return 0;
 }
 
-void PrintQueryResultAsCsv(const protos::RawQueryResult& res, FILE* output) {
-  PERFETTO_CHECK(res.columns_size() == res.column_descriptors_size());
-
-  for (int r = 0; r < static_cast<int>(res.num_records()); r++) {
-    if (r == 0) {
-      for (int c = 0; c < res.column_descriptors_size(); c++) {
-        const auto& col = res.column_descriptors(c);
-        if (c > 0)
-          fprintf(output, ",");
-        fprintf(output, "\"%s\"", col.name().c_str());
-      }
-      fprintf(output, "\n");
-    }
-
-    for (int c = 0; c < res.columns_size(); c++) {
+void PrintQueryResultAsCsv(const ColumnarBatch& batch, FILE* output) {
+  for (uint32_t r = 0; r < batch.num_rows; r++) {
+    for (uint32_t c = 0; c < batch.columns.size(); c++) {
       if (c > 0)
         fprintf(output, ",");
 
-      using ColumnDesc = protos::RawQueryResult::ColumnDesc;
-      if (res.columns(c).is_nulls(r)) {
+      const ColumnarBatch::Column& col = batch.columns[c];
+      if (col.is_nulls[r]) {
         fprintf(output, "\"%s\"", "[NULL]");
       } else {
-        switch (res.column_descriptors(c).type()) {
-          case ColumnDesc::STRING:
-            fprintf(output, "\"%s\"", res.columns(c).string_values(r).c_str());
+        switch (col.type) {
+          case SqlValue::kString:
+            fprintf(output, "\"%s\"",
+                    batch.strings[col.string_ids[r]].c_str());
             break;
-          case ColumnDesc::DOUBLE:
-            fprintf(output, "%f", res.columns(c).double_values(r));
+          case SqlValue::kDouble:
+            fprintf(output, "%f", col.double_values[r]);
             break;
-          case ColumnDesc::LONG: {
-            auto value = res.columns(c).long_values(r);
-            fprintf(output, "%lld", value);
+          case SqlValue::kLong:
+            fprintf(output, "%" PRId64, col.long_values[r]);
             break;
-          }
-          case ColumnDesc::UNKNOWN:
+          case SqlValue::kNull:
             PERFETTO_FATAL("Row should be null so handled above");
             break;
         }
@@ -385,40 +372,129 @@ bool RunQueryAndPrintResult(const std::vector<std::string> queries,
 
     PERFETTO_ILOG("Executing query: %s", sql_query.c_str());
 
-    protos::RawQueryArgs query;
-    query.set_sql_query(sql_query);
-    g_tp->ExecuteQuery(query, [output, &is_query_error,
-                               &has_output](const protos::RawQueryResult& res) {
-      if (res.has_error()) {
-        PERFETTO_ELOG("SQLite error: %s", res.error().c_str());
+    // The rows are read and printed in batches, without materializing the
+    // whole result.
+    const uint32_t kBatchRows = 4096;
+    auto it = g_tp->ExecuteQuery(base::StringView(sql_query));
+    ColumnarBatch batch;
+    bool has_rows = false;
+    for (;;) {
+      auto res = it.NextBatch(kBatchRows, &batch);
+      if (res == TraceProcessor::Iterator::NextResult::kError) {
+        PERFETTO_ELOG("SQLite error: %s", it.GetLastError()->c_str());
         is_query_error = true;
-        return;
-      } else if (res.num_records() != 0) {
+        break;
+      }
+      if (res == TraceProcessor::Iterator::NextResult::kEOF)
+        break;
+
+      if (!has_rows) {
         if (has_output) {
           PERFETTO_ELOG(
               "More than one query generated result rows. This is "
               "unsupported.");
           is_query_error = true;
-          return;
+          break;
         }
         has_output = true;
+        has_rows = true;
+        for (uint32_t c = 0; c < it.ColumnCount(); c++) {
+          if (c > 0)
+            fprintf(output, ",");
+          fprintf(output, "\"%s\"", it.GetColumnName(c).c_str());
+        }
+        fprintf(output, "\n");
       }
-      PrintQueryResultAsCsv(res, output);
-    });
+      PrintQueryResultAsCsv(batch, output);
+    }
   }
   return !is_query_error;
 }
 
+// Loads the trace in chunks using async IO. We create a simple pipeline where,
+// at each iteration, we parse the current chunk and asynchronously start
+// reading the next chunk. Returns the number of bytes read.
+uint64_t LoadTraceInChunks(TraceProcessor* tp, int fd) {
+  // 1MB chunk size seems the best tradeoff on a MacBook Pro 2013 - i7 2.8 GHz.
+  constexpr size_t kChunkSize = 1024 * 1024;
+  struct aiocb cb {};
+  cb.aio_nbytes = kChunkSize;
+  cb.aio_fildes = fd;
+
+  std::unique_ptr<uint8_t[]> aio_buf(new uint8_t[kChunkSize]);
+  cb.aio_buf = aio_buf.get();
+
+  PERFETTO_CHECK(aio_read(&cb) == 0);
+  struct aiocb* aio_list[1] = {&cb};
+
+  uint64_t file_size = 0;
+  for (int i = 0;; i++) {
+    if (i % 128 == 0)
+      fprintf(stderr, "\rLoading trace: %.2f MB\r", file_size / 1E6);
+
+    // Block waiting for the pending read to complete.
+    PERFETTO_CHECK(aio_suspend(aio_list, 1, nullptr) == 0);
+    auto rsize = aio_return(&cb);
+    if (rsize <= 0)
+      break;
+    file_size += static_cast<uint64_t>(rsize);
+
+    // Take ownership of the completed buffer and enqueue a new async read
+    // with a fresh buffer.
+    std::unique_ptr<uint8_t[]> buf(std::move(aio_buf));
+    aio_buf.reset(new uint8_t[kChunkSize]);
+    cb.aio_buf = aio_buf.get();
+    cb.aio_offset += rsize;
+    PERFETTO_CHECK(aio_read(&cb) == 0);
+
+    // Parse the completed buffer while the async read is in-flight.
+    tp->Parse(std::move(buf), static_cast<size_t>(rsize));
+  }
+  return file_size;
+}
+
+// Loads the trace file into the trace processor.
+bool LoadTrace(TraceProcessor* tp, const char* trace_file_path) {
+  base::ScopedFile fd(base::OpenFile(trace_file_path, O_RDONLY));
+  if (!fd) {
+    PERFETTO_ELOG("Could not open trace file (path: %s)", trace_file_path);
+    return false;
+  }
+
+  uint64_t file_size = 0;
+  auto t_load_start = base::GetWallTimeMs();
+  struct stat st {};
+  if (fstat(*fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    // Regular files are memory-mapped and tokenized in place, without copying
+    // them into heap buffers.
+    file_size = static_cast<uint64_t>(st.st_size);
+    fprintf(stderr, "\rLoading trace: %.2f MB\r", file_size / 1E6);
+    tp->ParseMappedFile(trace_file_path);
+  } else {
+    file_size = LoadTraceInChunks(tp, *fd);
+  }
+  tp->NotifyEndOfFile();
+  double t_load = (base::GetWallTimeMs() - t_load_start).count() / 1E3;
+  double size_mb = file_size / 1E6;
+  PERFETTO_ILOG("Trace loaded: %.2f MB (%.1f MB/s)", size_mb, size_mb / t_load);
+  return true;
+}
+
 void PrintUsage(char** argv) {
   PERFETTO_ELOG(
       "Interactive trace processor shell.\n"
-      "Usage: %s [OPTIONS] trace_file.pb\n\n"
+      "Usage: %s [OPTIONS] trace_file.pb\n"
+      "       %s [OPTIONS] --load-snapshot FILE\n\n"
       "Options:\n"
       " -d        Enable virtual table debugging.\n"
+      " -p        Tokenize and parse the trace on separate threads.\n"
       " -s FILE   Read and execute contents of file before launching an "
       "interactive shell.\n"
       " -q FILE   Read and execute an SQL query from a file.\n"
-      " -e FILE   Export the trace into a SQLite database.\n",
+      " -e FILE   Export the trace into a SQLite database.\n"
+      " --save-snapshot FILE  Save the parsed trace into a snapshot.\n"
+      " --load-snapshot FILE  Load a snapshot instead of parsing a trace.\n",
+      argv[0],
       argv[0]);
 }
 
@@ -430,12 +506,19 @@ int TraceProcessorMain(int argc, char** argv) {
   const char* trace_file_path = nullptr;
   const char* query_file_path = nullptr;
   const char* sqlite_file_path = nullptr;
+  const char* save_snapshot_path = nullptr;
+  const char* load_snapshot_path = nullptr;
   bool launch_shell = true;
+  Config config;
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "-d") == 0) {
       EnableSQLiteVtableDebugging();
       continue;
     }
+    if (strcmp(argv[i], "-p") == 0) {
+      config.pipelined_parsing = true;
+      continue;
+    }
     if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "-s") == 0) {
       launch_shell = strcmp(argv[i], "-s") == 0;
       if (++i == argc) {
@@ -451,6 +534,20 @@ int TraceProcessorMain(int argc, char** argv) {
       }
       sqlite_file_path = argv[i];
       continue;
+    } else if (strcmp(argv[i], "--save-snapshot") == 0) {
+      if (++i == argc) {
+        PrintUsage(argv);
+        return 1;
+      }
+      save_snapshot_path = argv[i];
+      continue;
+    } else if (strcmp(argv[i], "--load-snapshot") == 0) {
+      if (++i == argc) {
+        PrintUsage(argv);
+        return 1;
+      }
+      load_snapshot_path = argv[i];
+      continue;
     } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
       PrintUsage(argv);
       return 0;
@@ -461,64 +558,28 @@ int TraceProcessorMain(int argc, char** argv) {
     trace_file_path = argv[i];
   }
 
-  if (trace_file_path == nullptr) {
+  if ((trace_file_path == nullptr) == (load_snapshot_path == nullptr)) {
     PrintUsage(argv);
     return 1;
   }
 
-  // Load the trace file into the trace processor.
-  Config config;
   std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
-  base::ScopedFile fd(base::OpenFile(trace_file_path, O_RDONLY));
-  if (!fd) {
-    PERFETTO_ELOG("Could not open trace file (path: %s)", trace_file_path);
+  if (load_snapshot_path) {
+    auto t_load_start = base::GetWallTimeMs();
+    if (!tp->LoadSnapshot(load_snapshot_path)) {
+      PERFETTO_ELOG("Could not load snapshot (path: %s)", load_snapshot_path);
+      return 1;
+    }
+    double t_load = (base::GetWallTimeMs() - t_load_start).count() / 1E3;
+    PERFETTO_ILOG("Snapshot loaded in %.2f s", t_load);
+  } else if (!LoadTrace(tp.get(), trace_file_path)) {
     return 1;
   }
 
-  // Load the trace in chunks using async IO. We create a simple pipeline where,
-  // at each iteration, we parse the current chunk and asynchronously start
-  // reading the next chunk.
-
-  // 1MB chunk size seems the best tradeoff on a MacBook Pro 2013 - i7 2.8 GHz.
-  constexpr size_t kChunkSize = 1024 * 1024;
-  struct aiocb cb {};
-  cb.aio_nbytes = kChunkSize;
-  cb.aio_fildes = *fd;
-
-  std::unique_ptr<uint8_t[]> aio_buf(new uint8_t[kChunkSize]);
-  cb.aio_buf = aio_buf.get();
-
-  PERFETTO_CHECK(aio_read(&cb) == 0);
-  struct aiocb* aio_list[1] = {&cb};
-
-  uint64_t file_size = 0;
-  auto t_load_start = base::GetWallTimeMs();
-  for (int i = 0;; i++) {
-    if (i % 128 == 0)
-      fprintf(stderr, "\rLoading trace: %.2f MB\r", file_size / 1E6);
-
-    // Block waiting for the pending read to complete.
-    PERFETTO_CHECK(aio_suspend(aio_list, 1, nullptr) == 0);
-    auto rsize = aio_return(&cb);
-    if (rsize <= 0)
-      break;
-    file_size += static_cast<uint64_t>(rsize);
-
-    // Take ownership of the completed buffer and enqueue a new async read
-    // with a fresh buffer.
-    std::unique_ptr<uint8_t[]> buf(std::move(aio_buf));
-    aio_buf.reset(new uint8_t[kChunkSize]);
-    cb.aio_buf = aio_buf.get();
-    cb.aio_offset += rsize;
-    PERFETTO_CHECK(aio_read(&cb) == 0);
-
-    // Parse the completed buffer while the async read is in-flight.
-    tp->Parse(std::move(buf), static_cast<size_t>(rsize));
+  if (save_snapshot_path && !tp->SaveSnapshot(save_snapshot_path)) {
+    PERFETTO_ELOG("Could not save snapshot (path: %s)", save_snapshot_path);
+    return 1;
   }
-  tp->NotifyEndOfFile();
-  double t_load = (base::GetWallTimeMs() - t_load_start).count() / 1E3;
-  double size_mb = file_size / 1E6;
-  PERFETTO_ILOG("Trace loaded: %.2f MB (%.1f MB/s)", size_mb, size_mb / t_load);
   g_tp = tp.get();
 
 #if PERFETTO_HAS_SIGNAL_H()
@@ -17,9 +17,12 @@
 #ifndef SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 #define SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 
+#include <algorithm>
+#include <functional>
 #include <vector>
 
 #include "perfetto/base/circular_queue.h"
+#include "perfetto/base/optional.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "src/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/trace_processor_context.h"
@@ -40,7 +43,8 @@ namespace trace_processor {
 //
 // Due to this, this class is oprerates as a streaming merge-sort of N+1 queues
 // (N = num cpus + 1 for non-ftrace events). Each queue in turn gets sorted (if
-// necessary) before proceeding with the global merge-sort-extract.
+// necessary) before proceeding with the global merge-sort-extract, which picks
+// the next queue to extract from using a min-heap of the queue heads.
 // When an event is pushed through, it is just appeneded to the end of one of
 // the N queues. While appending, we keep track of the fact that the queue
 // is still ordered or just lost ordering. When an out-of-order event is
@@ -57,45 +61,74 @@ namespace trace_processor {
 // from there to the end.
 class TraceSorter {
  public:
+  // An event staged in the sorter. Rather than holding a TraceBlobView, which
+  // would refcount the buffer of each event, pieces refer to their data by
+  // address in the sorter's ChunkTable. This keeps them to 16 bytes.
   struct TimestampedTracePiece {
-    TimestampedTracePiece(int64_t ts, uint64_t idx, TraceBlobView tbv)
-        : timestamp(ts), packet_idx_(idx), blob_view(std::move(tbv)) {}
-
-    TimestampedTracePiece(TimestampedTracePiece&&) noexcept = default;
-    TimestampedTracePiece& operator=(TimestampedTracePiece&&) = default;
-
     // For std::lower_bound().
     static inline bool Compare(const TimestampedTracePiece& x, int64_t ts) {
       return x.timestamp < ts;
     }
 
-    // For std::sort().
+    // For std::stable_sort(), which keeps events with the same timestamp in
+    // the order they were pushed in.
     inline bool operator<(const TimestampedTracePiece& o) const {
-      return timestamp < o.timestamp ||
-             (timestamp == o.timestamp && packet_idx_ < o.packet_idx_);
+      return timestamp < o.timestamp;
     }
 
     int64_t timestamp;
-    uint64_t packet_idx_;
+    uint32_t address;
+    uint32_t length;
+  };
+
+  // An event extracted from the sorter, ready to be parsed.
+  struct SortedEvent {
+    SortedEvent(int64_t ts, uint32_t c, TraceBlobView tbv)
+        : timestamp(ts), cpu(c), blob_view(std::move(tbv)) {}
+
+    SortedEvent(SortedEvent&&) noexcept = default;
+    SortedEvent& operator=(SortedEvent&&) = default;
+
+    int64_t timestamp;
+    uint32_t cpu;  // kNoCpu for trace packets, the CPU for ftrace events.
     TraceBlobView blob_view;
   };
 
+  using SortedEventBatch = std::vector<SortedEvent>;
+  using SortedEventsCallback = std::function<void(SortedEventBatch)>;
+
+  static constexpr uint32_t kNoCpu = std::numeric_limits<uint32_t>::max();
+
   TraceSorter(TraceProcessorContext*, int64_t window_size_ns);
 
   inline void PushTracePacket(int64_t timestamp, TraceBlobView packet) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
     auto* queue = GetQueue(0);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(packet)));
+    if (queue->Append(CreatePiece(timestamp, packet, packet.data(),
+                                  packet.length()))) {
+      UpdateQueueHeap(0);
+    }
     MaybeExtractEvents(queue);
   }
 
   inline void PushFtraceEvent(uint32_t cpu,
                               int64_t timestamp,
                               TraceBlobView event) {
+    PushFtraceEvent(cpu, timestamp, event, event.data(), event.length());
+  }
+
+  // Pushes the event at [data, data + length), which must be within the
+  // buffer of |bundle|. This avoids creating a TraceBlobView per event.
+  inline void PushFtraceEvent(uint32_t cpu,
+                              int64_t timestamp,
+                              const TraceBlobView& bundle,
+                              const uint8_t* data,
+                              size_t length) {
     set_ftrace_batch_cpu_for_DCHECK(cpu);
-    GetQueue(cpu + 1)->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(event)));
+    if (GetQueue(cpu + 1)->Append(
+            CreatePiece(timestamp, bundle, data, length))) {
+      UpdateQueueHeap(cpu + 1);
+    }
 
     // The caller must call FinalizeFtraceEventBatch() after having pushed a
     // batch of ftrace events. This is to amortize the overhead of handling
@@ -111,21 +144,145 @@ class TraceSorter {
 
   // Extract all events ignoring the window.
   void ExtractEventsForced() {
+    UpdatePeakMemoryStats();
     SortAndExtractEventsBeyondWindow(/*window_size_ns=*/0);
+    if (!sorted_events_.empty())
+      PassSortedEvents();
+  }
+
+  // By default events are parsed as soon as they are extracted. If a callback
+  // is set, the extracted events are instead accumulated, in order, into
+  // batches which are passed to |callback|. This allows to parse the events
+  // on a different thread. ExtractEventsForced() always passes the last
+  // (partial) batch.
+  void set_sorted_events_callback(SortedEventsCallback callback) {
+    sorted_events_callback_ = std::move(callback);
   }
 
   void set_window_ns_for_testing(int64_t window_size_ns) {
     window_size_ns_ = window_size_ns;
   }
 
+  // The max number of events staged in the sorter at any time.
+  size_t peak_num_events() const { return peak_num_events_; }
+
+  // The max memory used at any time by the staged events and the trace
+  // buffers they keep alive.
+  size_t peak_memory_bytes() const { return peak_memory_bytes_; }
+
  private:
   static constexpr uint32_t kNoBatch = std::numeric_limits<uint32_t>::max();
+  static constexpr size_t kNotInHeap = std::numeric_limits<size_t>::max();
+
+  // Leaves enough room in the address space of |chunks_| for the events
+  // pushed between two calls to MaybeExtractEvents().
+  static constexpr uint32_t kMaxAddressSpan = 1u << 31;
+
+  // Number of events in the batches passed to |sorted_events_callback_|.
+  static constexpr size_t kSortedEventBatchSize = 4096;
+
+  // Owns the buffers of the staged events. The buffers are laid out, in the
+  // order they are pushed, in a 32-bit address space: each chunk maps a range
+  // of addresses to a range of a buffer. Consecutive events from the same
+  // buffer share a chunk, which holds a single reference to the buffer.
+  // A chunk releases its buffer once all its events have been extracted.
+  class ChunkTable {
+   public:
+    // Returns the address of [data, data + length), which must be within the
+    // buffer of |blob|.
+    inline uint32_t Add(const TraceBlobView& blob,
+                        const uint8_t* data,
+                        size_t length) {
+      const size_t offset = blob.offset_of(data);
+      // Empty events still take one address, so that they can be found.
+      const size_t span = std::max<size_t>(length, 1);
+      if (PERFETTO_LIKELY(!chunks_.empty())) {
+        Chunk& chunk = chunks_.back();
+        if (PERFETTO_LIKELY(chunk.blob && chunk.blob->SharesBufferWith(blob) &&
+                            offset >= chunk.offset &&
+                            offset + span - chunk.offset <= kMaxChunkSize)) {
+          const uint32_t chunk_offset =
+              static_cast<uint32_t>(offset - chunk.offset);
+          const uint32_t end = chunk_offset + static_cast<uint32_t>(span);
+          if (end > chunk.size) {
+            if (PERFETTO_UNLIKELY(offset + length > chunk.blob_end))
+              chunk.SetBlob(blob);
+            retained_bytes_ += end - chunk.size;
+            chunk.size = end;
+            end_address_ = chunk.address + chunk.size;
+          }
+          chunk.pending_events++;
+          return chunk.address + chunk_offset;
+        }
+      }
+      return AddChunk(blob, offset, span);
+    }
+
+    // Returns a view on the data of the event at |address| and marks it as
+    // extracted.
+    TraceBlobView Extract(uint32_t address, uint32_t length);
+
+    // Removes the chunks at the front whose events have all been extracted.
+    void RemoveDrainedChunks();
+
+    // The size of the address range in use.
+    uint32_t address_span() const {
+      return end_address_ - begin_address_;
+    }
+
+    // The number of bytes of the trace referenced by the staged events.
+    size_t retained_bytes() const { return retained_bytes_; }
+
+   private:
+    // Bounds the size of a chunk and thus of the address span wasted when
+    // events of a buffer are not pushed in order.
+    static constexpr size_t kMaxChunkSize = 64 * 1024 * 1024;
+
+    struct Chunk {
+      Chunk(size_t o, uint32_t a) : offset(o), address(a) {}
+
+      inline void SetBlob(const TraceBlobView& b) {
+        blob = b.slice(b.offset_of(b.data()), b.length());
+        blob_end = b.offset_of(b.data()) + b.length();
+      }
+
+      // A view on the buffer of the chunk which ends after the chunk, so that
+      // the events can be sliced from it. Reset, releasing the buffer, as
+      // soon as all the events of the chunk have been extracted.
+      base::Optional<TraceBlobView> blob;
+      size_t blob_end = 0;  // Offset in the buffer of the end of |blob|.
+      size_t offset;        // Offset in the buffer of the first byte.
+      uint32_t address;     // Address of the first byte (wraps around).
+      uint32_t size = 0;
+      uint32_t pending_events = 0;
+    };
+
+    uint32_t AddChunk(const TraceBlobView& blob, size_t offset, size_t span);
+
+    base::CircularQueue<Chunk> chunks_;
+
+    // The address of the first chunk, |end_address_| if there are none.
+    uint32_t begin_address_ = 0;
+
+    // The address of the byte following the last chunk.
+    uint32_t end_address_ = 0;
+
+    // The sum of the sizes of the chunks which still hold their buffer.
+    size_t retained_bytes_ = 0;
+
+    // Index in |chunks_| of the chunk last found by Extract().
+    size_t last_extracted_chunk_ = 0;
+  };
 
   struct Queue {
-    inline void Append(TimestampedTracePiece ttp) {
+    // Returns true if the event is the new head of the queue, in which case
+    // the queue must be moved up in |queue_heap_|.
+    inline bool Append(TimestampedTracePiece ttp) {
       const int64_t timestamp = ttp.timestamp;
       events_.emplace_back(std::move(ttp));
-      min_ts_ = std::min(min_ts_, timestamp);
+      const bool is_new_min = timestamp < min_ts_;
+      if (is_new_min)
+        min_ts_ = timestamp;
 
       // Events are often seen in order.
       if (PERFETTO_LIKELY(timestamp >= max_ts_)) {
@@ -146,6 +303,7 @@ class TraceSorter {
       }
 
       PERFETTO_DCHECK(min_ts_ <= max_ts_);
+      return is_new_min;
     }
 
     bool needs_sorting() const { return sort_start_idx_ != 0; }
@@ -156,12 +314,57 @@ class TraceSorter {
     int64_t max_ts_ = 0;
     size_t sort_start_idx_ = 0;
     int64_t sort_min_ts_ = 0;
+
+    // Position of the queue in |queue_heap_|, kNotInHeap if empty.
+    size_t heap_pos_ = kNotInHeap;
+  };
+
+  // An entry of |queue_heap_|.
+  struct QueueHeapEntry {
+    inline bool operator<(const QueueHeapEntry& o) const {
+      return min_ts < o.min_ts ||
+             (min_ts == o.min_ts && queue_idx < o.queue_idx);
+    }
+
+    int64_t min_ts;
+    size_t queue_idx;
   };
 
   // This method passes any events older than window_size_ns to the
   // parser to be parsed and then stored.
   void SortAndExtractEventsBeyondWindow(int64_t windows_size_ns);
 
+  void PassSortedEvents();
+
+  // Inserts the queue at |queue_idx| into |queue_heap_|, or moves it up if
+  // its min_ts_ has decreased.
+  void UpdateQueueHeap(size_t queue_idx);
+
+  // Moves the entry at |pos| of |queue_heap_| up or down to its place.
+  void SiftUpQueueHeap(size_t pos);
+  void SiftDownQueueHeap(size_t pos);
+
+  inline void SetQueueHeapEntry(size_t pos, QueueHeapEntry entry) {
+    queue_heap_[pos] = entry;
+    queues_[entry.queue_idx].heap_pos_ = pos;
+  }
+
+  inline TimestampedTracePiece CreatePiece(int64_t timestamp,
+                                           const TraceBlobView& blob,
+                                           const uint8_t* data,
+                                           size_t length) {
+    num_events_++;
+    return TimestampedTracePiece{timestamp, chunks_.Add(blob, data, length),
+                                 static_cast<uint32_t>(length)};
+  }
+
+  inline void UpdatePeakMemoryStats() {
+    peak_num_events_ = std::max(peak_num_events_, num_events_);
+    size_t memory_bytes =
+        num_events_ * sizeof(TimestampedTracePiece) + chunks_.retained_bytes();
+    peak_memory_bytes_ = std::max(peak_memory_bytes_, memory_bytes);
+  }
+
   inline Queue* GetQueue(size_t index) {
     if (PERFETTO_UNLIKELY(index >= queues_.size()))
       queues_.resize(index + 1);
@@ -172,6 +375,16 @@ class TraceSorter {
     DCHECK_ftrace_batch_cpu(kNoBatch);
     global_max_ts_ = std::max(global_max_ts_, queue->max_ts_);
     global_min_ts_ = std::min(global_min_ts_, queue->min_ts_);
+    UpdatePeakMemoryStats();
+
+    if (PERFETTO_UNLIKELY(chunks_.address_span() > kMaxAddressSpan)) {
+      // The staged events are about to exhaust the address space of
+      // |chunks_|. This would take GBs of trace within the window: give up
+      // on the window and extract everything.
+      PERFETTO_ELOG("Too much data in the sorting window, flushing it");
+      SortAndExtractEventsBeyondWindow(/*window_size_ns=*/0);
+      return;
+    }
 
     if (global_max_ts_ - global_min_ts_ < window_size_ns_)
       return;
@@ -186,6 +399,13 @@ class TraceSorter {
   // queues_[x] is the ftrace queue for CPU(x - 1).
   std::vector<Queue> queues_;
 
+  // Binary min-heap of the non-empty queues, ordered by min_ts_ (i.e. the
+  // timestamp of their first event once sorted). The earliest queue is
+  // queue_heap_[0] and the next one is either queue_heap_[1] or [2].
+  std::vector<QueueHeapEntry> queue_heap_;
+
+  ChunkTable chunks_;
+
   // Events are propagated to the next stage only after (max - min) timestamp
   // is larger than this value.
   int64_t window_size_ns_;
@@ -196,12 +416,19 @@ class TraceSorter {
   // min(e.timestamp for e in queues_).
   int64_t global_min_ts_ = std::numeric_limits<int64_t>::max();
 
-  // Monotonic increasing value used to index timestamped trace pieces.
-  uint64_t packet_idx_ = 0;
+  // The number of events staged in |queues_|.
+  size_t num_events_ = 0;
+
+  size_t peak_num_events_ = 0;
+  size_t peak_memory_bytes_ = 0;
 
   // Used for performance tests. True when setting TRACE_PROCESSOR_SORT_ONLY=1.
   bool bypass_next_stage_for_testing_ = false;
 
+  // See set_sorted_events_callback().
+  SortedEventsCallback sorted_events_callback_;
+  SortedEventBatch sorted_events_;
+
 #if PERFETTO_DCHECK_IS_ON()
   // Used only for DCHECK-ing that FinalizeFtraceEventBatch() is called.
   uint32_t ftrace_batch_cpu_ = kNoBatch;
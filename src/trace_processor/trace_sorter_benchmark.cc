@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "src/trace_processor/trace_processor_context.h"
+#include "src/trace_processor/trace_sorter.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+struct Event {
+  uint32_t cpu;
+  int64_t ts;
+};
+
+// Generates |events| ftrace events spread over |cpus| CPUs. Like in real
+// traces, every 100us each CPU emits a bundle of 64 events spanning that
+// period, so the CPUs are interleaved in time. 1 event out of 16 is out of
+// order within its bundle.
+std::vector<Event> CreateEvents(size_t events, uint32_t cpus) {
+  const size_t kEventsPerBundle = 64;
+  const int64_t kPeriodNs = 100 * 1000;
+  const uint32_t kMaxGapNs = 3000;  // About kPeriodNs / kEventsPerBundle * 2.
+  std::minstd_rand0 rnd(0);
+  std::vector<Event> res;
+  res.reserve(events);
+  std::vector<uint32_t> cpu_order(cpus);
+  for (uint32_t cpu = 0; cpu < cpus; cpu++)
+    cpu_order[cpu] = cpu;
+  for (int64_t period_ts = kPeriodNs; res.size() < events;
+       period_ts += kPeriodNs) {
+    std::shuffle(cpu_order.begin(), cpu_order.end(), rnd);
+    for (uint32_t cpu : cpu_order) {
+      int64_t ts = period_ts;
+      for (size_t e = 0; e < kEventsPerBundle && res.size() < events; e++) {
+        ts += static_cast<int64_t>(rnd() % kMaxGapNs);
+        int64_t event_ts = ts;
+        if (rnd() % 16 == 0)
+          event_ts -= static_cast<int64_t>(rnd() % 1000);
+        res.push_back(Event{cpu, event_ts});
+      }
+    }
+  }
+  return res;
+}
+
+void SorterArgs(benchmark::internal::Benchmark* b) {
+  for (int cpus : {8, 64, 256})
+    b->Arg(cpus);
+}
+
+}  // namespace
+
+// Pushes ftrace events for state.range(0) CPUs through the sorter, with a
+// window of 1ms, and measures the events extracted per second.
+static void BM_TraceSorter(benchmark::State& state) {
+  const size_t kEvents = IsBenchmarkFunctionalOnly() ? 10000 : 1000000;
+  std::vector<Event> events =
+      CreateEvents(kEvents, static_cast<uint32_t>(state.range(0)));
+  // Like the tokenizer, pushes events by reference to their bundle, one byte
+  // each.
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[kEvents]);
+  TraceBlobView blob(std::move(buf), 0, kEvents);
+
+  size_t extracted = 0;
+  for (auto _ : state) {
+    TraceProcessorContext context;
+    TraceSorter sorter(&context, /*window_size_ns=*/1000 * 1000);
+    sorter.set_sorted_events_callback(
+        [&extracted](TraceSorter::SortedEventBatch batch) {
+          extracted += batch.size();
+        });
+    uint32_t cpu = events[0].cpu;
+    for (size_t i = 0; i < events.size(); i++) {
+      const Event& event = events[i];
+      if (event.cpu != cpu) {
+        sorter.FinalizeFtraceEventBatch(cpu);
+        cpu = event.cpu;
+      }
+      sorter.PushFtraceEvent(event.cpu, event.ts, blob, blob.data() + i, 1);
+    }
+    sorter.FinalizeFtraceEventBatch(cpu);
+    sorter.ExtractEventsForced();
+  }
+  PERFETTO_CHECK(extracted ==
+                 kEvents * static_cast<size_t>(state.iterations()));
+  state.SetItemsProcessed(static_cast<int64_t>(extracted));
+}
+BENCHMARK(BM_TraceSorter)->Unit(benchmark::kMillisecond)->Apply(SorterArgs);
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -167,6 +167,98 @@ TEST_F(TraceSorterTest, MultiQueueSorting) {
   EXPECT_TRUE(expectations.empty());
 }
 
+// Tests that the buffer of the events is released as soon as all its events
+// have been extracted, while the sorter still holds events of other buffers.
+TEST_F(TraceSorterTest, ReleasesBuffersOfExtractedEvents) {
+  uint8_t data_1[16] = {};
+  uint8_t data_2[16] = {};
+  bool released_1 = false;
+  bool released_2 = false;
+  std::unique_ptr<TraceBlobView> bundle_1(new TraceBlobView(
+      data_1, 0, sizeof(data_1), [&released_1] { released_1 = true; }));
+  std::unique_ptr<TraceBlobView> bundle_2(new TraceBlobView(
+      data_2, 0, sizeof(data_2), [&released_2] { released_2 = true; }));
+
+  EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(_, _, _, 8)).Times(4);
+  context_.sorter->set_window_ns_for_testing(100);
+  context_.sorter->PushFtraceEvent(0, 1000, *bundle_1, data_1, 8);
+  context_.sorter->PushFtraceEvent(0, 1010, *bundle_1, data_1 + 8, 8);
+  context_.sorter->FinalizeFtraceEventBatch(0);
+  context_.sorter->PushFtraceEvent(1, 1050, *bundle_2, data_2, 8);
+  context_.sorter->FinalizeFtraceEventBatch(1);
+  bundle_1.reset();
+  ASSERT_FALSE(released_1);
+
+  // Extracts all the events of the first bundle but only one of the second.
+  context_.sorter->PushFtraceEvent(1, 1200, *bundle_2, data_2 + 8, 8);
+  context_.sorter->FinalizeFtraceEventBatch(1);
+  ASSERT_TRUE(released_1);
+  bundle_2.reset();
+  ASSERT_FALSE(released_2);
+
+  context_.sorter->ExtractEventsForced();
+  ASSERT_TRUE(released_2);
+  ASSERT_EQ(context_.sorter->peak_num_events(), 4u);
+  // Each staged event takes 16 bytes, on top of the buffers.
+  ASSERT_EQ(context_.sorter->peak_memory_bytes(),
+            4 * 16 + sizeof(data_1) + sizeof(data_2));
+}
+
+// Pushes events on many CPUs, partially out of order within each CPU, with a
+// window small enough that they are extracted while being pushed. Tests that
+// they come out in timestamp order and, within each CPU, in the order they
+// were pushed for equal timestamps.
+TEST_F(TraceSorterTest, ManyQueuesWithWindow) {
+  const uint32_t kCpus = 256;
+  const size_t kEvents = 20000;
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[kEvents]);
+  TraceBlobView events(std::move(buf), 0, kEvents);
+
+  std::vector<TraceSorter::SortedEvent> sorted;
+  context_.sorter->set_sorted_events_callback(
+      [&sorted](TraceSorter::SortedEventBatch batch) {
+        for (auto& event : batch)
+          sorted.emplace_back(std::move(event));
+      });
+  context_.sorter->set_window_ns_for_testing(1000);
+
+  std::minstd_rand0 rnd_engine(0);
+  std::vector<int64_t> expected;
+  int64_t now = 1000;
+  size_t idx = 0;
+  while (idx < kEvents) {
+    uint32_t cpu = static_cast<uint32_t>(rnd_engine() % kCpus);
+    for (int i = 0; i < 16 && idx < kEvents; i++, idx++) {
+      now += static_cast<int64_t>(rnd_engine() % 4);
+      // Every few events go back in time, but stay within the window.
+      int64_t ts = now;
+      if (rnd_engine() % 8 == 0)
+        ts -= static_cast<int64_t>(rnd_engine() % 500);
+      expected.push_back(ts);
+      context_.sorter->PushFtraceEvent(cpu, ts, events.slice(idx, 1));
+    }
+    context_.sorter->FinalizeFtraceEventBatch(cpu);
+  }
+  context_.sorter->ExtractEventsForced();
+
+  ASSERT_EQ(sorted.size(), kEvents);
+  std::vector<std::vector<size_t>> idx_for_cpu(kCpus);
+  for (size_t i = 0; i < sorted.size(); i++) {
+    const auto& event = sorted[i];
+    if (i > 0) {
+      ASSERT_LE(sorted[i - 1].timestamp, event.timestamp);
+    }
+    size_t event_idx = static_cast<size_t>(event.blob_view.data() -
+                                           events.data());
+    ASSERT_EQ(expected[event_idx], event.timestamp);
+    auto& cpu_idx = idx_for_cpu[event.cpu];
+    if (!cpu_idx.empty() && expected[cpu_idx.back()] == event.timestamp) {
+      ASSERT_LT(cpu_idx.back(), event_idx);
+    }
+    cpu_idx.push_back(event_idx);
+  }
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
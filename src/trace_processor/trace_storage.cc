@@ -42,24 +42,13 @@ TraceStorage::TraceStorage() {
   // Upid/utid 0 is reserved for idle processes/threads.
   unique_processes_.emplace_back(0);
   unique_threads_.emplace_back(0);
-
-  // Reserve string ID 0 for the empty string.
-  InternString("");
 }
 
 TraceStorage::~TraceStorage() {}
 
 StringId TraceStorage::InternString(base::StringView str) {
-  auto hash = str.Hash();
-  auto id_it = string_index_.find(hash);
-  if (id_it != string_index_.end()) {
-    PERFETTO_DCHECK(base::StringView(string_pool_[id_it->second]) == str);
-    return id_it->second;
-  }
-  string_pool_.emplace_back(str.ToStdString());
-  StringId string_id = static_cast<uint32_t>(string_pool_.size() - 1);
-  string_index_.emplace(hash, string_id);
-  return string_id;
+  // The pool always reserves string ID 0 for the empty string.
+  return string_pool_.InternString(str);
 }
 
 void TraceStorage::ResetStorage() {
@@ -107,5 +96,156 @@ std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs() const {
   return std::make_pair(start_ns, end_ns);
 }
 
+namespace {
+// Returns the approximate number of bytes of heap memory used by |map|: its
+// buckets and a node per entry.
+template <typename Map>
+size_t MapMemoryUsage(const Map& map) {
+  return map.bucket_count() * sizeof(void*) +
+         map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+}  // namespace
+
+ArgSetId TraceStorage::Args::AddArgSet(const std::vector<Arg>& args,
+                                       uint32_t begin,
+                                       uint32_t end) {
+  base::Hash hash;
+  for (uint32_t i = begin; i < end; i++) {
+    hash.Update(ArgHasher()(args[i]));
+  }
+
+  // Grows the table first so that the slot found stays valid.
+  size_t min_table_size = 2 * (static_cast<size_t>(arg_set_count()) + 1);
+  if (set_ids_by_hash_.size() < min_table_size) {
+    std::vector<ArgSetId> old_ids = std::move(set_ids_by_hash_);
+    set_ids_by_hash_.assign(std::max<size_t>(64, old_ids.size() * 2),
+                            kInvalidArgSetId);
+    for (ArgSetId old_id : old_ids) {
+      if (old_id != kInvalidArgSetId)
+        set_ids_by_hash_[FindSetSlot(set_hashes_[old_id - 1])] = old_id;
+    }
+  }
+
+  ArgSetHash digest = hash.digest();
+  size_t slot = FindSetSlot(digest);
+  if (set_ids_by_hash_[slot] != kInvalidArgSetId) {
+    return set_ids_by_hash_[slot];
+  }
+
+  // The +1 ensures that nothing has an id == kInvalidArgSetId == 0.
+  ArgSetId id = arg_set_count() + 1;
+  set_ids_by_hash_[slot] = id;
+  set_shapes_.emplace_back(InternShape(args, begin, end));
+  set_first_rows_.emplace_back(args_count());
+  set_hashes_.emplace_back(digest);
+  for (uint32_t i = begin; i < end; i++) {
+    values_.emplace_back(EncodeValue(args[i].value));
+  }
+  while ((block_sets_.size() << kRowsPerBlockLog2) < values_.size()) {
+    block_sets_.emplace_back(id - 1);
+  }
+  return id;
+}
+
+size_t TraceStorage::Args::FindSetSlot(ArgSetHash digest) const {
+  size_t mask = set_ids_by_hash_.size() - 1;
+  for (size_t slot = static_cast<size_t>(digest) & mask;;
+       slot = (slot + 1) & mask) {
+    ArgSetId id = set_ids_by_hash_[slot];
+    if (id == kInvalidArgSetId || set_hashes_[id - 1] == digest)
+      return slot;
+  }
+}
+
+TraceStorage::Args::ShapeId TraceStorage::Args::InternShape(
+    const std::vector<Arg>& args,
+    uint32_t begin,
+    uint32_t end) {
+  base::Hash hash;
+  for (uint32_t i = begin; i < end; i++) {
+    hash.Update(args[i].flat_key);
+    hash.Update(args[i].key);
+    hash.Update(static_cast<uint32_t>(args[i].value.type));
+  }
+
+  auto same_shape = [this, &args, begin, end](ShapeId shape) {
+    uint32_t first = shape_first_args_[shape];
+    if (shape_first_args_[shape + 1] - first != end - begin)
+      return false;
+    for (uint32_t i = begin; i < end; i++) {
+      const ShapeArg& shape_arg = shape_args_[first + i - begin];
+      if (shape_arg.flat_key != args[i].flat_key ||
+          shape_arg.key != args[i].key ||
+          shape_arg.type != args[i].value.type) {
+        return false;
+      }
+    }
+    return true;
+  };
+  uint64_t digest = hash.digest();
+  auto it = shape_for_hash_.find(digest);
+  if (it != shape_for_hash_.end() && same_shape(it->second)) {
+    return it->second;
+  }
+
+  // Shapes with colliding hashes are not deduplicated.
+  ShapeId shape = shape_count();
+  for (uint32_t i = begin; i < end; i++) {
+    shape_args_.emplace_back(
+        ShapeArg{args[i].flat_key, args[i].key, args[i].value.type});
+  }
+  shape_first_args_.emplace_back(static_cast<uint32_t>(shape_args_.size()));
+  if (it == shape_for_hash_.end())
+    shape_for_hash_.emplace(digest, shape);
+  return shape;
+}
+
+// static
+uint64_t TraceStorage::Args::EncodeValue(const Variadic& value) {
+  uint64_t encoded = 0;
+  switch (value.type) {
+    case Variadic::Type::kInt:
+      memcpy(&encoded, &value.int_value, sizeof(value.int_value));
+      break;
+    case Variadic::Type::kString:
+      encoded = value.string_value;
+      break;
+    case Variadic::Type::kReal:
+      memcpy(&encoded, &value.real_value, sizeof(value.real_value));
+      break;
+  }
+  return encoded;
+}
+
+// static
+TraceStorage::Args::Variadic TraceStorage::Args::DecodeValue(
+    Variadic::Type type,
+    uint64_t value) {
+  switch (type) {
+    case Variadic::Type::kInt: {
+      int64_t int_value;
+      memcpy(&int_value, &value, sizeof(int_value));
+      return Variadic::Integer(int_value);
+    }
+    case Variadic::Type::kString:
+      return Variadic::String(static_cast<StringId>(value));
+    case Variadic::Type::kReal: {
+      double real_value;
+      memcpy(&real_value, &value, sizeof(real_value));
+      return Variadic::Real(real_value);
+    }
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+size_t TraceStorage::Args::memory_usage() const {
+  return shape_args_.capacity() * sizeof(ShapeArg) +
+         shape_first_args_.capacity() * sizeof(uint32_t) +
+         MapMemoryUsage(shape_for_hash_) + set_shapes_.memory_usage() +
+         set_first_rows_.memory_usage() + set_hashes_.memory_usage() +
+         set_ids_by_hash_.capacity() * sizeof(ArgSetId) +
+         block_sets_.memory_usage() + values_.memory_usage();
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -30,8 +30,11 @@
 #include "perfetto/base/optional.h"
 #include "perfetto/base/string_view.h"
 #include "perfetto/base/utils.h"
+#include "src/trace_processor/chunked_vector.h"
 #include "src/trace_processor/ftrace_utils.h"
+#include "src/trace_processor/interval_index.h"
 #include "src/trace_processor/stats.h"
+#include "src/trace_processor/string_pool.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -45,8 +48,8 @@ using UniquePid = uint32_t;
 // be reused.
 using UniqueTid = uint32_t;
 
-// StringId is an offset into |string_pool_|.
-using StringId = uint32_t;
+// StringId is an id of a string interned in |string_pool_|.
+using StringId = StringPool::Id;
 
 // Identifiers for all the tables in the database.
 enum TableId : uint8_t {
@@ -108,6 +111,13 @@ class TraceStorage {
   };
 
   // Generic key value storage which can be referenced by other tables.
+  //
+  // Args are added by sets, which are deduplicated. The keys and types of the
+  // args of a set, its "shape", are interned once and shared by all the sets
+  // with the same keys (e.g. all the ftrace events of a type) which then only
+  // store their values, in 8 bytes each. The args of a set are contiguous rows
+  // and the sets are stored in the order of their ids, so the rows of a set
+  // are found in O(1) from its id.
   class Args {
    public:
     // Variadic type representing the possible values for the args table.
@@ -157,6 +167,7 @@ class TraceStorage {
         base::Hash hash;
         hash.Update(arg.key);
         // We don't hash arg.flat_key because it's a subsequence of arg.key.
+        hash.Update(static_cast<uint32_t>(arg.value.type));
         switch (arg.value.type) {
           case Variadic::Type::kInt:
             hash.Update(arg.value.int_value);
@@ -172,50 +183,132 @@ class TraceStorage {
       }
     };
 
-    const std::deque<ArgSetId>& set_ids() const { return set_ids_; }
-    const std::deque<StringId>& flat_keys() const { return flat_keys_; }
-    const std::deque<StringId>& keys() const { return keys_; }
-    const std::deque<Variadic>& arg_values() const { return arg_values_; }
+    // The key and type of an arg of a shape.
+    struct ShapeArg {
+      StringId flat_key;
+      StringId key;
+      Variadic::Type type;
+    };
+
+    // Returns the number of args, which are the rows of the args table.
     uint32_t args_count() const {
-      return static_cast<uint32_t>(set_ids_.size());
+      return static_cast<uint32_t>(values_.size());
     }
 
-    ArgSetId AddArgSet(const std::vector<Arg>& args,
-                       uint32_t begin,
-                       uint32_t end) {
-      base::Hash hash;
-      for (uint32_t i = begin; i < end; i++) {
-        hash.Update(ArgHasher()(args[i]));
-      }
+    // Returns the number of arg sets. Their ids go from 1 to arg_set_count().
+    uint32_t arg_set_count() const {
+      return static_cast<uint32_t>(set_shapes_.size());
+    }
 
-      ArgSetHash digest = hash.digest();
-      auto it = arg_row_for_hash_.find(digest);
-      if (it != arg_row_for_hash_.end()) {
-        return set_ids_[it->second];
-      }
+    // Returns the number of distinct shapes of the arg sets.
+    uint32_t shape_count() const {
+      return static_cast<uint32_t>(shape_first_args_.size() - 1);
+    }
+
+    // Returns the first row of the set |id| and the row after its last one.
+    // The range is empty for ids not in the storage.
+    std::pair<uint32_t, uint32_t> RowsForArgSet(ArgSetId id) const {
+      if (id == kInvalidArgSetId || id > arg_set_count())
+        return std::make_pair(args_count(), args_count());
+      uint32_t set = id - 1;
+      ShapeId shape = set_shapes_[set];
+      uint32_t first_row = set_first_rows_[set];
+      uint32_t size = shape_first_args_[shape + 1] - shape_first_args_[shape];
+      return std::make_pair(first_row, first_row + size);
+    }
 
-      // The +1 ensures that nothing has an id == kInvalidArgSetId == 0.
-      ArgSetId id = static_cast<uint32_t>(arg_row_for_hash_.size()) + 1;
-      arg_row_for_hash_.emplace(digest, args_count());
-      for (uint32_t i = begin; i < end; i++) {
-        const auto& arg = args[i];
-        set_ids_.emplace_back(id);
-        flat_keys_.emplace_back(arg.flat_key);
-        keys_.emplace_back(arg.key);
-        arg_values_.emplace_back(arg.value);
+    ArgSetId set_id(uint32_t row) const { return SetIndexForRow(row) + 1; }
+    StringId flat_key(uint32_t row) const {
+      return ShapeArgForRow(row).flat_key;
+    }
+    StringId key(uint32_t row) const { return ShapeArgForRow(row).key; }
+    Variadic arg_value(uint32_t row) const {
+      return DecodeValue(ShapeArgForRow(row).type, values_[row]);
+    }
+
+    // Calls |fn(row, shape_arg)| for each row in [start_row, end_row), in
+    // order, with the key and type of the arg at the row. This walks the sets
+    // rather than looking up the set of each row.
+    template <typename Fn>
+    void ForEachArg(uint32_t start_row, uint32_t end_row, Fn fn) const {
+      if (start_row >= end_row)
+        return;
+      uint32_t row = start_row;
+      for (uint32_t set = SetIndexForRow(start_row); row < end_row; set++) {
+        ShapeId shape = set_shapes_[set];
+        uint32_t first_row = set_first_rows_[set];
+        uint32_t first_arg = shape_first_args_[shape];
+        uint32_t set_end = first_row + shape_first_args_[shape + 1] - first_arg;
+        for (; row < set_end && row < end_row; row++)
+          fn(row, shape_args_[first_arg + row - first_row]);
       }
-      return id;
     }
 
+    ArgSetId AddArgSet(const std::vector<Arg>& args,
+                       uint32_t begin,
+                       uint32_t end);
+
+    // Returns the number of bytes of heap memory used by the args.
+    size_t memory_usage() const;
+
    private:
     using ArgSetHash = uint64_t;
+    using ShapeId = uint32_t;
+
+    // The first row of every block of kRowsPerBlock rows has its set
+    // recorded, so that the set of a row is found by only checking the first
+    // rows of a few sets.
+    static constexpr uint32_t kRowsPerBlockLog2 = 4;
+
+    static uint64_t EncodeValue(const Variadic& value);
+    static Variadic DecodeValue(Variadic::Type type, uint64_t value);
+
+    // Returns the slot of the set with hash |digest| in |set_ids_by_hash_|,
+    // or the empty slot where to add it.
+    size_t FindSetSlot(ArgSetHash digest) const;
+
+    ShapeId InternShape(const std::vector<Arg>& args,
+                        uint32_t begin,
+                        uint32_t end);
+
+    // Returns the index of the set (i.e. its id - 1) containing |row|.
+    uint32_t SetIndexForRow(uint32_t row) const {
+      PERFETTO_DCHECK(row < args_count());
+      uint32_t set = block_sets_[row >> kRowsPerBlockLog2];
+      while (set + 1 < arg_set_count() && set_first_rows_[set + 1] <= row)
+        set++;
+      return set;
+    }
 
-    std::deque<ArgSetId> set_ids_;
-    std::deque<StringId> flat_keys_;
-    std::deque<StringId> keys_;
-    std::deque<Variadic> arg_values_;
+    const ShapeArg& ShapeArgForRow(uint32_t row) const {
+      uint32_t set = SetIndexForRow(row);
+      uint32_t shape_arg = shape_first_args_[set_shapes_[set]] + row -
+                           set_first_rows_[set];
+      return shape_args_[shape_arg];
+    }
+
+    // The args of the shape s are shape_args_[shape_first_args_[s]] to
+    // shape_args_[shape_first_args_[s + 1] - 1].
+    std::vector<ShapeArg> shape_args_;
+    std::vector<uint32_t> shape_first_args_{0};
+    std::unordered_map<uint64_t, ShapeId> shape_for_hash_;
+
+    // The shape, first row and hash of each set, indexed by set id - 1.
+    ChunkedVector<ShapeId> set_shapes_;
+    ChunkedVector<uint32_t> set_first_rows_;
+    ChunkedVector<ArgSetHash> set_hashes_;
+
+    // Open addressing hash table of the set ids by hash, with
+    // kInvalidArgSetId in the empty slots. It is kept at most half full.
+    // Unlike a std::unordered_map, it costs a few bytes per set.
+    std::vector<ArgSetId> set_ids_by_hash_;
+
+    // |block_sets_[i]| is the index of the set containing the row
+    // i << kRowsPerBlockLog2.
+    ChunkedVector<uint32_t> block_sets_;
 
-    std::unordered_map<ArgSetHash, uint32_t> arg_row_for_hash_;
+    // The value of each arg, encoded with EncodeValue() for its type.
+    ChunkedVector<uint64_t> values_;
   };
 
   class Slices {
@@ -233,10 +326,14 @@ class TraceStorage {
       end_states_.emplace_back(end_state);
       priorities_.emplace_back(priority);
 
+      const uint32_t row = static_cast<uint32_t>(slice_count() - 1);
+      if (cpu >= rows_for_cpus_.size())
+        rows_for_cpus_.resize(cpu + 1);
+      rows_for_cpus_[cpu].emplace_back(row);
       if (utid >= rows_for_utids_.size())
         rows_for_utids_.resize(utid + 1);
-      rows_for_utids_[utid].emplace_back(slice_count() - 1);
-      return slice_count() - 1;
+      rows_for_utids_[utid].emplace_back(row);
+      return row;
     }
 
     void set_duration(size_t index, int64_t duration_ns) {
@@ -249,36 +346,50 @@ class TraceStorage {
 
     size_t slice_count() const { return start_ns_.size(); }
 
-    const std::deque<uint32_t>& cpus() const { return cpus_; }
+    const ChunkedVector<uint32_t>& cpus() const { return cpus_; }
 
-    const std::deque<int64_t>& start_ns() const { return start_ns_; }
+    const ChunkedVector<int64_t>& start_ns() const { return start_ns_; }
 
-    const std::deque<int64_t>& durations() const { return durations_; }
+    const ChunkedVector<int64_t>& durations() const { return durations_; }
 
-    const std::deque<UniqueTid>& utids() const { return utids_; }
+    const ChunkedVector<UniqueTid>& utids() const { return utids_; }
 
-    const std::deque<ftrace_utils::TaskState>& end_state() const {
+    const ChunkedVector<ftrace_utils::TaskState>& end_state() const {
       return end_states_;
     }
 
-    const std::deque<int32_t>& priorities() const { return priorities_; }
+    const ChunkedVector<int32_t>& priorities() const { return priorities_; }
+
+    const std::deque<std::vector<uint32_t>>& rows_for_cpus() const {
+      return rows_for_cpus_;
+    }
 
     const std::deque<std::vector<uint32_t>>& rows_for_utids() const {
       return rows_for_utids_;
     }
 
+    const IntervalIndex& end_index() const { return end_index_; }
+
+    // Indexes the ends of the slices, for overlap queries. Called once the
+    // slices don't change anymore.
+    void BuildEndIndex() { end_index_.Build(start_ns_, durations_); }
+
    private:
-    // Each deque below has the same number of entries (the number of slices
+    // Each column below has the same number of entries (the number of slices
     // in the trace for the CPU).
-    std::deque<uint32_t> cpus_;
-    std::deque<int64_t> start_ns_;
-    std::deque<int64_t> durations_;
-    std::deque<UniqueTid> utids_;
-    std::deque<ftrace_utils::TaskState> end_states_;
-    std::deque<int32_t> priorities_;
-
-    // One row per utid.
+    ChunkedVector<uint32_t> cpus_;
+    ChunkedVector<int64_t> start_ns_;
+    ChunkedVector<int64_t> durations_;
+    ChunkedVector<UniqueTid> utids_;
+    ChunkedVector<ftrace_utils::TaskState> end_states_;
+    ChunkedVector<int32_t> priorities_;
+
+    // The rows of each cpu and utid, in increasing order. As slices are
+    // added in timestamp order, these are also sorted by timestamp.
+    std::deque<std::vector<uint32_t>> rows_for_cpus_;
     std::deque<std::vector<uint32_t>> rows_for_utids_;
+
+    IntervalIndex end_index_;
   };
 
   class NestableSlices {
@@ -311,26 +422,34 @@ class TraceStorage {
     }
 
     size_t slice_count() const { return start_ns_.size(); }
-    const std::deque<int64_t>& start_ns() const { return start_ns_; }
-    const std::deque<int64_t>& durations() const { return durations_; }
-    const std::deque<UniqueTid>& utids() const { return utids_; }
-    const std::deque<StringId>& cats() const { return cats_; }
-    const std::deque<StringId>& names() const { return names_; }
-    const std::deque<uint8_t>& depths() const { return depths_; }
-    const std::deque<int64_t>& stack_ids() const { return stack_ids_; }
-    const std::deque<int64_t>& parent_stack_ids() const {
+    const ChunkedVector<int64_t>& start_ns() const { return start_ns_; }
+    const ChunkedVector<int64_t>& durations() const { return durations_; }
+    const ChunkedVector<UniqueTid>& utids() const { return utids_; }
+    const ChunkedVector<StringId>& cats() const { return cats_; }
+    const ChunkedVector<StringId>& names() const { return names_; }
+    const ChunkedVector<uint8_t>& depths() const { return depths_; }
+    const ChunkedVector<int64_t>& stack_ids() const { return stack_ids_; }
+    const ChunkedVector<int64_t>& parent_stack_ids() const {
       return parent_stack_ids_;
     }
 
+    const IntervalIndex& end_index() const { return end_index_; }
+
+    // Indexes the ends of the slices, for overlap queries. Called once the
+    // slices don't change anymore.
+    void BuildEndIndex() { end_index_.Build(start_ns_, durations_); }
+
    private:
-    std::deque<int64_t> start_ns_;
-    std::deque<int64_t> durations_;
-    std::deque<UniqueTid> utids_;
-    std::deque<StringId> cats_;
-    std::deque<StringId> names_;
-    std::deque<uint8_t> depths_;
-    std::deque<int64_t> stack_ids_;
-    std::deque<int64_t> parent_stack_ids_;
+    ChunkedVector<int64_t> start_ns_;
+    ChunkedVector<int64_t> durations_;
+    ChunkedVector<UniqueTid> utids_;
+    ChunkedVector<StringId> cats_;
+    ChunkedVector<StringId> names_;
+    ChunkedVector<uint8_t> depths_;
+    ChunkedVector<int64_t> stack_ids_;
+    ChunkedVector<int64_t> parent_stack_ids_;
+
+    IntervalIndex end_index_;
   };
 
   class Counters {
@@ -353,25 +472,25 @@ class TraceStorage {
 
     size_t counter_count() const { return timestamps_.size(); }
 
-    const std::deque<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
 
-    const std::deque<StringId>& name_ids() const { return name_ids_; }
+    const ChunkedVector<StringId>& name_ids() const { return name_ids_; }
 
-    const std::deque<double>& values() const { return values_; }
+    const ChunkedVector<double>& values() const { return values_; }
 
-    const std::deque<int64_t>& refs() const { return refs_; }
+    const ChunkedVector<int64_t>& refs() const { return refs_; }
 
-    const std::deque<RefType>& types() const { return types_; }
+    const ChunkedVector<RefType>& types() const { return types_; }
 
-    const std::deque<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
+    const ChunkedVector<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
 
    private:
-    std::deque<int64_t> timestamps_;
-    std::deque<StringId> name_ids_;
-    std::deque<double> values_;
-    std::deque<int64_t> refs_;
-    std::deque<RefType> types_;
-    std::deque<ArgSetId> arg_set_ids_;
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<StringId> name_ids_;
+    ChunkedVector<double> values_;
+    ChunkedVector<int64_t> refs_;
+    ChunkedVector<RefType> types_;
+    ChunkedVector<ArgSetId> arg_set_ids_;
   };
 
   class SqlStats {
@@ -414,25 +533,25 @@ class TraceStorage {
 
     size_t instant_count() const { return timestamps_.size(); }
 
-    const std::deque<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
 
-    const std::deque<StringId>& name_ids() const { return name_ids_; }
+    const ChunkedVector<StringId>& name_ids() const { return name_ids_; }
 
-    const std::deque<double>& values() const { return values_; }
+    const ChunkedVector<double>& values() const { return values_; }
 
-    const std::deque<int64_t>& refs() const { return refs_; }
+    const ChunkedVector<int64_t>& refs() const { return refs_; }
 
-    const std::deque<RefType>& types() const { return types_; }
+    const ChunkedVector<RefType>& types() const { return types_; }
 
-    const std::deque<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
+    const ChunkedVector<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
 
    private:
-    std::deque<int64_t> timestamps_;
-    std::deque<StringId> name_ids_;
-    std::deque<double> values_;
-    std::deque<int64_t> refs_;
-    std::deque<RefType> types_;
-    std::deque<ArgSetId> arg_set_ids_;
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<StringId> name_ids_;
+    ChunkedVector<double> values_;
+    ChunkedVector<int64_t> refs_;
+    ChunkedVector<RefType> types_;
+    ChunkedVector<ArgSetId> arg_set_ids_;
   };
 
   class RawEvents {
@@ -454,22 +573,22 @@ class TraceStorage {
 
     size_t raw_event_count() const { return timestamps_.size(); }
 
-    const std::deque<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
 
-    const std::deque<StringId>& name_ids() const { return name_ids_; }
+    const ChunkedVector<StringId>& name_ids() const { return name_ids_; }
 
-    const std::deque<uint32_t>& cpus() const { return cpus_; }
+    const ChunkedVector<uint32_t>& cpus() const { return cpus_; }
 
-    const std::deque<UniqueTid>& utids() const { return utids_; }
+    const ChunkedVector<UniqueTid>& utids() const { return utids_; }
 
-    const std::deque<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
+    const ChunkedVector<ArgSetId>& arg_set_ids() const { return arg_set_ids_; }
 
    private:
-    std::deque<int64_t> timestamps_;
-    std::deque<StringId> name_ids_;
-    std::deque<uint32_t> cpus_;
-    std::deque<UniqueTid> utids_;
-    std::deque<ArgSetId> arg_set_ids_;
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<StringId> name_ids_;
+    ChunkedVector<uint32_t> cpus_;
+    ChunkedVector<UniqueTid> utids_;
+    ChunkedVector<ArgSetId> arg_set_ids_;
   };
 
   class AndroidLogs {
@@ -489,18 +608,18 @@ class TraceStorage {
 
     size_t size() const { return timestamps_.size(); }
 
-    const std::deque<int64_t>& timestamps() const { return timestamps_; }
-    const std::deque<UniqueTid>& utids() const { return utids_; }
-    const std::deque<uint8_t>& prios() const { return prios_; }
-    const std::deque<StringId>& tag_ids() const { return tag_ids_; }
-    const std::deque<StringId>& msg_ids() const { return msg_ids_; }
+    const ChunkedVector<int64_t>& timestamps() const { return timestamps_; }
+    const ChunkedVector<UniqueTid>& utids() const { return utids_; }
+    const ChunkedVector<uint8_t>& prios() const { return prios_; }
+    const ChunkedVector<StringId>& tag_ids() const { return tag_ids_; }
+    const ChunkedVector<StringId>& msg_ids() const { return msg_ids_; }
 
    private:
-    std::deque<int64_t> timestamps_;
-    std::deque<UniqueTid> utids_;
-    std::deque<uint8_t> prios_;
-    std::deque<StringId> tag_ids_;
-    std::deque<StringId> msg_ids_;
+    ChunkedVector<int64_t> timestamps_;
+    ChunkedVector<UniqueTid> utids_;
+    ChunkedVector<uint8_t> prios_;
+    ChunkedVector<StringId> tag_ids_;
+    ChunkedVector<StringId> msg_ids_;
   };
 
   struct Stats {
@@ -559,9 +678,17 @@ class TraceStorage {
   }
 
   // Reading methods.
-  const std::string& GetString(StringId id) const {
+  // The returned view is valid for the lifetime of the storage and is always
+  // null terminated.
+  base::StringView GetString(StringId id) const {
     PERFETTO_DCHECK(id < string_pool_.size());
-    return string_pool_[id];
+    return string_pool_.Get(id);
+  }
+
+  // Returns the id of |str| if it was previously interned or nullopt
+  // otherwise. Unlike InternString, this never modifies the string pool.
+  base::Optional<StringId> GetStringId(base::StringView str) const {
+    return string_pool_.GetId(str);
   }
 
   const Process& GetProcess(UniquePid upid) const {
@@ -612,7 +739,7 @@ class TraceStorage {
   const RawEvents& raw_events() const { return raw_events_; }
   RawEvents* mutable_raw_events() { return &raw_events_; }
 
-  const std::deque<std::string>& string_pool() const { return string_pool_; }
+  const StringPool& string_pool() const { return string_pool_; }
 
   // |unique_processes_| always contains at least 1 element becuase the 0th ID
   // is reserved to indicate an invalid process.
@@ -632,9 +759,7 @@ class TraceStorage {
  private:
   static constexpr uint8_t kRowIdTableShift = 32;
 
-  using StringHash = uint64_t;
-
-  TraceStorage& operator=(const TraceStorage&) = default;
+  TraceStorage& operator=(TraceStorage&&) = default;
 
   // Stats about parsing the trace.
   StatsMap stats_{};
@@ -646,10 +771,7 @@ class TraceStorage {
   Args args_;
 
   // One entry for each unique string in the trace.
-  std::deque<std::string> string_pool_;
-
-  // One entry for each unique string in the trace.
-  std::unordered_map<StringHash, StringId> string_index_;
+  StringPool string_pool_;
 
   // One entry for each UniquePid, with UniquePid as the index.
   std::deque<Process> unique_processes_;
@@ -15,6 +15,7 @@
  */
 
 #include <emscripten/emscripten.h>
+#include <functional>
 #include <map>
 #include <string>
 
@@ -45,6 +46,34 @@ using ReplyFunction = void (*)(RequestID,
 namespace {
 TraceProcessor* g_trace_processor;
 ReplyFunction g_reply;
+
+// Parses the arguments of a RPC method invocation, calls |method| with them
+// and replies with the serialized result.
+template <typename Args, typename Result>
+void CallMethod(RequestID id,
+                const uint8_t* data,
+                int len,
+                void (TraceProcessor::*method)(
+                    const Args&,
+                    std::function<void(const Result&)>)) {
+  Args args;
+  bool parsed = args.ParseFromArray(data, len);
+  if (!parsed) {
+    std::string err = "Failed to parse input request";
+    g_reply(id, false, err.data(), err.size());
+    return;
+  }
+
+  // When the C++ class implementing the service replies, serialize the protobuf
+  // result and post it back to the worker script (|g_reply|).
+  auto callback = [id](const Result& res) {
+    std::string encoded;
+    res.SerializeToString(&encoded);
+    g_reply(id, true, encoded.data(), static_cast<uint32_t>(encoded.size()));
+  };
+
+  (g_trace_processor->*method)(args, callback);
+}
 }  // namespace
 // +---------------------------------------------------------------------------+
 // | Exported functions called by the JS/TS running in the worker.             |
@@ -90,23 +119,32 @@ void EMSCRIPTEN_KEEPALIVE trace_processor_rawQuery(RequestID,
 void trace_processor_rawQuery(RequestID id,
                               const uint8_t* query_data,
                               int len) {
-  protos::RawQueryArgs query;
-  bool parsed = query.ParseFromArray(query_data, len);
-  if (!parsed) {
-    std::string err = "Failed to parse input request";
-    g_reply(id, false, err.data(), err.size());
-    return;
-  }
+  CallMethod(id, query_data, len, &TraceProcessor::ExecuteQuery);
+}
 
-  // When the C++ class implementing the service replies, serialize the protobuf
-  // result and post it back to the worker script (|g_reply|).
-  auto callback = [id](const protos::RawQueryResult& res) {
-    std::string encoded;
-    res.SerializeToString(&encoded);
-    g_reply(id, true, encoded.data(), static_cast<uint32_t>(encoded.size()));
-  };
+// The streaming query methods: the rows are returned in batches, each one
+// in its own reply, so the memory is bounded by the size of a batch.
+void EMSCRIPTEN_KEEPALIVE trace_processor_openQuery(RequestID,
+                                                    const uint8_t*,
+                                                    int);
+void trace_processor_openQuery(RequestID id, const uint8_t* data, int len) {
+  CallMethod(id, data, len, &TraceProcessor::OpenQuery);
+}
+
+void EMSCRIPTEN_KEEPALIVE trace_processor_fetchQueryRows(RequestID,
+                                                         const uint8_t*,
+                                                         int);
+void trace_processor_fetchQueryRows(RequestID id,
+                                    const uint8_t* data,
+                                    int len) {
+  CallMethod(id, data, len, &TraceProcessor::FetchQueryRows);
+}
 
-  g_trace_processor->ExecuteQuery(query, callback);
+void EMSCRIPTEN_KEEPALIVE trace_processor_closeQuery(RequestID,
+                                                     const uint8_t*,
+                                                     int);
+void trace_processor_closeQuery(RequestID id, const uint8_t* data, int len) {
+  CallMethod(id, data, len, &TraceProcessor::CloseQuery);
 }
 
 }  // extern "C"
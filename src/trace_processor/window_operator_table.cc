@@ -16,41 +16,102 @@
 
 #include "src/trace_processor/window_operator_table.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+
 #include "src/trace_processor/sqlite_utils.h"
+#include "src/trace_processor/trace_storage.h"
 
 namespace perfetto {
 namespace trace_processor {
 
 namespace {
 using namespace sqlite_utils;
+
+// Whether the cursor applies the constraint itself while collecting the
+// source rows. SQLite can't: the source columns are null unless restricted
+// by equality, and a null matches no other constraint.
+bool IsSourceConstraint(const QueryConstraints::Constraint& cs) {
+  if (cs.iColumn != WindowOperatorTable::Column::kSourceRef &&
+      cs.iColumn != WindowOperatorTable::Column::kSourceName) {
+    return false;
+  }
+  switch (cs.op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+    case SQLITE_INDEX_CONSTRAINT_NE:
+    case SQLITE_INDEX_CONSTRAINT_GE:
+    case SQLITE_INDEX_CONSTRAINT_GT:
+    case SQLITE_INDEX_CONSTRAINT_LE:
+    case SQLITE_INDEX_CONSTRAINT_LT:
+    case SQLITE_INDEX_CONSTRAINT_ISNULL:
+    case SQLITE_INDEX_CONSTRAINT_ISNOTNULL:
+      return true;
+    case SQLITE_INDEX_CONSTRAINT_LIKE:
+    case SQLITE_INDEX_CONSTRAINT_GLOB:
+      return cs.iColumn == WindowOperatorTable::Column::kSourceName;
+  }
+  return false;
+}
 }  // namespace
 
-WindowOperatorTable::WindowOperatorTable(sqlite3*, const TraceStorage*) {}
+WindowOperatorTable::WindowOperatorTable(sqlite3*, const TraceStorage* storage)
+    : storage_(storage) {}
 
 void WindowOperatorTable::RegisterTable(sqlite3* db,
                                         const TraceStorage* storage) {
   Table::Register<WindowOperatorTable>(db, storage, "window", true);
 }
 
-base::Optional<Table::Schema> WindowOperatorTable::Init(int,
-                                                        const char* const*) {
+base::Optional<Table::Schema> WindowOperatorTable::Init(
+    int argc,
+    const char* const* argv) {
+  // argv[0] - argv[2] are SQLite populated fields which are always present.
+  if (argc > 4) {
+    PERFETTO_ELOG("Window expected at most 1 arg, received %d", argc - 3);
+    return base::nullopt;
+  }
+  if (argc == 4) {
+    const char* source = argv[3];
+    if (strcmp(source, "sched") == 0) {
+      source_ = Source::kSched;
+    } else if (strcmp(source, "slices") == 0) {
+      source_ = Source::kSlices;
+    } else if (strcmp(source, "counters") == 0) {
+      source_ = Source::kCounters;
+    } else {
+      PERFETTO_ELOG("Window source %s is not supported", source);
+      return base::nullopt;
+    }
+  }
+
   const bool kHidden = true;
-  return Schema(
-      {
-          // These are the operator columns:
-          Table::Column(Column::kRowId, "rowid", ColumnType::kLong, kHidden),
-          Table::Column(Column::kQuantum, "quantum", ColumnType::kLong,
-                        kHidden),
-          Table::Column(Column::kWindowStart, "window_start", ColumnType::kLong,
-                        kHidden),
-          Table::Column(Column::kWindowDur, "window_dur", ColumnType::kLong,
-                        kHidden),
-          // These are the ouput columns:
-          Table::Column(Column::kTs, "ts", ColumnType::kLong),
-          Table::Column(Column::kDuration, "dur", ColumnType::kLong),
-          Table::Column(Column::kQuantumTs, "quantum_ts", ColumnType::kLong),
-      },
-      {Column::kRowId});
+  std::vector<Table::Column> columns = {
+      // These are the operator columns:
+      Table::Column(Column::kRowId, "rowid", ColumnType::kLong, kHidden),
+      Table::Column(Column::kQuantum, "quantum", ColumnType::kLong, kHidden),
+      Table::Column(Column::kWindowStart, "window_start", ColumnType::kLong,
+                    kHidden),
+      Table::Column(Column::kWindowDur, "window_dur", ColumnType::kLong,
+                    kHidden),
+      // These are the ouput columns:
+      Table::Column(Column::kTs, "ts", ColumnType::kLong),
+      Table::Column(Column::kDuration, "dur", ColumnType::kLong),
+      Table::Column(Column::kQuantumTs, "quantum_ts", ColumnType::kLong),
+  };
+  if (source_ != Source::kNone) {
+    columns.emplace_back(Column::kCount, "count", ColumnType::kUint);
+    columns.emplace_back(Column::kOverlapDur, "overlap_dur", ColumnType::kLong);
+    columns.emplace_back(Column::kMinValue, "min_value", ColumnType::kDouble);
+    columns.emplace_back(Column::kMaxValue, "max_value", ColumnType::kDouble);
+    columns.emplace_back(Column::kAvgValue, "avg_value", ColumnType::kDouble);
+    columns.emplace_back(Column::kSourceRef, "source_ref", ColumnType::kLong,
+                         kHidden);
+    columns.emplace_back(Column::kSourceName, "source_name",
+                         ColumnType::kString, kHidden);
+  }
+  return Schema(columns, {Column::kRowId});
 }
 
 std::unique_ptr<Table::Cursor> WindowOperatorTable::CreateCursor(
@@ -70,6 +131,12 @@ int WindowOperatorTable::BestIndex(const QueryConstraints& qc,
       !qc.order_by()[0].desc) {
     info->order_by_consumed = true;
   }
+
+  // The source filters are applied while collecting the source rows.
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    if (IsSourceConstraint(qc.constraints()[i]))
+      info->omit[i] = true;
+  }
   return SQLITE_OK;
 }
 
@@ -120,6 +187,194 @@ WindowOperatorTable::Cursor::Cursor(const WindowOperatorTable* table,
   } else {
     filter_type_ = FilterType::kReturnAll;
   }
+
+  if (table_->source_ != Source::kNone) {
+    InitSourceRows(qc, argv);
+    if (!Eof())
+      AggregateWindow();
+  }
+}
+
+void WindowOperatorTable::Cursor::InitSourceRows(const QueryConstraints& qc,
+                                                 sqlite3_value** argv) {
+  // The other constraints on the source columns are checked on every row.
+  std::vector<std::function<bool(int64_t)>> ref_predicates;
+  std::vector<std::function<bool(const char*)>> name_predicates;
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    if (!IsSourceConstraint(cs))
+      continue;
+    if (cs.iColumn == Column::kSourceRef) {
+      if (IsOpEq(cs.op)) {
+        ref_filter_ = sqlite3_value_int64(argv[i]);
+      } else {
+        ref_predicates.emplace_back(
+            CreateNumericPredicate<int64_t>(cs.op, argv[i]));
+      }
+    } else if (IsOpEq(cs.op)) {
+      const char* name =
+          reinterpret_cast<const char*>(sqlite3_value_text(argv[i]));
+      name_filter_ = name ? name : "";
+    } else {
+      name_predicates.emplace_back(CreateStringPredicate(cs.op, argv[i]));
+    }
+  }
+
+  const TraceStorage* storage = table_->storage_;
+  base::Optional<StringId> name_id;
+  if (name_filter_.has_value()) {
+    // Sched slices have no name and a name which was never interned matches
+    // no row.
+    name_id = storage->GetStringId(base::StringView(*name_filter_));
+    if (table_->source_ == Source::kSched || !name_id.has_value())
+      return;
+  }
+  auto matches_predicates = [&](int64_t ref, StringId name) {
+    for (const auto& predicate : ref_predicates) {
+      if (!predicate(ref))
+        return false;
+    }
+    // The string id 0, which sched slices pass, is reported as NULL.
+    const char* name_str =
+        name == 0 ? nullptr : storage->GetString(name).data();
+    for (const auto& predicate : name_predicates) {
+      if (!predicate(name_str))
+        return false;
+    }
+    return true;
+  };
+
+  switch (table_->source_) {
+    case Source::kSched: {
+      // Idle slices (utid 0) are skipped so that the windows aggregate the
+      // time the CPUs were busy.
+      const auto& slices = storage->slices();
+      if (ref_filter_.has_value()) {
+        int64_t cpu = *ref_filter_;
+        if (cpu < 0 ||
+            static_cast<size_t>(cpu) >= slices.rows_for_cpus().size()) {
+          break;
+        }
+        if (!matches_predicates(cpu, 0))
+          break;
+        for (uint32_t row : slices.rows_for_cpus()[static_cast<size_t>(cpu)]) {
+          if (slices.utids()[row] != 0)
+            rows_.emplace_back(row);
+        }
+        break;
+      }
+      for (uint32_t row = 0; row < slices.slice_count(); row++) {
+        if (slices.utids()[row] != 0 &&
+            matches_predicates(slices.cpus()[row], 0)) {
+          rows_.emplace_back(row);
+        }
+      }
+      break;
+    }
+    case Source::kSlices: {
+      const auto& slices = storage->nestable_slices();
+      for (uint32_t row = 0; row < slices.slice_count(); row++) {
+        if (ref_filter_.has_value() && slices.utids()[row] != *ref_filter_)
+          continue;
+        if (name_id.has_value() && slices.names()[row] != *name_id)
+          continue;
+        if (!matches_predicates(slices.utids()[row], slices.names()[row]))
+          continue;
+        rows_.emplace_back(row);
+      }
+      break;
+    }
+    case Source::kCounters: {
+      const auto& counters = storage->counters();
+      for (uint32_t row = 0; row < counters.counter_count(); row++) {
+        if (ref_filter_.has_value() && counters.refs()[row] != *ref_filter_)
+          continue;
+        if (name_id.has_value() && counters.name_ids()[row] != *name_id)
+          continue;
+        if (!matches_predicates(counters.refs()[row], counters.name_ids()[row]))
+          continue;
+        rows_.emplace_back(row);
+      }
+      break;
+    }
+    case Source::kNone:
+      PERFETTO_FATAL("Window without source");
+  }
+
+  // The storage is almost always sorted by ts already.
+  auto ts_less = [this](uint32_t a, uint32_t b) { return RowTs(a) < RowTs(b); };
+  if (!std::is_sorted(rows_.begin(), rows_.end(), ts_less))
+    std::stable_sort(rows_.begin(), rows_.end(), ts_less);
+}
+
+int64_t WindowOperatorTable::Cursor::RowTs(uint32_t row) const {
+  switch (table_->source_) {
+    case Source::kSched:
+      return table_->storage_->slices().start_ns()[row];
+    case Source::kSlices:
+      return table_->storage_->nestable_slices().start_ns()[row];
+    case Source::kCounters:
+      return table_->storage_->counters().timestamps()[row];
+    case Source::kNone:
+      break;
+  }
+  PERFETTO_FATAL("Window without source");
+}
+
+int64_t WindowOperatorTable::Cursor::RowDur(uint32_t row) const {
+  int64_t dur = 0;
+  switch (table_->source_) {
+    case Source::kSched:
+      dur = table_->storage_->slices().durations()[row];
+      break;
+    case Source::kSlices:
+      dur = table_->storage_->nestable_slices().durations()[row];
+      break;
+    case Source::kCounters:
+    case Source::kNone:
+      break;
+  }
+  // Slices which never ended are treated as instants.
+  return std::max<int64_t>(dur, 0);
+}
+
+void WindowOperatorTable::Cursor::AggregateWindow() {
+  // The last window is truncated to the end of the range.
+  int64_t start = current_ts_;
+  int64_t end =
+      window_end_ - start > step_size_ ? start + step_size_ : window_end_;
+
+  while (next_row_ < rows_.size() && RowTs(rows_[next_row_]) < end)
+    active_rows_.emplace_back(rows_[next_row_++]);
+
+  count_ = 0;
+  overlap_dur_ = 0;
+  min_value_ = std::numeric_limits<double>::max();
+  max_value_ = std::numeric_limits<double>::lowest();
+  sum_value_ = 0;
+
+  size_t kept = 0;
+  for (uint32_t row : active_rows_) {
+    int64_t row_start = RowTs(row);
+    int64_t row_end = row_start + RowDur(row);
+    // Instants overlap the window they are in; slices the windows they
+    // intersect.
+    bool overlaps = row_end > start || (row_end == row_start &&
+                                        row_start >= start);
+    if (overlaps) {
+      count_++;
+      overlap_dur_ += std::min(row_end, end) - std::max(row_start, start);
+      if (table_->source_ == Source::kCounters) {
+        double value = table_->storage_->counters().values()[row];
+        min_value_ = std::min(min_value_, value);
+        max_value_ = std::max(max_value_, value);
+        sum_value_ += value;
+      }
+    }
+    if (row_end > end)
+      active_rows_[kept++] = row;
+  }
+  active_rows_.resize(kept);
 }
 
 int WindowOperatorTable::Cursor::Column(sqlite3_context* context, int N) {
@@ -154,6 +409,47 @@ int WindowOperatorTable::Cursor::Column(sqlite3_context* context, int N) {
       sqlite3_result_int64(context, static_cast<sqlite_int64>(row_id_));
       break;
     }
+    case Column::kCount: {
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(count_));
+      break;
+    }
+    case Column::kOverlapDur: {
+      sqlite3_result_int64(context, static_cast<sqlite_int64>(overlap_dur_));
+      break;
+    }
+    case Column::kMinValue:
+    case Column::kMaxValue:
+    case Column::kAvgValue: {
+      // Only counters have values.
+      if (count_ == 0 || table_->source_ != Source::kCounters) {
+        sqlite3_result_null(context);
+        break;
+      }
+      double value = sum_value_ / static_cast<double>(count_);
+      if (N == Column::kMinValue)
+        value = min_value_;
+      else if (N == Column::kMaxValue)
+        value = max_value_;
+      sqlite3_result_double(context, value);
+      break;
+    }
+    case Column::kSourceRef: {
+      if (ref_filter_.has_value()) {
+        sqlite3_result_int64(context, *ref_filter_);
+      } else {
+        sqlite3_result_null(context);
+      }
+      break;
+    }
+    case Column::kSourceName: {
+      if (name_filter_.has_value()) {
+        sqlite3_result_text(context, name_filter_->c_str(), -1,
+                            kSqliteTransient);
+      } else {
+        sqlite3_result_null(context);
+      }
+      break;
+    }
     default: {
       PERFETTO_FATAL("Unknown column %d", N);
       break;
@@ -173,6 +469,8 @@ int WindowOperatorTable::Cursor::Next() {
       break;
   }
   row_id_++;
+  if (table_->source_ != Source::kNone && !Eof())
+    AggregateWindow();
   return SQLITE_OK;
 }
 
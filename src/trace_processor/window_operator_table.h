@@ -19,6 +19,8 @@
 
 #include <limits>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "src/trace_processor/table.h"
 
@@ -27,6 +29,17 @@ namespace trace_processor {
 
 class TraceStorage;
 
+// Generates the windows of |quantum| ns between window_start and
+// window_start + window_dur.
+//
+// When created with a source table, e.g.
+//   CREATE VIRTUAL TABLE cpu_buckets USING window(sched);
+// each window also aggregates the source rows overlapping it, in a single
+// sweep over the storage sorted by ts. The supported sources are sched
+// (without idle slices), slices and counters (which are instants). The
+// source can be restricted with constraints on source_ref (the cpu for sched,
+// the utid for slices, the ref for counters) and source_name (slices and
+// counters). These columns are only non-null when restricted by equality.
 class WindowOperatorTable : public Table {
  public:
   enum Column {
@@ -36,9 +49,19 @@ class WindowOperatorTable : public Table {
     kWindowDur = 3,
     kTs = 4,
     kDuration = 5,
-    kQuantumTs = 6
+    kQuantumTs = 6,
+    // These are only present when the table has a source.
+    kCount = 7,
+    kOverlapDur = 8,
+    kMinValue = 9,
+    kMaxValue = 10,
+    kAvgValue = 11,
+    kSourceRef = 12,
+    kSourceName = 13,
   };
 
+  enum class Source { kNone, kSched, kSlices, kCounters };
+
   static void RegisterTable(sqlite3* db, const TraceStorage* storage);
 
   WindowOperatorTable(sqlite3*, const TraceStorage*);
@@ -66,6 +89,16 @@ class WindowOperatorTable : public Table {
     int Column(sqlite3_context*, int N) override;
 
    private:
+    // Collects the source rows matching the constraints, sorted by ts.
+    void InitSourceRows(const QueryConstraints& qc, sqlite3_value** argv);
+
+    // Aggregates the source rows overlapping the current window, keeping
+    // the ones which extend past it for the next window.
+    void AggregateWindow();
+
+    int64_t RowTs(uint32_t row) const;
+    int64_t RowDur(uint32_t row) const;
+
     // Defines the data to be generated by the table.
     enum FilterType {
       // Returns all the spans.
@@ -84,8 +117,25 @@ class WindowOperatorTable : public Table {
     int64_t row_id_ = 0;
 
     FilterType filter_type_ = FilterType::kReturnAll;
+
+    base::Optional<int64_t> ref_filter_;
+    base::Optional<std::string> name_filter_;
+
+    std::vector<uint32_t> rows_;
+    size_t next_row_ = 0;
+    std::vector<uint32_t> active_rows_;
+
+    // Aggregates of the current window.
+    uint32_t count_ = 0;
+    int64_t overlap_dur_ = 0;
+    double min_value_ = 0;
+    double max_value_ = 0;
+    double sum_value_ = 0;
   };
 
+  const TraceStorage* const storage_;
+  Source source_ = Source::kNone;
+
   int64_t quantum_ = 0;
   int64_t window_start_ = 0;
 
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/window_operator_table.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/trace_processor/scoped_db.h"
+#include "src/trace_processor/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class WindowOperatorTableTest : public ::testing::Test {
+ public:
+  WindowOperatorTableTest() {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    WindowOperatorTable::RegisterTable(db_.get(), &storage_);
+  }
+
+  void PrepareValidStatement(const std::string& sql) {
+    int size = static_cast<int>(sql.size());
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_prepare_v2(*db_, sql.c_str(), size, &stmt, nullptr),
+              SQLITE_OK);
+    stmt_.reset(stmt);
+  }
+
+  void RunStatement(const std::string& sql) {
+    PrepareValidStatement(sql);
+    ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+  }
+
+  // Returns the rows of |sql|, with the columns separated by spaces.
+  std::vector<std::string> Rows(const std::string& sql) {
+    PrepareValidStatement(sql);
+    std::vector<std::string> rows;
+    int err;
+    while ((err = sqlite3_step(stmt_.get())) == SQLITE_ROW) {
+      std::string row;
+      for (int i = 0; i < sqlite3_column_count(stmt_.get()); i++) {
+        const unsigned char* text = sqlite3_column_text(stmt_.get(), i);
+        if (i > 0)
+          row += " ";
+        row += text ? reinterpret_cast<const char*>(text) : "null";
+      }
+      rows.emplace_back(std::move(row));
+    }
+    EXPECT_EQ(err, SQLITE_DONE);
+    return rows;
+  }
+
+ protected:
+  TraceStorage storage_;
+  ScopedDb db_;
+  ScopedStmt stmt_;
+};
+
+TEST_F(WindowOperatorTableTest, NoSource) {
+  RunStatement(
+      "UPDATE window SET window_start = 100, window_dur = 25, quantum = 10 "
+      "WHERE rowid = 0");
+  ASSERT_THAT(Rows("SELECT * FROM window"),
+              testing::ElementsAre("100 10 0", "110 10 1", "120 10 2"));
+}
+
+TEST_F(WindowOperatorTableTest, SchedOverlap) {
+  auto* slices = storage_.mutable_slices();
+  // A slice spanning three windows, one ending on a window boundary and an
+  // instant.
+  slices->AddSlice(0, 5, 30, 1, ftrace_utils::TaskState(), 120);
+  slices->AddSlice(1, 10, 10, 2, ftrace_utils::TaskState(), 120);
+  slices->AddSlice(0, 35, 10, 1, ftrace_utils::TaskState(), 120);
+  slices->AddSlice(1, 42, 0, 2, ftrace_utils::TaskState(), 120);
+  // Before the windows.
+  slices->AddSlice(1, 2, 3, 2, ftrace_utils::TaskState(), 120);
+  // Idle slices are ignored.
+  slices->AddSlice(1, 20, 10, 0, ftrace_utils::TaskState(), 120);
+
+  RunStatement("CREATE VIRTUAL TABLE cpu_buckets USING window(sched)");
+  RunStatement(
+      "UPDATE cpu_buckets SET window_start = 10, window_dur = 40, "
+      "quantum = 10 WHERE rowid = 0");
+  ASSERT_THAT(Rows("SELECT ts, dur, count, overlap_dur, min_value "
+                   "FROM cpu_buckets"),
+              testing::ElementsAre("10 10 2 20 null", "20 10 1 10 null",
+                                   "30 10 2 10 null", "40 10 2 5 null"));
+  ASSERT_THAT(Rows("SELECT ts, count, overlap_dur, source_ref "
+                   "FROM cpu_buckets WHERE source_ref = 1"),
+              testing::ElementsAre("10 1 10 1", "20 0 0 1", "30 0 0 1",
+                                   "40 1 0 1"));
+  ASSERT_THAT(Rows("SELECT count(*) FROM cpu_buckets "
+                   "WHERE source_name = 'foo' AND count > 0"),
+              testing::ElementsAre("0"));
+  // The other constraints restrict the source rows too, but the source
+  // columns stay null.
+  ASSERT_THAT(Rows("SELECT ts, count, overlap_dur, source_ref "
+                   "FROM cpu_buckets WHERE source_ref > 0"),
+              testing::ElementsAre("10 1 10 null", "20 0 0 null",
+                                   "30 0 0 null", "40 1 0 null"));
+  ASSERT_THAT(Rows("SELECT count FROM cpu_buckets "
+                   "WHERE source_name IS NULL AND source_ref != 1"),
+              testing::ElementsAre("1", "1", "2", "1"));
+}
+
+TEST_F(WindowOperatorTableTest, CounterValues) {
+  StringId mem = storage_.InternString("mem");
+  StringId freq = storage_.InternString("freq");
+  auto* counters = storage_.mutable_counters();
+  counters->AddCounter(0, mem, 1, 0, RefType::kRefNoRef);
+  counters->AddCounter(5, freq, 100, 0, RefType::kRefCpuId);
+  counters->AddCounter(12, mem, 4, 0, RefType::kRefNoRef);
+  counters->AddCounter(15, freq, 300, 1, RefType::kRefCpuId);
+  counters->AddCounter(18, mem, 2, 0, RefType::kRefNoRef);
+  // Out of order in storage.
+  counters->AddCounter(3, mem, 7, 0, RefType::kRefNoRef);
+
+  RunStatement("CREATE VIRTUAL TABLE counter_buckets USING window(counters)");
+  RunStatement(
+      "UPDATE counter_buckets SET window_start = 0, window_dur = 20, "
+      "quantum = 10 WHERE rowid = 0");
+  ASSERT_THAT(Rows("SELECT quantum_ts, count, min_value, max_value, avg_value "
+                   "FROM counter_buckets WHERE source_name = 'mem'"),
+              testing::ElementsAre("0 2 1.0 7.0 4.0", "1 2 2.0 4.0 3.0"));
+  ASSERT_THAT(Rows("SELECT quantum_ts, count, max_value FROM counter_buckets "
+                   "WHERE source_name = 'freq' AND source_ref = 1"),
+              testing::ElementsAre("0 0 null", "1 1 300.0"));
+  ASSERT_THAT(Rows("SELECT quantum_ts, count FROM counter_buckets"),
+              testing::ElementsAre("0 3", "1 3"));
+  ASSERT_THAT(Rows("SELECT quantum_ts, count, max_value FROM counter_buckets "
+                   "WHERE source_name != 'mem'"),
+              testing::ElementsAre("0 1 100.0", "1 1 300.0"));
+  ASSERT_THAT(Rows("SELECT quantum_ts, count FROM counter_buckets "
+                   "WHERE source_name LIKE 'fr%' AND source_ref < 1"),
+              testing::ElementsAre("0 1", "1 0"));
+}
+
+TEST_F(WindowOperatorTableTest, InvalidSource) {
+  ASSERT_NE(sqlite3_exec(*db_, "CREATE VIRTUAL TABLE w USING window(foo)",
+                         nullptr, nullptr, nullptr),
+            SQLITE_OK);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
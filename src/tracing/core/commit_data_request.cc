@@ -103,6 +103,11 @@ void CommitDataRequest::ChunksToMove::FromProto(
   static_assert(sizeof(target_buffer_) == sizeof(proto.target_buffer()),
                 "size mismatch");
   target_buffer_ = static_cast<decltype(target_buffer_)>(proto.target_buffer());
+
+  static_assert(sizeof(dropped_packets_) == sizeof(proto.dropped_packets()),
+                "size mismatch");
+  dropped_packets_ =
+      static_cast<decltype(dropped_packets_)>(proto.dropped_packets());
   unknown_fields_ = proto.unknown_fields();
 }
 
@@ -120,6 +125,11 @@ void CommitDataRequest::ChunksToMove::ToProto(
                 "size mismatch");
   proto->set_target_buffer(
       static_cast<decltype(proto->target_buffer())>(target_buffer_));
+
+  static_assert(sizeof(dropped_packets_) == sizeof(proto->dropped_packets()),
+                "size mismatch");
+  proto->set_dropped_packets(
+      static_cast<decltype(proto->dropped_packets())>(dropped_packets_));
   *(proto->mutable_unknown_fields()) = unknown_fields_;
 }
 
@@ -397,6 +397,66 @@ TEST_F(TracingServiceImplTest, WriteIntoFileAndStopOnMaxSize) {
   }
 }
 
+// Writes more packets than fit in a single writev() call, to check that they
+// are batched correctly and that each of them gets its own trusted fields.
+TEST_F(TracingServiceImplTest, WriteIntoFileManyPackets) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer", 123u /* uid */);
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(100000);  // 100s
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  static const int kNumTestPackets = 4096;
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (int i = 0; i < kNumTestPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    std::string payload = "payload" + std::to_string(i);
+    tp->set_for_testing()->set_str(payload.c_str(), payload.size());
+  }
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+
+  int num_test_packets = 0;
+  uint32_t sequence_id = 0;
+  for (const protos::TracePacket& tp : trace.packet()) {
+    if (!tp.has_for_testing())
+      continue;
+    ASSERT_EQ("payload" + std::to_string(num_test_packets++),
+              tp.for_testing().str());
+    ASSERT_EQ(123, tp.trusted_uid());
+    if (!sequence_id)
+      sequence_id = tp.trusted_packet_sequence_id();
+    ASSERT_NE(0u, sequence_id);
+    ASSERT_EQ(sequence_id, tp.trusted_packet_sequence_id());
+  }
+  ASSERT_EQ(kNumTestPackets, num_test_packets);
+}
+
 // Test the logic that allows the trace config to set the shm total size and
 // page size from the trace config. Also check that, if the config doesn't
 // specify a value we fall back on the hint provided by the producer.
@@ -61,59 +61,45 @@ SharedMemoryArbiterImpl::SharedMemoryArbiterImpl(
 
 Chunk SharedMemoryArbiterImpl::GetNewChunk(
     const SharedMemoryABI::ChunkHeader& header,
-    size_t size_hint) {
-  PERFETTO_DCHECK(size_hint == 0);  // Not implemented yet.
+    size_t size_hint,
+    BufferExhaustedPolicy policy,
+    uint32_t* page_hint) {
   int stall_count = 0;
   unsigned stall_interval_us = 0;
   static const unsigned kMaxStallIntervalUs = 100000;
   static const int kLogAfterNStalls = 3;
 
-  for (;;) {
-    // TODO(primiano): Probably this lock is not really required and this code
-    // could be rewritten leveraging only the Try* atomic operations in
-    // SharedMemoryABI. But let's not be too adventurous for the moment.
-    {
-      std::lock_guard<std::mutex> scoped_lock(lock_);
-      const size_t initial_page_idx = page_idx_;
-      for (size_t i = 0; i < shmem_abi_.num_pages(); i++) {
-        page_idx_ = (initial_page_idx + i) % shmem_abi_.num_pages();
-        bool is_new_page = false;
-
-        // TODO(primiano): make the page layout dynamic.
-        auto layout = SharedMemoryArbiterImpl::default_page_layout;
-
-        if (shmem_abi_.is_page_free(page_idx_)) {
-          // TODO(primiano): Use the |size_hint| here to decide the layout.
-          is_new_page = shmem_abi_.TryPartitionPage(page_idx_, layout);
-        }
-        uint32_t free_chunks;
-        if (is_new_page) {
-          free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
-        } else {
-          free_chunks = shmem_abi_.GetFreeChunks(page_idx_);
-        }
+  // Chunks are acquired only through the atomic Try* operations of
+  // SharedMemoryABI, without taking |lock_|: concurrent writers racing for the
+  // same page or chunk just move on to the next one. Each writer resumes the
+  // scan from the page of its previous chunk, so that writers on different
+  // threads spread over different pages instead of all contending on the
+  // first free one.
+  uint32_t first_page = 0;
+  if (!page_hint)
+    page_hint = &first_page;
+  const SharedMemoryABI::PageLayout layout =
+      GetPageLayoutForSizeHint(size_hint);
 
-        for (uint32_t chunk_idx = 0; free_chunks;
-             chunk_idx++, free_chunks >>= 1) {
-          if (!(free_chunks & 1))
-            continue;
-          // We found a free chunk.
-          Chunk chunk = shmem_abi_.TryAcquireChunkForWriting(
-              page_idx_, chunk_idx, &header);
-          if (!chunk.is_valid())
-            continue;
-          if (stall_count > kLogAfterNStalls) {
-            PERFETTO_LOG("Recovered from stall after %d iterations",
-                         stall_count);
-          }
-          return chunk;
-        }
+  for (;;) {
+    // Prefer chunks of the requested size. Only fall back on chunks of pages
+    // partitioned for other writers when there is none, rather than stalling.
+    Chunk chunk = TryGetNewChunk(header, layout, false, page_hint);
+    if (!chunk.is_valid())
+      chunk = TryGetNewChunk(header, layout, true, page_hint);
+    if (chunk.is_valid()) {
+      if (stall_count > kLogAfterNStalls) {
+        PERFETTO_LOG("Recovered from stall after %d iterations", stall_count);
       }
-    }  // std::lock_guard<std::mutex>
+      return chunk;
+    }
 
     // All chunks are taken (either kBeingWritten by us or kBeingRead by the
-    // Service). TODO: at this point we should return a bankrupcy chunk, not
-    // crash the process.
+    // Service). Writers that prefer losing data over blocking handle this
+    // themselves.
+    if (policy == BufferExhaustedPolicy::kDrop)
+      return chunk;
+
     if (stall_count++ == kLogAfterNStalls) {
       PERFETTO_ELOG("Shared memory buffer overrun! Stalling");
 
@@ -134,26 +120,86 @@ Chunk SharedMemoryArbiterImpl::GetNewChunk(
   }
 }
 
+SharedMemoryABI::PageLayout SharedMemoryArbiterImpl::GetPageLayoutForSizeHint(
+    size_t size_hint) const {
+  if (size_hint == 0)
+    return default_page_layout;
+  for (uint32_t layout = SharedMemoryABI::kPageDiv14;
+       layout > SharedMemoryABI::kPageDiv1; layout--) {
+    const size_t chunk_size = shmem_abi_.GetChunkSizeForLayout(
+        layout << SharedMemoryABI::kLayoutShift);
+    if (chunk_size - sizeof(SharedMemoryABI::ChunkHeader) >= size_hint)
+      return static_cast<SharedMemoryABI::PageLayout>(layout);
+  }
+  return SharedMemoryABI::kPageDiv1;
+}
+
+Chunk SharedMemoryArbiterImpl::TryGetNewChunk(
+    const SharedMemoryABI::ChunkHeader& header,
+    SharedMemoryABI::PageLayout layout,
+    bool any_layout,
+    uint32_t* page_hint) {
+  const size_t num_pages = shmem_abi_.num_pages();
+  const size_t initial_page_idx = *page_hint;
+  for (size_t i = 0; i < num_pages; i++) {
+    const size_t page_idx = (initial_page_idx + i) % num_pages;
+    bool is_new_page = false;
+
+    if (shmem_abi_.is_page_free(page_idx))
+      is_new_page = shmem_abi_.TryPartitionPage(page_idx, layout);
+
+    uint32_t free_chunks;
+    if (is_new_page) {
+      free_chunks = (1 << SharedMemoryABI::kNumChunksForLayout[layout]) - 1;
+    } else {
+      const uint32_t page_layout = shmem_abi_.GetPageLayout(page_idx);
+      const uint32_t partitioned_layout =
+          (page_layout & SharedMemoryABI::kLayoutMask) >>
+          SharedMemoryABI::kLayoutShift;
+      if (!any_layout && partitioned_layout != layout)
+        continue;
+      free_chunks = shmem_abi_.GetFreeChunks(page_idx);
+    }
+
+    for (uint32_t chunk_idx = 0; free_chunks; chunk_idx++, free_chunks >>= 1) {
+      if (!(free_chunks & 1))
+        continue;
+      // We found a free chunk.
+      Chunk chunk =
+          shmem_abi_.TryAcquireChunkForWriting(page_idx, chunk_idx, &header);
+      if (!chunk.is_valid())
+        continue;
+      if (*page_hint != page_idx)
+        *page_hint = static_cast<uint32_t>(page_idx);
+      return chunk;
+    }
+  }
+  return Chunk();
+}
+
 void SharedMemoryArbiterImpl::ReturnCompletedChunk(Chunk chunk,
                                                    BufferID target_buffer,
-                                                   PatchList* patch_list) {
+                                                   PatchList* patch_list,
+                                                   uint32_t dropped_packets) {
   PERFETTO_DCHECK(chunk.is_valid());
   const WriterID writer_id = chunk.writer_id();
   UpdateCommitDataRequest(std::move(chunk), writer_id, target_buffer,
-                          patch_list);
+                          patch_list, dropped_packets);
 }
 
 void SharedMemoryArbiterImpl::SendPatches(WriterID writer_id,
                                           BufferID target_buffer,
                                           PatchList* patch_list) {
   PERFETTO_DCHECK(!patch_list->empty() && patch_list->front().is_patched());
-  UpdateCommitDataRequest(Chunk(), writer_id, target_buffer, patch_list);
+  UpdateCommitDataRequest(Chunk(), writer_id, target_buffer, patch_list, 0);
 }
 
-void SharedMemoryArbiterImpl::UpdateCommitDataRequest(Chunk chunk,
-                                                      WriterID writer_id,
-                                                      BufferID target_buffer,
-                                                      PatchList* patch_list) {
+void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
+    Chunk chunk,
+    WriterID writer_id,
+    BufferID target_buffer,
+    PatchList* patch_list,
+    uint32_t dropped_packets) {
   // Note: chunk will be invalid if the call came from SendPatches().
   bool should_post_callback = false;
   bool should_commit_synchronously = false;
@@ -181,6 +227,8 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(Chunk chunk,
       ctm->set_page(static_cast<uint32_t>(page_idx));
       ctm->set_chunk(chunk_idx);
       ctm->set_target_buffer(target_buffer);
+      if (dropped_packets)
+        ctm->set_dropped_packets(dropped_packets);
 
       // If more than half of the SMB.size() is filled with completed chunks for
       // which we haven't notified the service yet (i.e. they are still enqueued
@@ -282,7 +330,8 @@ void SharedMemoryArbiterImpl::FlushPendingCommitDataRequests(
 }
 
 std::unique_ptr<TraceWriter> SharedMemoryArbiterImpl::CreateTraceWriter(
-    BufferID target_buffer) {
+    BufferID target_buffer,
+    BufferExhaustedPolicy buffer_exhausted_policy) {
   WriterID id;
   {
     std::lock_guard<std::mutex> scoped_lock(lock_);
@@ -296,7 +345,7 @@ std::unique_ptr<TraceWriter> SharedMemoryArbiterImpl::CreateTraceWriter(
       weak_this->producer_endpoint_->RegisterTraceWriter(id, target_buffer);
   });
   return std::unique_ptr<TraceWriter>(
-      new TraceWriterImpl(this, id, target_buffer));
+      new TraceWriterImpl(this, id, target_buffer, buffer_exhausted_policy));
 }
 
 void SharedMemoryArbiterImpl::BindStartupTraceWriterRegistry(
@@ -45,9 +45,9 @@ class TaskRunner;
 // This class handles the shared memory buffer on the producer side. It is used
 // to obtain thread-local chunks and to partition pages from several threads.
 // There is one arbiter instance per Producer.
-// This class is thread-safe and uses locks to do so. Data sources are supposed
-// to interact with this sporadically, only when they run out of space on their
-// current thread-local chunk.
+// This class is thread-safe. GetNewChunk() is lock-free, the other methods use
+// a lock. Data sources are supposed to interact with this sporadically, only
+// when they run out of space on their current thread-local chunk.
 class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
  public:
   // Args:
@@ -65,12 +65,29 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
                           TracingService::ProducerEndpoint*,
                           base::TaskRunner*);
 
-  // Returns a new Chunk to write tracing data. The call always returns a valid
-  // Chunk. TODO(primiano): right now this blocks if there are no free chunks
-  // in the SMB. In the long term the caller should be allowed to pick a policy
-  // and handle the retry itself asynchronously.
-  SharedMemoryABI::Chunk GetNewChunk(const SharedMemoryABI::ChunkHeader&,
-                                     size_t size_hint = 0);
+  // Returns a new Chunk to write tracing data. If there are no free chunks in
+  // the SMB, the call blocks until one is freed if |policy| is kStall, and
+  // returns an invalid Chunk straight away if |policy| is kDrop. In the latter
+  // case the caller is expected to retry later.
+  // |size_hint| is the number of payload bytes the caller expects to write
+  // into the chunk before returning it, 0 if it has no idea. Free pages are
+  // partitioned with the layout returned by GetPageLayoutForSizeHint(). The
+  // returned chunk can still be smaller or larger than the hint if the SMB has
+  // no free chunk of the preferred size.
+  // |page_hint|, if not null, is the page where the scan for a free chunk
+  // starts, and is updated to the page of the returned chunk. Writers keep it
+  // across calls so that writers on different threads spread over different
+  // pages. Without it, the scan starts from the first page.
+  SharedMemoryABI::Chunk GetNewChunk(
+      const SharedMemoryABI::ChunkHeader&,
+      size_t size_hint = 0,
+      BufferExhaustedPolicy policy = BufferExhaustedPolicy::kDefault,
+      uint32_t* page_hint = nullptr);
+
+  // Returns the layout with the smallest chunks whose payload fits
+  // |size_hint| bytes, kPageDiv1 if none does, or the default layout if
+  // |size_hint| is 0.
+  SharedMemoryABI::PageLayout GetPageLayoutForSizeHint(size_t size_hint) const;
 
   // Puts back a Chunk that has been completed and sends a request to the
   // service to move it to the central tracing buffer. |target_buffer| is the
@@ -80,9 +97,13 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // PatchList is a pointer to the list of patches for previous chunks. The
   // first patched entries will be removed from the patched list and sent over
   // to the service in the same CommitData() IPC request.
+  // |dropped_packets| is the number of packets the writer dropped before this
+  // chunk because the SMB was full (see BufferExhaustedPolicy::kDrop). It is
+  // sent to the service along with the chunk.
   void ReturnCompletedChunk(SharedMemoryABI::Chunk,
                             BufferID target_buffer,
-                            PatchList*);
+                            PatchList*,
+                            uint32_t dropped_packets = 0);
 
   // Send a request to the service to apply completed patches from |patch_list|.
   // |writer_id| is the ID of the TraceWriter that calls this method,
@@ -104,7 +125,9 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // SharedMemoryArbiter implementation.
   // See include/perfetto/tracing/core/shared_memory_arbiter.h for comments.
   std::unique_ptr<TraceWriter> CreateTraceWriter(
-      BufferID target_buffer) override;
+      BufferID target_buffer,
+      BufferExhaustedPolicy buffer_exhausted_policy =
+          BufferExhaustedPolicy::kDefault) override;
   void BindStartupTraceWriterRegistry(
       std::unique_ptr<StartupTraceWriterRegistry>,
       BufferID target_buffer) override;
@@ -120,10 +143,20 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   SharedMemoryArbiterImpl(const SharedMemoryArbiterImpl&) = delete;
   SharedMemoryArbiterImpl& operator=(const SharedMemoryArbiterImpl&) = delete;
 
+  // Scans the SMB once, starting from |*page_hint|, for a free chunk. Free
+  // pages are partitioned with |layout|. Chunks of pages partitioned with
+  // other layouts are only taken if |any_layout| is true. On success, updates
+  // |*page_hint| to the page of the returned chunk.
+  SharedMemoryABI::Chunk TryGetNewChunk(const SharedMemoryABI::ChunkHeader&,
+                                        SharedMemoryABI::PageLayout layout,
+                                        bool any_layout,
+                                        uint32_t* page_hint);
+
   void UpdateCommitDataRequest(SharedMemoryABI::Chunk chunk,
                                WriterID writer_id,
                                BufferID target_buffer,
-                               PatchList* patch_list);
+                               PatchList* patch_list,
+                               uint32_t dropped_packets);
 
   // Called by the TraceWriter destructor.
   void ReleaseWriterID(WriterID);
@@ -131,10 +164,12 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   base::TaskRunner* const task_runner_;
   TracingService::ProducerEndpoint* const producer_endpoint_;
 
+  // Only accessed through the atomic operations of SharedMemoryABI, doesn't
+  // need |lock_|.
+  SharedMemoryABI shmem_abi_;
+
   // --- Begin lock-protected members ---
   std::mutex lock_;
-  SharedMemoryABI shmem_abi_;
-  size_t page_idx_ = 0;
   std::unique_ptr<CommitDataRequest> commit_data_req_;
   size_t bytes_pending_commit_ = 0;  // SUM(chunk.size() : commit_data_req_).
   IdAllocator<WriterID> active_writer_ids_;
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+
+#include "benchmark/benchmark.h"
+#include "perfetto/base/paged_memory.h"
+#include "perfetto/base/task_runner.h"
+#include "perfetto/tracing/core/basic_types.h"
+#include "perfetto/tracing/core/commit_data_request.h"
+#include "perfetto/tracing/core/shared_memory_abi.h"
+#include "src/tracing/core/shared_memory_arbiter_impl.h"
+
+namespace perfetto {
+namespace {
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kNumPages = 256;
+
+// The arbiter only uses the task runner when the SMB is full, which doesn't
+// happen here as every chunk is freed right after being acquired.
+class NoopTaskRunner : public base::TaskRunner {
+ public:
+  void PostTask(std::function<void()>) override {}
+  void PostDelayedTask(std::function<void()>, uint32_t) override {}
+  void AddFileDescriptorWatch(int, std::function<void()>) override {}
+  void RemoveFileDescriptorWatch(int) override {}
+  bool RunsTasksOnCurrentThread() const override { return false; }
+};
+
+struct BenchmarkSmb {
+  BenchmarkSmb()
+      : mem(base::PagedMemory::Allocate(kPageSize * kNumPages)),
+        arbiter(mem.Get(),
+                kPageSize * kNumPages,
+                kPageSize,
+                nullptr,
+                &task_runner) {
+    SharedMemoryArbiterImpl::set_default_layout_for_testing(
+        SharedMemoryABI::PageLayout::kPageDiv4);
+  }
+
+  base::PagedMemory mem;
+  NoopTaskRunner task_runner;
+  SharedMemoryArbiterImpl arbiter;
+};
+
+BenchmarkSmb* GetBenchmarkSmb() {
+  static BenchmarkSmb* smb = new BenchmarkSmb();
+  return smb;
+}
+
+}  // namespace
+
+// Each benchmark thread acts as a TraceWriter with its own writer ID, getting
+// a new chunk from an arbiter shared by all the threads. The chunk is then
+// completed and freed straight away, as if the service had read it, so the
+// SMB never fills up and the benchmark only measures chunk acquisition.
+static void BM_GetNewChunk(benchmark::State& state) {
+  static std::atomic<uint32_t> next_writer_id{0};
+  SharedMemoryArbiterImpl* arbiter = &GetBenchmarkSmb()->arbiter;
+  SharedMemoryABI* abi = arbiter->shmem_abi_for_testing();
+
+  SharedMemoryABI::ChunkHeader header = {};
+  header.writer_id.store(
+      static_cast<WriterID>(1 + next_writer_id++ % kMaxWriterID),
+      std::memory_order_relaxed);
+  ChunkID chunk_id = 0;
+  uint32_t page_hint = 0;
+  for (auto _ : state) {
+    header.chunk_id.store(chunk_id++, std::memory_order_relaxed);
+    SharedMemoryABI::Chunk chunk = arbiter->GetNewChunk(
+        header, 0, BufferExhaustedPolicy::kDefault, &page_hint);
+    uint8_t chunk_idx = chunk.chunk_idx();
+    size_t page_idx = abi->ReleaseChunkAsComplete(std::move(chunk));
+    chunk = abi->TryAcquireChunkForReading(page_idx, chunk_idx);
+    abi->ReleaseChunkAsFree(std::move(chunk));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_GetNewChunk)->ThreadRange(1, 64)->UseRealTime();
+
+}  // namespace perfetto
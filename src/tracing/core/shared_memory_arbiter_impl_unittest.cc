@@ -16,6 +16,13 @@
 
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "perfetto/base/utils.h"
@@ -42,7 +49,9 @@ class MockProducerEndpoint : public TracingService::ProducerEndpoint {
   void NotifyDataSourceStopped(DataSourceInstanceID) override {}
   SharedMemory* shared_memory() const override { return nullptr; }
   size_t shared_buffer_page_size_kb() const override { return 0; }
-  std::unique_ptr<TraceWriter> CreateTraceWriter(BufferID) override {
+  std::unique_ptr<TraceWriter> CreateTraceWriter(
+      BufferID,
+      BufferExhaustedPolicy) override {
     return nullptr;
   }
 
@@ -131,6 +140,61 @@ TEST_P(SharedMemoryArbiterImplTest, GetAndReturnChunks) {
   task_runner_->RunUntilCheckpoint("on_commit_2");
 }
 
+// Free pages are partitioned with the smallest chunks that fit the size hint.
+TEST_P(SharedMemoryArbiterImplTest, SizeHintSelectsPageLayout) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv4);
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  auto payload_size = [abi](SharedMemoryABI::PageLayout layout) {
+    return abi->GetChunkSizeForLayout(layout << SharedMemoryABI::kLayoutShift) -
+           sizeof(SharedMemoryABI::ChunkHeader);
+  };
+
+  EXPECT_EQ(SharedMemoryABI::kPageDiv4, arbiter_->GetPageLayoutForSizeHint(0));
+  EXPECT_EQ(SharedMemoryABI::kPageDiv14, arbiter_->GetPageLayoutForSizeHint(1));
+  EXPECT_EQ(SharedMemoryABI::kPageDiv14,
+            arbiter_->GetPageLayoutForSizeHint(
+                payload_size(SharedMemoryABI::kPageDiv14)));
+  EXPECT_EQ(SharedMemoryABI::kPageDiv7,
+            arbiter_->GetPageLayoutForSizeHint(
+                payload_size(SharedMemoryABI::kPageDiv14) + 1));
+  EXPECT_EQ(SharedMemoryABI::kPageDiv1,
+            arbiter_->GetPageLayoutForSizeHint(page_size()));
+
+  SharedMemoryABI::Chunk small_chunk = arbiter_->GetNewChunk({}, 1);
+  SharedMemoryABI::Chunk large_chunk = arbiter_->GetNewChunk({}, page_size());
+  SharedMemoryABI::Chunk default_chunk = arbiter_->GetNewChunk({}, 0);
+  EXPECT_EQ(payload_size(SharedMemoryABI::kPageDiv14),
+            small_chunk.payload_size());
+  EXPECT_EQ(payload_size(SharedMemoryABI::kPageDiv1),
+            large_chunk.payload_size());
+  EXPECT_EQ(payload_size(SharedMemoryABI::kPageDiv4),
+            default_chunk.payload_size());
+}
+
+// The scan for a free chunk starts from the page hint, which is moved to the
+// page of the returned chunk.
+TEST_P(SharedMemoryArbiterImplTest, PageHint) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv1);
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  uint32_t page_hint = 3;
+  SharedMemoryABI::Chunk chunk_1 = arbiter_->GetNewChunk(
+      {}, 0, BufferExhaustedPolicy::kDefault, &page_hint);
+  EXPECT_EQ(3u, abi->GetPageAndChunkIndex(chunk_1).first);
+  EXPECT_EQ(3u, page_hint);
+
+  // Page 3 is taken now.
+  SharedMemoryABI::Chunk chunk_2 = arbiter_->GetNewChunk(
+      {}, 0, BufferExhaustedPolicy::kDefault, &page_hint);
+  EXPECT_EQ(4u, abi->GetPageAndChunkIndex(chunk_2).first);
+  EXPECT_EQ(4u, page_hint);
+
+  // Without a hint, the scan starts from the first page.
+  SharedMemoryABI::Chunk chunk_3 = arbiter_->GetNewChunk({});
+  EXPECT_EQ(0u, abi->GetPageAndChunkIndex(chunk_3).first);
+}
+
 // Check that we can actually create up to kMaxWriterID TraceWriter(s).
 TEST_P(SharedMemoryArbiterImplTest, WriterIDsAllocation) {
   auto checkpoint = task_runner_->CreateCheckpoint("last_unregistered");
@@ -163,7 +227,44 @@ TEST_P(SharedMemoryArbiterImplTest, WriterIDsAllocation) {
   task_runner_->RunUntilCheckpoint("last_unregistered", 15000);
 }
 
-// TODO(primiano): add multi-threaded tests.
+// Checks that writers on different threads never get the same chunk. Each
+// thread fills its chunks with its own writer ID and checks that the content
+// is intact before releasing them.
+TEST_P(SharedMemoryArbiterImplTest, GetNewChunkFromMultipleThreads) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv4);
+  static constexpr WriterID kNumThreads = 8;
+  static constexpr int kChunksPerThread = 2000;
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  std::atomic<int> num_corrupted_chunks{0};
+  std::vector<std::thread> threads;
+  for (WriterID writer_id = 1; writer_id <= kNumThreads; writer_id++) {
+    threads.emplace_back([this, abi, writer_id, &num_corrupted_chunks] {
+      SharedMemoryABI::ChunkHeader header = {};
+      header.writer_id.store(writer_id);
+      const uint8_t fill = static_cast<uint8_t>(writer_id);
+      uint32_t page_hint = 0;
+      for (int i = 0; i < kChunksPerThread; i++) {
+        SharedMemoryABI::Chunk chunk = arbiter_->GetNewChunk(
+            header, 0, BufferExhaustedPolicy::kDefault, &page_hint);
+        memset(chunk.payload_begin(), fill, chunk.payload_size());
+        std::this_thread::yield();
+        const uint8_t* payload = chunk.payload_begin();
+        if (std::any_of(payload, payload + chunk.payload_size(),
+                        [fill](uint8_t c) { return c != fill; })) {
+          num_corrupted_chunks++;
+        }
+        uint8_t chunk_idx = chunk.chunk_idx();
+        size_t page_idx = abi->ReleaseChunkAsComplete(std::move(chunk));
+        chunk = abi->TryAcquireChunkForReading(page_idx, chunk_idx);
+        abi->ReleaseChunkAsFree(std::move(chunk));
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(0, num_corrupted_chunks);
+}
 
 }  // namespace
 }  // namespace perfetto
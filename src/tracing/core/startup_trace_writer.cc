@@ -35,7 +35,8 @@ namespace {
 SharedMemoryABI::Chunk NewChunk(SharedMemoryArbiterImpl* arbiter,
                                 WriterID writer_id,
                                 ChunkID chunk_id,
-                                bool fragmenting_packet) {
+                                bool fragmenting_packet,
+                                uint32_t* page_hint) {
   ChunkHeader::Packets packets = {};
   if (fragmenting_packet) {
     packets.count = 1;
@@ -50,7 +51,8 @@ SharedMemoryABI::Chunk NewChunk(SharedMemoryArbiterImpl* arbiter,
   header.chunk_id.store(chunk_id, std::memory_order_relaxed);
   header.packets.store(packets, std::memory_order_relaxed);
 
-  return arbiter->GetNewChunk(header);
+  return arbiter->GetNewChunk(header, 0 /* size_hint */,
+                              BufferExhaustedPolicy::kDefault, page_hint);
 }
 
 class LocalBufferReader {
@@ -303,8 +305,9 @@ ChunkID StartupTraceWriter::CommitLocalBufferChunks(
                                   static_cast<size_t>(0u)));
 
   ChunkID next_chunk_id = 0;
+  uint32_t page_hint = 0;
   SharedMemoryABI::Chunk cur_chunk =
-      NewChunk(arbiter, writer_id, next_chunk_id++, false);
+      NewChunk(arbiter, writer_id, next_chunk_id++, false, &page_hint);
 
   size_t max_payload_size = cur_chunk.payload_size();
   size_t cur_payload_size = 0;
@@ -359,8 +362,8 @@ ChunkID StartupTraceWriter::CommitLocalBufferChunks(
 
         // Avoid creating a new chunk after the last write.
         if (!last_write) {
-          cur_chunk =
-              NewChunk(arbiter, writer_id, next_chunk_id++, is_fragmenting);
+          cur_chunk = NewChunk(arbiter, writer_id, next_chunk_id++,
+                               is_fragmenting, &page_hint);
           max_payload_size = cur_chunk.payload_size();
           cur_payload_size = 0;
           cur_num_packets = is_fragmenting ? 1 : 0;
@@ -16,6 +16,7 @@
 
 #include "src/tracing/core/trace_buffer.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "perfetto/base/logging.h"
@@ -94,9 +95,9 @@ bool TraceBuffer::Initialize(size_t size) {
   stats_.set_buffer_size(size);
   max_chunk_size_ = std::min(size, ChunkRecord::kMaxSize);
   wptr_ = begin();
-  index_.clear();
-  last_chunk_id_written_.clear();
-  read_iter_ = GetReadIterForSequence(index_.end());
+  sequences_.clear();
+  sorted_sequences_.clear();
+  read_iter_ = SequenceIterator();
   return true;
 }
 
@@ -151,9 +152,10 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // before receiving commit requests for them from the producer. Note that the
   // service may scrape and thus override chunks in arbitrary order since the
   // chunks aren't ordered in the SMB.
-  const auto it = index_.find(key);
-  if (PERFETTO_UNLIKELY(it != index_.end())) {
-    ChunkMeta* record_meta = &it->second;
+  ChunkSequence* seq = FindSequence(producer_id_trusted, writer_id);
+  const size_t chunk_idx = seq ? seq->Find(chunk_id) : 0;
+  if (PERFETTO_UNLIKELY(seq && chunk_idx != seq->size())) {
+    ChunkMeta* record_meta = &(*seq)[chunk_idx];
     ChunkRecord* prev = record_meta->chunk_record;
 
     // Verify that the old chunk's metadata corresponds to the new one.
@@ -174,13 +176,11 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
     // chunk N after having read from chunk N+1, thereby violating sequential
     // read of packets. This shouldn't happen if the producer is well-behaved,
     // because it shouldn't start chunk N+1 before completing chunk N.
-    ChunkMeta::Key subsequent_key = key;
     static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                   "ChunkID wraps");
-    subsequent_key.chunk_id++;
-    const auto subsequent_it = index_.find(subsequent_key);
-    if (subsequent_it != index_.end() &&
-        subsequent_it->second.num_fragments_read > 0) {
+    const size_t subsequent_idx = seq->Find(chunk_id + 1);
+    if (subsequent_idx != seq->size() &&
+        (*seq)[subsequent_idx].num_fragments_read > 0) {
       stats_.set_abi_violations(stats_.abi_violations() + 1);
       PERFETTO_DCHECK(suppress_sanity_dchecks_for_testing_);
       return;
@@ -268,10 +268,11 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // Now first insert the new chunk. At the end, if necessary, add the padding.
   stats_.set_chunks_written(stats_.chunks_written() + 1);
   stats_.set_bytes_written(stats_.bytes_written() + record_size);
-  auto it_and_inserted = index_.emplace(
-      key, ChunkMeta(GetChunkRecordAt(wptr_), num_fragments, chunk_complete,
-                     chunk_flags, producer_uid_trusted));
-  PERFETTO_DCHECK(it_and_inserted.second);
+  // DeleteNextChunksFor() might have overwritten older chunks of the same
+  // sequence, but never this one, as it wasn't in the buffer.
+  seq = GetOrCreateSequence(producer_id_trusted, writer_id);
+  seq->Insert(ChunkMeta(GetChunkRecordAt(wptr_), chunk_id, num_fragments,
+                        chunk_complete, chunk_flags, producer_uid_trusted));
   TRACE_BUFFER_DLOG("  copying @ [%lu - %lu] %zu", wptr_ - begin(),
                     uintptr_t(wptr_ - begin()) + record_size, record_size);
   WriteChunkRecord(wptr_, record, src, size);
@@ -296,8 +297,7 @@ void TraceBuffer::CopyChunkUntrusted(ProducerID producer_id_trusted,
   // last_chunk_id shouldn't be updated even though it's larger (e.g. |chunk_id|
   // = kMaxChunkId and |last_chunk_id| = 1; chunk_id - last_chunk_id =
   // kMaxChunkId - 1).
-  auto producer_and_writer_id = std::make_pair(producer_id_trusted, writer_id);
-  ChunkID& last_chunk_id = last_chunk_id_written_[producer_and_writer_id];
+  ChunkID& last_chunk_id = seq->last_chunk_id_written;
   static_assert(std::numeric_limits<ChunkID>::max() == kMaxChunkID,
                 "This code assumes that ChunkID wraps at kMaxChunkID");
   if (chunk_id - last_chunk_id < kMaxChunkID / 2) {
@@ -322,7 +322,7 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   TRACE_BUFFER_DLOG("Delete [%zu %zu]", wptr_ - begin(), search_end - begin());
   DcheckIsAlignedAndWithinBounds(wptr_);
   PERFETTO_DCHECK(search_end <= end());
-  std::vector<ChunkMap::iterator> index_delete;
+  std::vector<std::pair<ChunkSequence*, ChunkID>> index_delete;
   uint64_t chunks_overwritten = stats_.chunks_overwritten();
   uint64_t bytes_overwritten = stats_.bytes_overwritten();
   uint64_t padding_bytes_cleared = stats_.padding_bytes_cleared();
@@ -348,17 +348,18 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     // records are not part of the index).
     if (PERFETTO_LIKELY(!next_chunk.is_padding)) {
       ChunkMeta::Key key(next_chunk);
-      auto it = index_.find(key);
+      ChunkSequence* seq = FindSequence(key.producer_id, key.writer_id);
+      const size_t chunk_idx = seq ? seq->Find(key.chunk_id) : 0;
       bool will_remove = false;
-      if (PERFETTO_LIKELY(it != index_.end())) {
-        const ChunkMeta& meta = it->second;
+      if (PERFETTO_LIKELY(seq && chunk_idx != seq->size())) {
+        const ChunkMeta& meta = (*seq)[chunk_idx];
         if (PERFETTO_UNLIKELY(meta.num_fragments_read < meta.num_fragments)) {
           if (overwrite_policy_ == kDiscard)
             return -1;
           chunks_overwritten++;
           bytes_overwritten += next_chunk.size;
         }
-        index_delete.push_back(it);
+        index_delete.emplace_back(seq, key.chunk_id);
         will_remove = true;
       }
       TRACE_BUFFER_DLOG("  del index {%" PRIu32 ",%" PRIu32
@@ -380,9 +381,11 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
     PERFETTO_CHECK(next_chunk_ptr <= end());
   }
 
-  // Remove from the index.
-  for (auto it : index_delete) {
-    index_.erase(it);
+  // Remove from the index. The chunks are deleted in buffer order, which for
+  // each sequence is usually the ChunkID order, making Erase() a pop-front.
+  for (const auto& seq_and_chunk_id : index_delete) {
+    ChunkSequence* seq = seq_and_chunk_id.first;
+    seq->Erase(seq->Find(seq_and_chunk_id.second));
   }
   stats_.set_chunks_overwritten(chunks_overwritten);
   stats_.set_bytes_overwritten(bytes_overwritten);
@@ -410,12 +413,13 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
                                         size_t patches_size,
                                         bool other_patches_pending) {
   ChunkMeta::Key key(producer_id, writer_id, chunk_id);
-  auto it = index_.find(key);
-  if (it == index_.end()) {
+  ChunkSequence* seq = FindSequence(producer_id, writer_id);
+  const size_t chunk_idx = seq ? seq->Find(chunk_id) : 0;
+  if (!seq || chunk_idx == seq->size()) {
     stats_.set_patches_failed(stats_.patches_failed() + 1);
     return false;
   }
-  ChunkMeta& chunk_meta = it->second;
+  ChunkMeta& chunk_meta = (*seq)[chunk_idx];
 
   // Check that the index is consistent with the actual ProducerID/WriterID
   // stored in the ChunkRecord.
@@ -467,78 +471,169 @@ bool TraceBuffer::TryPatchChunkContents(ProducerID producer_id,
 }
 
 void TraceBuffer::BeginRead() {
-  read_iter_ = GetReadIterForSequence(index_.begin());
+  read_iter_ = GetReadIterForSequence(0);
 #if PERFETTO_DCHECK_IS_ON()
   changed_since_last_read_ = false;
 #endif
 }
 
 TraceBuffer::SequenceIterator TraceBuffer::GetReadIterForSequence(
-    ChunkMap::iterator seq_begin) {
+    size_t seq_idx) {
   SequenceIterator iter;
-  iter.seq_begin = seq_begin;
-  if (seq_begin == index_.end()) {
-    iter.cur = iter.seq_end = index_.end();
-    return iter;
-  }
 
-#if PERFETTO_DCHECK_IS_ON()
-  // Either |seq_begin| is == index_.begin() or the item immediately before must
-  // belong to a different {ProducerID, WriterID} sequence.
-  if (seq_begin != index_.begin() && seq_begin != index_.end()) {
-    auto prev_it = seq_begin;
-    prev_it--;
-    PERFETTO_DCHECK(
-        seq_begin == index_.begin() ||
-        std::tie(prev_it->first.producer_id, prev_it->first.writer_id) <
-            std::tie(seq_begin->first.producer_id, seq_begin->first.writer_id));
+  // Skip the sequences whose chunks have all been overwritten.
+  while (seq_idx < sorted_sequences_.size() &&
+         sorted_sequences_[seq_idx]->empty()) {
+    seq_idx++;
   }
-#endif
+  if (seq_idx == sorted_sequences_.size())
+    return iter;
 
-  // Find the first entry that has a greater {ProducerID, WriterID} (or just
-  // index_.end() if we reached the end).
-  ChunkMeta::Key key = seq_begin->first;  // Deliberate copy.
-  key.chunk_id = kMaxChunkID;
-  iter.seq_end = index_.upper_bound(key);
-  PERFETTO_DCHECK(iter.seq_begin != iter.seq_end);
-
-  // Now find the first entry between [seq_begin, seq_end) that is
-  // > last_chunk_id_written_. This is where we the sequence will start (see
-  // notes about wrapping of IDs in the header).
-  auto producer_and_writer_id = std::make_pair(key.producer_id, key.writer_id);
-  PERFETTO_DCHECK(last_chunk_id_written_.count(producer_and_writer_id));
-  iter.wrapping_id = last_chunk_id_written_[producer_and_writer_id];
-  key.chunk_id = iter.wrapping_id;
-  iter.cur = index_.upper_bound(key);
-  if (iter.cur == iter.seq_end)
-    iter.cur = iter.seq_begin;
+  iter.seq = sorted_sequences_[seq_idx];
+  iter.seq_idx = seq_idx;
+
+  // Now find the first chunk that is > |last_chunk_id_written|. This is where
+  // we the sequence will start (see notes about wrapping of IDs in the header).
+  iter.wrapping_id = iter.seq->last_chunk_id_written;
+  iter.cur = iter.seq->UpperBound(iter.wrapping_id);
+  if (iter.cur == iter.seq->size())
+    iter.cur = 0;
   return iter;
 }
 
+TraceBuffer::ChunkSequence* TraceBuffer::FindSequence(ProducerID producer_id,
+                                                      WriterID writer_id) {
+  auto it = sequences_.find(SequenceKey(producer_id, writer_id));
+  return it == sequences_.end() ? nullptr : &it->second;
+}
+
+TraceBuffer::ChunkSequence* TraceBuffer::GetOrCreateSequence(
+    ProducerID producer_id,
+    WriterID writer_id) {
+  auto it_and_inserted = sequences_.emplace(
+      std::piecewise_construct,
+      std::forward_as_tuple(SequenceKey(producer_id, writer_id)),
+      std::forward_as_tuple(producer_id, writer_id));
+  ChunkSequence* seq = &it_and_inserted.first->second;
+  if (PERFETTO_LIKELY(!it_and_inserted.second))
+    return seq;
+
+  // New sequences are rare, keep |sorted_sequences_| sorted on insertion.
+  auto pos = std::lower_bound(
+      sorted_sequences_.begin(), sorted_sequences_.end(), seq,
+      [](const ChunkSequence* a, const ChunkSequence* b) {
+        return std::tie(a->producer_id, a->writer_id) <
+               std::tie(b->producer_id, b->writer_id);
+      });
+  sorted_sequences_.insert(pos, seq);
+  return seq;
+}
+
 void TraceBuffer::SequenceIterator::MoveNext() {
   // Stop iterating when we reach the end of the sequence.
-  // Note: |seq_begin| might be == |seq_end|.
-  if (cur == seq_end || cur->first.chunk_id == wrapping_id) {
-    cur = seq_end;
+  if (!is_valid() || (*seq)[cur].chunk_id == wrapping_id) {
+    MoveToEnd();
     return;
   }
 
   // If the current chunk wasn't completed yet, we shouldn't advance past it as
   // it may be rewritten with additional packets.
-  if (!cur->second.is_complete) {
-    cur = seq_end;
+  if (!(*seq)[cur].is_complete) {
+    MoveToEnd();
     return;
   }
 
-  ChunkID last_chunk_id = cur->first.chunk_id;
-  if (++cur == seq_end)
-    cur = seq_begin;
+  ChunkID last_chunk_id = (*seq)[cur].chunk_id;
+  if (++cur == seq->size())
+    cur = 0;
 
   // There may be a missing chunk in the sequence of chunks, in which case the
   // next chunk's ID won't follow the last one's. If so, skip the rest of the
   // sequence. We'll return to it later once the hole is filled.
-  if (last_chunk_id + 1 != cur->first.chunk_id)
-    cur = seq_end;
+  if (last_chunk_id + 1 != (*seq)[cur].chunk_id)
+    MoveToEnd();
+}
+
+size_t TraceBuffer::ChunkSequence::Find(ChunkID chunk_id) const {
+  if (size_ == 0)
+    return size_;
+
+  // Fast path: the ChunkIDs in the sequence are usually contiguous, in which
+  // case the position of a chunk is its distance from the first one.
+  const ChunkID offset = chunk_id - (*this)[0].chunk_id;
+  if (offset < size_ && (*this)[offset].chunk_id == chunk_id)
+    return offset;
+
+  const size_t idx = LowerBound(chunk_id);
+  if (idx != size_ && (*this)[idx].chunk_id == chunk_id)
+    return idx;
+  return size_;
+}
+
+size_t TraceBuffer::ChunkSequence::LowerBound(ChunkID chunk_id) const {
+  size_t lo = 0;
+  size_t hi = size_;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if ((*this)[mid].chunk_id < chunk_id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+size_t TraceBuffer::ChunkSequence::UpperBound(ChunkID chunk_id) const {
+  if (size_ == 0 || (*this)[size_ - 1].chunk_id <= chunk_id)
+    return size_;
+  return LowerBound(chunk_id + 1);
+}
+
+void TraceBuffer::ChunkSequence::Insert(const ChunkMeta& meta) {
+  if (size_ == slots_.size()) {
+    // Grow the ring, unwrapping its contents at the beginning of the new one.
+    std::vector<ChunkMeta> slots(std::max<size_t>(slots_.size() * 2, 8));
+    for (size_t i = 0; i < size_; i++)
+      slots[i] = (*this)[i];
+    slots_.swap(slots);
+    head_ = 0;
+  }
+  const size_t mask = slots_.size() - 1;
+
+  // Common case: the chunk is newer than all the others in the sequence.
+  if (size_ == 0 || (*this)[size_ - 1].chunk_id < meta.chunk_id) {
+    slots_[(head_ + size_++) & mask] = meta;
+    return;
+  }
+
+  const size_t idx = LowerBound(meta.chunk_id);
+  PERFETTO_DCHECK((*this)[idx].chunk_id != meta.chunk_id);
+  if (idx == 0) {
+    head_ = (head_ + mask) & mask;
+    size_++;
+    slots_[head_] = meta;
+    return;
+  }
+
+  // Chunks committed out of order: shift the newer ones to make room.
+  for (size_t i = size_; i > idx; i--)
+    slots_[(head_ + i) & mask] = slots_[(head_ + i - 1) & mask];
+  slots_[(head_ + idx) & mask] = meta;
+  size_++;
+}
+
+void TraceBuffer::ChunkSequence::Erase(size_t idx) {
+  PERFETTO_DCHECK(idx < size_);
+  const size_t mask = slots_.size() - 1;
+  if (idx == 0) {
+    head_ = (head_ + 1) & mask;
+    size_--;
+    return;
+  }
+  for (size_t i = idx; i + 1 < size_; i++)
+    slots_[(head_ + i) & mask] = slots_[(head_ + i + 1) & mask];
+  size_--;
 }
 
 bool TraceBuffer::ReadNextTracePacket(
@@ -560,16 +655,16 @@ bool TraceBuffer::ReadNextTracePacket(
   for (;; read_iter_.MoveNext()) {
     if (PERFETTO_UNLIKELY(!read_iter_.is_valid())) {
       // We ran out of chunks in the current {ProducerID, WriterID} sequence or
-      // we just reached the index_.end().
+      // we just reached the last sequence.
 
-      if (PERFETTO_UNLIKELY(read_iter_.seq_end == index_.end()))
+      if (PERFETTO_UNLIKELY(!read_iter_.seq))
         return false;
 
       // We reached the end of sequence, move to the next one.
-      // Note: ++read_iter_.seq_end might become index_.end(), but
-      // GetReadIterForSequence() knows how to deal with that.
-      read_iter_ = GetReadIterForSequence(read_iter_.seq_end);
-      PERFETTO_DCHECK(read_iter_.is_valid() && read_iter_.cur != index_.end());
+      read_iter_ = GetReadIterForSequence(read_iter_.seq_idx + 1);
+      if (PERFETTO_UNLIKELY(!read_iter_.seq))
+        return false;
+      PERFETTO_DCHECK(read_iter_.is_valid());
     }
 
     ChunkMeta* chunk_meta = &*read_iter_;
@@ -673,8 +768,8 @@ bool TraceBuffer::ReadNextTracePacket(
 
         // TODO(primiano): optimization: this MoveToEnd() is the reason why
         // MoveNext() (that is called in the outer for(;;MoveNext)) needs to
-        // deal gracefully with the case of |cur|==|seq_end|. Maybe we can do
-        // something to avoid that check by reshuffling the code here?
+        // deal gracefully with the case of |cur| == |seq->size()|. Maybe we
+        // can do something to avoid that check by reshuffling the code here?
         read_iter_.MoveToEnd();
 
         // This break will go back to beginning of the for(;;MoveNext()). That
@@ -823,6 +918,10 @@ bool TraceBuffer::ReadNextPacketInChunk(ChunkMeta* chunk_meta,
                         chunk_meta->is_complete)) {
     stats_.set_chunks_read(stats_.chunks_read() + 1);
     stats_.set_bytes_read(stats_.bytes_read() + chunk_meta->chunk_record->size);
+    // Whatever follows the last fragment was left unused by the producer.
+    stats_.set_unused_chunk_bytes_read(
+        stats_.unused_chunk_bytes_read() +
+        static_cast<uint64_t>(record_end - next_packet));
   }
 
   if (PERFETTO_UNLIKELY(packet_size == 0)) {
@@ -22,8 +22,9 @@
 
 #include <array>
 #include <limits>
-#include <map>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/base/paged_memory.h"
@@ -108,8 +109,8 @@ class TracePacket;
 // quite useful in future to recover the buffer from crash reports).
 //
 // However, in order to keep some operations (patching and reading) fast, a
-// lookaside index is maintained (in |index_|), keeping each chunk in the buffer
-// indexed by their {ProducerID, WriterID, ChunkID} tuple.
+// lookaside index is maintained (in |sequences_|), keeping each chunk in the
+// buffer indexed by their {ProducerID, WriterID, ChunkID} tuple.
 //
 // Patching data out-of-band
 // -------------------------
@@ -244,6 +245,13 @@ class TraceBuffer {
   bool ReadNextTracePacket(TracePacket*,
                            PacketSequenceProperties* sequence_properties);
 
+  // Accounts |count| packets that a producer dropped, rather than writing
+  // them into this buffer, because its shared memory buffer was full.
+  void AddPacketsDroppedByProducer(uint32_t count) {
+    stats_.set_packets_dropped_by_producers(
+        stats_.packets_dropped_by_producers() + count);
+  }
+
   const TraceStats::BufferStats& stats() const { return stats_; }
   size_t size() const { return size_; }
 
@@ -318,7 +326,7 @@ class TraceBuffer {
   // This struct should not have any field that is essential for reconstructing
   // the contents of the buffer from a crash dump.
   struct ChunkMeta {
-    // Key used for sorting in the map.
+    // Identifies a chunk in the buffer.
     struct Key {
       Key(ProducerID p, WriterID w, ChunkID c)
           : producer_id{p}, writer_id{w}, chunk_id{c} {}
@@ -326,14 +334,6 @@ class TraceBuffer {
       explicit Key(const ChunkRecord& cr)
           : Key(cr.producer_id, cr.writer_id, cr.chunk_id) {}
 
-      // Note that this sorting doesn't keep into account the fact that ChunkID
-      // will wrap over at some point. The extra logic in SequenceIterator deals
-      // with that.
-      bool operator<(const Key& other) const {
-        return std::tie(producer_id, writer_id, chunk_id) <
-               std::tie(other.producer_id, other.writer_id, other.chunk_id);
-      }
-
       bool operator==(const Key& other) const {
         return std::tie(producer_id, writer_id, chunk_id) ==
                std::tie(other.producer_id, other.writer_id, other.chunk_id);
@@ -349,15 +349,28 @@ class TraceBuffer {
       ChunkID chunk_id;
     };
 
-    ChunkMeta(ChunkRecord* r, uint16_t p, bool c, uint8_t f, uid_t u)
+    ChunkMeta() = default;
+    ChunkMeta(ChunkRecord* r,
+              ChunkID i,
+              uint16_t p,
+              bool c,
+              uint8_t f,
+              uid_t u)
         : chunk_record{r},
           trusted_uid{u},
+          chunk_id{i},
           is_complete{c},
           flags{f},
           num_fragments{p} {}
 
-    ChunkRecord* const chunk_record;  // Addr of ChunkRecord within |data_|.
-    const uid_t trusted_uid;          // uid of the producer.
+    // These are not const only to allow moving ChunkMeta(s) within their
+    // ChunkSequence.
+    ChunkRecord* chunk_record = nullptr;  // Addr of ChunkRecord within |data_|.
+    uid_t trusted_uid = kInvalidUid;      // uid of the producer.
+
+    // Corresponds to |chunk_record->chunk_id|. The ProducerID and WriterID are
+    // the ones of the ChunkSequence that contains this ChunkMeta.
+    ChunkID chunk_id = 0;
 
     // If true, the chunk state was kChunkComplete at the time it was copied. If
     // false, the chunk was still kChunkBeingWritten while copied. |is_complete|
@@ -380,62 +393,130 @@ class TraceBuffer {
     uint16_t cur_fragment_offset = 0;
   };
 
-  using ChunkMap = std::map<ChunkMeta::Key, ChunkMeta>;
+  // The index entries of all the chunks in the buffer that belong to the same
+  // {ProducerID, WriterID} sequence, sorted by ChunkID. They are stored in a
+  // flat ring, rather than in a tree, so that the common operations are O(1)
+  // and cache friendly: appending the next chunk of the sequence, removing its
+  // oldest chunk when it's overwritten and looking up a chunk by ChunkID as
+  // long as the ChunkIDs in the buffer are contiguous. Lookups fall back on a
+  // binary search when they are not, and chunks committed out of order are
+  // inserted by shifting the newer ones.
+  // Note that the sorting doesn't keep into account the fact that ChunkID will
+  // wrap over at some point. The extra logic in SequenceIterator deals with
+  // that.
+  class ChunkSequence {
+   public:
+    ChunkSequence(ProducerID p, WriterID w) : producer_id{p}, writer_id{w} {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // |idx| is the position of the chunk in the ChunkID order, from 0 to
+    // size() - 1.
+    ChunkMeta& operator[](size_t idx) {
+      PERFETTO_DCHECK(idx < size_);
+      return slots_[(head_ + idx) & (slots_.size() - 1)];
+    }
+    const ChunkMeta& operator[](size_t idx) const {
+      PERFETTO_DCHECK(idx < size_);
+      return slots_[(head_ + idx) & (slots_.size() - 1)];
+    }
+
+    // Returns the position of the chunk with the given ID, or size() if the
+    // sequence doesn't contain it.
+    size_t Find(ChunkID) const;
+
+    // Returns the position of the first chunk with an ID > the given one, or
+    // size() if there is none.
+    size_t UpperBound(ChunkID) const;
+
+    // Inserts a chunk, which must not be in the sequence already, keeping the
+    // ChunkID order.
+    void Insert(const ChunkMeta&);
+
+    // Removes the chunk at the given position.
+    void Erase(size_t idx);
+
+    const ProducerID producer_id;
+    const WriterID writer_id;
 
-  // Allows to iterate over a sub-sequence of |index_| for all keys belonging to
-  // the same {ProducerID,WriterID}. Furthermore takes into account the wrapping
-  // of ChunkID. Instances are valid only as long as the |index_| is not altered
-  // (can be used safely only between adjacent ReadNextTracePacket() calls).
+    // Keeps track of the highest ChunkID written for this sequence, taking
+    // into account a potential overflow of ChunkIDs. In the case of overflow,
+    // stores the highest ChunkID written since the overflow.
+    ChunkID last_chunk_id_written = 0;
+
+   private:
+    ChunkSequence(const ChunkSequence&) = delete;
+    ChunkSequence& operator=(const ChunkSequence&) = delete;
+
+    // Returns the position of the first chunk with an ID >= the given one.
+    size_t LowerBound(ChunkID) const;
+
+    // The size of |slots_| is always 0 or a power of two, so that positions
+    // can be wrapped with a bitwise-AND.
+    std::vector<ChunkMeta> slots_;
+    size_t head_ = 0;  // Index in |slots_| of the chunk with the lowest ID.
+    size_t size_ = 0;  // Number of chunks in the sequence.
+  };
+
+  // Allows to iterate over the chunks of a ChunkSequence. Furthermore takes
+  // into account the wrapping of ChunkID. Instances are valid only as long as
+  // the index is not altered (can be used safely only between adjacent
+  // ReadNextTracePacket() calls).
   // The order of the iteration will proceed in the following order:
-  // |wrapping_id| + 1 -> |seq_end|, |seq_begin| -> |wrapping_id|.
+  // |wrapping_id| + 1 -> last chunk, first chunk -> |wrapping_id|.
   // Practical example:
   // - Assume that kMaxChunkID == 7
   // - Assume that we have all 8 chunks in the range (0..7).
-  // - Hence, |seq_begin| == c0, |seq_end| == c7
+  // - Hence, the first chunk is c0 and the last one is c7.
   // - Assume |wrapping_id| = 4 (c4 is the last chunk copied over
   //   through a CopyChunkUntrusted()).
   // The resulting iteration order will be: c5, c6, c7, c0, c1, c2, c3, c4.
   struct SequenceIterator {
-    // Points to the 1st key (the one with the numerically min ChunkID).
-    ChunkMap::iterator seq_begin;
+    // The sequence being iterated, nullptr if there are no (more) sequences.
+    ChunkSequence* seq = nullptr;
 
-    // Points one past the last key (the one with the numerically max ChunkID).
-    ChunkMap::iterator seq_end;
+    // Position of |seq| in |sorted_sequences_|. Used to move to the next
+    // sequence once this one has been iterated.
+    size_t seq_idx = 0;
 
-    // Current iterator, always >= seq_begin && <= seq_end.
-    ChunkMap::iterator cur;
+    // Position of the current chunk in |seq|, == seq->size() at the end.
+    size_t cur = 0;
 
     // The latest ChunkID written. Determines the start/end of the sequence.
-    ChunkID wrapping_id;
+    ChunkID wrapping_id = 0;
 
-    bool is_valid() const { return cur != seq_end; }
+    bool is_valid() const { return seq && cur != seq->size(); }
 
     ProducerID producer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.producer_id;
+      return seq->producer_id;
     }
 
     WriterID writer_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.writer_id;
+      return seq->writer_id;
     }
 
     ChunkID chunk_id() const {
       PERFETTO_DCHECK(is_valid());
-      return cur->first.chunk_id;
+      return (*seq)[cur].chunk_id;
     }
 
     ChunkMeta& operator*() {
       PERFETTO_DCHECK(is_valid());
-      return cur->second;
+      return (*seq)[cur];
     }
 
-    // Moves |cur| to the next chunk in the index.
+    // Moves |cur| to the next chunk in the sequence.
     // is_valid() will become false after calling this, if this was the last
     // entry of the sequence.
     void MoveNext();
 
-    void MoveToEnd() { cur = seq_end; }
+    void MoveToEnd() {
+      PERFETTO_DCHECK(seq);
+      cur = seq->size();
+    }
   };
 
   enum class ReadAheadResult {
@@ -450,14 +531,24 @@ class TraceBuffer {
 
   bool Initialize(size_t size);
 
-  // Returns an object that allows to iterate over chunks in the |index_| that
-  // have the same {ProducerID, WriterID} of
-  // |seq_begin.first.{producer,writer}_id|. |seq_begin| must be an iterator to
-  // the first entry in the |index_| that has a different {ProducerID, WriterID}
-  // from the previous one. It is valid for |seq_begin| to be == index_.end()
-  // (i.e. if the index is empty). The iteration takes care of ChunkID wrapping,
-  // by using |last_chunk_id_|.
-  SequenceIterator GetReadIterForSequence(ChunkMap::iterator seq_begin);
+  // Returns an object that allows to iterate over the chunks of the first
+  // non-empty sequence in |sorted_sequences_| at or after |seq_idx|. The
+  // iterator is not valid if there is none (e.g. if the index is empty). The
+  // iteration takes care of ChunkID wrapping, by using the sequence's
+  // |last_chunk_id_written|.
+  SequenceIterator GetReadIterForSequence(size_t seq_idx);
+
+  static uint32_t SequenceKey(ProducerID producer_id, WriterID writer_id) {
+    static_assert(sizeof(ProducerID) == 2 && sizeof(WriterID) == 2,
+                  "SequenceKey() assumes 16 bit IDs");
+    return (static_cast<uint32_t>(producer_id) << 16) | writer_id;
+  }
+
+  // Returns the sequence with the given IDs, or nullptr if there is none.
+  ChunkSequence* FindSequence(ProducerID, WriterID);
+
+  // Returns the sequence with the given IDs, creating it if necessary.
+  ChunkSequence* GetOrCreateSequence(ProducerID, WriterID);
 
   // Used as a last resort when a buffer corruption is detected.
   void ClearContentsAndResetRWCursors();
@@ -561,11 +652,21 @@ class TraceBuffer {
   uint8_t* wptr_ = nullptr;    // Write pointer.
 
   // An index that keeps track of the positions and metadata of each
-  // ChunkRecord.
-  ChunkMap index_;
+  // ChunkRecord, hashed by {ProducerID, WriterID} (see SequenceKey()).
+  // Sequences are never removed, even when they have no chunks left, as they
+  // keep track of the last ChunkID written.
+  //
+  // TODO(primiano): should clean up sequences. Right now they grow without
+  // bounds (although realistically is not a problem unless we have too many
+  // producers/writers within the same trace session).
+  std::unordered_map<uint32_t, ChunkSequence> sequences_;
+
+  // The sequences in |sequences_|, sorted by {ProducerID, WriterID}. Reads
+  // iterate over sequences in this order.
+  std::vector<ChunkSequence*> sorted_sequences_;
 
   // Read iterator used for ReadNext(). It is reset by calling BeginRead().
-  // It becomes invalid after any call to methods that alters the |index_|.
+  // It becomes invalid after any call to methods that alters the index.
   SequenceIterator read_iter_;
 
   // See comments at the top of the file.
@@ -575,15 +676,6 @@ class TraceBuffer {
   // a write fails because it would overwrite unread chunks.
   bool discard_writes_ = false;
 
-  // Keeps track of the highest ChunkID written for a given sequence, taking
-  // into account a potential overflow of ChunkIDs. In the case of overflow,
-  // stores the highest ChunkID written since the overflow.
-  //
-  // TODO(primiano): should clean up keys from this map. Right now it grows
-  // without bounds (although realistically is not a problem unless we have too
-  // many producers/writers within the same trace session).
-  std::map<std::pair<ProducerID, WriterID>, ChunkID> last_chunk_id_written_;
-
   // Statistics about buffer usage.
   TraceStats::BufferStats stats_;
 
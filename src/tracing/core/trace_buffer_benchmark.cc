@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "perfetto/tracing/core/basic_types.h"
+#include "perfetto/tracing/core/trace_packet.h"
+#include "src/tracing/core/trace_buffer.h"
+
+namespace perfetto {
+namespace {
+
+constexpr size_t kBufferSize = 32 * 1024 * 1024;
+
+// Each chunk is 512 bytes once copied into the buffer (including its 16 bytes
+// ChunkRecord) and contains 4 packets of 124 bytes (including their 1 byte
+// size header).
+constexpr uint16_t kPacketsPerChunk = 4;
+constexpr uint8_t kPacketPayloadSize = 123;
+
+std::vector<uint8_t> CreateChunkPayload() {
+  std::vector<uint8_t> payload;
+  for (uint16_t i = 0; i < kPacketsPerChunk; i++) {
+    payload.push_back(kPacketPayloadSize);
+    payload.insert(payload.end(), kPacketPayloadSize, 'x');
+  }
+  return payload;
+}
+
+void CopyChunks(TraceBuffer* buf,
+                const std::vector<uint8_t>& payload,
+                WriterID num_writers,
+                ChunkID chunk_id) {
+  for (WriterID writer_id = 1; writer_id <= num_writers; writer_id++) {
+    buf->CopyChunkUntrusted(/*producer_id_trusted=*/1,
+                            /*producer_uid_trusted=*/0, writer_id, chunk_id,
+                            kPacketsPerChunk, /*chunk_flags=*/0,
+                            /*chunk_complete=*/true, payload.data(),
+                            payload.size());
+  }
+}
+
+}  // namespace
+
+// Copies one chunk per writer on each iteration, without ever reading them
+// back. Once the buffer is full, each copy also overwrites the oldest chunks.
+static void BM_TraceBuffer_WriteChunks(benchmark::State& state) {
+  const WriterID num_writers = static_cast<WriterID>(state.range(0));
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  const std::vector<uint8_t> payload = CreateChunkPayload();
+  ChunkID chunk_id = 0;
+  for (auto _ : state)
+    CopyChunks(buf.get(), payload, num_writers, chunk_id++);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_writers);
+  state.SetBytesProcessed(static_cast<int64_t>(
+      state.iterations() * num_writers * payload.size()));
+}
+BENCHMARK(BM_TraceBuffer_WriteChunks)->Arg(1)->Arg(16)->Arg(256);
+
+// Copies 1024 chunks spread over the writers and then reads back all their
+// packets on each iteration, as the service does when periodically writing
+// into a file. Each read pass also walks past the chunks already read in the
+// previous passes, which stay in the buffer until they are overwritten.
+static void BM_TraceBuffer_WriteAndReadChunks(benchmark::State& state) {
+  const WriterID num_writers = static_cast<WriterID>(state.range(0));
+  const ChunkID chunks_per_writer = 1024 / num_writers;
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  const std::vector<uint8_t> payload = CreateChunkPayload();
+  ChunkID chunk_id = 0;
+  for (auto _ : state) {
+    for (ChunkID i = 0; i < chunks_per_writer; i++)
+      CopyChunks(buf.get(), payload, num_writers, chunk_id++);
+    buf->BeginRead();
+    TracePacket packet;
+    TraceBuffer::PacketSequenceProperties sequence_properties;
+    while (buf->ReadNextTracePacket(&packet, &sequence_properties))
+      packet = TracePacket();
+  }
+  const int64_t num_chunks =
+      static_cast<int64_t>(state.iterations() * chunks_per_writer) *
+      num_writers;
+  state.SetItemsProcessed(num_chunks);
+  state.SetBytesProcessed(num_chunks * static_cast<int64_t>(payload.size()));
+}
+BENCHMARK(BM_TraceBuffer_WriteAndReadChunks)->Arg(1)->Arg(16)->Arg(256);
+
+}  // namespace perfetto
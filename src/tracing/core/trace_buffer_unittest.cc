@@ -114,9 +114,14 @@ class TraceBufferTest : public testing::Test {
   }
 
   SequenceIterator GetReadIterForSequence(ProducerID p, WriterID w) {
-    TraceBuffer::ChunkMeta::Key key(p, w, 0);
-    return trace_buffer_->GetReadIterForSequence(
-        trace_buffer_->index_.lower_bound(key));
+    const auto& seqs = trace_buffer_->sorted_sequences_;
+    size_t seq_idx = 0;
+    while (seq_idx < seqs.size() &&
+           std::make_pair(seqs[seq_idx]->producer_id,
+                          seqs[seq_idx]->writer_id) < std::make_pair(p, w)) {
+      seq_idx++;
+    }
+    return trace_buffer_->GetReadIterForSequence(seq_idx);
   }
 
   void SuppressSanityDchecksForTesting() {
@@ -125,9 +130,10 @@ class TraceBufferTest : public testing::Test {
 
   std::vector<ChunkMetaKey> GetIndex() {
     std::vector<ChunkMetaKey> keys;
-    keys.reserve(trace_buffer_->index_.size());
-    for (const auto& it : trace_buffer_->index_)
-      keys.push_back(it.first);
+    for (const auto* seq : trace_buffer_->sorted_sequences_) {
+      for (size_t i = 0; i < seq->size(); i++)
+        keys.emplace_back(seq->producer_id, seq->writer_id, (*seq)[i].chunk_id);
+    }
     return keys;
   }
 
@@ -175,6 +181,26 @@ TEST_F(TraceBufferTest, ReadWrite_Simple) {
   }
 }
 
+// Chunks committed before being full are padded up to their size. The unused
+// bytes should be accounted once the chunk is read.
+TEST_F(TraceBufferTest, ReadWrite_UnusedChunkBytes) {
+  ResetBuffer(4096);
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(0))
+      .AddPacket(40, 'a')
+      .PadTo(112)
+      .CopyIntoTraceBuffer();
+  CreateChunk(ProducerID(1), WriterID(1), ChunkID(1))
+      .AddPacket(112 - 16, 'b')
+      .CopyIntoTraceBuffer();
+  trace_buffer()->BeginRead();
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(40, 'a')));
+  ASSERT_THAT(ReadPacket(), ElementsAre(FakePacketFragment(112 - 16, 'b')));
+  ASSERT_THAT(ReadPacket(), IsEmpty());
+  EXPECT_EQ(2u, trace_buffer()->stats().chunks_read());
+  EXPECT_EQ(224u, trace_buffer()->stats().bytes_read());
+  EXPECT_EQ(112u - 16 - 40, trace_buffer()->stats().unused_chunk_bytes_read());
+}
+
 TEST_F(TraceBufferTest, ReadWrite_OneChunkPerWriter) {
   for (int8_t num_writers = 1; num_writers <= 10; num_writers++) {
     ResetBuffer(4096);
@@ -1307,6 +1333,26 @@ TEST_F(TraceBufferTest, Iterator_ManyStreamsWrapping) {
   ASSERT_TRUE(IteratorSeqEq(ProducerID(3), WriterID(1), {Neg(-1), 0, 1}));
 }
 
+TEST_F(TraceBufferTest, Iterator_OneStreamOutOfOrder) {
+  ResetBuffer(64 * 1024);
+  AppendChunks({
+      {ProducerID(1), WriterID(1), ChunkID(3)},
+      {ProducerID(1), WriterID(1), ChunkID(0)},
+      {ProducerID(1), WriterID(1), ChunkID(1)},
+      {ProducerID(1), WriterID(1), ChunkID(11)},
+      {ProducerID(1), WriterID(1), ChunkID(6)},
+      {ProducerID(1), WriterID(1), ChunkID(2)},
+      {ProducerID(1), WriterID(1), ChunkID(4)},
+      {ProducerID(1), WriterID(1), ChunkID(10)},
+      {ProducerID(1), WriterID(1), ChunkID(5)},
+      {ProducerID(1), WriterID(1), ChunkID(9)},
+      {ProducerID(1), WriterID(1), ChunkID(7)},
+      {ProducerID(1), WriterID(1), ChunkID(8)},
+  });
+  ASSERT_TRUE(IteratorSeqEq(ProducerID(1), WriterID(1),
+                            {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}));
+}
+
 // -------------------
 // Re-writing same chunk id
 // -------------------
@@ -47,6 +47,11 @@ void TracePacket::AddSlice(const void* start, size_t size) {
   slices_.emplace_back(start, size);
 }
 
+void TracePacket::Clear() {
+  slices_.clear();
+  size_ = 0;
+}
+
 std::tuple<char*, size_t> TracePacket::GetProtoPreamble() {
   using protozero::proto_utils::MakeTagLengthDelimited;
   using protozero::proto_utils::WriteVarInt;
@@ -95,6 +95,25 @@ TEST(TracePacketTest, Sliced) {
   ASSERT_EQ(proto.for_testing().str(), decoded_packet.for_testing().str());
 }
 
+TEST(TracePacketTest, Clear) {
+  protos::TracePacket proto;
+  proto.mutable_for_testing()->set_str("string field");
+  std::string ser_buf = proto.SerializeAsString();
+  TracePacket tp;
+  tp.AddSlice(ser_buf.data(), 3);
+  tp.AddSlice(ser_buf.data() + 3, ser_buf.size() - 3);
+  tp.Clear();
+  ASSERT_EQ(0u, tp.size());
+  ASSERT_TRUE(tp.slices().empty());
+
+  tp.AddSlice(ser_buf.data(), ser_buf.size());
+  ASSERT_EQ(ser_buf.size(), tp.size());
+  ASSERT_EQ(1u, tp.slices().size());
+  protos::TracePacket decoded_packet;
+  ASSERT_TRUE(tp.Decode(&decoded_packet));
+  ASSERT_EQ(proto.for_testing().str(), decoded_packet.for_testing().str());
+}
+
 TEST(TracePacketTest, Corrupted) {
   protos::TracePacket proto;
   proto.mutable_for_testing()->set_str("string field");
@@ -210,6 +210,19 @@ void TraceStats::BufferStats::FromProto(
                 "size mismatch");
   chunks_read_ = static_cast<decltype(chunks_read_)>(proto.chunks_read());
 
+  static_assert(sizeof(unused_chunk_bytes_read_) ==
+                    sizeof(proto.unused_chunk_bytes_read()),
+                "size mismatch");
+  unused_chunk_bytes_read_ = static_cast<decltype(unused_chunk_bytes_read_)>(
+      proto.unused_chunk_bytes_read());
+
+  static_assert(sizeof(packets_dropped_by_producers_) ==
+                    sizeof(proto.packets_dropped_by_producers()),
+                "size mismatch");
+  packets_dropped_by_producers_ =
+      static_cast<decltype(packets_dropped_by_producers_)>(
+          proto.packets_dropped_by_producers());
+
   static_assert(sizeof(chunks_committed_out_of_order_) ==
                     sizeof(proto.chunks_committed_out_of_order()),
                 "size mismatch");
@@ -315,6 +328,20 @@ void TraceStats::BufferStats::ToProto(
   proto->set_chunks_read(
       static_cast<decltype(proto->chunks_read())>(chunks_read_));
 
+  static_assert(sizeof(unused_chunk_bytes_read_) ==
+                    sizeof(proto->unused_chunk_bytes_read()),
+                "size mismatch");
+  proto->set_unused_chunk_bytes_read(
+      static_cast<decltype(proto->unused_chunk_bytes_read())>(
+          unused_chunk_bytes_read_));
+
+  static_assert(sizeof(packets_dropped_by_producers_) ==
+                    sizeof(proto->packets_dropped_by_producers()),
+                "size mismatch");
+  proto->set_packets_dropped_by_producers(
+      static_cast<decltype(proto->packets_dropped_by_producers())>(
+          packets_dropped_by_producers_));
+
   static_assert(sizeof(chunks_committed_out_of_order_) ==
                     sizeof(proto->chunks_committed_out_of_order()),
                 "size mismatch");
@@ -36,14 +36,19 @@ namespace perfetto {
 
 namespace {
 constexpr size_t kPacketHeaderSize = SharedMemoryABI::kPacketHeaderSize;
+constexpr size_t kGarbageChunkSize = 4096;
 }  // namespace
 
+constexpr uint32_t TraceWriterImpl::kPacketsBetweenChunkRetries;
+
 TraceWriterImpl::TraceWriterImpl(SharedMemoryArbiterImpl* shmem_arbiter,
                                  WriterID id,
-                                 BufferID target_buffer)
+                                 BufferID target_buffer,
+                                 BufferExhaustedPolicy buffer_exhausted_policy)
     : shmem_arbiter_(shmem_arbiter),
       id_(id),
       target_buffer_(target_buffer),
+      buffer_exhausted_policy_(buffer_exhausted_policy),
       protobuf_stream_writer_(this) {
   // TODO(primiano): we could handle the case of running out of TraceWriterID(s)
   // more gracefully and always return a no-op TracePacket in NewTracePacket().
@@ -66,10 +71,19 @@ void TraceWriterImpl::Flush(std::function<void()> callback) {
   PERFETTO_CHECK(cur_packet_->is_finalized());
 
   if (cur_chunk_.is_valid()) {
+    // The chunk is returned before being full: size the next one after what
+    // was written into this one, with some headroom.
+    const size_t used_size = static_cast<size_t>(
+        protobuf_stream_writer_.write_ptr() - cur_chunk_.payload_begin());
+    if (used_size > 0)
+      chunk_size_hint_ = used_size + used_size / 2;
     shmem_arbiter_->ReturnCompletedChunk(std::move(cur_chunk_), target_buffer_,
-                                         &patch_list_);
+                                         &patch_list_, dropped_packets_);
+    dropped_packets_ = 0;
   } else {
-    PERFETTO_DCHECK(patch_list_.empty());
+    // The patches of a packet interrupted by the SMB running out of chunks
+    // can be left behind while dropping packets.
+    PERFETTO_DCHECK(patch_list_.empty() || drop_packets_);
   }
   // Always issue the Flush request, even if there is nothing to flush, just
   // for the sake of getting the callback posted back.
@@ -95,7 +109,14 @@ TraceWriterImpl::TracePacketHandle TraceWriterImpl::NewTracePacket() {
   // a realistic packet).
   bool chunk_too_full =
       protobuf_stream_writer_.bytes_available() < kPacketHeaderSize + 8;
-  if (chunk_too_full || reached_max_packets_per_chunk_) {
+  // While dropping packets, each packet overwrites the previous one in
+  // |garbage_chunk_|. Trying to get a real chunk again scans the whole SMB, so
+  // it is only done every kPacketsBetweenChunkRetries packets.
+  if (drop_packets_ &&
+      ++packets_since_chunk_retry_ < kPacketsBetweenChunkRetries) {
+    protobuf_stream_writer_.Reset(GetGarbageBuffer());
+  } else if (chunk_too_full || reached_max_packets_per_chunk_ ||
+             drop_packets_) {
     protobuf_stream_writer_.Reset(GetNewBuffer());
   }
 
@@ -111,9 +132,14 @@ TraceWriterImpl::TracePacketHandle TraceWriterImpl::NewTracePacket() {
   uint8_t* header = protobuf_stream_writer_.ReserveBytes(kPacketHeaderSize);
   memset(header, 0, kPacketHeaderSize);
   cur_packet_->set_size_field(header);
-  uint16_t new_packet_count = cur_chunk_.IncrementPacketCount();
-  reached_max_packets_per_chunk_ =
-      new_packet_count == ChunkHeader::Packets::kMaxCount;
+  if (drop_packets_) {
+    // The packet is written into |garbage_chunk_| and will be lost.
+    dropped_packets_++;
+  } else {
+    uint16_t new_packet_count = cur_chunk_.IncrementPacketCount();
+    reached_max_packets_per_chunk_ =
+        new_packet_count == ChunkHeader::Packets::kMaxCount;
+  }
   TracePacketHandle handle(cur_packet_.get());
   cur_fragment_start_ = protobuf_stream_writer_.write_ptr();
   fragmenting_packet_ = true;
@@ -129,6 +155,11 @@ TraceWriterImpl::TracePacketHandle TraceWriterImpl::NewTracePacket() {
 // In this case |fragmenting_packet_| == false and we just want a new chunk
 // without creating any fragments.
 protozero::ContiguousMemoryRange TraceWriterImpl::GetNewBuffer() {
+  // A packet that doesn't fit in |garbage_chunk_| just overwrites it: it is
+  // lost anyways. Getting a real chunk again waits for the next packet.
+  if (drop_packets_ && fragmenting_packet_)
+    return GetGarbageBuffer();
+
   if (fragmenting_packet_) {
     uint8_t* const wptr = protobuf_stream_writer_.write_ptr();
     PERFETTO_DCHECK(wptr >= cur_fragment_start_);
@@ -181,10 +212,14 @@ protozero::ContiguousMemoryRange TraceWriterImpl::GetNewBuffer() {
   }  // if(fragmenting_packet)
 
   if (cur_chunk_.is_valid()) {
+    // The chunk is full: ask for larger chunks from now on, up to a full page.
+    chunk_size_hint_ = 2 * cur_chunk_.payload_size();
+
     // ReturnCompletedChunk will consume the first patched entries from
     // |patch_list_| and shrink it.
     shmem_arbiter_->ReturnCompletedChunk(std::move(cur_chunk_), target_buffer_,
-                                         &patch_list_);
+                                         &patch_list_, dropped_packets_);
+    dropped_packets_ = 0;
   }
 
   // Start a new chunk.
@@ -200,11 +235,28 @@ protozero::ContiguousMemoryRange TraceWriterImpl::GetNewBuffer() {
   // into the shared buffer with the proper barriers.
   ChunkHeader header = {};
   header.writer_id.store(id_, std::memory_order_relaxed);
-  header.chunk_id.store(next_chunk_id_++, std::memory_order_relaxed);
+  header.chunk_id.store(next_chunk_id_, std::memory_order_relaxed);
   header.packets.store(packets, std::memory_order_relaxed);
 
-  cur_chunk_ = shmem_arbiter_->GetNewChunk(header);
+  cur_chunk_ = shmem_arbiter_->GetNewChunk(header, chunk_size_hint_,
+                                           buffer_exhausted_policy_,
+                                           &page_hint_);
   reached_max_packets_per_chunk_ = false;
+  if (!cur_chunk_.is_valid()) {
+    // The SMB is full and the policy is kDrop. If we were in the middle of a
+    // packet, its first fragments are already in the previous chunk: skip a
+    // ChunkID so that the service sees a gap and discards them.
+    if (fragmenting_packet_) {
+      next_chunk_id_++;
+      dropped_packets_++;
+    }
+    drop_packets_ = true;
+    packets_since_chunk_retry_ = 0;
+    return GetGarbageBuffer();
+  }
+  drop_packets_ = false;
+  next_chunk_id_++;
+
   uint8_t* payload_begin = cur_chunk_.payload_begin();
   if (fragmenting_packet_) {
     cur_packet_->set_size_field(payload_begin);
@@ -216,6 +268,20 @@ protozero::ContiguousMemoryRange TraceWriterImpl::GetNewBuffer() {
   return protozero::ContiguousMemoryRange{payload_begin, cur_chunk_.end()};
 }
 
+protozero::ContiguousMemoryRange TraceWriterImpl::GetGarbageBuffer() {
+  if (!garbage_chunk_)
+    garbage_chunk_.reset(new uint8_t[kGarbageChunkSize]);
+  uint8_t* payload_begin = garbage_chunk_.get();
+  if (fragmenting_packet_) {
+    // Don't let the packet write its size into a chunk that now belongs to
+    // the service.
+    cur_packet_->set_size_field(payload_begin);
+    payload_begin += kPacketHeaderSize;
+  }
+  return protozero::ContiguousMemoryRange{
+      payload_begin, garbage_chunk_.get() + kGarbageChunkSize};
+}
+
 WriterID TraceWriterImpl::writer_id() const {
   return id_;
 }
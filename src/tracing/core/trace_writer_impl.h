@@ -33,7 +33,10 @@ class TraceWriterImpl : public TraceWriter,
                         public protozero::ScatteredStreamWriter::Delegate {
  public:
   // TracePacketHandle is defined in trace_writer.h
-  TraceWriterImpl(SharedMemoryArbiterImpl*, WriterID, BufferID);
+  TraceWriterImpl(SharedMemoryArbiterImpl*,
+                  WriterID,
+                  BufferID,
+                  BufferExhaustedPolicy);
   ~TraceWriterImpl() override;
 
   // TraceWriter implementation. See documentation in trace_writer.h.
@@ -47,6 +50,10 @@ class TraceWriterImpl : public TraceWriter,
 
   void ResetChunkForTesting() { cur_chunk_ = SharedMemoryABI::Chunk(); }
 
+  // While the SMB is exhausted, how many packets are dropped between two
+  // attempts to get a new chunk.
+  static constexpr uint32_t kPacketsBetweenChunkRetries = 16;
+
  private:
   TraceWriterImpl(const TraceWriterImpl&) = delete;
   TraceWriterImpl& operator=(const TraceWriterImpl&) = delete;
@@ -54,6 +61,9 @@ class TraceWriterImpl : public TraceWriter,
   // ScatteredStreamWriter::Delegate implementation.
   protozero::ContiguousMemoryRange GetNewBuffer() override;
 
+  // Returns the range of |garbage_chunk_|, allocating it if needed.
+  protozero::ContiguousMemoryRange GetGarbageBuffer();
+
   // The per-producer arbiter that coordinates access to the shared memory
   // buffer from several threads.
   SharedMemoryArbiterImpl* const shmem_arbiter_;
@@ -65,6 +75,9 @@ class TraceWriterImpl : public TraceWriter,
   // See comments in data_source_config.proto for |target_buffer|.
   const BufferID target_buffer_;
 
+  // What to do when the arbiter has no free chunk to give us.
+  const BufferExhaustedPolicy buffer_exhausted_policy_;
+
   // Monotonic (% wrapping) sequence id of the chunk. Together with the WriterID
   // this allows the Service to reconstruct the linear sequence of packets.
   ChunkID next_chunk_id_ = 0;
@@ -72,6 +85,17 @@ class TraceWriterImpl : public TraceWriter,
   // The chunk we are holding onto (if any).
   SharedMemoryABI::Chunk cur_chunk_;
 
+  // Payload size passed to the arbiter when asking for the next chunk. It
+  // grows while this writer fills its chunks and shrinks to the amount of data
+  // written when a chunk is flushed before being full, so that writers that
+  // flush often don't waste most of their chunks. 0 means no preference, i.e.
+  // the arbiter's default layout.
+  size_t chunk_size_hint_ = 0;
+
+  // Page where the arbiter starts looking for our next chunk: the page of the
+  // previous one. See SharedMemoryArbiterImpl::GetNewChunk().
+  uint32_t page_hint_ = 0;
+
   // Passed to protozero message to write directly into |cur_chunk_|. It
   // keeps track of the write pointer. It calls us back (GetNewBuffer()) when
   // |cur_chunk_| is filled.
@@ -102,6 +126,23 @@ class TraceWriterImpl : public TraceWriter,
   // later sent out-of-band to the tracing service, who will patch the required
   // chunks, if they are still around.
   PatchList patch_list_;
+
+  // true while the SMB is exhausted and we are writing into |garbage_chunk_|
+  // rather than into |cur_chunk_|. Only with BufferExhaustedPolicy::kDrop.
+  bool drop_packets_ = false;
+
+  // Number of packets written into |garbage_chunk_| (or interrupted by running
+  // out of chunks) that haven't been reported to the service yet. They are
+  // reported along with the next chunk we return to the arbiter.
+  uint32_t dropped_packets_ = 0;
+
+  // Packets started since the last failed attempt to get a chunk, while
+  // |drop_packets_| is true.
+  uint32_t packets_since_chunk_retry_ = 0;
+
+  // Throwaway memory handed to |protobuf_stream_writer_| while |drop_packets_|
+  // is true. Allocated the first time the SMB is exhausted.
+  std::unique_ptr<uint8_t[]> garbage_chunk_;
 };
 
 }  // namespace perfetto
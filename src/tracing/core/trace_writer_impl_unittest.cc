@@ -145,6 +145,95 @@ TEST_P(TraceWriterImplTest, FragmentingPacket) {
   ASSERT_EQ(1, last_commit.chunks_to_patch()[0].patches_size());
 }
 
+// A writer that flushes little data at a time should get chunks sized for it
+// after the first flush, rather than the default ones.
+TEST_P(TraceWriterImplTest, ChunkSizeFollowsFlushedData) {
+  std::unique_ptr<TraceWriter> writer = arbiter_->CreateTraceWriter(42);
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  const auto& last_commit = fake_producer_endpoint_.last_commit_data_request;
+  std::vector<size_t> chunk_sizes;
+  for (int i = 0; i < 3; i++) {
+    writer->NewTracePacket()->set_for_testing()->set_str("foo");
+    writer->Flush();
+    ASSERT_EQ(1, last_commit.chunks_to_move_size());
+    uint32_t page_layout =
+        abi->GetPageLayout(last_commit.chunks_to_move()[0].page());
+    chunk_sizes.push_back(abi->GetChunkSizeForLayout(page_layout));
+  }
+  auto chunk_size = [abi](SharedMemoryABI::PageLayout layout) {
+    return abi->GetChunkSizeForLayout(layout << SharedMemoryABI::kLayoutShift);
+  };
+  EXPECT_EQ(chunk_size(SharedMemoryABI::kPageDiv4), chunk_sizes[0]);
+  EXPECT_EQ(chunk_size(SharedMemoryABI::kPageDiv14), chunk_sizes[1]);
+  EXPECT_EQ(chunk_size(SharedMemoryABI::kPageDiv14), chunk_sizes[2]);
+}
+
+// With BufferExhaustedPolicy::kDrop, a writer keeps going when the SMB is full,
+// and reports the packets it lost along with its next chunk.
+TEST_P(TraceWriterImplTest, DropPacketsWhenBufferIsExhausted) {
+  std::unique_ptr<TraceWriter> writer =
+      arbiter_->CreateTraceWriter(42, BufferExhaustedPolicy::kDrop);
+  SharedMemoryABI* abi = arbiter_->shmem_abi_for_testing();
+  const auto& last_commit = fake_producer_endpoint_.last_commit_data_request;
+
+  // Let the writer take its first chunk, then take all the others.
+  writer->NewTracePacket()->set_for_testing()->set_str("foo");
+  std::vector<SharedMemoryABI::Chunk> chunks;
+  for (;;) {
+    SharedMemoryABI::Chunk chunk =
+        arbiter_->GetNewChunk({}, 0, BufferExhaustedPolicy::kDrop);
+    if (!chunk.is_valid())
+      break;
+    chunks.push_back(std::move(chunk));
+  }
+
+  // This packet doesn't fit in the writer's chunk, which is committed with the
+  // first fragment. The rest of the packet, as well as the next packets, are
+  // written into a throwaway chunk smaller than them.
+  std::string large_string(page_size(), 'x');
+  writer->NewTracePacket()->set_for_testing()->set_str(large_string.data(),
+                                                       large_string.size());
+  arbiter_->FlushPendingCommitDataRequests();
+  ASSERT_EQ(1, last_commit.chunks_to_move_size());
+  EXPECT_EQ(0u, last_commit.chunks_to_move()[0].dropped_packets());
+  SharedMemoryABI::Chunk first_chunk =
+      abi->TryAcquireChunkForReading(last_commit.chunks_to_move()[0].page(),
+                                     last_commit.chunks_to_move()[0].chunk());
+  ASSERT_TRUE(first_chunk.is_valid());
+  EXPECT_TRUE(first_chunk.header()->packets.load().flags &
+              SharedMemoryABI::ChunkHeader::kLastPacketContinuesOnNextChunk);
+  writer->NewTracePacket()->set_for_testing()->set_str(large_string.data(),
+                                                       large_string.size());
+  writer->NewTracePacket()->set_for_testing()->set_str("bar");
+
+  // Once chunks are freed, the writer goes back to the SMB at its next retry
+  // and reports the packets it dropped until then. The ChunkID of the packet
+  // it couldn't finish is skipped, so that the service discards its first
+  // fragment.
+  abi->ReleaseChunkAsFree(std::move(first_chunk));
+  for (auto& chunk : chunks) {
+    uint8_t chunk_idx = chunk.chunk_idx();
+    size_t page_idx = abi->ReleaseChunkAsComplete(std::move(chunk));
+    chunk = abi->TryAcquireChunkForReading(page_idx, chunk_idx);
+    abi->ReleaseChunkAsFree(std::move(chunk));
+  }
+  const uint32_t kRetryInterval = TraceWriterImpl::kPacketsBetweenChunkRetries;
+  // Three packets have been dropped so far.
+  for (uint32_t i = 3; i < kRetryInterval; i++)
+    writer->NewTracePacket()->set_for_testing()->set_str("dropped");
+  writer->NewTracePacket()->set_for_testing()->set_str("baz");
+  writer->Flush();
+  ASSERT_EQ(1, last_commit.chunks_to_move_size());
+  EXPECT_EQ(kRetryInterval, last_commit.chunks_to_move()[0].dropped_packets());
+  SharedMemoryABI::Chunk chunk =
+      abi->TryAcquireChunkForReading(last_commit.chunks_to_move()[0].page(),
+                                     last_commit.chunks_to_move()[0].chunk());
+  ASSERT_TRUE(chunk.is_valid());
+  EXPECT_EQ(2u, chunk.header()->chunk_id.load());
+  EXPECT_EQ(1, chunk.header()->packets.load().count);
+  EXPECT_EQ(0, chunk.header()->packets.load().flags);
+}
+
 // TODO(primiano): add multi-writer test.
 // TODO(primiano): add Flush() test.
 
@@ -104,6 +104,28 @@ uid_t geteuid() {
 }
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 
+// Max size of the TrustedPacket fields that the service appends to each packet
+// read from the trace buffers.
+constexpr size_t kTrustedBufSize = 16;
+
+// Max size of the preamble returned by TracePacket::GetProtoPreamble(): a one
+// byte tag followed by the packet size varint.
+constexpr size_t kMaxPreambleSize = 8;
+
+// Serializes the trusted fields of a packet into |buf|, which must be at least
+// kTrustedBufSize bytes long. Returns the number of bytes written.
+size_t SerializeTrustedFields(uid_t trusted_uid,
+                              PacketSequenceID packet_sequence_id,
+                              uint8_t* buf) {
+  protos::TrustedPacket trusted_packet;
+  trusted_packet.set_trusted_uid(static_cast<int32_t>(trusted_uid));
+  trusted_packet.set_trusted_packet_sequence_id(packet_sequence_id);
+  PERFETTO_CHECK(trusted_packet.SerializeToArray(buf, kTrustedBufSize));
+  size_t size = static_cast<size_t>(trusted_packet.GetCachedSize());
+  PERFETTO_DCHECK(size > 0 && size <= kTrustedBufSize);
+  return size;
+}
+
 }  // namespace
 
 // These constants instead are defined in the header because are used by tests.
@@ -112,6 +134,108 @@ constexpr size_t TracingServiceImpl::kMaxShmSize;
 constexpr uint32_t TracingServiceImpl::kDataSourceStopTimeoutMs;
 constexpr uint8_t TracingServiceImpl::kSyncMarker[];
 
+// The iovecs of the packet payloads point straight into the memory of the
+// TraceBuffer(s), or of the packets generated by the service, which stay valid
+// for the whole WriteIntoFile() call. Only the preambles and the trusted fields
+// are copied, into |arena|. Both |iovecs| and |arena| are reused across calls,
+// so writing a packet doesn't require any heap allocation.
+struct TracingServiceImpl::FileWriteBatch {
+  // writev() can take at most IOV_MAX entries per call.
+  static constexpr size_t kMaxIovecs = IOV_MAX;
+  static constexpr size_t kArenaSize = 16 * 1024;
+
+  void Reset(int file_fd, uint64_t file_size, uint64_t file_max_size) {
+    fd = file_fd;
+    size = file_size;
+    max_size = file_max_size;
+    bytes_written = 0;
+    PERFETTO_DCHECK(num_iovecs == 0 && pending_size == 0);
+    arena_used = 0;
+  }
+
+  // Appends |packet| to the batch, followed by a slice with |trusted_size|
+  // bytes of trusted fields, if any. The memory of the slices of |packet| must
+  // stay valid until the next Flush(), while |packet| itself can be reused.
+  // Returns false if the packet would make the file exceed |max_size| (in
+  // which case it's not appended) or if writev() failed.
+  bool AppendPacket(TracePacket* packet,
+                    const uint8_t* trusted,
+                    size_t trusted_size) {
+    const size_t arena_size_needed = trusted_size + kMaxPreambleSize;
+    if (kArenaSize - arena_used < arena_size_needed) {
+      // The arena data of the packets in the batch must be written out before
+      // being overwritten.
+      if (!Flush())
+        return false;
+      arena_used = 0;
+    }
+    uint8_t* arena_ptr = &arena[arena_used];
+    if (trusted_size) {
+      memcpy(arena_ptr, trusted, trusted_size);
+      packet->AddSlice(arena_ptr, trusted_size);
+    }
+
+    char* preamble;
+    size_t preamble_size;
+    std::tie(preamble, preamble_size) = packet->GetProtoPreamble();
+    PERFETTO_DCHECK(preamble_size <= kMaxPreambleSize);
+    if (size + pending_size + preamble_size + packet->size() >= max_size)
+      return false;
+
+    // The preamble is stored in |packet|, which might be reused by the caller
+    // before the batch is flushed.
+    memcpy(arena_ptr + trusted_size, preamble, preamble_size);
+    arena_used += trusted_size + preamble_size;
+    if (!AppendIovec(arena_ptr + trusted_size, preamble_size))
+      return false;
+    for (const Slice& slice : packet->slices()) {
+      if (!AppendIovec(slice.start, slice.size))
+        return false;
+    }
+    return true;
+  }
+
+  // Writes the pending iovecs into |fd|. Returns false if writev() failed.
+  bool Flush() {
+    if (num_iovecs == 0)
+      return true;
+    ssize_t wr_size = PERFETTO_EINTR(
+        writev(fd, &iovecs[0], static_cast<int>(num_iovecs)));
+    num_iovecs = 0;
+    pending_size = 0;
+    if (wr_size <= 0) {
+      PERFETTO_PLOG("writev() failed");
+      return false;
+    }
+    size += static_cast<uint64_t>(wr_size);
+    bytes_written += static_cast<uint64_t>(wr_size);
+    return true;
+  }
+
+  bool AppendIovec(const void* start, size_t len) {
+    if (num_iovecs == kMaxIovecs && !Flush())
+      return false;
+    // writev() doesn't change the passed pointer. However, struct iovec
+    // take a non-const ptr because it's the same struct used by readv().
+    // Hence the const_cast here.
+    iovecs[num_iovecs++] = {const_cast<void*>(start), len};
+    pending_size += len;
+    return true;
+  }
+
+  int fd = -1;
+  uint64_t size = 0;      // Size of the file, including the flushed iovecs.
+  uint64_t max_size = 0;  // See TracingSession::max_file_size_bytes.
+  uint64_t bytes_written = 0;  // By the Flush() calls since Reset().
+
+  struct iovec iovecs[kMaxIovecs];
+  size_t num_iovecs = 0;
+  uint64_t pending_size = 0;  // SUM(iov_len for each iovec in |iovecs|).
+
+  uint8_t arena[kArenaSize];
+  size_t arena_used = 0;
+};
+
 // static
 std::unique_ptr<TracingService> TracingService::CreateInstance(
     std::unique_ptr<SharedMemory::Factory> shm_factory,
@@ -882,7 +1006,7 @@ void TracingServiceImpl::ScrapeSharedMemoryBuffers(
       CopyProducerPageIntoLogBuffer(
           producer->id_, producer->uid_, writer_id, chunk_id, *target_buffer_id,
           packet_count, flags, chunk_complete, chunk.payload_begin(),
-          chunk.payload_size());
+          chunk.payload_size(), /*dropped_packets=*/0);
     }
   }
 }
@@ -980,14 +1104,42 @@ void TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
   }
   MaybeEmitTraceConfig(tracing_session, &packets);
 
+  // If the caller asked us to write into a file by setting
+  // |write_into_file| == true in the trace config, drain the packets into the
+  // given file descriptor.
+  if (tracing_session->write_into_file) {
+    bool stop_writing_into_file = !WriteIntoFile(tracing_session, &packets) ||
+                                  tracing_session->write_period_ms == 0;
+    int fd = *tracing_session->write_into_file;
+
+    PERFETTO_DLOG("Draining into file, written: %" PRIu64 " KB, stop: %d",
+                  (file_write_batch_->bytes_written + 1023) / 1024,
+                  stop_writing_into_file);
+    if (stop_writing_into_file) {
+      // Ensure all data was written to the file before we close it.
+      base::FlushFile(fd);
+      tracing_session->write_into_file.reset();
+      tracing_session->write_period_ms = 0;
+      if (tracing_session->state == TracingSession::STARTED)
+        DisableTracing(tsid);
+      return;
+    }
+
+    auto weak_this = weak_ptr_factory_.GetWeakPtr();
+    task_runner_->PostDelayedTask(
+        [weak_this, tsid] {
+          if (weak_this)
+            weak_this->ReadBuffers(tsid, nullptr);
+        },
+        tracing_session->delay_to_next_write_period_ms());
+    return;
+  }  // if (tracing_session->write_into_file)
+
   size_t packets_bytes = 0;  // SUM(slice.size() for each slice in |packets|).
-  size_t total_slices = 0;   // SUM(#slices in |packets|).
 
   // Add up size for packets added by the Maybe* calls above.
-  for (const TracePacket& packet : packets) {
+  for (const TracePacket& packet : packets)
     packets_bytes += packet.size();
-    total_slices += packet.slices().size();
-  }
 
   // This is a rough threshold to determine how much to read from the buffer in
   // each task. This is to avoid executing a single huge sending task for too
@@ -1038,114 +1190,22 @@ void TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
       // truncated packets are also rejected, so the producer can't give us a
       // partial packet (e.g., a truncated string) which only becomes valid when
       // the trusted data is appended here.
-      protos::TrustedPacket trusted_packet;
-      trusted_packet.set_trusted_uid(
-          static_cast<int32_t>(sequence_properties.producer_uid_trusted));
-      trusted_packet.set_trusted_packet_sequence_id(
+      Slice slice = Slice::Allocate(kTrustedBufSize);
+      slice.size = SerializeTrustedFields(
+          sequence_properties.producer_uid_trusted,
           tracing_session->GetPacketSequenceID(
               sequence_properties.producer_id_trusted,
-              sequence_properties.writer_id));
-      static constexpr size_t kTrustedBufSize = 16;
-      Slice slice = Slice::Allocate(kTrustedBufSize);
-      PERFETTO_CHECK(
-          trusted_packet.SerializeToArray(slice.own_data(), kTrustedBufSize));
-      slice.size = static_cast<size_t>(trusted_packet.GetCachedSize());
-      PERFETTO_DCHECK(slice.size > 0 && slice.size <= kTrustedBufSize);
+              sequence_properties.writer_id),
+          slice.own_data());
       packet.AddSlice(std::move(slice));
 
       // Append the packet (inclusive of the trusted uid) to |packets|.
       packets_bytes += packet.size();
-      total_slices += packet.slices().size();
-      did_hit_threshold = packets_bytes >= kApproxBytesPerTask &&
-                          !tracing_session->write_into_file;
+      did_hit_threshold = packets_bytes >= kApproxBytesPerTask;
       packets.emplace_back(std::move(packet));
     }  // for(packets...)
   }    // for(buffers...)
 
-  // If the caller asked us to write into a file by setting
-  // |write_into_file| == true in the trace config, drain the packets read
-  // (if any) into the given file descriptor.
-  if (tracing_session->write_into_file) {
-    const uint64_t max_size = tracing_session->max_file_size_bytes
-                                  ? tracing_session->max_file_size_bytes
-                                  : std::numeric_limits<size_t>::max();
-
-    // When writing into a file, the file should look like a root trace.proto
-    // message. Each packet should be prepended with a proto preamble stating
-    // its field id (within trace.proto) and size. Hence the addition below.
-    const size_t max_iovecs = total_slices + packets.size();
-
-    size_t num_iovecs = 0;
-    bool stop_writing_into_file = tracing_session->write_period_ms == 0;
-    std::unique_ptr<struct iovec[]> iovecs(new struct iovec[max_iovecs]);
-    size_t num_iovecs_at_last_packet = 0;
-    uint64_t bytes_about_to_be_written = 0;
-    for (TracePacket& packet : packets) {
-      std::tie(iovecs[num_iovecs].iov_base, iovecs[num_iovecs].iov_len) =
-          packet.GetProtoPreamble();
-      bytes_about_to_be_written += iovecs[num_iovecs].iov_len;
-      num_iovecs++;
-      for (const Slice& slice : packet.slices()) {
-        // writev() doesn't change the passed pointer. However, struct iovec
-        // take a non-const ptr because it's the same struct used by readv().
-        // Hence the const_cast here.
-        char* start = static_cast<char*>(const_cast<void*>(slice.start));
-        bytes_about_to_be_written += slice.size;
-        iovecs[num_iovecs++] = {start, slice.size};
-      }
-
-      if (tracing_session->bytes_written_into_file +
-              bytes_about_to_be_written >=
-          max_size) {
-        stop_writing_into_file = true;
-        num_iovecs = num_iovecs_at_last_packet;
-        break;
-      }
-
-      num_iovecs_at_last_packet = num_iovecs;
-    }
-    PERFETTO_DCHECK(num_iovecs <= max_iovecs);
-    int fd = *tracing_session->write_into_file;
-
-    uint64_t total_wr_size = 0;
-
-    // writev() can take at most IOV_MAX entries per call. Batch them.
-    constexpr size_t kIOVMax = IOV_MAX;
-    for (size_t i = 0; i < num_iovecs; i += kIOVMax) {
-      int iov_batch_size = static_cast<int>(std::min(num_iovecs - i, kIOVMax));
-      ssize_t wr_size = PERFETTO_EINTR(writev(fd, &iovecs[i], iov_batch_size));
-      if (wr_size <= 0) {
-        PERFETTO_PLOG("writev() failed");
-        stop_writing_into_file = true;
-        break;
-      }
-      total_wr_size += static_cast<size_t>(wr_size);
-    }
-
-    tracing_session->bytes_written_into_file += total_wr_size;
-
-    PERFETTO_DLOG("Draining into file, written: %" PRIu64 " KB, stop: %d",
-                  (total_wr_size + 1023) / 1024, stop_writing_into_file);
-    if (stop_writing_into_file) {
-      // Ensure all data was written to the file before we close it.
-      base::FlushFile(fd);
-      tracing_session->write_into_file.reset();
-      tracing_session->write_period_ms = 0;
-      if (tracing_session->state == TracingSession::STARTED)
-        DisableTracing(tsid);
-      return;
-    }
-
-    auto weak_this = weak_ptr_factory_.GetWeakPtr();
-    task_runner_->PostDelayedTask(
-        [weak_this, tsid] {
-          if (weak_this)
-            weak_this->ReadBuffers(tsid, nullptr);
-        },
-        tracing_session->delay_to_next_write_period_ms());
-    return;
-  }  // if (tracing_session->write_into_file)
-
   const bool has_more = did_hit_threshold;
   if (has_more) {
     auto weak_consumer = consumer->GetWeakPtr();
@@ -1161,6 +1221,75 @@ void TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
   consumer->consumer_->OnTraceData(std::move(packets), has_more);
 }
 
+bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
+                                       std::vector<TracePacket>* packets) {
+  PERFETTO_DCHECK(tracing_session->write_into_file);
+  const uint64_t max_size = tracing_session->max_file_size_bytes
+                                ? tracing_session->max_file_size_bytes
+                                : std::numeric_limits<uint64_t>::max();
+  if (!file_write_batch_)
+    file_write_batch_.reset(new FileWriteBatch());
+  FileWriteBatch* batch = file_write_batch_.get();
+  batch->Reset(*tracing_session->write_into_file,
+               tracing_session->bytes_written_into_file, max_size);
+
+  // When writing into a file, the file should look like a root trace.proto
+  // message. Each packet is prepended with a proto preamble stating its field
+  // id (within trace.proto) and size by FileWriteBatch::AppendPacket().
+  bool success = true;
+  for (TracePacket& packet : *packets) {
+    success = batch->AppendPacket(&packet, nullptr, 0);
+    if (!success)
+      break;
+  }
+
+  // Unlike ReadBuffers() for consumers, this reads all the buffers in one go.
+  // The same TracePacket is reused for all the packets read, as their slices
+  // are copied into the batch's iovecs straight away.
+  TracePacket packet;
+  uint8_t trusted_buf[kTrustedBufSize];
+  for (size_t buf_idx = 0; success && buf_idx < tracing_session->num_buffers();
+       buf_idx++) {
+    auto tbuf_iter = buffers_.find(tracing_session->buffers_index[buf_idx]);
+    if (tbuf_iter == buffers_.end()) {
+      PERFETTO_DFATAL("Buffer not found.");
+      continue;
+    }
+    TraceBuffer& tbuf = *tbuf_iter->second;
+    tbuf.BeginRead();
+    for (;;) {
+      packet.Clear();
+      TraceBuffer::PacketSequenceProperties sequence_properties{};
+      if (!tbuf.ReadNextTracePacket(&packet, &sequence_properties))
+        break;
+      PERFETTO_DCHECK(sequence_properties.producer_id_trusted != 0);
+      PERFETTO_DCHECK(sequence_properties.writer_id != 0);
+      PERFETTO_DCHECK(sequence_properties.producer_uid_trusted != kInvalidUid);
+      PERFETTO_DCHECK(packet.size() > 0);
+      if (!PacketStreamValidator::Validate(packet.slices())) {
+        PERFETTO_DLOG("Dropping invalid packet");
+        continue;
+      }
+
+      // See ReadBuffers() for why the trusted fields are appended last.
+      size_t trusted_size = SerializeTrustedFields(
+          sequence_properties.producer_uid_trusted,
+          tracing_session->GetPacketSequenceID(
+              sequence_properties.producer_id_trusted,
+              sequence_properties.writer_id),
+          trusted_buf);
+      success = batch->AppendPacket(&packet, trusted_buf, trusted_size);
+      if (!success)
+        break;
+    }  // for(packets...)
+  }    // for(buffers...)
+
+  // Write out the packets appended before hitting the max file size, if any.
+  success &= batch->Flush();
+  tracing_session->bytes_written_into_file += batch->bytes_written;
+  return success;
+}
+
 void TracingServiceImpl::FreeBuffers(TracingSessionID tsid) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
   PERFETTO_DLOG("Freeing buffers for session %" PRIu64, tsid);
@@ -1384,7 +1513,8 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
     uint8_t chunk_flags,
     bool chunk_complete,
     const uint8_t* src,
-    size_t size) {
+    size_t size,
+    uint32_t dropped_packets) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
 
   ProducerEndpointImpl* producer = GetProducer(producer_id_trusted);
@@ -1431,6 +1561,9 @@ void TracingServiceImpl::CopyProducerPageIntoLogBuffer(
     return;
   }
 
+  if (dropped_packets)
+    buf->AddPacketsDroppedByProducer(dropped_packets);
+
   buf->CopyChunkUntrusted(producer_id_trusted, producer_uid_trusted, writer_id,
                           chunk_id, num_fragments, chunk_flags, chunk_complete,
                           src, size);
@@ -1923,7 +2056,8 @@ void TracingServiceImpl::ProducerEndpointImpl::CommitData(
 
     service_->CopyProducerPageIntoLogBuffer(
         id_, uid_, writer_id, chunk_id, buffer_id, num_fragments, chunk_flags,
-        /*chunk_complete=*/true, chunk.payload_begin(), chunk.payload_size());
+        /*chunk_complete=*/true, chunk.payload_begin(), chunk.payload_size(),
+        entry.dropped_packets());
 
     // This one has release-store semantics.
     shmem_abi_.ReleaseChunkAsFree(std::move(chunk));
@@ -1988,8 +2122,11 @@ TracingServiceImpl::ProducerEndpointImpl::GetOrCreateShmemArbiter() {
 
 // Can be called on any thread.
 std::unique_ptr<TraceWriter>
-TracingServiceImpl::ProducerEndpointImpl::CreateTraceWriter(BufferID buf_id) {
-  return GetOrCreateShmemArbiter()->CreateTraceWriter(buf_id);
+TracingServiceImpl::ProducerEndpointImpl::CreateTraceWriter(
+    BufferID buf_id,
+    BufferExhaustedPolicy buffer_exhausted_policy) {
+  return GetOrCreateShmemArbiter()->CreateTraceWriter(buf_id,
+                                                      buffer_exhausted_policy);
 }
 
 void TracingServiceImpl::ProducerEndpointImpl::NotifyFlushComplete(
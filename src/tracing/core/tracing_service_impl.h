@@ -81,7 +81,9 @@ class TracingServiceImpl : public TracingService {
     void UnregisterTraceWriter(uint32_t writer_id) override;
     void CommitData(const CommitDataRequest&, CommitDataCallback) override;
     void SetSharedMemory(std::unique_ptr<SharedMemory>);
-    std::unique_ptr<TraceWriter> CreateTraceWriter(BufferID) override;
+    std::unique_ptr<TraceWriter> CreateTraceWriter(
+        BufferID,
+        BufferExhaustedPolicy = BufferExhaustedPolicy::kDefault) override;
     void NotifyFlushComplete(FlushRequestID) override;
     void NotifyDataSourceStopped(DataSourceInstanceID) override;
     SharedMemory* shared_memory() const override;
@@ -201,7 +203,8 @@ class TracingServiceImpl : public TracingService {
                                      uint8_t chunk_flags,
                                      bool chunk_complete,
                                      const uint8_t* src,
-                                     size_t size);
+                                     size_t size,
+                                     uint32_t dropped_packets);
   void ApplyChunkPatches(ProducerID,
                          const std::vector<CommitDataRequest::ChunkToPatch>&);
   void NotifyFlushDoneForProducer(ProducerID, FlushRequestID);
@@ -379,6 +382,10 @@ class TracingServiceImpl : public TracingService {
     uint64_t bytes_written_into_file = 0;
   };
 
+  // Accumulates the iovecs of the packets that WriteIntoFile() passes to
+  // writev(). Defined in the .cc file.
+  struct FileWriteBatch;
+
   TracingServiceImpl(const TracingServiceImpl&) = delete;
   TracingServiceImpl& operator=(const TracingServiceImpl&) = delete;
 
@@ -407,6 +414,11 @@ class TracingServiceImpl : public TracingService {
   void SnapshotStats(TracingSession*, std::vector<TracePacket>*);
   TraceStats GetTraceStats(TracingSession* tracing_session);
   void MaybeEmitTraceConfig(TracingSession*, std::vector<TracePacket>*);
+
+  // Writes |packets|, followed by all the packets in the session buffers, into
+  // |write_into_file|. Returns false if the file reached |max_file_size_bytes|
+  // or writing failed, in which case the caller should stop writing into it.
+  bool WriteIntoFile(TracingSession*, std::vector<TracePacket>* packets);
   void OnFlushTimeout(TracingSessionID, FlushRequestID);
   void OnDisableTracingTimeout(TracingSessionID);
   void DisableTracingNotifyConsumerAndFlushFile(TracingSession*);
@@ -443,6 +455,9 @@ class TracingServiceImpl : public TracingService {
   uint8_t sync_marker_packet_[32];  // Lazily initialized.
   size_t sync_marker_packet_size_ = 0;
 
+  // Reused by all the WriteIntoFile() calls. Lazily initialized.
+  std::unique_ptr<FileWriteBatch> file_write_batch_;
+
   // Stats.
   uint64_t chunks_discarded_ = 0;
   uint64_t patches_discarded_ = 0;
@@ -13,9 +13,13 @@
 // limitations under the License.
 
 #include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <random>
 
 #include "benchmark/benchmark.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/base/temp_file.h"
 #include "perfetto/base/time.h"
 #include "perfetto/traced/traced.h"
 #include "perfetto/tracing/core/trace_config.h"
@@ -207,6 +211,72 @@ static void BenchmarkConsumer(benchmark::State& state) {
                          read_time_taken_ns);
 }
 
+// Streams the packets of a saturated producer into a file, as done for long
+// traces (write_into_file), and measures how fast the service writes them.
+static void BenchmarkWriteIntoFile(benchmark::State& state) {
+  base::TestTaskRunner task_runner;
+
+  TestHelper helper(&task_runner);
+  helper.StartServiceIfRequired();
+
+  FakeProducer* producer = helper.ConnectFakeProducer();
+  helper.ConnectConsumer();
+  helper.WaitForConsumerConnect();
+
+  TraceConfig trace_config;
+
+  static const uint32_t kBufferSizeBytes =
+      IsBenchmarkFunctionalOnly() ? 16 * 1024 : 32 * 1024 * 1024;
+  trace_config.add_buffers()->set_size_kb(kBufferSizeBytes / 1024);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(100);  // The minimum allowed.
+
+  // Each batch fills a quarter of the buffer, so that the periodic writes can
+  // keep up without the producer overwriting unread data.
+  static constexpr uint32_t kRandomSeed = 42;
+  uint32_t message_bytes = static_cast<uint32_t>(state.range(0));
+  uint32_t message_count = kBufferSizeBytes / 4 / message_bytes;
+
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("android.perfetto.FakeProducer");
+  ds_config->set_target_buffer(0);
+  ds_config->mutable_for_testing()->set_seed(kRandomSeed);
+  ds_config->mutable_for_testing()->set_message_count(message_count);
+  ds_config->mutable_for_testing()->set_message_size(message_bytes);
+
+  base::TempFile tmp_file = base::TempFile::CreateUnlinked();
+  helper.StartTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+  helper.WaitForProducerEnabled();
+
+  uint64_t wall_start_ns = static_cast<uint64_t>(base::GetWallTimeNs().count());
+  uint64_t service_start_ns = helper.service_thread()->GetThreadCPUTimeNs();
+  uint64_t iterations = 0;
+  for (auto _ : state) {
+    auto cname = "produced.and.committed." + std::to_string(iterations++);
+    auto on_produced_and_committed = task_runner.CreateCheckpoint(cname);
+    producer->ProduceEventBatch(helper.WrapTask(on_produced_and_committed));
+    task_runner.RunUntilCheckpoint(cname);
+  }
+
+  // Disabling tracing writes whatever is left in the buffer into the file.
+  helper.DisableTracing();
+  helper.WaitForTracingDisabled();
+
+  uint64_t service_ns =
+      helper.service_thread()->GetThreadCPUTimeNs() - service_start_ns;
+  uint64_t wall_ns =
+      static_cast<uint64_t>(base::GetWallTimeNs().count()) - wall_start_ns;
+
+  struct stat file_stat;
+  PERFETTO_CHECK(fstat(tmp_file.fd(), &file_stat) == 0);
+  uint64_t file_bytes = static_cast<uint64_t>(file_stat.st_size);
+
+  state.counters["Ser CPU"] = benchmark::Counter(100.0 * service_ns / wall_ns);
+  state.counters["Ser MB/s"] =
+      benchmark::Counter(1000.0 * file_bytes / service_ns);
+  state.SetBytesProcessed(static_cast<int64_t>(file_bytes));
+}
+
 void SaturateCpuProducerArgs(benchmark::internal::Benchmark* b) {
   int min_message_count = 16;
   int max_message_count = IsBenchmarkFunctionalOnly() ? 1024 : 1024 * 1024;
@@ -246,6 +316,13 @@ void ConstantRateConsumerArgs(benchmark::internal::Benchmark* b) {
   }
 }
 
+void WriteIntoFileArgs(benchmark::internal::Benchmark* b) {
+  int min_payload = 32;
+  int max_payload = IsBenchmarkFunctionalOnly() ? 64 : 4096;
+  for (int bytes = min_payload; bytes <= max_payload; bytes *= 4)
+    b->Arg(bytes);
+}
+
 }  // namespace
 
 static void BM_EndToEnd_Producer_SaturateCpu(benchmark::State& state) {
@@ -284,4 +361,13 @@ BENCHMARK(BM_EndToEnd_Consumer_ConstantRate)
     ->UseRealTime()
     ->Apply(ConstantRateConsumerArgs);
 
+static void BM_EndToEnd_WriteIntoFile(benchmark::State& state) {
+  BenchmarkWriteIntoFile(state);
+}
+
+BENCHMARK(BM_EndToEnd_WriteIntoFile)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Apply(WriteIntoFileArgs);
+
 }  // namespace perfetto